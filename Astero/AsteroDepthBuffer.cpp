@@ -0,0 +1,86 @@
+//
+//  AsteroDepthBuffer.cpp
+//  Astero
+//
+//  Created by Yuzhe Wang on 10/18/26.
+//  Copyright © 2026 Yuzhe Wang. All rights reserved.
+//
+
+#include "AsteroDepthBuffer.h"
+#include "AsteroRenderTarget.h"
+
+namespace Astero {
+	//--------------------------------------------------------------------------------------------------------------------------------
+	DepthBuffer::DepthBuffer(unsigned short pool_id, unsigned short bit_depth, unsigned int width, unsigned int height,
+							 unsigned int fsaa, const std::string & fsaa_hint, bool manual)
+	: pool_id_(pool_id), bit_depth_(bit_depth), width_(width), height_(height), fsaa_(fsaa), fsaa_hint_(fsaa_hint),
+	manual_(manual) {
+		
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	DepthBuffer::~DepthBuffer() {
+		detachFromAllRenderTargets();
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void DepthBuffer::setPoolId(unsigned short pool_id) {
+		// Render targets using this buffer belong to old pool.
+		detachFromAllRenderTargets();
+		pool_id_ = pool_id;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	unsigned short DepthBuffer::getPoolId() const {
+		return pool_id_;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	unsigned short DepthBuffer::getBitDepth() const {
+		return bit_depth_;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	unsigned int DepthBuffer::getWidth() const {
+		return width_;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	unsigned int DepthBuffer::getHeight() const {
+		return height_;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	unsigned int DepthBuffer::getFSAA() const {
+		return fsaa_;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	const std::string & DepthBuffer::getFSAAHint() const {
+		return fsaa_hint_;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	bool DepthBuffer::isManual() const {
+		return manual_;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	bool DepthBuffer::isCompatible(RenderTarget * render_target) const {
+		// A larger depth buffer serves a smaller target, samples and format must match exactly.
+		return width_ >= render_target->getWidth() && height_ >= render_target->getHeight()
+		&& fsaa_ == render_target->getFSAA() && bit_depth_ == render_target->getDepthBitDepth();
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	bool DepthBuffer::isAttached() const {
+		return !attached_render_targets_.empty();
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	size_t DepthBuffer::getAttachedRenderTargetCount() const {
+		return attached_render_targets_.size();
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void DepthBuffer::notifyRenderTargetAttached(RenderTarget * render_target) {
+		attached_render_targets_.insert(render_target);
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void DepthBuffer::notifyRenderTargetDetached(RenderTarget * render_target) {
+		attached_render_targets_.erase(render_target);
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void DepthBuffer::detachFromAllRenderTargets() {
+		for (auto render_target : attached_render_targets_)
+			render_target->notifyDepthBufferDestroyed();
+		attached_render_targets_.clear();
+	}
+}
@@ -12,7 +12,11 @@
 #include "AsteroPrerequisites.h"
 
 namespace Astero {
+	class RenderTarget;
+	
 	//--------------------------------------------------------------------------------------------------------------------------------
+	// Depth buffer which render targets of same pool share, when it has their format and FSAA and is at least as large as
+	// them. Attached render targets are tracked, so unreferenced buffers can be freed.
 	class DepthBuffer {
 	public:
 		enum PoolId {
@@ -25,7 +29,22 @@ namespace Astero {
 					unsigned int fsaa, const std::string & fsaa_hint, bool manual);
 		virtual ~DepthBuffer();
 		
-		void setPoolId();
+		void setPoolId(unsigned short pool_id);
+		unsigned short getPoolId() const;
+		unsigned short getBitDepth() const;
+		unsigned int getWidth() const;
+		unsigned int getHeight() const;
+		unsigned int getFSAA() const;
+		const std::string & getFSAAHint() const;
+		// Manual depth buffers are created by user, and not freed by RenderSystem::cleanupDepthBuffers.
+		bool isManual() const;
+		// Whether render target can use this depth buffer.
+		virtual bool isCompatible(RenderTarget * render_target) const;
+		bool isAttached() const;
+		size_t getAttachedRenderTargetCount() const;
+		// Called by render targets when they attach or detach this depth buffer.
+		void notifyRenderTargetAttached(RenderTarget * render_target);
+		void notifyRenderTargetDetached(RenderTarget * render_target);
 		
 	protected:
 		typedef std::unordered_set<RenderTarget *> RenderTargetSet;
@@ -0,0 +1,152 @@
+//
+//  AsteroFrameStats.cpp
+//  Astero
+//
+//  Created by Yuzhe Wang on 10/18/26.
+//  Copyright © 2026 Yuzhe Wang. All rights reserved.
+//
+
+#include <cmath>
+#include "AsteroFrameStats.h"
+
+namespace Astero {
+	namespace {
+		// Nearest rank percentile of sorted values.
+		double getPercentile(const std::vector<double> & sorted_values, double percentile) {
+			if (sorted_values.empty())
+				return 0.0;
+			percentile = std::min(std::max(percentile, 0.0), 100.0);
+			// Multiplies before dividing, so a rank which is a whole number is not rounded up past itself.
+			size_t rank = static_cast<size_t>(std::ceil(percentile * sorted_values.size() / 100.0));
+			return sorted_values[rank ? rank - 1 : 0];
+		}
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	FrameStatsHistory::FrameStatsHistory(size_t capacity) : frames_(capacity), first_(0), count_(0) {
+		assert(capacity > 0);
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void FrameStatsHistory::addFrame(const FrameRecord & record) {
+		Lock lock(mutex_);
+		if (count_ < frames_.size()) {
+			frames_[count_++] = record;
+		}
+		else {
+			frames_[first_] = record;
+			first_ = (first_ + 1) % frames_.size();
+		}
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void FrameStatsHistory::clear() {
+		Lock lock(mutex_);
+		first_ = 0;
+		count_ = 0;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	size_t FrameStatsHistory::getCapacity() const {
+		return frames_.size();
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	size_t FrameStatsHistory::getFrameCount() const {
+		Lock lock(mutex_);
+		return count_;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	const FrameRecord & FrameStatsHistory::getFrameImpl(size_t index) const {
+		assert(index < count_);
+		return frames_[(first_ + index) % frames_.size()];
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	FrameRecord FrameStatsHistory::getFrame(size_t index) const {
+		Lock lock(mutex_);
+		return getFrameImpl(index);
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	FrameRecord FrameStatsHistory::getLastFrame() const {
+		Lock lock(mutex_);
+		if (count_ == 0) {
+			FrameRecord record = {0, 0.0, 0.0, 0, 0, 0};
+			return record;
+		}
+		return getFrameImpl(count_ - 1);
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	double FrameStatsHistory::getFrameTimePercentile(double percentile) const {
+		Lock lock(mutex_);
+		sorted_times_.clear();
+		for (size_t i = 0; i < count_; ++i)
+			sorted_times_.push_back(getFrameImpl(i).frame_time);
+		std::sort(sorted_times_.begin(), sorted_times_.end());
+		return getPercentile(sorted_times_, percentile);
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	FrameTimeSummary FrameStatsHistory::getFrameTimeSummaryImpl() const {
+		FrameTimeSummary summary = {count_, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0};
+		if (count_ == 0)
+			return summary;
+		sorted_times_.clear();
+		double total = 0.0;
+		for (size_t i = 0; i < count_; ++i) {
+			double frame_time = getFrameImpl(i).frame_time;
+			sorted_times_.push_back(frame_time);
+			total += frame_time;
+		}
+		std::sort(sorted_times_.begin(), sorted_times_.end());
+		summary.average = total / count_;
+		summary.best = sorted_times_.front();
+		summary.worst = sorted_times_.back();
+		summary.p50 = getPercentile(sorted_times_, 50.0);
+		summary.p95 = getPercentile(sorted_times_, 95.0);
+		summary.p99 = getPercentile(sorted_times_, 99.0);
+		return summary;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	FrameTimeSummary FrameStatsHistory::getFrameTimeSummary() const {
+		Lock lock(mutex_);
+		return getFrameTimeSummaryImpl();
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void FrameStatsHistory::writeCSV(std::ostream & stream) const {
+		Lock lock(mutex_);
+		stream << "frame,frame_time_ms,submission_time_ms,batches,faces,vertices\n";
+		for (size_t i = 0; i < count_; ++i) {
+			const FrameRecord & record = getFrameImpl(i);
+			stream << record.frame_number << ',' << record.frame_time << ',' << record.submission_time << ','
+				   << record.batch_count << ',' << record.face_count << ',' << record.vertex_count << '\n';
+		}
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void FrameStatsHistory::writeJSON(std::ostream & stream) const {
+		Lock lock(mutex_);
+		FrameTimeSummary summary = getFrameTimeSummaryImpl();
+		stream << "{\n\t\"frame_count\": " << summary.frame_count << ",\n";
+		stream << "\t\"frame_time_ms\": {\"average\": " << summary.average << ", \"best\": " << summary.best
+			   << ", \"worst\": " << summary.worst << ", \"p50\": " << summary.p50 << ", \"p95\": " << summary.p95
+			   << ", \"p99\": " << summary.p99 << "},\n";
+		stream << "\t\"frames\": [";
+		for (size_t i = 0; i < count_; ++i) {
+			const FrameRecord & record = getFrameImpl(i);
+			stream << (i ? ",\n" : "\n") << "\t\t{\"frame\": " << record.frame_number << ", \"frame_time_ms\": "
+				   << record.frame_time << ", \"submission_time_ms\": " << record.submission_time << ", \"batches\": "
+				   << record.batch_count << ", \"faces\": " << record.face_count << ", \"vertices\": "
+				   << record.vertex_count << "}";
+		}
+		stream << "\n\t]\n}\n";
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	bool FrameStatsHistory::exportCSV(const std::string & path) const {
+		std::ofstream stream(path.c_str());
+		if (!stream)
+			return false;
+		writeCSV(stream);
+		return true;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	bool FrameStatsHistory::exportJSON(const std::string & path) const {
+		std::ofstream stream(path.c_str());
+		if (!stream)
+			return false;
+		writeJSON(stream);
+		return true;
+	}
+}
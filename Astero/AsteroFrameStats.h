@@ -0,0 +1,84 @@
+//
+//  AsteroFrameStats.h
+//  Astero
+//
+//  Created by Yuzhe Wang on 10/18/26.
+//  Copyright © 2026 Yuzhe Wang. All rights reserved.
+//
+
+#ifndef AsteroFrameStats_h
+#define AsteroFrameStats_h
+
+#include <mutex>
+#include "AsteroPrerequisites.h"
+
+// Number of frames kept in frame statistics history.
+#define FRAME_STATS_HISTORY_SIZE 600
+
+namespace Astero {
+	// Measurements of one frame.
+	struct FrameRecord {
+		size_t frame_number;
+		// Milliseconds of CPU time between end of previous frame and end of this one.
+		double frame_time;
+		// Milliseconds between beginFrame and endFrame, spent submitting work to GPU.
+		double submission_time;
+		size_t batch_count;
+		size_t face_count;
+		size_t vertex_count;
+	};
+
+	// Summary of frames in history.
+	struct FrameTimeSummary {
+		size_t frame_count;
+		double average;
+		double best;
+		double worst;
+		double p50;
+		double p95;
+		double p99;
+	};
+
+	// Ring buffer of last frames, with percentile frame times and CSV and JSON export. Frames are added by render thread,
+	// and can be queried from any thread.
+	class FrameStatsHistory {
+	public:
+		FrameStatsHistory(size_t capacity = FRAME_STATS_HISTORY_SIZE);
+		
+		void addFrame(const FrameRecord & record);
+		void clear();
+		size_t getCapacity() const;
+		size_t getFrameCount() const;
+		// Frame at index, 0 being oldest frame kept.
+		FrameRecord getFrame(size_t index) const;
+		FrameRecord getLastFrame() const;
+		// Frame time at percentile in [0, 100] by nearest rank, 0 if history is empty.
+		double getFrameTimePercentile(double percentile) const;
+		FrameTimeSummary getFrameTimeSummary() const;
+		// One row per frame, oldest first.
+		void writeCSV(std::ostream & stream) const;
+		// Summary and all frames, oldest first.
+		void writeJSON(std::ostream & stream) const;
+		// Write to a file, return false if it cannot be opened.
+		bool exportCSV(const std::string & path) const;
+		bool exportJSON(const std::string & path) const;
+		
+	protected:
+		typedef std::mutex Mutex;
+		typedef std::lock_guard<Mutex> Lock;
+		
+		// Following methods require mutex_ held.
+		const FrameRecord & getFrameImpl(size_t index) const;
+		FrameTimeSummary getFrameTimeSummaryImpl() const;
+		
+		std::vector<FrameRecord> frames_;
+		// Index of oldest frame once history is full.
+		size_t first_;
+		size_t count_;
+		// Reused to sort frame times for percentiles.
+		mutable std::vector<double> sorted_times_;
+		mutable Mutex mutex_;
+	};
+}
+
+#endif // AsteroFrameStats_h
@@ -0,0 +1,28 @@
+//
+//  AsteroGLContext.h
+//  Astero
+//
+//  Created by Yuzhe Wang on 10/18/26.
+//  Copyright © 2026 Yuzhe Wang. All rights reserved.
+//
+
+#ifndef AsteroGLContext_h
+#define AsteroGLContext_h
+
+#include "AsteroPrerequisites.h"
+
+namespace Astero {
+	// GL context of a window, implemented by windowing system. A context is current on at most one thread at a time, so
+	// thread holding it must end it before another thread sets it current.
+	class GLContext {
+	public:
+		virtual ~GLContext() {}
+
+		// Makes context current on calling thread.
+		virtual void setCurrent() = 0;
+		// Releases context from calling thread.
+		virtual void endCurrent() = 0;
+	};
+} // namespace Astero
+
+#endif // AsteroGLContext_h
@@ -21,7 +21,7 @@ namespace Astero {
 		~GLDefaultHardwareVertexBuffer();
 		
 		void * getData(size_t offset) const {
-			return (void *)(data_ + offset);
+			return (void *)(static_cast<const unsigned char *>(storage_.getContiguousData()) + offset);
 		}
 	protected:
 		
@@ -35,7 +35,7 @@ namespace Astero {
 		~GLDefaultHardwareIndexBuffer();
 		
 		void * getData(size_t offset) const {
-			return (void *)(data_ + offset);
+			return (void *)(static_cast<const unsigned char *>(storage_.getContiguousData()) + offset);
 		}
 	protected:
 		
@@ -0,0 +1,28 @@
+//
+//  AsteroGLFWContext.cpp
+//  Astero
+//
+//  Created by Yuzhe Wang on 10/18/26.
+//  Copyright © 2026 Yuzhe Wang. All rights reserved.
+//
+
+#include <cassert>
+#include <GLFW/glfw3.h>
+#include "AsteroGLFWContext.h"
+
+namespace Astero {
+	//--------------------------------------------------------------------------------------------------------------------------------
+	GLFWContext::GLFWContext(GLFWwindow * window) : window_(window) {
+		assert(window_);
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void GLFWContext::setCurrent() {
+		glfwMakeContextCurrent(window_);
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void GLFWContext::endCurrent() {
+		// GLFW releases whatever context is current on calling thread.
+		if (glfwGetCurrentContext() == window_)
+			glfwMakeContextCurrent(nullptr);
+	}
+} // namespace Astero
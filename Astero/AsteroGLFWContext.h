@@ -0,0 +1,33 @@
+//
+//  AsteroGLFWContext.h
+//  Astero
+//
+//  Created by Yuzhe Wang on 10/18/26.
+//  Copyright © 2026 Yuzhe Wang. All rights reserved.
+//
+
+#ifndef AsteroGLFWContext_h
+#define AsteroGLFWContext_h
+
+#include "AsteroGLContext.h"
+
+struct GLFWwindow;
+
+namespace Astero {
+	// Context of a GLFW window, which lets a window created through GLFW be set as main context of GLRenderSystem. Does not
+	// own window.
+	class GLFWContext : public GLContext {
+	public:
+		explicit GLFWContext(GLFWwindow * window);
+
+		void setCurrent() override;
+		void endCurrent() override;
+
+		GLFWwindow * getWindow() const { return window_; }
+
+	protected:
+		GLFWwindow * window_;
+	};
+} // namespace Astero
+
+#endif // AsteroGLFWContext_h
@@ -0,0 +1,194 @@
+//
+//  AsteroGLProgramBinaryCache.cpp
+//  Astero
+//
+//  Created by Yuzhe Wang on 10/18/26.
+//  Copyright © 2026 Yuzhe Wang. All rights reserved.
+//
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <vector>
+#include <unistd.h>
+#include "AsteroGLProgramBinaryCache.h"
+#include "AsteroProfiler.h"
+
+namespace Astero {
+	template <> GLProgramBinaryCache * Singleton<GLProgramBinaryCache>::ptr_ = nullptr;
+	
+	namespace {
+		uint64_t hashString(const GLubyte * value, uint64_t seed) {
+			const char * string = value ? reinterpret_cast<const char *>(value) : "";
+			// Hashes terminator too, so adjacent strings cannot shift into each other.
+			return GLProgramBinaryCache::hash(string, strlen(string) + 1, seed);
+		}
+		
+		// Temporary file name unique to this process and save, so concurrent saves of one key never write the same file.
+		std::string makeTempSuffix() {
+			static std::atomic<unsigned int> counter(0);
+			return "." + std::to_string(getpid()) + "." + std::to_string(counter++) + ".tmp";
+		}
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	GLProgramBinaryCache::GLProgramBinaryCache(const std::string & directory) : directory_(directory), driver_hash_(0),
+	driver_queried_(false), supported_(false), hit_count_(0), miss_count_(0) {
+		if (directory_.empty()) {
+			const char * value = getenv("ASTERO_PROGRAM_CACHE_DIR");
+			if (value)
+				directory_ = value;
+		}
+		if (!directory_.empty() && directory_.back() != '/')
+			directory_ += '/';
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	uint64_t GLProgramBinaryCache::hash(const void * data, size_t size, uint64_t seed) {
+		const unsigned char * bytes = static_cast<const unsigned char *>(data);
+		for (size_t i = 0; i < size; i++) {
+			seed ^= bytes[i];
+			seed *= 0x100000001b3ull;
+		}
+		return seed;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void GLProgramBinaryCache::queryDriver() {
+		if (driver_queried_)
+			return;
+		driver_queried_ = true;
+		uint64_t seed = hash(GL_PROGRAM_BINARY_CACHE_MAGIC, sizeof(GL_PROGRAM_BINARY_CACHE_MAGIC));
+		seed = hashString(glGetString(GL_VENDOR), seed);
+		seed = hashString(glGetString(GL_RENDERER), seed);
+		seed = hashString(glGetString(GL_VERSION), seed);
+		driver_hash_ = hashString(glGetString(GL_SHADING_LANGUAGE_VERSION), seed);
+		if (GLEW_VERSION_4_1 || GLEW_ARB_get_program_binary) {
+			// Some drivers expose the entry points but no binary format.
+			GLint format_count = 0;
+			glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &format_count);
+			supported_ = format_count > 0;
+		}
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	bool GLProgramBinaryCache::isEnabled() {
+		Lock lock(mutex_);
+		if (directory_.empty())
+			return false;
+		queryDriver();
+		return supported_;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	uint64_t GLProgramBinaryCache::makeKey(uint64_t source_hash, const std::string & defines) {
+		Lock lock(mutex_);
+		queryDriver();
+		uint64_t key = hash(&source_hash, sizeof(source_hash), driver_hash_);
+		return hash(defines.data(), defines.size(), key);
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	std::string GLProgramBinaryCache::getPath(uint64_t key) const {
+		char name[17];
+		snprintf(name, sizeof(name), "%016llx", static_cast<unsigned long long>(key));
+		return directory_ + name + GL_PROGRAM_BINARY_CACHE_EXTENSION;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	bool GLProgramBinaryCache::load(GLuint program, uint64_t key) {
+		ASTERO_PROFILE_SCOPE("GLProgramBinaryCache::load");
+		std::string path;
+		{
+			Lock lock(mutex_);
+			path = getPath(key);
+		}
+		std::ifstream stream(path, std::ios::binary);
+		bool valid = false;
+		if (stream) {
+			FileHeader header;
+			std::vector<char> data;
+			if (stream.read(reinterpret_cast<char *>(&header), sizeof(header))
+				&& memcmp(header.magic, GL_PROGRAM_BINARY_CACHE_MAGIC, sizeof(header.magic)) == 0 && header.key == key) {
+				data.resize(header.size);
+				valid = stream.read(data.data(), data.size()) && hash(data.data(), data.size()) == header.data_hash;
+			}
+			stream.close();
+			if (valid) {
+				glProgramBinary(program, header.format, data.data(), static_cast<GLsizei>(data.size()));
+				GLint status = GL_FALSE;
+				glGetProgramiv(program, GL_LINK_STATUS, &status);
+				valid = status == GL_TRUE;
+			}
+			// Damaged, or made stale by a driver change its version string does not show.
+			if (!valid)
+				remove(key);
+		}
+		Lock lock(mutex_);
+		if (valid)
+			hit_count_++;
+		else
+			miss_count_++;
+		return valid;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	bool GLProgramBinaryCache::save(GLuint program, uint64_t key) {
+		ASTERO_PROFILE_SCOPE("GLProgramBinaryCache::save");
+		GLint size = 0;
+		glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &size);
+		if (size <= 0)
+			return false;
+		std::vector<char> data(size);
+		GLenum format = 0;
+		GLsizei length = 0;
+		glGetProgramBinary(program, size, &length, &format, data.data());
+		if (length <= 0)
+			return false;
+		data.resize(length);
+		
+		FileHeader header;
+		memcpy(header.magic, GL_PROGRAM_BINARY_CACHE_MAGIC, sizeof(header.magic));
+		header.key = key;
+		header.data_hash = hash(data.data(), data.size());
+		header.format = format;
+		header.size = static_cast<uint32_t>(data.size());
+		std::string path;
+		{
+			Lock lock(mutex_);
+			path = getPath(key);
+		}
+		// Written aside and renamed, so a concurrent run or a crash never leaves a partial file under key.
+		std::string temp_path = path + makeTempSuffix();
+		{
+			std::ofstream stream(temp_path, std::ios::binary | std::ios::trunc);
+			if (!stream)
+				return false;
+			stream.write(reinterpret_cast<const char *>(&header), sizeof(header));
+			stream.write(data.data(), data.size());
+			if (!stream) {
+				stream.close();
+				std::remove(temp_path.c_str());
+				return false;
+			}
+		}
+		if (std::rename(temp_path.c_str(), path.c_str()) != 0) {
+			std::remove(temp_path.c_str());
+			return false;
+		}
+		return true;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void GLProgramBinaryCache::remove(uint64_t key) {
+		std::string path;
+		{
+			Lock lock(mutex_);
+			path = getPath(key);
+		}
+		std::remove(path.c_str());
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	size_t GLProgramBinaryCache::getHitCount() const {
+		Lock lock(mutex_);
+		return hit_count_;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	size_t GLProgramBinaryCache::getMissCount() const {
+		Lock lock(mutex_);
+		return miss_count_;
+	}
+}
@@ -0,0 +1,77 @@
+//
+//  AsteroGLProgramBinaryCache.h
+//  Astero
+//
+//  Created by Yuzhe Wang on 10/18/26.
+//  Copyright © 2026 Yuzhe Wang. All rights reserved.
+//
+
+#ifndef AsteroGLProgramBinaryCache_h
+#define AsteroGLProgramBinaryCache_h
+
+#include <GL/glew.h>
+#include <mutex>
+#include "AsteroPrerequisites.h"
+#include "AsteroSingleton.tpp"
+
+// Leading bytes of a cached program binary file, changed whenever file layout changes.
+#define GL_PROGRAM_BINARY_CACHE_MAGIC "ASTPRGB1"
+#define GL_PROGRAM_BINARY_CACHE_EXTENSION ".glbin"
+
+namespace Astero {
+	// On-disk cache of linked GLSL programs, so later runs restore them with glProgramBinary instead of compiling sources.
+	// Each binary is stored in its own file named after its key, which hashes program sources, preprocessor defines and
+	// driver vendor, renderer and version, so a driver update or a changed source simply misses. Binaries the driver
+	// rejects are deleted, and their programs fall back to compiling.
+	class GLProgramBinaryCache : public Singleton<GLProgramBinaryCache> {
+	public:
+		// With an empty directory, uses ASTERO_PROGRAM_CACHE_DIR environment variable. Cache is disabled if neither is set.
+		explicit GLProgramBinaryCache(const std::string & directory = "");
+
+		// Whether a directory is set and driver supports program binaries. Needs a current context on first call.
+		bool isEnabled();
+		const std::string & getDirectory() const { return directory_; }
+		// Key of a program whose sources hash to source_hash. Needs a current context on first call.
+		uint64_t makeKey(uint64_t source_hash, const std::string & defines);
+		// Restores program from binary stored under key. Returns false if there is none, or if it is damaged or rejected by
+		// driver, in which case stored binary is deleted.
+		bool load(GLuint program, uint64_t key);
+		// Stores binary of linked program under key. Program should be linked with GL_PROGRAM_BINARY_RETRIEVABLE_HINT set.
+		bool save(GLuint program, uint64_t key);
+		// Deletes binary stored under key.
+		void remove(uint64_t key);
+		size_t getHitCount() const;
+		size_t getMissCount() const;
+
+		// 64 bit FNV-1a hash, chained through seed.
+		static uint64_t hash(const void * data, size_t size, uint64_t seed = 0xcbf29ce484222325ull);
+
+	protected:
+		typedef std::mutex Mutex;
+		typedef std::lock_guard<Mutex> Lock;
+
+		// Header of a cached binary file, followed by binary itself.
+		struct FileHeader {
+			char magic[8];
+			uint64_t key;
+			uint64_t data_hash;
+			uint32_t format;
+			uint32_t size;
+		};
+
+		// Reads driver strings and program binary support, once.
+		void queryDriver();
+		std::string getPath(uint64_t key) const;
+
+		std::string directory_;
+		// Hash of driver vendor, renderer, version and shading language version.
+		uint64_t driver_hash_;
+		bool driver_queried_;
+		bool supported_;
+		size_t hit_count_;
+		size_t miss_count_;
+		mutable Mutex mutex_;
+	};
+}
+
+#endif // AsteroGLProgramBinaryCache_h
@@ -0,0 +1,913 @@
+//
+//  AsteroGLStateCacheManager.cpp
+//  Astero
+//
+//  Created by Yuzhe Wang on 10/18/26.
+//  Copyright © 2026 Yuzhe Wang. All rights reserved.
+//
+
+#include <algorithm>
+#include <fstream>
+
+#include "AsteroGLStateCacheManager.h"
+
+namespace Astero {
+	template <> GLStateCacheManager * Singleton<GLStateCacheManager>::ptr_ = nullptr;
+#if ASTERO_GL_CALL_STATS
+	//--------------------------------------------------------------------------------------------------------------------------------
+	// GLCallStats
+	//--------------------------------------------------------------------------------------------------------------------------------
+	bool GLCallStats::Call::operator<(const Call & other) const {
+		if (type != other.type)
+			return type < other.type;
+		if (target != other.target)
+			return target < other.target;
+		return value < other.value;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	GLCallStats::GLCallStats() : frame_number_(0) {
+		for (size_t i = 0; i < GCT_COUNT; ++i)
+			issued_[i] = elided_[i] = last_issued_[i] = last_elided_[i] = 0;
+		const char * path = getenv("ASTERO_GL_CALL_STATS_JSON");
+		if (path)
+			dump_path_ = path;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	GLCallStats & GLCallStats::getInstance() {
+		static GLCallStats instance;
+		return instance;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	const char * GLCallStats::getCallTypeName(CallType type) {
+		static const char * names[GCT_COUNT] = {
+			"bind_buffer",
+			"bind_vertex_array",
+			"use_program",
+			"active_texture",
+			"bind_texture",
+			"bind_sampler",
+			"enable_disable",
+			"blend",
+			"depth_stencil",
+			"rasterizer",
+			"vertex_attrib_array",
+			"vertex_attrib_divisor",
+			"client_state",
+			"attrib_pointer",
+			"draw"
+		};
+		return names[type];
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void GLCallStats::notifyIssued(CallType type) {
+		++issued_[type];
+		flushSequence();
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void GLCallStats::notifyElided(CallType type, GLenum target, GLuint value) {
+		++elided_[type];
+		Call call = {type, target, value};
+		current_sequence_.push_back(call);
+		if (current_sequence_.size() >= GL_CALL_STATS_MAX_SEQUENCE_LENGTH)
+			flushSequence();
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void GLCallStats::endFrame() {
+		flushSequence();
+		for (size_t i = 0; i < GCT_COUNT; ++i) {
+			last_issued_[i] = issued_[i];
+			last_elided_[i] = elided_[i];
+			issued_[i] = elided_[i] = 0;
+		}
+		last_sequences_.swap(sequences_);
+		sequences_.clear();
+		++frame_number_;
+		if (!dump_path_.empty())
+			dumpJSON(dump_path_);
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	size_t GLCallStats::getFrameNumber() const {
+		return frame_number_;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	size_t GLCallStats::getIssuedCount(CallType type) const {
+		return last_issued_[type];
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	size_t GLCallStats::getElidedCount(CallType type) const {
+		return last_elided_[type];
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	size_t GLCallStats::getTotalIssuedCount() const {
+		size_t count = 0;
+		for (size_t i = 0; i < GCT_COUNT; ++i)
+			count += last_issued_[i];
+		return count;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	size_t GLCallStats::getTotalElidedCount() const {
+		size_t count = 0;
+		for (size_t i = 0; i < GCT_COUNT; ++i)
+			count += last_elided_[i];
+		return count;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	GLCallStats::SequenceCountList GLCallStats::getTopRedundantSequences(size_t count) const {
+		SequenceCountList sequences;
+		sequences.reserve(last_sequences_.size());
+		for (auto & value : last_sequences_) {
+			SequenceCount sequence_count = {value.first, value.second};
+			sequences.push_back(sequence_count);
+		}
+		count = std::min(count, sequences.size());
+		std::partial_sort(sequences.begin(), sequences.begin() + count, sequences.end(),
+						  [](const SequenceCount & a, const SequenceCount & b) { return a.count > b.count; });
+		sequences.resize(count);
+		return sequences;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void GLCallStats::writeJSON(std::ostream & stream, size_t top_sequence_count) const {
+		stream << "{\n\t\"frame\": " << frame_number_ << ",\n";
+		stream << "\t\"issued_total\": " << getTotalIssuedCount() << ",\n";
+		stream << "\t\"elided_total\": " << getTotalElidedCount() << ",\n";
+		stream << "\t\"calls\": {";
+		for (size_t i = 0; i < GCT_COUNT; ++i) {
+			stream << (i ? ",\n" : "\n") << "\t\t\"" << getCallTypeName(static_cast<CallType>(i)) << "\": {\"issued\": "
+				   << last_issued_[i] << ", \"elided\": " << last_elided_[i] << "}";
+		}
+		stream << "\n\t},\n\t\"top_redundant_sequences\": [";
+		SequenceCountList sequences = getTopRedundantSequences(top_sequence_count);
+		for (size_t i = 0; i < sequences.size(); ++i) {
+			stream << (i ? ",\n" : "\n") << "\t\t{\"count\": " << sequences[i].count << ", \"calls\": [";
+			const CallSequence & sequence = sequences[i].sequence;
+			for (size_t j = 0; j < sequence.size(); ++j) {
+				stream << (j ? ", " : "") << "{\"type\": \"" << getCallTypeName(sequence[j].type) << "\", \"target\": "
+					   << sequence[j].target << ", \"value\": " << sequence[j].value << "}";
+			}
+			stream << "]}";
+		}
+		stream << "\n\t]\n}\n";
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	bool GLCallStats::dumpJSON(const std::string & path, size_t top_sequence_count) const {
+		std::ofstream stream(path.c_str());
+		if (!stream)
+			return false;
+		writeJSON(stream, top_sequence_count);
+		return true;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void GLCallStats::flushSequence() {
+		if (current_sequence_.empty())
+			return;
+		++sequences_[current_sequence_];
+		current_sequence_.clear();
+	}
+#endif
+	//--------------------------------------------------------------------------------------------------------------------------------
+	// GLStateCacheManager
+	//--------------------------------------------------------------------------------------------------------------------------------
+	GLStateCacheManager::GLStateCacheManager() : imp_(nullptr) {
+		// Starts with cache of default context.
+		switchContext(0);
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	GLStateCacheManager::~GLStateCacheManager() {
+		for (auto & value : cache_map_)
+			delete value.second;
+		cache_map_.clear();
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void GLStateCacheManager::unregisterContext(intptr_t id) {
+		auto iter = cache_map_.find(id);
+		if (iter != cache_map_.end()) {
+			if (iter->second == imp_)
+				imp_ = nullptr;
+			delete iter->second;
+			cache_map_.erase(iter);
+		}
+		// imp_ always points to a non-empty GLStateCacheManagerImp pointer.
+		if (imp_ == nullptr) {
+			if (cache_map_.empty())
+				cache_map_.insert(CacheMap::value_type(0, new GLStateCacheManagerImp()));
+			imp_ = cache_map_.begin()->second;
+		}
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void GLStateCacheManager::switchContext(intptr_t id) {
+		auto iter = cache_map_.find(id);
+		if (iter != cache_map_.end())
+			imp_ = iter->second;
+		else {
+			// Creates a new cache if not found.
+			imp_ = new GLStateCacheManagerImp();
+			imp_->initializeCache();
+			cache_map_[id] = imp_;
+		}
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void GLStateCacheManager::clearCache() {
+		imp_->clearCache();
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void GLStateCacheManager::bindGLBuffer(GLenum target, GLuint buffer, bool force) {
+		imp_->bindGLBuffer(target, buffer, force);
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void GLStateCacheManager::deleteGLBuffer(GLenum target, GLuint buffer) {
+		imp_->deleteGLBuffer(target, buffer);
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void GLStateCacheManager::bindGLUniformBufferRange(GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size) {
+		imp_->bindGLUniformBufferRange(index, buffer, offset, size);
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void GLStateCacheManager::bindGLVertexArray(GLuint vertex_array, bool created) {
+		imp_->bindGLVertexArray(vertex_array, created);
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void GLStateCacheManager::deleteGLVertexArray(GLuint vertex_array) {
+		imp_->deleteGLVertexArray(vertex_array);
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	GLuint GLStateCacheManager::findGLVertexArray(const GLVertexArrayCache::Key & key) {
+		return imp_->findGLVertexArray(key);
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void GLStateCacheManager::cacheGLVertexArray(const GLVertexArrayCache::Key & key, GLuint vertex_array,
+												 const GLVertexArrayCache::BufferList & buffers) {
+		imp_->cacheGLVertexArray(key, vertex_array, buffers);
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void GLStateCacheManager::updateGLVertexArrayCache() {
+		imp_->updateGLVertexArrayCache();
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	const GLVertexArrayCache & GLStateCacheManager::getGLVertexArrayCache() const {
+		return imp_->getGLVertexArrayCache();
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void GLStateCacheManager::useGLProgram(GLuint program) {
+		imp_->useGLProgram(program);
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	bool GLStateCacheManager::activateGLTextureUnit(size_t unit) {
+		return imp_->activateGLTextureUnit(unit);
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void GLStateCacheManager::bindGLTexture(GLenum target, GLuint texture) {
+		imp_->bindGLTexture(target, texture);
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void GLStateCacheManager::deleteGLTexture(GLuint texture) {
+		imp_->deleteGLTexture(texture);
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void GLStateCacheManager::bindGLSampler(size_t unit, GLuint sampler) {
+		imp_->bindGLSampler(unit, sampler);
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void GLStateCacheManager::setEnabled(GLenum capability, bool enabled) {
+		imp_->setEnabled(capability, enabled);
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void GLStateCacheManager::setBlendFunc(GLenum source_rgb, GLenum dest_rgb, GLenum source_alpha, GLenum dest_alpha) {
+		imp_->setBlendFunc(source_rgb, dest_rgb, source_alpha, dest_alpha);
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void GLStateCacheManager::setBlendEquation(GLenum rgb, GLenum alpha) {
+		imp_->setBlendEquation(rgb, alpha);
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void GLStateCacheManager::setDepthFunc(GLenum func) {
+		imp_->setDepthFunc(func);
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void GLStateCacheManager::setDepthMask(bool mask) {
+		imp_->setDepthMask(mask);
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void GLStateCacheManager::setColorMask(bool red, bool green, bool blue, bool alpha) {
+		imp_->setColorMask(red, green, blue, alpha);
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void GLStateCacheManager::setStencilFunc(GLenum func, GLint ref, GLuint mask) {
+		imp_->setStencilFunc(func, ref, mask);
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void GLStateCacheManager::setStencilOp(GLenum stencil_fail, GLenum depth_fail, GLenum pass) {
+		imp_->setStencilOp(stencil_fail, depth_fail, pass);
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void GLStateCacheManager::setStencilMask(GLuint mask) {
+		imp_->setStencilMask(mask);
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void GLStateCacheManager::setCullFace(GLenum mode) {
+		imp_->setCullFace(mode);
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void GLStateCacheManager::setViewport(GLint x, GLint y, GLsizei width, GLsizei height) {
+		imp_->setViewport(x, y, width, height);
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void GLStateCacheManager::setScissor(GLint x, GLint y, GLsizei width, GLsizei height) {
+		imp_->setScissor(x, y, width, height);
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void GLStateCacheManager::setEnabledVertexAttribArrays(unsigned int mask) {
+		imp_->setEnabledVertexAttribArrays(mask);
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void GLStateCacheManager::setVertexAttribDivisor(GLuint index, GLuint divisor) {
+		imp_->setVertexAttribDivisor(index, divisor);
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void GLStateCacheManager::setClientActiveTexture(size_t unit) {
+		imp_->setClientActiveTexture(unit);
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void GLStateCacheManager::setEnabledClientStates(unsigned int mask) {
+		imp_->setEnabledClientStates(mask);
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	// GLStateCacheManagerImp
+	//--------------------------------------------------------------------------------------------------------------------------------
+	GLStateCacheManagerImp::GLStateCacheManagerImp()
+	: max_vertex_attribs_(GL_STATE_CACHE_MAX_VERTEX_ATTRIBS), max_texture_coords_(GL_STATE_CACHE_MAX_TEXTURE_UNITS),
+	limits_valid_(false), vertex_array_recording_(false) {
+		clearCache();
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void GLStateCacheManagerImp::initializeCache() {
+		clearCache();
+		queryLimits();
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void GLStateCacheManagerImp::queryLimits() {
+		if (limits_valid_)
+			return;
+		GLint max_vertex_attribs = 0;
+		glGetIntegerv(GL_MAX_VERTEX_ATTRIBS, &max_vertex_attribs);
+		// No current context yet, tries again on next use.
+		if (max_vertex_attribs <= 0)
+			return;
+		GLint max_texture_coords = 0;
+		glGetIntegerv(GL_MAX_TEXTURE_COORDS, &max_texture_coords);
+		// Core profile contexts have no fixed function texture coordinate arrays.
+		if (glGetError() != GL_NO_ERROR)
+			max_texture_coords = 0;
+		max_vertex_attribs_ = std::min(static_cast<GLuint>(max_vertex_attribs), static_cast<GLuint>(GL_STATE_CACHE_MAX_VERTEX_ATTRIBS));
+		max_texture_coords_ = std::min(static_cast<size_t>(std::max(max_texture_coords, 0)),
+									   static_cast<size_t>(GL_STATE_CACHE_MAX_TEXTURE_UNITS));
+		limits_valid_ = true;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void GLStateCacheManagerImp::clearCache() {
+		for (size_t i = 0; i < BS_COUNT; ++i)
+			buffers_[i] = GL_STATE_CACHE_UNKNOWN;
+		for (size_t i = 0; i < GL_STATE_CACHE_MAX_UNIFORM_BUFFER_BINDINGS; ++i)
+			uniform_buffers_[i] = GL_STATE_CACHE_UNKNOWN;
+		vertex_array_ = GL_STATE_CACHE_UNKNOWN;
+		vertex_array_recording_ = false;
+		program_ = GL_STATE_CACHE_UNKNOWN;
+		active_texture_unit_ = GL_STATE_CACHE_MAX_TEXTURE_UNITS;
+		for (size_t unit = 0; unit < GL_STATE_CACHE_MAX_TEXTURE_UNITS; ++unit) {
+			for (size_t i = 0; i < TS_COUNT; ++i)
+				textures_[unit][i] = GL_STATE_CACHE_UNKNOWN;
+			samplers_[unit] = GL_STATE_CACHE_UNKNOWN;
+		}
+		for (size_t i = 0; i < CAP_COUNT; ++i)
+			capabilities_[i] = TRI_UNKNOWN;
+		for (size_t i = 0; i < 4; ++i)
+			blend_func_[i] = GL_STATE_CACHE_UNKNOWN;
+		blend_equation_[0] = blend_equation_[1] = GL_STATE_CACHE_UNKNOWN;
+		depth_func_ = GL_STATE_CACHE_UNKNOWN;
+		depth_mask_ = TRI_UNKNOWN;
+		color_mask_ = GL_STATE_CACHE_UNKNOWN;
+		stencil_func_ = GL_STATE_CACHE_UNKNOWN;
+		stencil_ref_ = 0;
+		stencil_func_mask_ = 0;
+		stencil_op_[0] = stencil_op_[1] = stencil_op_[2] = GL_STATE_CACHE_UNKNOWN;
+		stencil_mask_ = GL_STATE_CACHE_UNKNOWN;
+		cull_face_ = GL_STATE_CACHE_UNKNOWN;
+		viewport_valid_ = false;
+		scissor_valid_ = false;
+		clearVertexArrayState();
+		client_active_texture_ = GL_STATE_CACHE_MAX_TEXTURE_UNITS;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void GLStateCacheManagerImp::bindGLBuffer(GLenum target, GLuint buffer, bool force) {
+		BufferSlot slot = getBufferSlot(target);
+		// Element array binding belongs to bound vertex array object, so binding an index buffer for an upload must not
+		// change a cached vertex array object.
+		if (slot == BS_ELEMENT_ARRAY && vertex_array_ != 0 && !vertex_array_recording_)
+			bindGLVertexArray(0);
+		if (slot != BS_COUNT) {
+			if (buffers_[slot] == buffer && !force) {
+				ASTERO_GL_CALL_ELIDED(GCT_BIND_BUFFER, target, buffer);
+				return;
+			}
+			buffers_[slot] = buffer;
+		}
+		ASTERO_GL_CALL_ISSUED(GCT_BIND_BUFFER);
+		if (target == GL_FRAMEBUFFER) {
+			glBindFramebuffer(target, buffer);
+		}
+		else if (target == GL_RENDERBUFFER) {
+			glBindRenderbuffer(target, buffer);
+		}
+		else {
+			glBindBuffer(target, buffer);
+		}
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void GLStateCacheManagerImp::deleteGLBuffer(GLenum target, GLuint buffer) {
+		if (buffer == 0)
+			return;
+		// Deleting unbinds object from every target of its kind, so cached bindings of those targets are reset too.
+		if (target == GL_FRAMEBUFFER) {
+			glDeleteFramebuffers(1, &buffer);
+			if (buffers_[BS_FRAMEBUFFER] == buffer)
+				buffers_[BS_FRAMEBUFFER] = 0;
+		}
+		else if (target == GL_RENDERBUFFER) {
+			glDeleteRenderbuffers(1, &buffer);
+			if (buffers_[BS_RENDERBUFFER] == buffer)
+				buffers_[BS_RENDERBUFFER] = 0;
+		}
+		else {
+			glDeleteBuffers(1, &buffer);
+			for (size_t i = 0; i < BS_FRAMEBUFFER; ++i) {
+				if (buffers_[i] == buffer)
+					buffers_[i] = 0;
+			}
+			for (size_t i = 0; i < GL_STATE_CACHE_MAX_UNIFORM_BUFFER_BINDINGS; ++i) {
+				if (uniform_buffers_[i] == buffer)
+					uniform_buffers_[i] = 0;
+			}
+			// Name may be reused by a new buffer, which cached vertex array objects must not be mistaken to reference.
+			vertex_array_cache_.removeBuffer(buffer, removed_vertex_arrays_);
+			deleteRemovedVertexArrays();
+		}
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void GLStateCacheManagerImp::bindGLUniformBufferRange(GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size) {
+		if (index < GL_STATE_CACHE_MAX_UNIFORM_BUFFER_BINDINGS) {
+			if (uniform_buffers_[index] == buffer && uniform_buffer_offsets_[index] == offset && uniform_buffer_sizes_[index] == size) {
+				ASTERO_GL_CALL_ELIDED(GCT_BIND_BUFFER, GL_UNIFORM_BUFFER, buffer);
+				return;
+			}
+			uniform_buffers_[index] = buffer;
+			uniform_buffer_offsets_[index] = offset;
+			uniform_buffer_sizes_[index] = size;
+		}
+		ASTERO_GL_CALL_ISSUED(GCT_BIND_BUFFER);
+		glBindBufferRange(GL_UNIFORM_BUFFER, index, buffer, offset, size);
+		buffers_[BS_UNIFORM] = buffer;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void GLStateCacheManagerImp::bindGLVertexArray(GLuint vertex_array, bool created) {
+		if (vertex_array_ == vertex_array) {
+			ASTERO_GL_CALL_ELIDED(GCT_BIND_VERTEX_ARRAY, GL_VERTEX_ARRAY, vertex_array);
+			return;
+		}
+		ASTERO_GL_CALL_ISSUED(GCT_BIND_VERTEX_ARRAY);
+		glBindVertexArray(vertex_array);
+		vertex_array_ = vertex_array;
+		vertex_array_recording_ = created;
+		clearVertexArrayState();
+		if (created) {
+			// New vertex array object has no element array buffer, and all arrays disabled with divisor 0.
+			buffers_[BS_ELEMENT_ARRAY] = 0;
+			vertex_attrib_mask_valid_ = true;
+			client_state_mask_valid_ = true;
+			for (size_t i = 0; i < GL_STATE_CACHE_MAX_VERTEX_ATTRIBS; ++i)
+				vertex_attrib_divisors_[i] = 0;
+		}
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void GLStateCacheManagerImp::deleteGLVertexArray(GLuint vertex_array) {
+		if (vertex_array == 0)
+			return;
+		glDeleteVertexArrays(1, &vertex_array);
+		// Deleting bound vertex array object binds default one.
+		if (vertex_array_ == vertex_array) {
+			vertex_array_ = 0;
+			vertex_array_recording_ = false;
+			clearVertexArrayState();
+		}
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	GLuint GLStateCacheManagerImp::findGLVertexArray(const GLVertexArrayCache::Key & key) {
+		return vertex_array_cache_.find(key);
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void GLStateCacheManagerImp::cacheGLVertexArray(const GLVertexArrayCache::Key & key, GLuint vertex_array,
+													const GLVertexArrayCache::BufferList & buffers) {
+		vertex_array_cache_.insert(key, vertex_array, buffers, removed_vertex_arrays_);
+		if (vertex_array_ == vertex_array)
+			vertex_array_recording_ = false;
+		deleteRemovedVertexArrays();
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void GLStateCacheManagerImp::updateGLVertexArrayCache() {
+		vertex_array_cache_.advanceFrame(GL_VERTEX_ARRAY_CACHE_MAX_AGE, removed_vertex_arrays_);
+		deleteRemovedVertexArrays();
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	const GLVertexArrayCache & GLStateCacheManagerImp::getGLVertexArrayCache() const {
+		return vertex_array_cache_;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void GLStateCacheManagerImp::useGLProgram(GLuint program) {
+		if (program_ == program) {
+			ASTERO_GL_CALL_ELIDED(GCT_USE_PROGRAM, GL_PROGRAM, program);
+			return;
+		}
+		ASTERO_GL_CALL_ISSUED(GCT_USE_PROGRAM);
+		glUseProgram(program);
+		program_ = program;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	bool GLStateCacheManagerImp::activateGLTextureUnit(size_t unit) {
+		if (unit >= GL_STATE_CACHE_MAX_TEXTURE_UNITS)
+			return false;
+		if (active_texture_unit_ != unit) {
+			ASTERO_GL_CALL_ISSUED(GCT_ACTIVE_TEXTURE);
+			glActiveTexture(GL_TEXTURE0 + static_cast<GLenum>(unit));
+			active_texture_unit_ = unit;
+		}
+		else {
+			ASTERO_GL_CALL_ELIDED(GCT_ACTIVE_TEXTURE, GL_ACTIVE_TEXTURE, static_cast<GLuint>(unit));
+		}
+		return true;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void GLStateCacheManagerImp::bindGLTexture(GLenum target, GLuint texture) {
+		TextureSlot slot = getTextureSlot(target);
+		if (slot != TS_COUNT && active_texture_unit_ < GL_STATE_CACHE_MAX_TEXTURE_UNITS) {
+			if (textures_[active_texture_unit_][slot] == texture) {
+				ASTERO_GL_CALL_ELIDED(GCT_BIND_TEXTURE, target, texture);
+				return;
+			}
+			textures_[active_texture_unit_][slot] = texture;
+		}
+		ASTERO_GL_CALL_ISSUED(GCT_BIND_TEXTURE);
+		glBindTexture(target, texture);
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void GLStateCacheManagerImp::deleteGLTexture(GLuint texture) {
+		if (texture == 0)
+			return;
+		glDeleteTextures(1, &texture);
+		for (size_t unit = 0; unit < GL_STATE_CACHE_MAX_TEXTURE_UNITS; ++unit) {
+			for (size_t i = 0; i < TS_COUNT; ++i) {
+				if (textures_[unit][i] == texture)
+					textures_[unit][i] = 0;
+			}
+		}
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void GLStateCacheManagerImp::bindGLSampler(size_t unit, GLuint sampler) {
+		if (unit < GL_STATE_CACHE_MAX_TEXTURE_UNITS) {
+			if (samplers_[unit] == sampler) {
+				ASTERO_GL_CALL_ELIDED(GCT_BIND_SAMPLER, static_cast<GLenum>(unit), sampler);
+				return;
+			}
+			samplers_[unit] = sampler;
+		}
+		ASTERO_GL_CALL_ISSUED(GCT_BIND_SAMPLER);
+		glBindSampler(static_cast<GLuint>(unit), sampler);
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void GLStateCacheManagerImp::setEnabled(GLenum capability, bool enabled) {
+		CapabilitySlot slot = getCapabilitySlot(capability);
+		if (slot != CAP_COUNT) {
+			TriState state = enabled ? TRI_TRUE : TRI_FALSE;
+			if (capabilities_[slot] == state) {
+				ASTERO_GL_CALL_ELIDED(GCT_ENABLE_DISABLE, capability, enabled ? 1 : 0);
+				return;
+			}
+			capabilities_[slot] = state;
+		}
+		ASTERO_GL_CALL_ISSUED(GCT_ENABLE_DISABLE);
+		if (enabled)
+			glEnable(capability);
+		else
+			glDisable(capability);
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void GLStateCacheManagerImp::setBlendFunc(GLenum source_rgb, GLenum dest_rgb, GLenum source_alpha, GLenum dest_alpha) {
+		if (blend_func_[0] == source_rgb && blend_func_[1] == dest_rgb && blend_func_[2] == source_alpha &&
+			blend_func_[3] == dest_alpha) {
+			ASTERO_GL_CALL_ELIDED(GCT_BLEND, GL_BLEND_SRC_RGB, source_rgb);
+			return;
+		}
+		ASTERO_GL_CALL_ISSUED(GCT_BLEND);
+		glBlendFuncSeparate(source_rgb, dest_rgb, source_alpha, dest_alpha);
+		blend_func_[0] = source_rgb;
+		blend_func_[1] = dest_rgb;
+		blend_func_[2] = source_alpha;
+		blend_func_[3] = dest_alpha;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void GLStateCacheManagerImp::setBlendEquation(GLenum rgb, GLenum alpha) {
+		if (blend_equation_[0] == rgb && blend_equation_[1] == alpha) {
+			ASTERO_GL_CALL_ELIDED(GCT_BLEND, GL_BLEND_EQUATION_RGB, rgb);
+			return;
+		}
+		ASTERO_GL_CALL_ISSUED(GCT_BLEND);
+		glBlendEquationSeparate(rgb, alpha);
+		blend_equation_[0] = rgb;
+		blend_equation_[1] = alpha;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void GLStateCacheManagerImp::setDepthFunc(GLenum func) {
+		if (depth_func_ == func) {
+			ASTERO_GL_CALL_ELIDED(GCT_DEPTH_STENCIL, GL_DEPTH_FUNC, func);
+			return;
+		}
+		ASTERO_GL_CALL_ISSUED(GCT_DEPTH_STENCIL);
+		glDepthFunc(func);
+		depth_func_ = func;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void GLStateCacheManagerImp::setDepthMask(bool mask) {
+		TriState state = mask ? TRI_TRUE : TRI_FALSE;
+		if (depth_mask_ == state) {
+			ASTERO_GL_CALL_ELIDED(GCT_DEPTH_STENCIL, GL_DEPTH_WRITEMASK, mask ? 1 : 0);
+			return;
+		}
+		ASTERO_GL_CALL_ISSUED(GCT_DEPTH_STENCIL);
+		glDepthMask(mask ? GL_TRUE : GL_FALSE);
+		depth_mask_ = state;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void GLStateCacheManagerImp::setColorMask(bool red, bool green, bool blue, bool alpha) {
+		GLuint color_mask = (red ? 1 : 0) | (green ? 2 : 0) | (blue ? 4 : 0) | (alpha ? 8 : 0);
+		if (color_mask_ == color_mask) {
+			ASTERO_GL_CALL_ELIDED(GCT_RASTERIZER, GL_COLOR_WRITEMASK, color_mask);
+			return;
+		}
+		ASTERO_GL_CALL_ISSUED(GCT_RASTERIZER);
+		glColorMask(red ? GL_TRUE : GL_FALSE, green ? GL_TRUE : GL_FALSE, blue ? GL_TRUE : GL_FALSE, alpha ? GL_TRUE : GL_FALSE);
+		color_mask_ = color_mask;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void GLStateCacheManagerImp::setStencilFunc(GLenum func, GLint ref, GLuint mask) {
+		if (stencil_func_ == func && stencil_ref_ == ref && stencil_func_mask_ == mask) {
+			ASTERO_GL_CALL_ELIDED(GCT_DEPTH_STENCIL, GL_STENCIL_FUNC, func);
+			return;
+		}
+		ASTERO_GL_CALL_ISSUED(GCT_DEPTH_STENCIL);
+		glStencilFunc(func, ref, mask);
+		stencil_func_ = func;
+		stencil_ref_ = ref;
+		stencil_func_mask_ = mask;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void GLStateCacheManagerImp::setStencilOp(GLenum stencil_fail, GLenum depth_fail, GLenum pass) {
+		if (stencil_op_[0] == stencil_fail && stencil_op_[1] == depth_fail && stencil_op_[2] == pass) {
+			ASTERO_GL_CALL_ELIDED(GCT_DEPTH_STENCIL, GL_STENCIL_FAIL, stencil_fail);
+			return;
+		}
+		ASTERO_GL_CALL_ISSUED(GCT_DEPTH_STENCIL);
+		glStencilOp(stencil_fail, depth_fail, pass);
+		stencil_op_[0] = stencil_fail;
+		stencil_op_[1] = depth_fail;
+		stencil_op_[2] = pass;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void GLStateCacheManagerImp::setStencilMask(GLuint mask) {
+		if (stencil_mask_ == mask && stencil_mask_ != GL_STATE_CACHE_UNKNOWN) {
+			ASTERO_GL_CALL_ELIDED(GCT_DEPTH_STENCIL, GL_STENCIL_WRITEMASK, mask);
+			return;
+		}
+		ASTERO_GL_CALL_ISSUED(GCT_DEPTH_STENCIL);
+		glStencilMask(mask);
+		stencil_mask_ = mask;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void GLStateCacheManagerImp::setCullFace(GLenum mode) {
+		if (cull_face_ == mode) {
+			ASTERO_GL_CALL_ELIDED(GCT_RASTERIZER, GL_CULL_FACE_MODE, mode);
+			return;
+		}
+		ASTERO_GL_CALL_ISSUED(GCT_RASTERIZER);
+		glCullFace(mode);
+		cull_face_ = mode;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void GLStateCacheManagerImp::setViewport(GLint x, GLint y, GLsizei width, GLsizei height) {
+		if (viewport_valid_ && viewport_[0] == x && viewport_[1] == y && viewport_[2] == width && viewport_[3] == height) {
+			ASTERO_GL_CALL_ELIDED(GCT_RASTERIZER, GL_VIEWPORT, static_cast<GLuint>(width));
+			return;
+		}
+		ASTERO_GL_CALL_ISSUED(GCT_RASTERIZER);
+		glViewport(x, y, width, height);
+		viewport_[0] = x;
+		viewport_[1] = y;
+		viewport_[2] = width;
+		viewport_[3] = height;
+		viewport_valid_ = true;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void GLStateCacheManagerImp::setScissor(GLint x, GLint y, GLsizei width, GLsizei height) {
+		if (scissor_valid_ && scissor_[0] == x && scissor_[1] == y && scissor_[2] == width && scissor_[3] == height) {
+			ASTERO_GL_CALL_ELIDED(GCT_RASTERIZER, GL_SCISSOR_BOX, static_cast<GLuint>(width));
+			return;
+		}
+		ASTERO_GL_CALL_ISSUED(GCT_RASTERIZER);
+		glScissor(x, y, width, height);
+		scissor_[0] = x;
+		scissor_[1] = y;
+		scissor_[2] = width;
+		scissor_[3] = height;
+		scissor_valid_ = true;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void GLStateCacheManagerImp::setEnabledVertexAttribArrays(unsigned int mask) {
+		queryLimits();
+		// Toggles only arrays which differ, or all arrays context has if current state is unknown.
+		unsigned int changed = vertex_attrib_mask_valid_ ? (vertex_attrib_mask_ ^ mask)
+			: static_cast<unsigned int>((1ull << max_vertex_attribs_) - 1);
+#if ASTERO_GL_CALL_STATS
+		// Arrays which stay enabled would have been enabled again without cache.
+		for (GLuint index = 0; index < GL_STATE_CACHE_MAX_VERTEX_ATTRIBS; ++index) {
+			if ((mask & ~changed) & (1u << index))
+				ASTERO_GL_CALL_ELIDED(GCT_VERTEX_ATTRIB_ARRAY, GL_VERTEX_ATTRIB_ARRAY_ENABLED, index);
+		}
+#endif
+		for (GLuint index = 0; changed && index < max_vertex_attribs_; ++index, changed >>= 1) {
+			if (!(changed & 1))
+				continue;
+			ASTERO_GL_CALL_ISSUED(GCT_VERTEX_ATTRIB_ARRAY);
+			if (mask & (1u << index))
+				glEnableVertexAttribArray(index);
+			else
+				glDisableVertexAttribArray(index);
+		}
+		vertex_attrib_mask_ = mask;
+		vertex_attrib_mask_valid_ = true;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void GLStateCacheManagerImp::setVertexAttribDivisor(GLuint index, GLuint divisor) {
+		if (index < GL_STATE_CACHE_MAX_VERTEX_ATTRIBS) {
+			if (vertex_attrib_divisors_[index] == divisor) {
+				ASTERO_GL_CALL_ELIDED(GCT_VERTEX_ATTRIB_DIVISOR, index, divisor);
+				return;
+			}
+			vertex_attrib_divisors_[index] = divisor;
+		}
+		ASTERO_GL_CALL_ISSUED(GCT_VERTEX_ATTRIB_DIVISOR);
+		glVertexAttribDivisor(index, divisor);
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void GLStateCacheManagerImp::setClientActiveTexture(size_t unit) {
+		if (client_active_texture_ == unit) {
+			ASTERO_GL_CALL_ELIDED(GCT_CLIENT_STATE, GL_CLIENT_ACTIVE_TEXTURE, static_cast<GLuint>(unit));
+			return;
+		}
+		ASTERO_GL_CALL_ISSUED(GCT_CLIENT_STATE);
+		glClientActiveTexture(GL_TEXTURE0 + static_cast<GLenum>(unit));
+		client_active_texture_ = unit;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void GLStateCacheManagerImp::setEnabledClientStates(unsigned int mask) {
+		static const GLenum arrays[] = {GL_VERTEX_ARRAY, GL_NORMAL_ARRAY, GL_COLOR_ARRAY, GL_SECONDARY_COLOR_ARRAY};
+		queryLimits();
+		unsigned int changed = client_state_mask_valid_ ? (client_state_mask_ ^ mask) : ~0u;
+#if ASTERO_GL_CALL_STATS
+		// States which stay enabled would have been enabled again without cache.
+		for (GLuint i = 0; i < 32; ++i) {
+			if ((mask & ~changed) & (1u << i))
+				ASTERO_GL_CALL_ELIDED(GCT_CLIENT_STATE, GL_CLIENT_ALL_ATTRIB_BITS, i);
+		}
+#endif
+		for (size_t i = 0; i < 4; ++i) {
+			if (!(changed & (1u << i)))
+				continue;
+			// Secondary color arrays are an extension.
+			if (arrays[i] == GL_SECONDARY_COLOR_ARRAY && !GLEW_EXT_secondary_color)
+				continue;
+			ASTERO_GL_CALL_ISSUED(GCT_CLIENT_STATE);
+			if (mask & (1u << i))
+				glEnableClientState(arrays[i]);
+			else
+				glDisableClientState(arrays[i]);
+		}
+		// Texture coordinate arrays are per client active texture unit, of which unknown state only resets those context has.
+		for (size_t unit = 0; unit < max_texture_coords_; ++unit) {
+			unsigned int bit = GLStateCacheManager::CS_TEXTURE_COORD_ARRAY << unit;
+			if (!(changed & bit))
+				continue;
+			setClientActiveTexture(unit);
+			ASTERO_GL_CALL_ISSUED(GCT_CLIENT_STATE);
+			if (mask & bit)
+				glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+			else
+				glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+		}
+		client_state_mask_ = mask;
+		client_state_mask_valid_ = true;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	GLStateCacheManagerImp::BufferSlot GLStateCacheManagerImp::getBufferSlot(GLenum target) {
+		switch (target) {
+			case GL_ARRAY_BUFFER:
+				return BS_ARRAY;
+			case GL_ELEMENT_ARRAY_BUFFER:
+				return BS_ELEMENT_ARRAY;
+			case GL_COPY_READ_BUFFER:
+				return BS_COPY_READ;
+			case GL_COPY_WRITE_BUFFER:
+				return BS_COPY_WRITE;
+			case GL_PIXEL_PACK_BUFFER:
+				return BS_PIXEL_PACK;
+			case GL_PIXEL_UNPACK_BUFFER:
+				return BS_PIXEL_UNPACK;
+			case GL_UNIFORM_BUFFER:
+				return BS_UNIFORM;
+			case GL_TEXTURE_BUFFER:
+				return BS_TEXTURE;
+			case GL_TRANSFORM_FEEDBACK_BUFFER:
+				return BS_TRANSFORM_FEEDBACK;
+			case GL_DRAW_INDIRECT_BUFFER:
+				return BS_DRAW_INDIRECT;
+			case GL_FRAMEBUFFER:
+				return BS_FRAMEBUFFER;
+			case GL_RENDERBUFFER:
+				return BS_RENDERBUFFER;
+			default:
+				return BS_COUNT;
+		}
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	GLStateCacheManagerImp::TextureSlot GLStateCacheManagerImp::getTextureSlot(GLenum target) {
+		switch (target) {
+			case GL_TEXTURE_1D:
+				return TS_1D;
+			case GL_TEXTURE_2D:
+				return TS_2D;
+			case GL_TEXTURE_3D:
+				return TS_3D;
+			case GL_TEXTURE_CUBE_MAP:
+				return TS_CUBE_MAP;
+			case GL_TEXTURE_2D_ARRAY:
+				return TS_2D_ARRAY;
+			case GL_TEXTURE_RECTANGLE:
+				return TS_RECTANGLE;
+			default:
+				return TS_COUNT;
+		}
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	GLStateCacheManagerImp::CapabilitySlot GLStateCacheManagerImp::getCapabilitySlot(GLenum capability) {
+		switch (capability) {
+			case GL_BLEND:
+				return CAP_BLEND;
+			case GL_DEPTH_TEST:
+				return CAP_DEPTH_TEST;
+			case GL_STENCIL_TEST:
+				return CAP_STENCIL_TEST;
+			case GL_CULL_FACE:
+				return CAP_CULL_FACE;
+			case GL_SCISSOR_TEST:
+				return CAP_SCISSOR_TEST;
+			case GL_POLYGON_OFFSET_FILL:
+				return CAP_POLYGON_OFFSET_FILL;
+			case GL_MULTISAMPLE:
+				return CAP_MULTISAMPLE;
+			case GL_SAMPLE_ALPHA_TO_COVERAGE:
+				return CAP_SAMPLE_ALPHA_TO_COVERAGE;
+			case GL_ALPHA_TEST:
+				return CAP_ALPHA_TEST;
+			case GL_LIGHTING:
+				return CAP_LIGHTING;
+			case GL_FOG:
+				return CAP_FOG;
+			case GL_PROGRAM_POINT_SIZE:
+				return CAP_PROGRAM_POINT_SIZE;
+			default:
+				return CAP_COUNT;
+		}
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void GLStateCacheManagerImp::clearVertexArrayState() {
+		// Element array binding, attribute and client state enables and divisors are part of vertex array object state.
+		buffers_[BS_ELEMENT_ARRAY] = GL_STATE_CACHE_UNKNOWN;
+		vertex_attrib_mask_ = 0;
+		vertex_attrib_mask_valid_ = false;
+		client_state_mask_ = 0;
+		client_state_mask_valid_ = false;
+		for (size_t i = 0; i < GL_STATE_CACHE_MAX_VERTEX_ATTRIBS; ++i)
+			vertex_attrib_divisors_[i] = GL_STATE_CACHE_UNKNOWN;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void GLStateCacheManagerImp::deleteRemovedVertexArrays() {
+		for (GLuint vertex_array : removed_vertex_arrays_)
+			deleteGLVertexArray(vertex_array);
+		removed_vertex_arrays_.clear();
+	}
+} // namespace Astero
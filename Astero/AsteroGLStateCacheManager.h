@@ -9,16 +9,140 @@
 #ifndef AsteroGLStateCacheManager_h
 #define AsteroGLStateCacheManager_h
 
+#include <GL/glew.h>
+
 #include "AsteroPrerequisites.h"
+#include "AsteroSingleton.tpp"
+#include "AsteroGLVertexArrayCache.h"
+
+// Number of texture units whose bindings are cached.
+#define GL_STATE_CACHE_MAX_TEXTURE_UNITS 16
+// Number of vertex attributes whose enable state and divisor are cached, at most 32.
+#define GL_STATE_CACHE_MAX_VERTEX_ATTRIBS 32
+// Number of indexed uniform buffer binding points whose ranges are cached.
+#define GL_STATE_CACHE_MAX_UNIFORM_BUFFER_BINDINGS 16
+// Value of cached names and enums which are not known, so next change is always issued.
+#define GL_STATE_CACHE_UNKNOWN 0xFFFFFFFF
+// GL call statistics are collected in debug builds only, unless ASTERO_GL_CALL_STATS is defined to 0 or 1.
+#ifndef ASTERO_GL_CALL_STATS
+#	ifdef NDEBUG
+#		define ASTERO_GL_CALL_STATS 0
+#	else
+#		define ASTERO_GL_CALL_STATS 1
+#	endif
+#endif
+// Runs of consecutive redundant calls longer than this are split.
+#define GL_CALL_STATS_MAX_SEQUENCE_LENGTH 8
+// Number of most frequent redundant call sequences reported by default.
+#define GL_CALL_STATS_TOP_SEQUENCES 10
+
+#if ASTERO_GL_CALL_STATS
+// Records a GL call of given GLCallStats::CallType which has been issued.
+#	define ASTERO_GL_CALL_ISSUED(type) GLCallStats::getInstance().notifyIssued(GLCallStats::type)
+// Records a GL call which has been skipped, since it would have set state to value it already had.
+#	define ASTERO_GL_CALL_ELIDED(type, target, value) GLCallStats::getInstance().notifyElided(GLCallStats::type, target, value)
+#else
+#	define ASTERO_GL_CALL_ISSUED(type)
+#	define ASTERO_GL_CALL_ELIDED(type, target, value)
+#endif
 
 namespace Astero {
-	class GLStateCacheManagerImp;
-	// This class stores OpenGL state in memory to save unnecessary state change performed by OpenGL.
-	class GLStateCacheManager {
+#if ASTERO_GL_CALL_STATS
+	// Per frame counts of GL calls issued and elided by state cache and render system, by type of call. Consecutive elided
+	// calls form a redundant sequence, and most frequent sequences point at code which sets the same state repeatedly.
+	// Only used on render thread. Counters of last finished frame are kept until next frame ends.
+	class GLCallStats {
 	public:
-		GLStateCacheManager() = default;
-		~GLStateCacheManager() = default;
+		enum CallType {
+			GCT_BIND_BUFFER,
+			GCT_BIND_VERTEX_ARRAY,
+			GCT_USE_PROGRAM,
+			GCT_ACTIVE_TEXTURE,
+			GCT_BIND_TEXTURE,
+			GCT_BIND_SAMPLER,
+			GCT_ENABLE_DISABLE,
+			GCT_BLEND,
+			GCT_DEPTH_STENCIL,
+			GCT_RASTERIZER,
+			GCT_VERTEX_ATTRIB_ARRAY,
+			GCT_VERTEX_ATTRIB_DIVISOR,
+			GCT_CLIENT_STATE,
+			GCT_ATTRIB_POINTER,
+			GCT_DRAW,
+			GCT_COUNT
+		};
+		// An elided call, identified by its type, target (or capability, unit, index) and value.
+		struct Call {
+			CallType type;
+			GLenum target;
+			GLuint value;
+			
+			bool operator<(const Call & other) const;
+		};
+		typedef std::vector<Call> CallSequence;
+		struct SequenceCount {
+			CallSequence sequence;
+			size_t count;
+		};
+		typedef std::vector<SequenceCount> SequenceCountList;
+		
+		GLCallStats();
+		
+		static GLCallStats & getInstance();
+		static const char * getCallTypeName(CallType type);
+		void notifyIssued(CallType type);
+		void notifyElided(CallType type, GLenum target, GLuint value);
+		// Finishes current frame. If ASTERO_GL_CALL_STATS_JSON names a file, last frame is written to it as JSON.
+		void endFrame();
+		// Counters of last finished frame.
+		size_t getFrameNumber() const;
+		size_t getIssuedCount(CallType type) const;
+		size_t getElidedCount(CallType type) const;
+		size_t getTotalIssuedCount() const;
+		size_t getTotalElidedCount() const;
+		// Most frequent redundant sequences of last finished frame, most frequent first.
+		SequenceCountList getTopRedundantSequences(size_t count) const;
+		void writeJSON(std::ostream & stream, size_t top_sequence_count = GL_CALL_STATS_TOP_SEQUENCES) const;
+		// Writes last finished frame to a file, returns false if it cannot be opened.
+		bool dumpJSON(const std::string & path, size_t top_sequence_count = GL_CALL_STATS_TOP_SEQUENCES) const;
 		
+	protected:
+		typedef std::map<CallSequence, size_t> SequenceMap;
+		
+		// Ends current run of elided calls.
+		void flushSequence();
+		
+		size_t frame_number_;
+		size_t issued_[GCT_COUNT];
+		size_t elided_[GCT_COUNT];
+		size_t last_issued_[GCT_COUNT];
+		size_t last_elided_[GCT_COUNT];
+		CallSequence current_sequence_;
+		SequenceMap sequences_;
+		SequenceMap last_sequences_;
+		std::string dump_path_;
+	};
+#endif
+	
+	class GLStateCacheManagerImp;
+	// This class stores OpenGL state in memory to save unnecessary state change performed by OpenGL. State is kept per
+	// context, and only calls which change state are issued. Code which changes state without going through this class
+	// must call clearCache afterwards.
+	class GLStateCacheManager : public Singleton<GLStateCacheManager> {
+	public:
+		// Bits of fixed function client states, see setEnabledClientStates.
+		enum ClientState {
+			CS_VERTEX_ARRAY = 1 << 0,
+			CS_NORMAL_ARRAY = 1 << 1,
+			CS_COLOR_ARRAY = 1 << 2,
+			CS_SECONDARY_COLOR_ARRAY = 1 << 3,
+			// Texture coordinate array of unit i is CS_TEXTURE_COORD_ARRAY << i.
+			CS_TEXTURE_COORD_ARRAY = 1 << 4
+		};
+
+		GLStateCacheManager();
+		~GLStateCacheManager();
+
 		// Drops all recorded state for a given context.
 		void unregisterContext(intptr_t id);
 		// Switch to context.
@@ -27,123 +151,191 @@ namespace Astero {
 		void clearCache();
 		// Binds an OpenGL buffer to target.
 		void bindGLBuffer(GLenum target, GLuint buffer, bool force = false);
-		// Deletes an OpenGL buffer.
-		void deleteGLBuffer(GLenum target, GLuint buffer, bool force = false);
-		
+		// Deletes an OpenGL buffer, which also unbinds it from all targets it is bound to.
+		void deleteGLBuffer(GLenum target, GLuint buffer);
+		// Binds range of buffer to an indexed uniform buffer binding point, which also binds buffer to GL_UNIFORM_BUFFER.
+		void bindGLUniformBufferRange(GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size);
+		// Binds a vertex array object. If it has just been generated, its state is known to be default.
+		void bindGLVertexArray(GLuint vertex_array, bool created = false);
+		void deleteGLVertexArray(GLuint vertex_array);
+		// Cached vertex array object of key in current context, or 0.
+		GLuint findGLVertexArray(const GLVertexArrayCache::Key & key);
+		// Caches a vertex array object of current context which references given buffer objects.
+		void cacheGLVertexArray(const GLVertexArrayCache::Key & key, GLuint vertex_array, const GLVertexArrayCache::BufferList & buffers);
+		// Deletes vertex array objects of current context unused for GL_VERTEX_ARRAY_CACHE_MAX_AGE frames. Called once per frame.
+		void updateGLVertexArrayCache();
+		const GLVertexArrayCache & getGLVertexArrayCache() const;
+		void useGLProgram(GLuint program);
+		// Sets active texture unit, returns false if unit is not supported.
+		bool activateGLTextureUnit(size_t unit);
+		// Binds texture to target of active texture unit.
+		void bindGLTexture(GLenum target, GLuint texture);
+		void deleteGLTexture(GLuint texture);
+		void bindGLSampler(size_t unit, GLuint sampler);
+		// Enables or disables a capability, e.g. GL_BLEND or GL_DEPTH_TEST.
+		void setEnabled(GLenum capability, bool enabled);
+		void setBlendFunc(GLenum source_rgb, GLenum dest_rgb, GLenum source_alpha, GLenum dest_alpha);
+		void setBlendEquation(GLenum rgb, GLenum alpha);
+		void setDepthFunc(GLenum func);
+		void setDepthMask(bool mask);
+		void setColorMask(bool red, bool green, bool blue, bool alpha);
+		void setStencilFunc(GLenum func, GLint ref, GLuint mask);
+		void setStencilOp(GLenum stencil_fail, GLenum depth_fail, GLenum pass);
+		void setStencilMask(GLuint mask);
+		void setCullFace(GLenum mode);
+		void setViewport(GLint x, GLint y, GLsizei width, GLsizei height);
+		void setScissor(GLint x, GLint y, GLsizei width, GLsizei height);
+		// Enables exactly vertex attribute arrays whose bits are set in mask, only toggling arrays which differ.
+		void setEnabledVertexAttribArrays(unsigned int mask);
+		void setVertexAttribDivisor(GLuint index, GLuint divisor);
+		void setClientActiveTexture(size_t unit);
+		// Enables exactly fixed function client states whose ClientState bits are set in mask.
+		void setEnabledClientStates(unsigned int mask);
+
 	protected:
 		typedef std::unordered_map<intptr_t, GLStateCacheManagerImp *> CacheMap;
 		CacheMap cache_map_;
 		GLStateCacheManagerImp * imp_;
 	};
-	
+
 	//--------------------------------------------------------------------------------------------------------------------------------
+	// State of one context. All state lives in fixed arrays indexed by slots, so lookups never hash or allocate.
 	class GLStateCacheManagerImp {
 	public:
+		GLStateCacheManagerImp();
+
 		void initializeCache();
 		void clearCache();
 		void bindGLBuffer(GLenum target, GLuint buffer, bool force = false);
-		void deleteGLBuffer(GLenum target, GLuint buffer, bool force = false);
-		
+		void deleteGLBuffer(GLenum target, GLuint buffer);
+		void bindGLUniformBufferRange(GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size);
+		void bindGLVertexArray(GLuint vertex_array, bool created = false);
+		void deleteGLVertexArray(GLuint vertex_array);
+		GLuint findGLVertexArray(const GLVertexArrayCache::Key & key);
+		void cacheGLVertexArray(const GLVertexArrayCache::Key & key, GLuint vertex_array, const GLVertexArrayCache::BufferList & buffers);
+		void updateGLVertexArrayCache();
+		const GLVertexArrayCache & getGLVertexArrayCache() const;
+		void useGLProgram(GLuint program);
+		bool activateGLTextureUnit(size_t unit);
+		void bindGLTexture(GLenum target, GLuint texture);
+		void deleteGLTexture(GLuint texture);
+		void bindGLSampler(size_t unit, GLuint sampler);
+		void setEnabled(GLenum capability, bool enabled);
+		void setBlendFunc(GLenum source_rgb, GLenum dest_rgb, GLenum source_alpha, GLenum dest_alpha);
+		void setBlendEquation(GLenum rgb, GLenum alpha);
+		void setDepthFunc(GLenum func);
+		void setDepthMask(bool mask);
+		void setColorMask(bool red, bool green, bool blue, bool alpha);
+		void setStencilFunc(GLenum func, GLint ref, GLuint mask);
+		void setStencilOp(GLenum stencil_fail, GLenum depth_fail, GLenum pass);
+		void setStencilMask(GLuint mask);
+		void setCullFace(GLenum mode);
+		void setViewport(GLint x, GLint y, GLsizei width, GLsizei height);
+		void setScissor(GLint x, GLint y, GLsizei width, GLsizei height);
+		void setEnabledVertexAttribArrays(unsigned int mask);
+		void setVertexAttribDivisor(GLuint index, GLuint divisor);
+		void setClientActiveTexture(size_t unit);
+		void setEnabledClientStates(unsigned int mask);
+
 	private:
-		typedef std::unordered_map<GLenum, GLuint> BindBufferMap;
-		typedef std::unordered_map<GLenum, GLuint> TextureParameterMap;
-		typedef std::unordered_map<GLenum, bool> BooleanStateMap;
-		struct TextureUnitParams {
-			~TextureUnitParams() {
-				tex_parameter_map.clear();
-			}
-			
-			TextureParameterMap tex_parameter_map;
+		enum BufferSlot {
+			BS_ARRAY,
+			BS_ELEMENT_ARRAY,
+			BS_COPY_READ,
+			BS_COPY_WRITE,
+			BS_PIXEL_PACK,
+			BS_PIXEL_UNPACK,
+			BS_UNIFORM,
+			BS_TEXTURE,
+			BS_TRANSFORM_FEEDBACK,
+			BS_DRAW_INDIRECT,
+			BS_FRAMEBUFFER,
+			BS_RENDERBUFFER,
+			BS_COUNT
 		};
-		typedef std::unordered_map<GLuint, TextureUnitParams> TextureUnitMap;
-		
-		BindBufferMap bind_buffer_map_;
-		TextureUnitMap texture_unit_map_;
-		BooleanStateMap boolean_state_map_;
+		enum TextureSlot {
+			TS_1D,
+			TS_2D,
+			TS_3D,
+			TS_CUBE_MAP,
+			TS_2D_ARRAY,
+			TS_RECTANGLE,
+			TS_COUNT
+		};
+		enum CapabilitySlot {
+			CAP_BLEND,
+			CAP_DEPTH_TEST,
+			CAP_STENCIL_TEST,
+			CAP_CULL_FACE,
+			CAP_SCISSOR_TEST,
+			CAP_POLYGON_OFFSET_FILL,
+			CAP_MULTISAMPLE,
+			CAP_SAMPLE_ALPHA_TO_COVERAGE,
+			CAP_ALPHA_TEST,
+			CAP_LIGHTING,
+			CAP_FOG,
+			CAP_PROGRAM_POINT_SIZE,
+			CAP_COUNT
+		};
+		// Cached boolean state, which may be unknown.
+		enum TriState {
+			TRI_FALSE,
+			TRI_TRUE,
+			TRI_UNKNOWN
+		};
+
+		// Slot of a target, or count if target is not cached.
+		static BufferSlot getBufferSlot(GLenum target);
+		static TextureSlot getTextureSlot(GLenum target);
+		static CapabilitySlot getCapabilitySlot(GLenum capability);
+		// Forgets state which belongs to bound vertex array object.
+		void clearVertexArrayState();
+		// Queries attribute and texture coordinate limits of current context once, clamped to cached array sizes.
+		void queryLimits();
+		// Deletes vertex array objects dropped by vertex array cache.
+		void deleteRemovedVertexArrays();
+
+		GLuint buffers_[BS_COUNT];
+		GLuint uniform_buffers_[GL_STATE_CACHE_MAX_UNIFORM_BUFFER_BINDINGS];
+		GLintptr uniform_buffer_offsets_[GL_STATE_CACHE_MAX_UNIFORM_BUFFER_BINDINGS];
+		GLsizeiptr uniform_buffer_sizes_[GL_STATE_CACHE_MAX_UNIFORM_BUFFER_BINDINGS];
+		GLuint vertex_array_;
+		GLuint program_;
+		size_t active_texture_unit_;
+		GLuint textures_[GL_STATE_CACHE_MAX_TEXTURE_UNITS][TS_COUNT];
+		GLuint samplers_[GL_STATE_CACHE_MAX_TEXTURE_UNITS];
+		TriState capabilities_[CAP_COUNT];
+		GLenum blend_func_[4];
+		GLenum blend_equation_[2];
+		GLenum depth_func_;
+		TriState depth_mask_;
+		// Color mask as bits, or GL_STATE_CACHE_UNKNOWN.
+		GLuint color_mask_;
+		GLenum stencil_func_;
+		GLint stencil_ref_;
+		GLuint stencil_func_mask_;
+		GLenum stencil_op_[3];
+		GLuint stencil_mask_;
+		GLenum cull_face_;
+		GLint viewport_[4];
+		bool viewport_valid_;
+		GLint scissor_[4];
+		bool scissor_valid_;
+		unsigned int vertex_attrib_mask_;
+		bool vertex_attrib_mask_valid_;
+		GLuint vertex_attrib_divisors_[GL_STATE_CACHE_MAX_VERTEX_ATTRIBS];
+		size_t client_active_texture_;
+		unsigned int client_state_mask_;
+		bool client_state_mask_valid_;
+		// Limits of context, so that unknown array state is reset without touching indices context does not have.
+		GLuint max_vertex_attribs_;
+		size_t max_texture_coords_;
+		bool limits_valid_;
+		GLVertexArrayCache vertex_array_cache_;
+		std::vector<GLuint> removed_vertex_arrays_;
+		// Whether bound vertex array object is being recorded, before it is added to vertex array cache.
+		bool vertex_array_recording_;
 	};
-	//--------------------------------------------------------------------------------------------------------------------------------
-	void GLStateCacheManager::unregisterContext(intptr_t id) {
-		auto iter = cache_map_.find(id);
-		if (iter != cache_map_.end()) {
-			if (iter->second == imp_)
-				imp_ = nullptr;
-			delete iter->second;
-			cache_map_.erase(iter);
-		}
-		// imp_ always points to a non-empty GLStateCacheManagerImp pointer.
-		if (imp_ == nullptr) {
-			if (cache_map_.empty())
-				cache_map_.insert(CacheMap::value_type(0, new GLStateCacheManagerImp()));
-			imp_ = cache_map_.begin()->second;
-		}
-	}
-	void GLStateCacheManager::switchContext(intptr_t id) {
-		auto iter = cache_map_.find(id);
-		if (iter != cache_map_.end())
-			imp_ = iter->second;
-		else {
-			// Creates a new cache if not found.
-			imp_ = new GLStateCacheManagerImp();
-			imp_->initializeCache();
-			cache_map_[id] = imp_;
-		}
-	}
-	void GLStateCacheManager::clearCache() {
-		imp_->clearCache();
-	}
-	void GLStateCacheManager::bindGLBuffer(GLenum target, GLuint buffer, bool force) {
-		imp_->bindGLBuffer(target, buffer, force);
-	}
-	void GLStateCacheManager::deleteGLBuffer(GLenum target, GLuint buffer, bool force) {
-		imp_->deleteGLBuffer(target, buffer, force);
-	}
-	//--------------------------------------------------------------------------------------------------------------------------------
-	void GLStateCacheManagerImp::initializeCache() {
-		
-	}
-	void GLStateCacheManagerImp::clearCache() {
-		
-	}
-	void GLStateCacheManagerImp::bindGLBuffer(GLenum target, GLuint buffer, bool force) {
-		bool update = false;
-		auto iter = bind_buffer_map_.find(target);
-		if (iter == bind_buffer_map_.end()) {
-			bind_buffer_map_.insert(BindBufferMap::value_type(target, buffer));
-			update = true;
-		}
-		else if (iter->second != buffer) {
-			iter->second = buffer;
-			update = true;
-		}
-		if (update || force) {
-			if (target == GL_FRAMEBUFFER) {
-				glBindFramebuffer(target, buffer);
-			}
-			else if (target == GL_RENDERBUFFER) {
-				glBindRenderbuffer(target, buffer);
-			}
-			else {
-				glBindBuffer(target, buffer);
-			}
-		}
-	}
-	void GLStateCacheManagerImp::deleteGLBuffer(GLenum target, GLuint buffer, bool force) {
-		if (buffer == 0)
-			return;
-		auto iter = bind_buffer_map_.find(target);
-		if (iter != bind_buffer_map_.end() && (iter->second == buffer || force)) {
-			if (target == GL_FRAMEBUFFER) {
-				glDeleteFramebuffers(1, &buffer);
-			}
-			else if (target == GL_RENDERBUFFER) {
-				glDeleteRenderbuffers(1, &buffer);
-			}
-			else {
-				glDeleteBuffers(1, &buffer);
-			}
-			iter->second = 0;
-		}
-	}
 }
 
 #endif // AsteroGLStateCacheManager_h
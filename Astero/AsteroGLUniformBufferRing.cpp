@@ -0,0 +1,141 @@
+//
+//  AsteroGLUniformBufferRing.cpp
+//  Astero
+//
+//  Created by Yuzhe Wang on 10/18/26.
+//  Copyright © 2026 Yuzhe Wang. All rights reserved.
+//
+
+#include <cstring>
+#include "AsteroGLUniformBufferRing.h"
+#include "AsteroGLStateCacheManager.h"
+#include "AsteroProfiler.h"
+
+namespace Astero {
+	//--------------------------------------------------------------------------------------------------------------------------------
+	GLUniformBufferRing::GLUniformBufferRing(GLStateCacheManager & state_cache_manager, size_t frame_size) :
+	state_cache_manager_(state_cache_manager), buffer_id_(0), frame_size_(frame_size), alignment_(256),
+	region_index_(GL_UNIFORM_BUFFER_RING_FRAME_COUNT - 1), used_size_(0), flushed_size_(0), peak_size_(0), overflow_count_(0), overflowed_(false),
+	mapped_data_(nullptr) {
+		for (size_t i = 0; i < GL_UNIFORM_BUFFER_RING_FRAME_COUNT; i++)
+			fences_[i] = nullptr;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	GLUniformBufferRing::~GLUniformBufferRing() {
+		destroyBuffer();
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void GLUniformBufferRing::createBuffer() {
+		GLint alignment = 0;
+		glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+		if (alignment > 0)
+			alignment_ = alignment;
+		frame_size_ = (frame_size_ + alignment_ - 1) / alignment_ * alignment_;
+		size_t size = frame_size_ * GL_UNIFORM_BUFFER_RING_FRAME_COUNT;
+		glGenBuffers(1, &buffer_id_);
+		state_cache_manager_.bindGLBuffer(GL_UNIFORM_BUFFER, buffer_id_);
+		if (GLEW_ARB_buffer_storage) {
+			GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+			glBufferStorage(GL_UNIFORM_BUFFER, size, nullptr, flags);
+			mapped_data_ = static_cast<char *>(glMapBufferRange(GL_UNIFORM_BUFFER, 0, size, flags));
+		}
+		if (mapped_data_ == nullptr) {
+			glBufferData(GL_UNIFORM_BUFFER, size, nullptr, GL_STREAM_DRAW);
+			staging_data_.resize(frame_size_);
+		}
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void GLUniformBufferRing::destroyBuffer() {
+		for (size_t i = 0; i < GL_UNIFORM_BUFFER_RING_FRAME_COUNT; i++) {
+			if (fences_[i]) {
+				glDeleteSync(fences_[i]);
+				fences_[i] = nullptr;
+			}
+		}
+		if (buffer_id_ == 0)
+			return;
+		if (mapped_data_) {
+			state_cache_manager_.bindGLBuffer(GL_UNIFORM_BUFFER, buffer_id_);
+			glUnmapBuffer(GL_UNIFORM_BUFFER);
+			mapped_data_ = nullptr;
+		}
+		// Driver keeps storage alive while GPU still reads it.
+		state_cache_manager_.deleteGLBuffer(GL_UNIFORM_BUFFER, buffer_id_);
+		buffer_id_ = 0;
+		staging_data_.clear();
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void GLUniformBufferRing::beginFrame() {
+		ASTERO_PROFILE_SCOPE("GLUniformBufferRing::beginFrame");
+		if (overflowed_) {
+			frame_size_ = std::max(frame_size_ * 2, peak_size_);
+			destroyBuffer();
+		}
+		if (buffer_id_ == 0)
+			createBuffer();
+		region_index_ = (region_index_ + 1) % GL_UNIFORM_BUFFER_RING_FRAME_COUNT;
+		GLsync fence = fences_[region_index_];
+		if (fence) {
+			// Flushes on first try, so a fence never waits on commands not yet sent.
+			GLbitfield flags = GL_SYNC_FLUSH_COMMANDS_BIT;
+			while (glClientWaitSync(fence, flags, 1000000000) == GL_TIMEOUT_EXPIRED)
+				flags = 0;
+			glDeleteSync(fence);
+			fences_[region_index_] = nullptr;
+		}
+		used_size_ = 0;
+		flushed_size_ = 0;
+		overflowed_ = false;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void GLUniformBufferRing::endFrame() {
+		if (buffer_id_ == 0)
+			return;
+		if (mapped_data_)
+			fences_[region_index_] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		else
+			flush();
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void * GLUniformBufferRing::allocate(size_t size, size_t & offset) {
+		assert(buffer_id_ != 0);
+		size_t start = (used_size_ + alignment_ - 1) / alignment_ * alignment_;
+		peak_size_ = std::max(peak_size_, start + size);
+		if (start + size > frame_size_) {
+			overflowed_ = true;
+			overflow_count_++;
+			return nullptr;
+		}
+		used_size_ = start + size;
+		offset = getRegionStart() + start;
+		if (mapped_data_)
+			return mapped_data_ + offset;
+		return staging_data_.data() + start;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	size_t GLUniformBufferRing::write(const void * data, size_t size) {
+		size_t offset = 0;
+		void * destination = allocate(size, offset);
+		if (destination == nullptr)
+			return ~(size_t)0;
+		memcpy(destination, data, size);
+		return offset;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void GLUniformBufferRing::flush() {
+		if (mapped_data_ || used_size_ == flushed_size_)
+			return;
+		ASTERO_PROFILE_SCOPE("GLUniformBufferRing::flush");
+		state_cache_manager_.bindGLBuffer(GL_UNIFORM_BUFFER, buffer_id_);
+		glBufferSubData(GL_UNIFORM_BUFFER, getRegionStart() + flushed_size_, used_size_ - flushed_size_,
+						staging_data_.data() + flushed_size_);
+		flushed_size_ = used_size_;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void GLUniformBufferRing::bind(GLuint binding, size_t offset, size_t size) {
+		// Writes are uploaded in bulk, only once a range not yet uploaded is needed.
+		if (offset + size > getRegionStart() + flushed_size_)
+			flush();
+		state_cache_manager_.bindGLUniformBufferRange(binding, buffer_id_, offset, size);
+	}
+}
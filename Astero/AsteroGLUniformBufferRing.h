@@ -0,0 +1,87 @@
+//
+//  AsteroGLUniformBufferRing.h
+//  Astero
+//
+//  Created by Yuzhe Wang on 10/18/26.
+//  Copyright © 2026 Yuzhe Wang. All rights reserved.
+//
+
+#ifndef AsteroGLUniformBufferRing_h
+#define AsteroGLUniformBufferRing_h
+
+#include <GL/glew.h>
+#include <vector>
+#include "AsteroPrerequisites.h"
+
+// Bytes of uniform data one frame can stream before ring grows.
+#define GL_UNIFORM_BUFFER_RING_DEFAULT_FRAME_SIZE (1 << 20)
+// Frames whose uniform data may be read by GPU at once.
+#define GL_UNIFORM_BUFFER_RING_FRAME_COUNT 3
+// Uniform block binding points. Programs get blocks named AsteroPass, AsteroObject and AsteroMaterial bound to them at link.
+#define GL_UNIFORM_BINDING_PASS 0
+#define GL_UNIFORM_BINDING_OBJECT 1
+#define GL_UNIFORM_BINDING_MATERIAL 2
+
+namespace Astero {
+	class GLStateCacheManager;
+
+	// Streams per frame uniform data through one uniform buffer split into a region per frame in flight. Constants of many
+	// draws are written back to back into current region, and each draw binds its range with glBindBufferRange, instead of
+	// issuing glUniform calls per object.
+	// With ARB_buffer_storage buffer is persistently mapped and written directly, and a fence per region keeps a frame from
+	// overwriting data GPU still reads. Otherwise data is staged in memory, and uploaded with one glBufferSubData per run of
+	// writes, when first range of that run is bound.
+	// A region that overflows fails further allocations for rest of frame, and ring grows to fit at next beginFrame. Ranges
+	// handed out earlier in frame stay in use, so ring cannot grow sooner.
+	class GLUniformBufferRing {
+	public:
+		GLUniformBufferRing(GLStateCacheManager & state_cache_manager, size_t frame_size = GL_UNIFORM_BUFFER_RING_DEFAULT_FRAME_SIZE);
+		~GLUniformBufferRing();
+
+		// Makes next region current, waiting until GPU has finished reading it.
+		void beginFrame();
+		void endFrame();
+		// Reserves size bytes in current region at an offset aligned for binding. Returns memory to fill, which stays valid
+		// until endFrame, and sets offset to its offset in buffer. Returns null if region is full.
+		void * allocate(size_t size, size_t & offset);
+		// Copies data into current region, and returns its offset, or ~0 if region is full.
+		size_t write(const void * data, size_t size);
+		// Binds range of buffer to uniform block binding point.
+		void bind(GLuint binding, size_t offset, size_t size);
+
+		GLuint getGLBufferId() const { return buffer_id_; }
+		size_t getFrameSize() const { return frame_size_; }
+		// Bytes allocated in current region.
+		size_t getUsedSize() const { return used_size_; }
+		// Most bytes any frame has asked for.
+		size_t getPeakSize() const { return peak_size_; }
+		// Number of allocations failed because their region was full.
+		size_t getOverflowCount() const { return overflow_count_; }
+		bool isPersistentlyMapped() const { return mapped_data_ != nullptr; }
+
+	protected:
+		void createBuffer();
+		void destroyBuffer();
+		// Uploads staged writes not yet uploaded.
+		void flush();
+		size_t getRegionStart() const { return region_index_ * frame_size_; }
+
+		GLStateCacheManager & state_cache_manager_;
+		GLuint buffer_id_;
+		size_t frame_size_;
+		// GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT.
+		size_t alignment_;
+		size_t region_index_;
+		size_t used_size_;
+		// Bytes of current region uploaded, without persistent mapping.
+		size_t flushed_size_;
+		size_t peak_size_;
+		size_t overflow_count_;
+		bool overflowed_;
+		char * mapped_data_;
+		std::vector<char> staging_data_;
+		GLsync fences_[GL_UNIFORM_BUFFER_RING_FRAME_COUNT];
+	};
+}
+
+#endif // AsteroGLUniformBufferRing_h
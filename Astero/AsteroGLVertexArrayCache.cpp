@@ -0,0 +1,92 @@
+//
+//  AsteroGLVertexArrayCache.cpp
+//  Astero
+//
+//  Created by Yuzhe Wang on 10/18/26.
+//  Copyright © 2026 Yuzhe Wang. All rights reserved.
+//
+
+#include "AsteroGLVertexArrayCache.h"
+
+namespace Astero {
+	//--------------------------------------------------------------------------------------------------------------------------------
+	GLVertexArrayCache::GLVertexArrayCache() : frame_number_(0), hit_count_(0), miss_count_(0) {
+		
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	GLuint GLVertexArrayCache::find(const Key & key) {
+		auto iter = entries_.find(key);
+		if (iter == entries_.end()) {
+			++miss_count_;
+			return 0;
+		}
+		++hit_count_;
+		iter->second.last_used_frame = frame_number_;
+		return iter->second.vertex_array;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void GLVertexArrayCache::insert(const Key & key, GLuint vertex_array, const BufferList & buffers, std::vector<GLuint> & removed) {
+		if (entries_.size() >= GL_VERTEX_ARRAY_CACHE_MAX_SIZE)
+			clear(removed);
+		Entry & entry = entries_[key];
+		if (entry.vertex_array != 0 && entry.vertex_array != vertex_array)
+			removed.push_back(entry.vertex_array);
+		entry.vertex_array = vertex_array;
+		entry.buffers = buffers;
+		entry.last_used_frame = frame_number_;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void GLVertexArrayCache::removeBuffer(GLuint buffer, std::vector<GLuint> & removed) {
+		for (auto iter = entries_.begin(); iter != entries_.end();) {
+			const BufferList & buffers = iter->second.buffers;
+			if (std::find(buffers.begin(), buffers.end(), buffer) != buffers.end()) {
+				removed.push_back(iter->second.vertex_array);
+				iter = entries_.erase(iter);
+			}
+			else {
+				++iter;
+			}
+		}
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void GLVertexArrayCache::advanceFrame(size_t max_age, std::vector<GLuint> & removed) {
+		++frame_number_;
+		for (auto iter = entries_.begin(); iter != entries_.end();) {
+			if (frame_number_ - iter->second.last_used_frame > max_age) {
+				removed.push_back(iter->second.vertex_array);
+				iter = entries_.erase(iter);
+			}
+			else {
+				++iter;
+			}
+		}
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void GLVertexArrayCache::clear(std::vector<GLuint> & removed) {
+		for (auto & value : entries_)
+			removed.push_back(value.second.vertex_array);
+		entries_.clear();
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	size_t GLVertexArrayCache::getSize() const {
+		return entries_.size();
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	size_t GLVertexArrayCache::getHitCount() const {
+		return hit_count_;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	size_t GLVertexArrayCache::getMissCount() const {
+		return miss_count_;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	size_t GLVertexArrayCache::KeyHash::operator()(const Key & key) const {
+		// FNV-1a over words of key.
+		size_t hash = 14695981039346656037ULL;
+		for (size_t word : key) {
+			hash ^= word;
+			hash *= 1099511628211ULL;
+		}
+		return hash;
+	}
+} // namespace Astero
@@ -0,0 +1,67 @@
+//
+//  AsteroGLVertexArrayCache.h
+//  Astero
+//
+//  Created by Yuzhe Wang on 10/18/26.
+//  Copyright © 2026 Yuzhe Wang. All rights reserved.
+//
+
+#ifndef AsteroGLVertexArrayCache_h
+#define AsteroGLVertexArrayCache_h
+
+#include <GL/glew.h>
+
+#include "AsteroPrerequisites.h"
+
+// Vertex array objects not used for this many frames are deleted.
+#define GL_VERTEX_ARRAY_CACHE_MAX_AGE 300
+// Maximum number of cached vertex array objects, all are dropped when exceeded.
+#define GL_VERTEX_ARRAY_CACHE_MAX_SIZE 4096
+
+namespace Astero {
+	// Vertex array objects of one context, keyed on everything they capture: per element its layout, buffer object, base
+	// offset, instancing and attribute location, plus vertex start and index buffer. Keys are built by render system from
+	// contents, so a changed declaration, binding or program simply maps to another entry. Buffer objects may be deleted
+	// while a vertex array object still references them, so entries referencing a deleted buffer are removed. The cache does
+	// not issue GL calls itself; vertex array objects it drops are returned for deletion by state cache.
+	class GLVertexArrayCache {
+	public:
+		typedef std::vector<size_t> Key;
+		typedef std::vector<GLuint> BufferList;
+		
+		GLVertexArrayCache();
+		
+		// Returns vertex array object of key, or 0 if none is cached.
+		GLuint find(const Key & key);
+		// Caches a vertex array object which references given buffer objects. Returns vertex array objects dropped to make
+		// room, which must be deleted.
+		void insert(const Key & key, GLuint vertex_array, const BufferList & buffers, std::vector<GLuint> & removed);
+		// Removes entries referencing buffer object.
+		void removeBuffer(GLuint buffer, std::vector<GLuint> & removed);
+		// Starts a new frame and removes entries not used for max_age frames.
+		void advanceFrame(size_t max_age, std::vector<GLuint> & removed);
+		void clear(std::vector<GLuint> & removed);
+		size_t getSize() const;
+		// Lookups since creation.
+		size_t getHitCount() const;
+		size_t getMissCount() const;
+		
+	protected:
+		struct KeyHash {
+			size_t operator()(const Key & key) const;
+		};
+		struct Entry {
+			GLuint vertex_array;
+			BufferList buffers;
+			size_t last_used_frame;
+		};
+		typedef std::unordered_map<Key, Entry, KeyHash> EntryMap;
+		
+		EntryMap entries_;
+		size_t frame_number_;
+		size_t hit_count_;
+		size_t miss_count_;
+	};
+}
+
+#endif // AsteroGLVertexArrayCache_h
@@ -0,0 +1,229 @@
+//
+//  AsteroGpuProgram.cpp
+//  Astero
+//
+//  Created by Yuzhe Wang on 10/18/26.
+//  Copyright © 2026 Yuzhe Wang. All rights reserved.
+//
+
+#include <cstring>
+#include "AsteroGpuProgram.h"
+#include "AsteroGLProgramBinaryCache.h"
+#include "AsteroGLUniformBufferRing.h"
+#include "AsteroProfiler.h"
+
+namespace Astero {
+	namespace {
+		// Appends compile or link log of a shader or program object to log.
+		void appendInfoLog(GLuint object, bool is_program, const char * label, std::string & log) {
+			GLint length = 0;
+			if (is_program)
+				glGetProgramiv(object, GL_INFO_LOG_LENGTH, &length);
+			else
+				glGetShaderiv(object, GL_INFO_LOG_LENGTH, &length);
+			if (length <= 1)
+				return;
+			std::string info(length, '\0');
+			if (is_program)
+				glGetProgramInfoLog(object, length, nullptr, &info[0]);
+			else
+				glGetShaderInfoLog(object, length, nullptr, &info[0]);
+			info.resize(strlen(info.c_str()));
+			log += label;
+			log += ":\n";
+			log += info;
+			log += '\n';
+		}
+		
+		// Indexed by semantic - 1.
+		const char * const attribute_names[VES_COUNT] = {
+			"vertex", "blendWeights", "blendIndices", "normal", "colour", "secondary_colour", "uv", "binormal", "tangent"
+		};
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	GLGpuProgram::GLGpuProgram() : program_id_(0), loaded_from_cache_(false) {
+		clearAttributeTable();
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	GLGpuProgram::~GLGpuProgram() {
+		unlink();
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void GLGpuProgram::setSource(GLenum shader_type, const std::string & source) {
+		if (source.empty())
+			sources_.erase(shader_type);
+		else
+			sources_[shader_type] = source;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void GLGpuProgram::setPreprocessorDefines(const std::string & defines) {
+		defines_ = defines;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	std::string GLGpuProgram::getPreprocessedSource(const std::string & source) const {
+		std::string define_lines;
+		size_t start = 0;
+		while (start < defines_.size()) {
+			size_t end = defines_.find_first_of(";,", start);
+			if (end == std::string::npos)
+				end = defines_.size();
+			std::string define = defines_.substr(start, end - start);
+			start = end + 1;
+			if (define.empty())
+				continue;
+			size_t equal = define.find('=');
+			if (equal != std::string::npos)
+				define[equal] = ' ';
+			define_lines += "#define " + define + "\n";
+		}
+		if (define_lines.empty())
+			return source;
+		// #version must stay first, and #line keeps reported line numbers matching original source.
+		size_t version = source.find("#version");
+		if (version == std::string::npos)
+			return define_lines + "#line 1\n" + source;
+		size_t line_end = source.find('\n', version);
+		if (line_end == std::string::npos)
+			return source + "\n" + define_lines;
+		return source.substr(0, line_end + 1) + define_lines + "#line 2\n" + source.substr(line_end + 1);
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	uint64_t GLGpuProgram::getSourceHash() const {
+		uint64_t hash = GLProgramBinaryCache::hash(nullptr, 0);
+		for (auto & value : sources_) {
+			hash = GLProgramBinaryCache::hash(&value.first, sizeof(value.first), hash);
+			hash = GLProgramBinaryCache::hash(value.second.data(), value.second.size(), hash);
+		}
+		return hash;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	bool GLGpuProgram::link() {
+		ASTERO_PROFILE_SCOPE("GLGpuProgram::link");
+		unlink();
+		if (sources_.empty())
+			return false;
+		GLProgramBinaryCache * cache = nullptr;
+		if (GLProgramBinaryCache::hasSingleton() && GLProgramBinaryCache::getSingleton().isEnabled())
+			cache = GLProgramBinaryCache::getSingletonPtr();
+		
+		uint64_t key = 0;
+		program_id_ = glCreateProgram();
+		if (cache) {
+			key = cache->makeKey(getSourceHash(), defines_);
+			if (cache->load(program_id_, key)) {
+				loaded_from_cache_ = true;
+				buildAttributeTable();
+				bindUniformBlocks();
+				return true;
+			}
+			// Program a rejected binary was loaded into is left unlinked, start over with a fresh one.
+			glDeleteProgram(program_id_);
+			program_id_ = glCreateProgram();
+			glProgramParameteri(program_id_, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+		}
+		if (!compileAndLink()) {
+			unlink();
+			return false;
+		}
+		if (cache)
+			cache->save(program_id_, key);
+		buildAttributeTable();
+		bindUniformBlocks();
+		return true;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	bool GLGpuProgram::compileAndLink() {
+		log_.clear();
+		std::vector<GLuint> shaders;
+		bool success = true;
+		for (auto & value : sources_) {
+			GLuint shader = glCreateShader(value.first);
+			std::string source = getPreprocessedSource(value.second);
+			const GLchar * source_string = source.c_str();
+			glShaderSource(shader, 1, &source_string, nullptr);
+			glCompileShader(shader);
+			GLint status = GL_FALSE;
+			glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
+			appendInfoLog(shader, false, "compile", log_);
+			if (status != GL_TRUE) {
+				glDeleteShader(shader);
+				success = false;
+				break;
+			}
+			glAttachShader(program_id_, shader);
+			shaders.push_back(shader);
+		}
+		if (success) {
+			glLinkProgram(program_id_);
+			GLint status = GL_FALSE;
+			glGetProgramiv(program_id_, GL_LINK_STATUS, &status);
+			appendInfoLog(program_id_, true, "link", log_);
+			success = status == GL_TRUE;
+		}
+		// Linked program keeps its code, shader objects are no longer needed.
+		for (auto shader : shaders) {
+			glDetachShader(program_id_, shader);
+			glDeleteShader(shader);
+		}
+		return success;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void GLGpuProgram::unlink() {
+		if (program_id_ != 0) {
+			glDeleteProgram(program_id_);
+			program_id_ = 0;
+		}
+		loaded_from_cache_ = false;
+		clearAttributeTable();
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	std::string GLGpuProgram::getAttributeName(VertexElementSemantic semantic, unsigned int index) {
+		assert(semantic >= VES_POSITION && semantic <= VES_COUNT);
+		std::string name = attribute_names[semantic - 1];
+		if (index > 0 || semantic == VES_TEXTURE_COORDINATES)
+			name += std::to_string(index);
+		return name;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void GLGpuProgram::clearAttributeTable() {
+		for (size_t i = 0; i < VES_COUNT; i++) {
+			for (size_t j = 0; j < GL_GPU_PROGRAM_MAX_ATTRIBUTE_INDEX; j++)
+				attribute_locations_[i][j] = -1;
+			attribute_valid_masks_[i] = 0;
+		}
+		attribute_location_mask_ = 0;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void GLGpuProgram::buildAttributeTable() {
+		clearAttributeTable();
+		GLint active_count = 0;
+		glGetProgramiv(program_id_, GL_ACTIVE_ATTRIBUTES, &active_count);
+		if (active_count == 0)
+			return;
+		for (unsigned int semantic = VES_POSITION; semantic <= VES_COUNT; semantic++) {
+			for (unsigned int index = 0; index < GL_GPU_PROGRAM_MAX_ATTRIBUTE_INDEX; index++) {
+				std::string name = getAttributeName(static_cast<VertexElementSemantic>(semantic), index);
+				GLint location = glGetAttribLocation(program_id_, name.c_str());
+				if (location < 0)
+					continue;
+				attribute_locations_[semantic - 1][index] = location;
+				attribute_valid_masks_[semantic - 1] |= 1u << index;
+				if (location < 32)
+					attribute_location_mask_ |= 1u << location;
+			}
+		}
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void GLGpuProgram::bindUniformBlocks() {
+		if (!GLEW_ARB_uniform_buffer_object)
+			return;
+		// Block bindings are not part of program binaries, so they are set after every link.
+		const char * const names[] = {"AsteroPass", "AsteroObject", "AsteroMaterial"};
+		const GLuint bindings[] = {GL_UNIFORM_BINDING_PASS, GL_UNIFORM_BINDING_OBJECT, GL_UNIFORM_BINDING_MATERIAL};
+		for (size_t i = 0; i < 3; i++) {
+			GLuint block = glGetUniformBlockIndex(program_id_, names[i]);
+			if (block != GL_INVALID_INDEX)
+				glUniformBlockBinding(program_id_, block, bindings[i]);
+		}
+	}
+}
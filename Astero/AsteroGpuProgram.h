@@ -9,19 +9,87 @@
 #ifndef AsteroGpuProgram_h
 #define AsteroGpuProgram_h
 
+#include "AsteroHardwareBuffer.h"
+
+// Indices per semantic held by attribute location tables, enough for 8 texture coordinate sets.
+#define GL_GPU_PROGRAM_MAX_ATTRIBUTE_INDEX 8
+
 namespace Astero {
 	class GpuProgram {
 	public:
+		GpuProgram() : adjacency_info_required_(false) {}
+		virtual ~GpuProgram() {}
 		virtual bool isAdjacencyInfoRequired() const { return adjacency_info_required_; }
 		
 	protected:
 		bool adjacency_info_required_;
 		
 	};
+	// GLSL program linked from sources of its stages. When GLProgramBinaryCache exists and is enabled, link restores program
+	// from a cached binary, and compiles sources only on a miss, storing resulting binary for next run.
+	// Uniform blocks AsteroPass, AsteroObject and AsteroMaterial are assigned their binding points at link.
+	// Vertex attributes are named after their semantic, like vertex, normal, colour or uv0 to uv7, with index appended for
+	// other semantics past 0. Their locations are looked up once at link into a table indexed by semantic and index, so per
+	// draw queries are array reads.
 	class GLGpuProgram : public GpuProgram {
 	public:
-		virtual bool isAttributeValid(VertexElementSemantic semantic, unsigned int index);
-		virtual GLuint getAttributeIndex(VertexElementSemantic semantic, unsigned int index);
+		GLGpuProgram();
+		~GLGpuProgram();
+		
+		// Sets source of a stage, like GL_VERTEX_SHADER or GL_FRAGMENT_SHADER. Takes effect on next link.
+		void setSource(GLenum shader_type, const std::string & source);
+		// Sets preprocessor defines separated by ';' or ',', each as NAME or NAME=VALUE. Takes effect on next link.
+		void setPreprocessorDefines(const std::string & defines);
+		const std::string & getPreprocessorDefines() const { return defines_; }
+		bool link();
+		void unlink();
+		bool isLinked() const { return program_id_ != 0; }
+		GLuint getProgramId() const { return program_id_; }
+		// Whether last link restored program from binary cache.
+		bool isLoadedFromCache() const { return loaded_from_cache_; }
+		// Compiler and linker messages of last link that compiled sources.
+		const std::string & getLog() const { return log_; }
+		
+		// Location of attribute, or -1 if program does not use it.
+		GLint getAttributeLocation(VertexElementSemantic semantic, unsigned int index) const {
+			return index < GL_GPU_PROGRAM_MAX_ATTRIBUTE_INDEX ? attribute_locations_[semantic - 1][index] : -1;
+		}
+		bool isAttributeValid(VertexElementSemantic semantic, unsigned int index) const {
+			return index < GL_GPU_PROGRAM_MAX_ATTRIBUTE_INDEX && (attribute_valid_masks_[semantic - 1] >> index & 1) != 0;
+		}
+		GLuint getAttributeIndex(VertexElementSemantic semantic, unsigned int index) const {
+			assert(isAttributeValid(semantic, index));
+			return static_cast<GLuint>(attribute_locations_[semantic - 1][index]);
+		}
+		// Bit per attribute location used by program.
+		uint32_t getAttributeLocationMask() const { return attribute_location_mask_; }
+		// Name vertex programs give attribute of semantic and index.
+		static std::string getAttributeName(VertexElementSemantic semantic, unsigned int index);
+		
+	protected:
+		// Ordered, so source hash does not depend on order stages are set in.
+		typedef std::map<GLenum, std::string> SourceMap;
+		
+		bool compileAndLink();
+		// Source with defines inserted after its #version line.
+		std::string getPreprocessedSource(const std::string & source) const;
+		uint64_t getSourceHash() const;
+		// Fills attribute location table from linked program.
+		void buildAttributeTable();
+		// Assigns uniform blocks with known names to binding points of GLUniformBufferRing.
+		void bindUniformBlocks();
+		void clearAttributeTable();
+		
+		SourceMap sources_;
+		std::string defines_;
+		std::string log_;
+		GLuint program_id_;
+		bool loaded_from_cache_;
+		// Indexed by semantic - 1 and index.
+		GLint attribute_locations_[VES_COUNT][GL_GPU_PROGRAM_MAX_ATTRIBUTE_INDEX];
+		// Bit per index of a semantic with a valid location.
+		uint32_t attribute_valid_masks_[VES_COUNT];
+		uint32_t attribute_location_mask_;
 	};
 }
 
@@ -10,29 +10,138 @@
 
 #include "AsteroHardwareBuffer.h"
 #include "AsteroHardwareBufferManager.h"
+#include "AsteroProfiler.h"
 
 namespace Astero {
-	HardwareBuffer::HardwareBuffer(Usage usage, bool use_system_memory, bool use_shadow_buffer)
-	: size_in_bytes_(0), usage_(usage), locked_(false), lock_offset_(false), lock_size_(false), use_system_memory_(use_system_memory), use_shadow_buffer_(use_shadow_buffer), shadow_buffer_(nullptr), shadow_updated_(false), suppress_hardware_update_(false) {
+	//--------------------------------------------------------------------------------------------------------------------------------
+	// HardwareBufferDirtyRanges
+	//--------------------------------------------------------------------------------------------------------------------------------
+	HardwareBufferDirtyRanges::HardwareBufferDirtyRanges(size_t merge_gap) : merge_gap_(merge_gap) {
 		
 	}
-	HardwareBuffer::~HardwareBuffer() {}
-	void * HardwareBuffer::lock(size_t offset, size_t size, LockOption option) {
-		return nullptr;
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void HardwareBufferDirtyRanges::add(size_t offset, size_t size) {
+		if (size == 0)
+			return;
+		size_t begin = offset;
+		size_t end = offset + size;
+		// First range which ends close enough to begin to be merged. Ranges are disjoint, so their ends are sorted too.
+		auto first = std::lower_bound(ranges_.begin(), ranges_.end(), begin, [this](const Range & range, size_t value) {
+			return range.offset + range.size + merge_gap_ < value;
+		});
+		auto last = first;
+		while (last != ranges_.end() && last->offset <= end + merge_gap_) {
+			begin = std::min(begin, last->offset);
+			end = std::max(end, last->offset + last->size);
+			++last;
+		}
+		Range range = {begin, end - begin};
+		if (first == last) {
+			ranges_.insert(first, range);
+		}
+		else {
+			*first = range;
+			ranges_.erase(first + 1, last);
+		}
 	}
-	void * HardwareBuffer::lock(LockOption) {
-		return nullptr;
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void HardwareBufferDirtyRanges::clear() {
+		ranges_.clear();
 	}
-	void HardwareBuffer::unlock(void) {
-		
+	//--------------------------------------------------------------------------------------------------------------------------------
+	bool HardwareBufferDirtyRanges::empty() const {
+		return ranges_.empty();
 	}
-	void HardwareBuffer::copyData(HardwareBuffer & src_buffer, size_t src_offset,
-				  size_t dest_offset, size_t size,
-								  bool discard_whole_buffer) {
+	//--------------------------------------------------------------------------------------------------------------------------------
+	const HardwareBufferDirtyRanges::RangeList & HardwareBufferDirtyRanges::getRanges() const {
+		return ranges_;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	size_t HardwareBufferDirtyRanges::getDirtyBytes() const {
+		size_t bytes = 0;
+		for (auto & range : ranges_)
+			bytes += range.size;
+		return bytes;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	size_t HardwareBufferDirtyRanges::getMergeGap() const {
+		return merge_gap_;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void HardwareBufferDirtyRanges::setMergeGap(size_t merge_gap) {
+		merge_gap_ = merge_gap;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	// HardwareBufferReadback
+	//--------------------------------------------------------------------------------------------------------------------------------
+	HardwareBufferReadback::HardwareBufferReadback(size_t offset, size_t size)
+	: offset_(offset), size_(size), data_(size), status_(RS_PENDING) {
 		
 	}
-	void HardwareBuffer::copyData(HardwareBuffer & src_buffer) {
+	HardwareBufferReadback::Status HardwareBufferReadback::getStatus() const {
+		return status_.load(std::memory_order_acquire);
+	}
+	bool HardwareBufferReadback::isReady() const {
+		return getStatus() == RS_READY;
+	}
+	size_t HardwareBufferReadback::getOffset() const {
+		return offset_;
+	}
+	size_t HardwareBufferReadback::getSize() const {
+		return size_;
+	}
+	const void * HardwareBufferReadback::getData() const {
+		assert(isReady());
+		return data_.data();
+	}
+	void * HardwareBufferReadback::getDataForWrite() {
+		return data_.data();
+	}
+	void HardwareBufferReadback::notifyReady() {
+		status_.store(RS_READY, std::memory_order_release);
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	// HardwareBuffer
+	//--------------------------------------------------------------------------------------------------------------------------------
+	HardwareBuffer::HardwareBuffer(Usage usage, bool use_system_memory, bool use_shadow_buffer)
+	: size_in_bytes_(0), base_offset_(0), usage_(usage), locked_(false), lock_offset_(false), lock_size_(false), use_system_memory_(use_system_memory), use_shadow_buffer_(use_shadow_buffer), shadow_buffer_(nullptr), shadow_updated_(false), suppress_hardware_update_(false) {
 		
+	}
+	HardwareBuffer::~HardwareBuffer() {}
+	void * HardwareBuffer::lock(size_t offset, size_t size, LockOption option) {
+		ASTERO_PROFILE_SCOPE("HardwareBuffer::lock");
+		assert(!isLocked());
+		assert(offset + size <= size_in_bytes_);
+		void * ret = nullptr;
+		if (use_shadow_buffer_) {
+			// Writes go to shadow buffer, and are uploaded to hardware buffer before it is used.
+			if (option != HBL_READ_ONLY) {
+				shadow_updated_ = true;
+				dirty_ranges_.add(offset, size);
+			}
+			ret = shadow_buffer_->lock(offset, size, option);
+		}
+		else {
+			ret = lockImpl(offset, size, option);
+			locked_ = true;
+		}
+		lock_offset_ = offset;
+		lock_size_ = size;
+		return ret;
+	}
+	void * HardwareBuffer::lock(LockOption option) {
+		return lock(0, size_in_bytes_, option);
+	}
+	void HardwareBuffer::unlock(void) {
+		ASTERO_PROFILE_SCOPE("HardwareBuffer::unlock");
+		assert(isLocked());
+		if (use_shadow_buffer_ && shadow_buffer_->isLocked()) {
+			shadow_buffer_->unlock();
+		}
+		else {
+			unlockImpl();
+			locked_ = false;
+		}
 	}
 	void HardwareBuffer::updateFromShadow() {
 		
@@ -49,6 +158,45 @@ namespace Astero {
 	bool HardwareBuffer::isLocked() const {
 		return locked_ || (use_shadow_buffer_ && shadow_buffer_->isLocked());
 	}
+	void HardwareBuffer::copyData(HardwareBuffer & src_buffer, size_t src_offset, size_t dest_offset, size_t size,
+								  bool discard_whole_buffer) {
+		assert(src_offset + size <= src_buffer.getSizeInBytes());
+		assert(dest_offset + size <= size_in_bytes_);
+		if (use_shadow_buffer_ && src_buffer.use_shadow_buffer_) {
+			// Copies between shadow buffers, which share chunks where possible, and leaves upload to updateFromShadow.
+			shadow_buffer_->copyData(*src_buffer.shadow_buffer_, src_offset, dest_offset, size, discard_whole_buffer);
+			shadow_updated_ = true;
+			dirty_ranges_.add(dest_offset, size);
+		}
+		else {
+			const void * src = src_buffer.lock(src_offset, size, HBL_READ_ONLY);
+			writeData(dest_offset, size, src, discard_whole_buffer);
+			src_buffer.unlock();
+		}
+	}
+	void HardwareBuffer::copyData(HardwareBuffer & src_buffer) {
+		size_t size = std::min(size_in_bytes_, src_buffer.getSizeInBytes());
+		copyData(src_buffer, 0, 0, size, true);
+	}
+	HardwareBufferReadbackPtr HardwareBuffer::readDataAsync(size_t offset, size_t size) {
+		assert(offset + size <= size_in_bytes_);
+		HardwareBufferReadbackPtr readback = std::make_shared<HardwareBufferReadback>(offset, size);
+		readData(offset, size, readback->getDataForWrite());
+		readback->notifyReady();
+		return readback;
+	}
+	size_t HardwareBuffer::getBaseOffset() const {
+		return base_offset_;
+	}
+	bool HardwareBuffer::isShadowDirty() const {
+		return shadow_updated_;
+	}
+	const HardwareBufferDirtyRanges & HardwareBuffer::getDirtyRanges() const {
+		return dirty_ranges_;
+	}
+	void HardwareBuffer::setDirtyRangeMergeGap(size_t merge_gap) {
+		dirty_ranges_.setMergeGap(merge_gap);
+	}
 	//--------------------------------------------------------------------------------------------------------------------------------
 	// HardwareVertexBuffer
 	//--------------------------------------------------------------------------------------------------------------------------------
@@ -100,192 +248,806 @@ namespace Astero {
 			abort();
 		}
 	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	// VertexDeclaration
+	//--------------------------------------------------------------------------------------------------------------------------------
+	const VertexElement & VertexDeclaration::addElement(unsigned short source, size_t offset, VertexElementType type,
+														VertexElementSemantic semantic, unsigned short index) {
+		vertex_element_list_.push_back(VertexElement(source, offset, type, semantic, index));
+		return vertex_element_list_.back();
+	}
 } // namespace Astero
 
 #include "AsteroAllocator.tpp"
 namespace Astero {
+	//--------------------------------------------------------------------------------------------------------------------------------
+	// SharedBufferStorage
+	//--------------------------------------------------------------------------------------------------------------------------------
+	SharedBufferStorage::SharedBufferStorage(size_t size)
+	: chunks_((size + SHARED_BUFFER_STORAGE_CHUNK_SIZE - 1) / SHARED_BUFFER_STORAGE_CHUNK_SIZE), size_(size), locked_(false),
+	lock_write_back_(false), lock_offset_(0), lock_size_(0), staging_(nullptr), staging_capacity_(0),
+	contiguous_(nullptr), contiguous_valid_(false) {
+		
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	SharedBufferStorage::~SharedBufferStorage() {
+		free_simd<MEMCATEGORY_GEOMETRY>(staging_);
+		free_simd<MEMCATEGORY_GEOMETRY>(contiguous_);
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	size_t SharedBufferStorage::getSize() const {
+		return size_;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void SharedBufferStorage::read(size_t offset, size_t size, void * dest) const {
+		assert(offset + size <= size_);
+		unsigned char * dest_bytes = static_cast<unsigned char *>(dest);
+		while (size > 0) {
+			size_t index = offset / SHARED_BUFFER_STORAGE_CHUNK_SIZE;
+			size_t chunk_offset = offset % SHARED_BUFFER_STORAGE_CHUNK_SIZE;
+			size_t length = std::min(size, SHARED_BUFFER_STORAGE_CHUNK_SIZE - chunk_offset);
+			if (chunks_[index])
+				memcpy(dest_bytes, chunks_[index].get() + chunk_offset, length);
+			else
+				memset(dest_bytes, 0, length);
+			dest_bytes += length;
+			offset += length;
+			size -= length;
+		}
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void SharedBufferStorage::write(size_t offset, size_t size, const void * src) {
+		assert(offset + size <= size_);
+		const unsigned char * src_bytes = static_cast<const unsigned char *>(src);
+		while (size > 0) {
+			size_t index = offset / SHARED_BUFFER_STORAGE_CHUNK_SIZE;
+			size_t chunk_offset = offset % SHARED_BUFFER_STORAGE_CHUNK_SIZE;
+			size_t length = std::min(size, SHARED_BUFFER_STORAGE_CHUNK_SIZE - chunk_offset);
+			// A write which covers whole chunk does not need to copy its old contents.
+			if (length == SHARED_BUFFER_STORAGE_CHUNK_SIZE && chunks_[index].use_count() > 1)
+				chunks_[index].reset();
+			memcpy(getChunkForWrite(index) + chunk_offset, src_bytes, length);
+			src_bytes += length;
+			offset += length;
+			size -= length;
+		}
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void SharedBufferStorage::share(const SharedBufferStorage & src_storage, size_t src_offset, size_t dest_offset, size_t size) {
+		assert(src_offset + size <= src_storage.size_);
+		assert(dest_offset + size <= size_);
+		assert(!locked_);
+		if (&src_storage == this) {
+			// Copying within one storage may overlap, so goes through a temporary copy.
+			std::vector<unsigned char> temp(size);
+			read(src_offset, size, temp.data());
+			write(dest_offset, size, temp.data());
+			return;
+		}
+		// Chunks can only be shared when both ranges have the same alignment within chunks.
+		if (src_offset % SHARED_BUFFER_STORAGE_CHUNK_SIZE != dest_offset % SHARED_BUFFER_STORAGE_CHUNK_SIZE) {
+			std::vector<unsigned char> temp(size);
+			src_storage.read(src_offset, size, temp.data());
+			write(dest_offset, size, temp.data());
+			return;
+		}
+		while (size > 0) {
+			size_t src_index = src_offset / SHARED_BUFFER_STORAGE_CHUNK_SIZE;
+			size_t index = dest_offset / SHARED_BUFFER_STORAGE_CHUNK_SIZE;
+			size_t chunk_offset = dest_offset % SHARED_BUFFER_STORAGE_CHUNK_SIZE;
+			size_t length = std::min(size, SHARED_BUFFER_STORAGE_CHUNK_SIZE - chunk_offset);
+			// Whole chunk, or tail chunk of both storages, is shared.
+			bool whole_chunk = length == SHARED_BUFFER_STORAGE_CHUNK_SIZE ||
+				(chunk_offset == 0 && src_offset + length == src_storage.size_ && dest_offset + length == size_);
+			if (whole_chunk) {
+				chunks_[index] = src_storage.chunks_[src_index];
+				contiguous_valid_ = false;
+			}
+			else if (src_storage.chunks_[src_index]) {
+				memcpy(getChunkForWrite(index) + chunk_offset, src_storage.chunks_[src_index].get() + chunk_offset, length);
+			}
+			else {
+				memset(getChunkForWrite(index) + chunk_offset, 0, length);
+			}
+			src_offset += length;
+			dest_offset += length;
+			size -= length;
+		}
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void * SharedBufferStorage::lock(size_t offset, size_t size, bool read_only, bool discard) {
+		assert(!locked_);
+		assert(offset + size <= size_);
+		locked_ = true;
+		lock_write_back_ = false;
+		lock_offset_ = offset;
+		lock_size_ = size;
+		// Nothing may be accessed through an empty lock, and offset may be past last chunk.
+		if (size == 0)
+			return nullptr;
+		size_t index = offset / SHARED_BUFFER_STORAGE_CHUNK_SIZE;
+		size_t chunk_offset = offset % SHARED_BUFFER_STORAGE_CHUNK_SIZE;
+		if (chunk_offset + size <= SHARED_BUFFER_STORAGE_CHUNK_SIZE) {
+			// A read of a chunk not written yet still needs memory to point to.
+			if (read_only && chunks_[index])
+				return chunks_[index].get() + chunk_offset;
+			// A discarding lock of whole chunk does not need to copy its old contents.
+			if (discard && size == SHARED_BUFFER_STORAGE_CHUNK_SIZE && chunks_[index].use_count() > 1)
+				chunks_[index].reset();
+			return getChunkForWrite(index) + chunk_offset;
+		}
+		if (staging_capacity_ < size) {
+			free_simd<MEMCATEGORY_GEOMETRY>(staging_);
+			staging_ = static_cast<unsigned char *>(malloc_simd<MEMCATEGORY_GEOMETRY>(size));
+			staging_capacity_ = size;
+		}
+		if (!discard || read_only)
+			read(offset, size, staging_);
+		lock_write_back_ = !read_only;
+		return staging_;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void SharedBufferStorage::unlock() {
+		assert(locked_);
+		locked_ = false;
+		if (lock_write_back_)
+			write(lock_offset_, lock_size_, staging_);
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	bool SharedBufferStorage::isLocked() const {
+		return locked_;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void SharedBufferStorage::visitChunks(size_t offset, size_t size,
+										  const std::function<void(size_t, const void *, size_t)> & visitor) const {
+		assert(offset + size <= size_);
+		static const unsigned char zeros[SHARED_BUFFER_STORAGE_CHUNK_SIZE] = {};
+		while (size > 0) {
+			size_t index = offset / SHARED_BUFFER_STORAGE_CHUNK_SIZE;
+			size_t chunk_offset = offset % SHARED_BUFFER_STORAGE_CHUNK_SIZE;
+			size_t length = std::min(size, SHARED_BUFFER_STORAGE_CHUNK_SIZE - chunk_offset);
+			visitor(offset, chunks_[index] ? chunks_[index].get() + chunk_offset : zeros + chunk_offset, length);
+			offset += length;
+			size -= length;
+		}
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	const void * SharedBufferStorage::getContiguousData() const {
+		if (!contiguous_valid_) {
+			if (!contiguous_)
+				contiguous_ = static_cast<unsigned char *>(malloc_simd<MEMCATEGORY_GEOMETRY>(size_));
+			read(0, size_, contiguous_);
+			contiguous_valid_ = true;
+		}
+		return contiguous_;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	size_t SharedBufferStorage::getAllocatedBytes() const {
+		size_t bytes = 0;
+		for (auto & chunk : chunks_) {
+			if (chunk)
+				bytes += SHARED_BUFFER_STORAGE_CHUNK_SIZE;
+		}
+		return bytes;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	size_t SharedBufferStorage::getSharedBytes() const {
+		size_t bytes = 0;
+		for (auto & chunk : chunks_) {
+			if (chunk && chunk.use_count() > 1)
+				bytes += SHARED_BUFFER_STORAGE_CHUNK_SIZE;
+		}
+		return bytes;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	unsigned char * SharedBufferStorage::getChunkForWrite(size_t index) {
+		ChunkPtr & chunk = chunks_[index];
+		contiguous_valid_ = false;
+		if (chunk && chunk.use_count() == 1)
+			return chunk.get();
+		ChunkPtr new_chunk(static_cast<unsigned char *>(malloc_simd<MEMCATEGORY_GEOMETRY>(SHARED_BUFFER_STORAGE_CHUNK_SIZE)),
+						   [](unsigned char * data) { free_simd<MEMCATEGORY_GEOMETRY>(data); });
+		if (chunk)
+			memcpy(new_chunk.get(), chunk.get(), SHARED_BUFFER_STORAGE_CHUNK_SIZE);
+		else
+			memset(new_chunk.get(), 0, SHARED_BUFFER_STORAGE_CHUNK_SIZE);
+		chunk = new_chunk;
+		return chunk.get();
+	}
+	// Storage of a default buffer, which copies can share chunks of, or nullptr for other buffers.
+	static const SharedBufferStorage * getDefaultBufferStorage(const HardwareBuffer & buffer) {
+		if (const DefaultHardwareVertexBuffer * vertex_buffer = dynamic_cast<const DefaultHardwareVertexBuffer *>(&buffer))
+			return &vertex_buffer->getStorage();
+		if (const DefaultHardwareIndexBuffer * index_buffer = dynamic_cast<const DefaultHardwareIndexBuffer *>(&buffer))
+			return &index_buffer->getStorage();
+		return nullptr;
+	}
 	//--------------------------------------------------------------------------------------------------------------------------------
 	// DefaultHardwareVertexBuffer
 	//--------------------------------------------------------------------------------------------------------------------------------
 	DefaultHardwareVertexBuffer::DefaultHardwareVertexBuffer(size_t vertex_size,
 															 size_t vertex_num,
 															 HardwareBuffer::Usage usage)
-	: HardwareVertexBuffer(nullptr, vertex_size, vertex_num, usage, true, false), data_(nullptr) {
-		data_ = static_cast<unsigned char *>(malloc_simd<MEMCATEGORY_GEOMETRY>(size_in_bytes_));
+	: HardwareVertexBuffer(nullptr, vertex_size, vertex_num, usage, true, false), storage_(size_in_bytes_) {
+		
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	DefaultHardwareVertexBuffer::DefaultHardwareVertexBuffer(HardwareBufferManager * manager,
+															 size_t vertex_size,
+															 size_t vertex_num,
+															 HardwareBuffer::Usage usage)
+	: HardwareVertexBuffer(manager, vertex_size, vertex_num, usage, true, false), storage_(size_in_bytes_) {
+		
 	}
 	//--------------------------------------------------------------------------------------------------------------------------------
 	DefaultHardwareVertexBuffer::~DefaultHardwareVertexBuffer() {
-		free_simd<MEMCATEGORY_GEOMETRY>(data_);
+		
 	}
 	//--------------------------------------------------------------------------------------------------------------------------------
 	void * DefaultHardwareVertexBuffer::lock(size_t offset, size_t size, LockOption option) {
 		locked_ = true;
-		return data_ + offset;
+		return storage_.lock(offset, size, option == HBL_READ_ONLY, option == HBL_DISCARD || option == HBL_NO_OVERWRITE);
 	}
 	//--------------------------------------------------------------------------------------------------------------------------------
 	void  DefaultHardwareVertexBuffer::unlock() {
+		storage_.unlock();
 		locked_ = false;
 	}
 	//--------------------------------------------------------------------------------------------------------------------------------
 	void DefaultHardwareVertexBuffer::readData(size_t offset, size_t size, void * dest) {
 		assert((offset + size) <= size_in_bytes_);
-		memcpy(dest, data_ + offset, size);
+		storage_.read(offset, size, dest);
 	}
 	//--------------------------------------------------------------------------------------------------------------------------------
 	void DefaultHardwareVertexBuffer::writeData(size_t offset, size_t size, const void * src, bool discard_whole_buffer) {
 		assert((offset + size) <= size_in_bytes_);
-		memcpy(data_ + offset, src, size);
+		storage_.write(offset, size, src);
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void DefaultHardwareVertexBuffer::copyData(HardwareBuffer & src_buffer, size_t src_offset, size_t dest_offset, size_t size,
+											   bool discard_whole_buffer) {
+		const SharedBufferStorage * src_storage = getDefaultBufferStorage(src_buffer);
+		if (src_storage) {
+			assert(dest_offset + size <= size_in_bytes_);
+			storage_.share(*src_storage, src_offset, dest_offset, size);
+		}
+		else {
+			HardwareBuffer::copyData(src_buffer, src_offset, dest_offset, size, discard_whole_buffer);
+		}
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	const SharedBufferStorage & DefaultHardwareVertexBuffer::getStorage() const {
+		return storage_;
 	}
 	//--------------------------------------------------------------------------------------------------------------------------------
 	void * DefaultHardwareVertexBuffer::lockImpl(size_t offset, size_t size, LockOption option) {
-		return data_ + offset;
+		return storage_.lock(offset, size, option == HBL_READ_ONLY, option == HBL_DISCARD || option == HBL_NO_OVERWRITE);
 	}
 	//--------------------------------------------------------------------------------------------------------------------------------
 	void DefaultHardwareVertexBuffer::unlockImpl() {
-		
+		storage_.unlock();
 	}
 } // namespace Astero
 
 namespace Astero {
 	//--------------------------------------------------------------------------------------------------------------------------------
-	// GLHardwareVertexBuffer
+	// GLBufferWriteHistory
 	//--------------------------------------------------------------------------------------------------------------------------------
-	GLHardwareVertexBuffer::GLHardwareVertexBuffer(HardwareBufferManager * manager,
-												   size_t vertex_size,
-												   size_t vertex_num,
-												   HardwareBuffer::Usage usage,
-												   bool use_shadow_buffer)
-	: HardwareVertexBuffer(manager, vertex_size, vertex_num, usage, false, use_shadow_buffer), locked_to_scratch_(false), scratch_upload_on_unlock_(false), scratch_offset_(0), scratch_size_(0), scratch_(nullptr) {
-		glGenBuffersARB(1, &buffer_id_);
-		assert(buffer_id_);
-		static_cast<GLHardwareBufferManager *>(manager)->getStateCacheManager()->bindGLBuffer(GL_ARRAY_BUFFER_ARB, buffer_id_);
-		// Initializes buffer and set usage.
-		glBufferDataARB(GL_ARRAY_BUFFER_ARB, size_in_bytes_, nullptr, GLHardwareBufferManager::getGLUsage(usage));
+	GLBufferWriteHistory::GLBufferWriteHistory() : history_(0), frame_count_(0), written_(false) {
+		
 	}
 	//--------------------------------------------------------------------------------------------------------------------------------
-	GLHardwareVertexBuffer::~GLHardwareVertexBuffer() {
-		static_cast<GLHardwareBufferManager *>(manager_)->getStateCacheManager()->deleteGLBuffer(GL_ARRAY_BUFFER_ARB, buffer_id_);
+	void GLBufferWriteHistory::notifyWrite() {
+		written_ = true;
 	}
 	//--------------------------------------------------------------------------------------------------------------------------------
-	GLuint GLHardwareVertexBuffer::getGLBufferId() const {
-		return buffer_id_;
+	void GLBufferWriteHistory::advanceFrame() {
+		history_ = (history_ << 1) | (written_ ? 1 : 0);
+		// Mask is built from a 64-bit value, so that a window of all 32 bits does not shift out of range.
+		history_ &= static_cast<unsigned int>((1ull << GL_BUFFER_WRITE_HISTORY_FRAMES) - 1);
+		if (frame_count_ < GL_BUFFER_WRITE_HISTORY_FRAMES)
+			++frame_count_;
+		written_ = false;
 	}
 	//--------------------------------------------------------------------------------------------------------------------------------
-	void GLHardwareVertexBuffer::readData(size_t offset, size_t size, void * dest) {
-		if (use_shadow_buffer_) {
+	void GLBufferWriteHistory::reset() {
+		history_ = 0;
+		frame_count_ = 0;
+		written_ = false;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	unsigned int GLBufferWriteHistory::getFrameCount() const {
+		return frame_count_;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	unsigned int GLBufferWriteHistory::getWrittenFrameCount() const {
+		return __builtin_popcount(history_);
+	}
+	// Uploads a range of shadow buffer to buffer object bound to target, one chunk of shadow storage at a time, so range
+	// is never gathered into a staging copy.
+	static void uploadShadowRange(GLenum target, const HardwareBuffer & shadow_buffer, size_t base_offset, size_t offset,
+								  size_t size) {
+		const SharedBufferStorage * storage = getDefaultBufferStorage(shadow_buffer);
+		assert(storage);
+		storage->visitChunks(offset, size, [target, base_offset](size_t chunk_offset, const void * data, size_t length) {
+			glBufferSubDataARB(target, base_offset + chunk_offset, length, data);
+		});
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	// GLBufferObjectHolder
+	//--------------------------------------------------------------------------------------------------------------------------------
+	GLBufferObjectHolder::GLBufferObjectHolder(HardwareBuffer & buffer, GLHardwareBufferManager * manager, GLenum target, size_t alignment)
+	: buffer_(buffer), gl_manager_(manager), target_(target), alignment_(alignment), buffer_id_(0), mega_buffer_(nullptr),
+	gl_usage_(GLHardwareBufferManager::getGLUsage(buffer.usage_)), resident_(true), locked_to_scratch_(false),
+	scratch_upload_on_unlock_(false), scratch_offset_(0), scratch_size_(0), scratch_(nullptr), in_lru_list_(false), last_used_frame_(0),
+	resource_account_(nullptr), group_account_(nullptr) {
+		// Static buffers may be sub-allocated from a shared mega-buffer.
+		if (gl_manager_->allocateMegaBufferRange(this, target_, buffer_.usage_, buffer_.size_in_bytes_, alignment_, mega_buffer_, buffer_.base_offset_)) {
+			buffer_id_ = mega_buffer_->getGLBufferId();
+		}
+		else {
+			glGenBuffersARB(1, &buffer_id_);
+			assert(buffer_id_);
+			gl_manager_->getStateCacheManager()->bindGLBuffer(target_, buffer_id_);
+			// Initializes buffer and set usage.
+			glBufferDataARB(target_, buffer_.size_in_bytes_, nullptr, gl_usage_);
+		}
+		gl_manager_->registerGLBuffer(this);
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	GLBufferObjectHolder::~GLBufferObjectHolder() {
+		gl_manager_->unregisterGLBuffer(this);
+		if (mega_buffer_)
+			gl_manager_->deallocateMegaBufferRange(mega_buffer_, buffer_.base_offset_);
+		else if (resident_)
+			gl_manager_->getStateCacheManager()->deleteGLBuffer(target_, buffer_id_);
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void GLBufferObjectHolder::notifyGLBufferRelocated(GLuint buffer_id, size_t base_offset) {
+		buffer_id_ = buffer_id;
+		buffer_.base_offset_ = base_offset;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	bool GLBufferObjectHolder::isGLBufferLocked() const {
+		return buffer_.isLocked();
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	GLenum GLBufferObjectHolder::getGLUsage() const {
+		return gl_usage_;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	bool GLBufferObjectHolder::setGLUsage(GLenum gl_usage) {
+		if (gl_usage == gl_usage_)
+			return true;
+		// Evicted buffers are recreated with new usage when restored.
+		if (!resident_) {
+			gl_usage_ = gl_usage;
+			return true;
+		}
+		if (isGLBufferLocked() || !GLEW_ARB_copy_buffer)
+			return false;
+		GLStateCacheManager * state_cache_manager = gl_manager_->getStateCacheManager();
+		size_t size = getGLBufferSize();
+		GLuint old_buffer_id = getGLBufferId();
+		size_t old_base_offset = getGLBufferOffset();
+		GLMegaBuffer * old_mega_buffer = mega_buffer_;
+		mega_buffer_ = nullptr;
+		GLuint buffer_id = 0;
+		size_t base_offset = 0;
+		// Buffers which became static move into a mega-buffer if sub-allocation is enabled.
+		if (gl_usage == GL_STATIC_DRAW_ARB && !old_mega_buffer
+			&& gl_manager_->allocateMegaBufferRange(this, getGLTarget(), HardwareBuffer::HBU_STATIC, size, getGLBufferAlignment(),
+												   mega_buffer_, base_offset)) {
+			buffer_id = mega_buffer_->getGLBufferId();
+		}
+		else {
+			glGenBuffersARB(1, &buffer_id);
+			assert(buffer_id);
+			state_cache_manager->bindGLBuffer(GL_COPY_WRITE_BUFFER, buffer_id);
+			glBufferDataARB(GL_COPY_WRITE_BUFFER, size, nullptr, gl_usage);
+		}
+		// Copies contents from old buffer object on GPU.
+		state_cache_manager->bindGLBuffer(GL_COPY_READ_BUFFER, old_buffer_id);
+		state_cache_manager->bindGLBuffer(GL_COPY_WRITE_BUFFER, buffer_id);
+		glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, old_base_offset, base_offset, size);
+		if (old_mega_buffer)
+			gl_manager_->deallocateMegaBufferRange(old_mega_buffer, old_base_offset);
+		else
+			state_cache_manager->deleteGLBuffer(GL_COPY_READ_BUFFER, old_buffer_id);
+		notifyGLBufferRelocated(buffer_id, base_offset);
+		gl_usage_ = gl_usage;
+		return true;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	size_t GLBufferObjectHolder::getGLBufferOffset() const {
+		return buffer_.base_offset_;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	size_t GLBufferObjectHolder::getGLBufferSize() const {
+		return buffer_.size_in_bytes_;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	bool GLBufferObjectHolder::isEvictable() const {
+		// Mega-buffer ranges would not give memory back.
+		return buffer_.use_shadow_buffer_ && !mega_buffer_ && !buffer_.isLocked();
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void GLBufferObjectHolder::evict() {
+		assert(resident_ && isEvictable());
+		gl_manager_->getStateCacheManager()->deleteGLBuffer(target_, buffer_id_);
+		buffer_id_ = 0;
+		resident_ = false;
+		// Shadow buffer is uploaded as a whole on restore.
+		buffer_.dirty_ranges_.clear();
+		buffer_.shadow_updated_ = false;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void GLBufferObjectHolder::restore() {
+		assert(!resident_);
+		glGenBuffersARB(1, &buffer_id_);
+		assert(buffer_id_);
+		gl_manager_->getStateCacheManager()->bindGLBuffer(target_, buffer_id_);
+		glBufferDataARB(target_, buffer_.size_in_bytes_, nullptr, gl_usage_);
+		uploadShadowRange(target_, *buffer_.shadow_buffer_, 0, 0, buffer_.size_in_bytes_);
+		resident_ = true;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void GLBufferObjectHolder::readGLBuffer(size_t offset, size_t size, void * dest) {
+		if (buffer_.use_shadow_buffer_) {
 			// Reads data from shadow buffer.
-			void * src = shadow_buffer_->lock(offset, size, HBL_READ_ONLY);
-			memcpy(dest, src, size);
-			shadow_buffer_->unlock();
+			buffer_.shadow_buffer_->readData(offset, size, dest);
 		}
 		else {
 			// Reads data from real buffer.
-			static_cast<GLHardwareBufferManager *>(manager_)->getStateCacheManager()->bindGLBuffer(GL_ARRAY_BUFFER_ARB, buffer_id_);
-			glGetBufferSubDataARB(GL_ARRAY_BUFFER_ARB, offset, size, dest);
+			gl_manager_->getStateCacheManager()->bindGLBuffer(target_, buffer_id_);
+			glGetBufferSubDataARB(target_, buffer_.base_offset_ + offset, size, dest);
 		}
 	}
 	//--------------------------------------------------------------------------------------------------------------------------------
-	void GLHardwareVertexBuffer::writeData(size_t offset, size_t size, const void * src,
-										   bool discard_whole_buffer) {
+	HardwareBufferReadbackPtr GLBufferObjectHolder::readGLBufferAsync(size_t offset, size_t size) {
+		// Shadow buffer is read from system memory, and without copy buffer and sync objects there is no way not to stall.
+		if (buffer_.use_shadow_buffer_ || !gl_manager_->isAsyncReadbackSupported())
+			return buffer_.HardwareBuffer::readDataAsync(offset, size);
+		assert(offset + size <= buffer_.size_in_bytes_);
+		HardwareBufferReadbackPtr readback = std::make_shared<HardwareBufferReadback>(offset, size);
+		gl_manager_->queueReadback(buffer_id_, buffer_.base_offset_ + offset, readback);
+		return readback;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void GLBufferObjectHolder::writeGLBuffer(size_t offset, size_t size, const void * src, bool discard_whole_buffer) {
+		write_history_.notifyWrite();
 		// Updates shadow buffer.
-		if (use_shadow_buffer_) {
-			void * dest = shadow_buffer_->lock(offset, size, discard_whole_buffer ? HBL_DISCARD : HBL_WRITE_ONLY);
-			memcpy(dest, src, size);
-			shadow_buffer_->unlock();
-		}
-		// Updates vertex buffer.
-		static_cast<GLHardwareBufferManager *>(manager_)->getStateCacheManager()->bindGLBuffer(GL_ARRAY_BUFFER_ARB, buffer_id_);
-		if (offset == 0 && size == size_in_bytes_) {
-			glBufferDataARB(GL_ARRAY_BUFFER_ARB, size, src, GLHardwareBufferManager::getGLUsage(usage_));
+		if (buffer_.use_shadow_buffer_)
+			buffer_.shadow_buffer_->writeData(offset, size, src, discard_whole_buffer);
+		// Evicted buffers are recreated from shadow buffer when used again.
+		if (!resident_)
+			return;
+		// Updates buffer object.
+		gl_manager_->getStateCacheManager()->bindGLBuffer(target_, buffer_id_);
+		// Sub-allocated buffers share their buffer object, so it must never be respecified.
+		if (offset == 0 && size == buffer_.size_in_bytes_ && !mega_buffer_) {
+			glBufferDataARB(target_, size, src, gl_usage_);
 		}
 		else {
-			if (discard_whole_buffer) {
-				glBufferDataARB(GL_ARRAY_BUFFER_ARB, size_in_bytes_, nullptr, GLHardwareBufferManager::getGLUsage(usage_));
+			if (discard_whole_buffer && !mega_buffer_) {
+				glBufferDataARB(target_, buffer_.size_in_bytes_, nullptr, gl_usage_);
 			}
-			glBufferSubDataARB(GL_ARRAY_BUFFER_ARB, offset, size, src);
+			glBufferSubDataARB(target_, buffer_.base_offset_ + offset, size, src);
 		}
 	}
 	//--------------------------------------------------------------------------------------------------------------------------------
-	void GLHardwareVertexBuffer::updateFromShadow() {
-		if (use_shadow_buffer_ && shadow_updated_ && !suppress_hardware_update_) {
-			const void * src = shadow_buffer_->lock(lock_offset_, lock_size_, HBL_READ_ONLY);
-			static_cast<GLHardwareBufferManager *>(manager_)->getStateCacheManager()->bindGLBuffer(GL_ARRAY_BUFFER_ARB, buffer_id_);
-			if (lock_offset_ == 0 && lock_size_ == size_in_bytes_) {
-				glBufferDataARB(GL_ARRAY_BUFFER_ARB, size_in_bytes_, src, GLHardwareBufferManager::getGLUsage(usage_));
+	void GLBufferObjectHolder::copyGLBuffer(HardwareBuffer & src_buffer, size_t src_offset, size_t dest_offset, size_t size,
+											bool discard_whole_buffer) {
+		GLBufferObjectHolder * gl_src_buffer = dynamic_cast<GLBufferObjectHolder *>(&src_buffer);
+		// Shadowed buffers are copied in system memory, and non GL buffers have no buffer object to copy from.
+		if (buffer_.use_shadow_buffer_ || src_buffer.hasShadowBuffer() || !gl_src_buffer || !GLEW_ARB_copy_buffer) {
+			buffer_.HardwareBuffer::copyData(src_buffer, src_offset, dest_offset, size, discard_whole_buffer);
+			return;
+		}
+		assert(src_offset + size <= src_buffer.getSizeInBytes());
+		assert(dest_offset + size <= buffer_.size_in_bytes_);
+		GLuint src_buffer_id = gl_src_buffer->getGLBufferId();
+		size_t read_offset = src_buffer.getBaseOffset() + src_offset;
+		size_t write_offset = buffer_.base_offset_ + dest_offset;
+		// Overlapping ranges of one buffer object cannot be copied on GPU.
+		if (src_buffer_id == buffer_id_ && read_offset < write_offset + size && write_offset < read_offset + size) {
+			buffer_.HardwareBuffer::copyData(src_buffer, src_offset, dest_offset, size, discard_whole_buffer);
+			return;
+		}
+		write_history_.notifyWrite();
+		GLStateCacheManager * state_cache_manager = gl_manager_->getStateCacheManager();
+		state_cache_manager->bindGLBuffer(GL_COPY_READ_BUFFER, src_buffer_id);
+		state_cache_manager->bindGLBuffer(GL_COPY_WRITE_BUFFER, buffer_id_);
+		if (discard_whole_buffer && !mega_buffer_ && src_buffer_id != buffer_id_) {
+			glBufferDataARB(GL_COPY_WRITE_BUFFER, buffer_.size_in_bytes_, nullptr, gl_usage_);
+		}
+		glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, read_offset, write_offset, size);
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void GLBufferObjectHolder::updateGLBufferFromShadow() {
+		if (buffer_.use_shadow_buffer_ && buffer_.shadow_updated_ && !buffer_.suppress_hardware_update_) {
+			write_history_.notifyWrite();
+			// Evicted buffer is recreated from whole shadow buffer when it is bound again.
+			if (!resident_) {
+				buffer_.dirty_ranges_.clear();
+				buffer_.shadow_updated_ = false;
+				return;
+			}
+			gl_manager_->getStateCacheManager()->bindGLBuffer(target_, buffer_id_);
+			const HardwareBufferDirtyRanges::RangeList & ranges = buffer_.dirty_ranges_.getRanges();
+			size_t size_in_bytes = buffer_.size_in_bytes_;
+			if (ranges.size() == 1 && ranges.front().offset == 0 && ranges.front().size == size_in_bytes && !mega_buffer_) {
+				// Respecified, so driver need not wait for draws still reading old contents.
+				glBufferDataARB(target_, size_in_bytes, nullptr, gl_usage_);
+				uploadShadowRange(target_, *buffer_.shadow_buffer_, 0, 0, size_in_bytes);
 			}
 			else {
-				glBufferSubDataARB(GL_ARRAY_BUFFER_ARB, lock_offset_, lock_size_, src);
+				// Uploads all coalesced ranges in one batch, straight from chunks of shadow storage.
+				for (auto & range : ranges)
+					uploadShadowRange(target_, *buffer_.shadow_buffer_, buffer_.base_offset_, range.offset, range.size);
 			}
-			shadow_buffer_->unlock();
-			shadow_updated_ = false;
+			buffer_.dirty_ranges_.clear();
+			buffer_.shadow_updated_ = false;
 		}
 	}
 	//--------------------------------------------------------------------------------------------------------------------------------
-	void * GLHardwareVertexBuffer::lockImpl(size_t offset, size_t size, LockOption option) {
-		if (locked_) {
+	void * GLBufferObjectHolder::lockGLBuffer(size_t offset, size_t size, HardwareBuffer::LockOption option) {
+		if (buffer_.locked_) {
 			return nullptr;
 		}
 		void * ret = nullptr;
-		GLHardwareBufferManager * gl_buffer_manager = static_cast<GLHardwareBufferManager*>(HardwareBufferManager::getSingletonPtr());
 		// If buffer size is smaller enough, uses scratch buffer instead.
-		if (size < gl_buffer_manager->getGLMapBufferThreshold()) {
-			ret = gl_buffer_manager->allocateScratch((unsigned int)size);
+		if (size < gl_manager_->getGLMapBufferThreshold()) {
+			ret = gl_manager_->allocateScratch((unsigned int)size);
 			if (ret) {
 				locked_to_scratch_ = true;
 				scratch_ = ret;
+				scratch_offset_ = offset;
+				scratch_size_ = size;
+				// Read only locks leave buffer untouched.
+				scratch_upload_on_unlock_ = (option != HardwareBuffer::HBL_READ_ONLY);
 				// If LockOption is not discard nor no_overwrite, reads data from real buffer to scratch buffer.
-				if (option != HBL_DISCARD && option != HBL_NO_OVERWRITE)
-					readData(offset, size, ret);
+				if (option != HardwareBuffer::HBL_DISCARD && option != HardwareBuffer::HBL_NO_OVERWRITE)
+					buffer_.readData(offset, size, ret);
 			}
 		}
 		// Scratches allocation failed or size is above threshold.
 		if(!ret) {
 			locked_to_scratch_ = false;
 			// Uses glMapBuffer.
-			static_cast<GLHardwareBufferManager *>(manager_)->getStateCacheManager()->bindGLBuffer(GL_ARRAY_BUFFER_ARB, buffer_id_);
-			if (option == HBL_DISCARD || option == HBL_NO_OVERWRITE) {
-				// Discards the buffer.
-				glBufferDataARB(GL_ARRAY_BUFFER_ARB, size_in_bytes_, nullptr, GLHardwareBufferManager::getGLUsage(usage_));
-				GLenum error = glGetError();
-				if (error) {
-					static_cast<GLHardwareBufferManager *>(manager_)->getStateCacheManager()->deleteGLBuffer(GL_ARRAY_BUFFER_ARB, buffer_id_);
-					buffer_id_ = 0;
-					glGenBuffersARB(1, &buffer_id_);
-					static_cast<GLHardwareBufferManager *>(manager_)->getStateCacheManager()->bindGLBuffer(GL_ARRAY_BUFFER_ARB, buffer_id_);
-					glBufferDataARB(GL_ARRAY_BUFFER_ARB, size_in_bytes_, nullptr, GLHardwareBufferManager::getGLUsage(usage_));
+			if (option != HardwareBuffer::HBL_READ_ONLY)
+				write_history_.notifyWrite();
+			GLStateCacheManager * state_cache_manager = gl_manager_->getStateCacheManager();
+			state_cache_manager->bindGLBuffer(target_, buffer_id_);
+			if (mega_buffer_) {
+				// Maps only own range of shared mega-buffer.
+				GLbitfield access = 0;
+				if (option == HardwareBuffer::HBL_DISCARD)
+					access = GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT;
+				else if (option == HardwareBuffer::HBL_NO_OVERWRITE)
+					access = GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT;
+				else if (option == HardwareBuffer::HBL_READ_ONLY)
+					access = GL_MAP_READ_BIT;
+				else if (buffer_.usage_ & HardwareBuffer::HBU_WRITE_ONLY)
+					access = GL_MAP_WRITE_BIT;
+				else
+					access = GL_MAP_READ_BIT | GL_MAP_WRITE_BIT;
+				ret = glMapBufferRange(target_, buffer_.base_offset_ + offset, size, access);
+				assert(ret);
+			}
+			else {
+				if (option == HardwareBuffer::HBL_DISCARD || option == HardwareBuffer::HBL_NO_OVERWRITE) {
+					// Discards the buffer.
+					glBufferDataARB(target_, buffer_.size_in_bytes_, nullptr, gl_usage_);
+					GLenum error = glGetError();
+					if (error) {
+						state_cache_manager->deleteGLBuffer(target_, buffer_id_);
+						buffer_id_ = 0;
+						glGenBuffersARB(1, &buffer_id_);
+						state_cache_manager->bindGLBuffer(target_, buffer_id_);
+						glBufferDataARB(target_, buffer_.size_in_bytes_, nullptr, gl_usage_);
+					}
 				}
+				GLenum access = 0;
+				if (buffer_.usage_ & HardwareBuffer::HBU_WRITE_ONLY)
+					access = GL_WRITE_ONLY_ARB;
+				else if (option == HardwareBuffer::HBL_READ_ONLY)
+					access = GL_READ_ONLY_ARB;
+				else
+					access = GL_READ_WRITE_ARB;
+				void * buffer = glMapBufferARB(target_, access);
+				assert(buffer);
+				// Returns offsetted pointer.
+				ret = static_cast<void *>(static_cast<unsigned char *>(buffer) + offset);
 			}
-			GLenum access = 0;
-			if (usage_ & HBU_WRITE_ONLY)
-				access = GL_WRITE_ONLY_ARB;
-			else if (option == HBL_READ_ONLY)
-				access = GL_READ_ONLY_ARB;
-			else
-				access = GL_READ_WRITE_ARB;
-			void * buffer = glMapBufferARB(GL_ARRAY_BUFFER_ARB, access);
-			assert(buffer);
-			// Returns offsetted pointer.
-			ret = static_cast<void *>(static_cast<unsigned char *>(buffer) + offset);
 		}
-		locked_ = true;
+		buffer_.locked_ = true;
 		return ret;
 	}
 	//--------------------------------------------------------------------------------------------------------------------------------
-	void GLHardwareVertexBuffer::unlockImpl() {
+	void GLBufferObjectHolder::unlockGLBuffer() {
 		if (locked_to_scratch_) {
 			if (scratch_upload_on_unlock_) {
-				// Writes data back to vertex buffer from scratch buffer.
-				writeData(scratch_offset_, scratch_size_, scratch_, scratch_offset_ == 0 && scratch_size_ == getSizeInBytes());
+				// Writes data back to buffer object from scratch buffer.
+				buffer_.writeData(scratch_offset_, scratch_size_, scratch_, scratch_offset_ == 0 && scratch_size_ == buffer_.size_in_bytes_);
 			}
 			// Deallocates memory from scratch buffer.
-			static_cast<GLHardwareBufferManager*>(HardwareBufferManager::getSingletonPtr())->deallocateScratch(scratch_);
+			gl_manager_->deallocateScratch(scratch_);
 			locked_to_scratch_ = false;
 		}
 		else {
 			// Uses glUnmapBuffer.
-			static_cast<GLHardwareBufferManager *>(manager_)->getStateCacheManager()->bindGLBuffer(GL_ARRAY_BUFFER_ARB, buffer_id_);
-			assert(glUnmapBufferARB(GL_ARRAY_BUFFER_ARB));
+			gl_manager_->getStateCacheManager()->bindGLBuffer(target_, buffer_id_);
+			GLboolean unmapped = glUnmapBufferARB(target_);
+			assert(unmapped);
+			(void)unmapped;
 		}
-		locked_ = false;
+		buffer_.locked_ = false;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	// GLHardwareVertexBuffer
+	//--------------------------------------------------------------------------------------------------------------------------------
+	GLHardwareVertexBuffer::GLHardwareVertexBuffer(HardwareBufferManager * manager,
+												   size_t vertex_size,
+												   size_t vertex_num,
+												   HardwareBuffer::Usage usage,
+												   bool use_shadow_buffer)
+	: HardwareVertexBuffer(manager, vertex_size, vertex_num, usage, false, use_shadow_buffer),
+	GLBufferObjectHolder(*this, static_cast<GLHardwareBufferManager *>(manager), GL_ARRAY_BUFFER_ARB, vertex_size) {
+		
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void GLHardwareVertexBuffer::readData(size_t offset, size_t size, void * dest) {
+		readGLBuffer(offset, size, dest);
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	HardwareBufferReadbackPtr GLHardwareVertexBuffer::readDataAsync(size_t offset, size_t size) {
+		return readGLBufferAsync(offset, size);
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void GLHardwareVertexBuffer::writeData(size_t offset, size_t size, const void * src, bool discard_whole_buffer) {
+		writeGLBuffer(offset, size, src, discard_whole_buffer);
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void GLHardwareVertexBuffer::copyData(HardwareBuffer & src_buffer, size_t src_offset, size_t dest_offset, size_t size,
+										bool discard_whole_buffer) {
+		copyGLBuffer(src_buffer, src_offset, dest_offset, size, discard_whole_buffer);
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void GLHardwareVertexBuffer::updateFromShadow() {
+		updateGLBufferFromShadow();
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void * GLHardwareVertexBuffer::lockImpl(size_t offset, size_t size, LockOption option) {
+		return lockGLBuffer(offset, size, option);
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void GLHardwareVertexBuffer::unlockImpl() {
+		unlockGLBuffer();
 	}
 }
+
+namespace Astero {
+	//--------------------------------------------------------------------------------------------------------------------------------
+	// HardwareIndexBuffer
+	//--------------------------------------------------------------------------------------------------------------------------------
+	HardwareIndexBuffer::HardwareIndexBuffer(HardwareBufferManager * manager,
+											 IndexType index_type,
+											 size_t index_num,
+											 HardwareBuffer::Usage usage,
+											 bool use_system_memory,
+											 bool use_shadow_buffer)
+	: HardwareBuffer(usage, use_system_memory, use_shadow_buffer), manager_(manager), index_type_(index_type), index_num_(index_num) {
+		index_size_ = (index_type_ == IT_16BIT) ? sizeof(unsigned short) : sizeof(unsigned int);
+		size_in_bytes_ = index_size_ * index_num_;
+		if (use_shadow_buffer_) {
+			shadow_buffer_ = new DefaultHardwareIndexBuffer(index_type_, index_num_, HardwareBuffer::HBU_DYNAMIC);
+		}
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	HardwareIndexBuffer::~HardwareIndexBuffer() {
+		delete shadow_buffer_;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	// DefaultHardwareIndexBuffer
+	//--------------------------------------------------------------------------------------------------------------------------------
+	DefaultHardwareIndexBuffer::DefaultHardwareIndexBuffer(IndexType index_type, size_t index_num, HardwareBuffer::Usage usage)
+	: HardwareIndexBuffer(nullptr, index_type, index_num, usage, true, false), storage_(size_in_bytes_) {
+		
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	DefaultHardwareIndexBuffer::DefaultHardwareIndexBuffer(HardwareBufferManager * manager, IndexType index_type,
+														   size_t index_num, HardwareBuffer::Usage usage)
+	: HardwareIndexBuffer(manager, index_type, index_num, usage, true, false), storage_(size_in_bytes_) {
+		
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	DefaultHardwareIndexBuffer::~DefaultHardwareIndexBuffer() {
+		
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void DefaultHardwareIndexBuffer::readData(size_t offset, size_t size, void * dest) {
+		assert((offset + size) <= size_in_bytes_);
+		storage_.read(offset, size, dest);
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void DefaultHardwareIndexBuffer::writeData(size_t offset, size_t size, const void * source, bool discard_whole_buffer) {
+		assert((offset + size) <= size_in_bytes_);
+		storage_.write(offset, size, source);
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void * DefaultHardwareIndexBuffer::lock(size_t offset, size_t size, LockOption option) {
+		locked_ = true;
+		return storage_.lock(offset, size, option == HBL_READ_ONLY, option == HBL_DISCARD || option == HBL_NO_OVERWRITE);
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void DefaultHardwareIndexBuffer::unlock() {
+		storage_.unlock();
+		locked_ = false;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void DefaultHardwareIndexBuffer::copyData(HardwareBuffer & src_buffer, size_t src_offset, size_t dest_offset, size_t size,
+											  bool discard_whole_buffer) {
+		const SharedBufferStorage * src_storage = getDefaultBufferStorage(src_buffer);
+		if (src_storage) {
+			assert(dest_offset + size <= size_in_bytes_);
+			storage_.share(*src_storage, src_offset, dest_offset, size);
+		}
+		else {
+			HardwareBuffer::copyData(src_buffer, src_offset, dest_offset, size, discard_whole_buffer);
+		}
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	const SharedBufferStorage & DefaultHardwareIndexBuffer::getStorage() const {
+		return storage_;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void * DefaultHardwareIndexBuffer::lockImpl(size_t offset, size_t size, LockOption option) {
+		return storage_.lock(offset, size, option == HBL_READ_ONLY, option == HBL_DISCARD || option == HBL_NO_OVERWRITE);
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void DefaultHardwareIndexBuffer::unlockImpl() {
+		storage_.unlock();
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	// GLHardwareIndexBuffer
+	//--------------------------------------------------------------------------------------------------------------------------------
+	GLHardwareIndexBuffer::GLHardwareIndexBuffer(HardwareBufferManager * manager,
+												 IndexType index_type,
+												 size_t index_num,
+												 HardwareBuffer::Usage usage,
+												 bool use_shadow_buffer)
+	: HardwareIndexBuffer(manager, index_type, index_num, usage, false, use_shadow_buffer),
+	GLBufferObjectHolder(*this, static_cast<GLHardwareBufferManager *>(manager), GL_ELEMENT_ARRAY_BUFFER_ARB, index_size_) {
+		
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void GLHardwareIndexBuffer::readData(size_t offset, size_t size, void * dest) {
+		readGLBuffer(offset, size, dest);
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	HardwareBufferReadbackPtr GLHardwareIndexBuffer::readDataAsync(size_t offset, size_t size) {
+		return readGLBufferAsync(offset, size);
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void GLHardwareIndexBuffer::writeData(size_t offset, size_t size, const void * src, bool discard_whole_buffer) {
+		writeGLBuffer(offset, size, src, discard_whole_buffer);
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void GLHardwareIndexBuffer::copyData(HardwareBuffer & src_buffer, size_t src_offset, size_t dest_offset, size_t size,
+									   bool discard_whole_buffer) {
+		copyGLBuffer(src_buffer, src_offset, dest_offset, size, discard_whole_buffer);
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void GLHardwareIndexBuffer::updateFromShadow() {
+		updateGLBufferFromShadow();
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void * GLHardwareIndexBuffer::lockImpl(size_t offset, size_t size, LockOption option) {
+		return lockGLBuffer(offset, size, option);
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void GLHardwareIndexBuffer::unlockImpl() {
+		unlockGLBuffer();
+	}
+} // namespace Astero
@@ -9,12 +9,129 @@
 #ifndef AsteroHardwareBuffer_h
 #define AsteroHardwareBuffer_h
 
+#include <atomic>
+#include <functional>
+
 #include <GL/glew.h>
 #include <OpenGL/glu.h>
 
 #include "AsteroPrerequisites.h"
 
+// Dirty ranges of a shadowed buffer closer than this many bytes are uploaded together.
+#define DEFAULT_DIRTY_RANGE_MERGE_GAP 256
+// Number of frames of write history kept per GL buffer, at most 32.
+#define GL_BUFFER_WRITE_HISTORY_FRAMES 32
+// Bytes per chunk of copy-on-write buffer storage.
+#define SHARED_BUFFER_STORAGE_CHUNK_SIZE 4096
+
 namespace Astero {
+	// Sorted set of byte ranges of a buffer which have been modified but not uploaded yet. Ranges which overlap, touch, or
+	// are separated by no more than merge gap are coalesced, trading a few redundant bytes for fewer upload calls.
+	class HardwareBufferDirtyRanges {
+	public:
+		struct Range {
+			size_t offset;
+			size_t size;
+		};
+		typedef std::vector<Range> RangeList;
+		
+		explicit HardwareBufferDirtyRanges(size_t merge_gap = DEFAULT_DIRTY_RANGE_MERGE_GAP);
+		
+		// Marks a range as dirty, merging it with nearby ranges.
+		void add(size_t offset, size_t size);
+		void clear();
+		bool empty() const;
+		// Ranges sorted by offset.
+		const RangeList & getRanges() const;
+		// Total bytes to upload, including merged gaps.
+		size_t getDirtyBytes() const;
+		size_t getMergeGap() const;
+		void setMergeGap(size_t merge_gap);
+		
+	protected:
+		RangeList ranges_;
+		size_t merge_gap_;
+	};
+	
+	// Ticket of an asynchronous read of buffer contents. Hardware buffers fill it on a later frame once GPU has finished
+	// copying, so polling isReady() never stalls the pipeline. Status may be polled from any thread.
+	class HardwareBufferReadback {
+	public:
+		enum Status {
+			RS_PENDING,
+			RS_READY
+		};
+		
+		HardwareBufferReadback(size_t offset, size_t size);
+		
+		Status getStatus() const;
+		bool isReady() const;
+		size_t getOffset() const;
+		size_t getSize() const;
+		// Read data, only valid once ready.
+		const void * getData() const;
+		// Destination of read data, used by hardware buffer backends.
+		void * getDataForWrite();
+		// Marks read data as available.
+		void notifyReady();
+		
+	protected:
+		size_t offset_;
+		size_t size_;
+		std::vector<unsigned char> data_;
+		std::atomic<Status> status_;
+	};
+	
+	// Byte storage split into fixed size chunks which may be shared by several storages, so a copy only pays memory for
+	// chunks it actually changes. Chunks are allocated on first write and read as zeros before. A lock of a range within
+	// one chunk returns a pointer into the chunk; other ranges are staged in a contiguous copy, which is written back on
+	// unlock. A storage must not be written while another storage shares from it.
+	class SharedBufferStorage {
+	public:
+		explicit SharedBufferStorage(size_t size);
+		~SharedBufferStorage();
+		// Owns staging and contiguous memory, use share() to copy contents.
+		SharedBufferStorage(const SharedBufferStorage &) = delete;
+		SharedBufferStorage & operator=(const SharedBufferStorage &) = delete;
+		
+		size_t getSize() const;
+		void read(size_t offset, size_t size, void * dest) const;
+		void write(size_t offset, size_t size, const void * src);
+		// Copies a range of another storage, sharing its chunks instead where both ranges cover whole chunks.
+		void share(const SharedBufferStorage & src_storage, size_t src_offset, size_t dest_offset, size_t size);
+		// Locks a range. With discard, previous contents of range are not kept, so a staged lock skips reading them.
+		void * lock(size_t offset, size_t size, bool read_only, bool discard = false);
+		void unlock();
+		bool isLocked() const;
+		// Calls visitor with each part of a range lying in one chunk, e.g. to upload it without gathering it first. Chunks
+		// not written yet are passed as zeros.
+		void visitChunks(size_t offset, size_t size, const std::function<void(size_t, const void *, size_t)> & visitor) const;
+		// Contents gathered in contiguous memory, e.g. for client side vertex arrays. Valid until storage is modified.
+		const void * getContiguousData() const;
+		// Bytes of allocated chunks, and of those also referenced by other storages.
+		size_t getAllocatedBytes() const;
+		size_t getSharedBytes() const;
+		
+	protected:
+		typedef std::shared_ptr<unsigned char> ChunkPtr;
+		
+		// Returns chunk for modification, allocating it or copying it if it is shared.
+		unsigned char * getChunkForWrite(size_t index);
+		
+		std::vector<ChunkPtr> chunks_;
+		size_t size_;
+		bool locked_;
+		// Whether staged range has to be written back on unlock.
+		bool lock_write_back_;
+		size_t lock_offset_;
+		size_t lock_size_;
+		// Contiguous copy of a locked range spanning several chunks.
+		unsigned char * staging_;
+		size_t staging_capacity_;
+		mutable unsigned char * contiguous_;
+		mutable bool contiguous_valid_;
+	};
+	
 	class HardwareBuffer {
 	public:
 		enum Usage {
@@ -40,20 +157,36 @@ namespace Astero {
 		void * lock(LockOption);
 		virtual void unlock(void);
 		virtual void readData(size_t offset, size_t size, void * dest) = 0;
+		// Reads data without waiting for GPU. Returned readback becomes ready on a later frame; buffers which have no
+		// asynchronous path read immediately and return a readback which is ready already.
+		virtual HardwareBufferReadbackPtr readDataAsync(size_t offset, size_t size);
 		virtual void writeData(size_t offset, size_t size, const void * src,
 							   bool discard_whole_buffer = false) = 0;
+		// Copies data from another buffer. If both buffers have shadow buffers, only shadow buffers are copied and copied
+		// range is uploaded lazily.
 		virtual void copyData(HardwareBuffer & src_buffer, size_t src_offset,
 							  size_t dest_offset, size_t size,
 							  bool discard_whole_buffer = false);
+		// Copies as much of another buffer as fits.
 		virtual void copyData(HardwareBuffer & src_buffer);
+		// Uploads all dirty ranges of shadow buffer to hardware buffer. Shadowed buffers are not uploaded on unlock, but lazily
+		// before they are bound for drawing.
 		virtual void updateFromShadow();
 		size_t getSizeInBytes() const;
 		Usage getUsage() const;
 		bool hasShadowBuffer() const;
 		bool isLocked() const;
+		// Offset in bytes of buffer contents in underlying storage, non-zero when buffer is sub-allocated.
+		size_t getBaseOffset() const;
+		// Whether shadow buffer has modifications not uploaded to hardware buffer yet.
+		bool isShadowDirty() const;
+		const HardwareBufferDirtyRanges & getDirtyRanges() const;
+		// Sets the largest gap in bytes between two dirty ranges which are still uploaded as one.
+		void setDirtyRangeMergeGap(size_t merge_gap);
 	
 	protected:
 		size_t size_in_bytes_;
+		size_t base_offset_;
 		Usage usage_;
 		bool locked_;
 		size_t lock_offset_;
@@ -63,9 +196,14 @@ namespace Astero {
 		HardwareBuffer * shadow_buffer_;
 		bool shadow_updated_;
 		bool suppress_hardware_update_;
+		// Ranges of shadow buffer written since last upload.
+		HardwareBufferDirtyRanges dirty_ranges_;
 		
 		virtual void * lockImpl(size_t offset, size_t size, LockOption option) = 0;
 		virtual void unlockImpl(void) = 0;
+		
+		// Implements GL vertex and index buffers on their behalf.
+		friend class GLBufferObjectHolder;
 	};
 	
 	template<typename T> struct HardwareBufferLockGuard {
@@ -331,7 +469,9 @@ namespace Astero {
 		
 		const VertexElementList getElements() const;
 		void sort();
-		virtual const VertexElement & addElement();
+		// Adds an element to end of declaration.
+		virtual const VertexElement & addElement(unsigned short source, size_t offset, VertexElementType type,
+												 VertexElementSemantic semantic, unsigned short index = 0);
 		virtual const VertexElement & insertElement();
 	protected:
 		VertexElementList vertex_element_list_;
@@ -363,15 +503,25 @@ namespace Astero {
 		DefaultHardwareVertexBuffer(size_t vertex_size,
 									size_t vertex_num,
 									HardwareBuffer::Usage usage);
+		// Creates a vertex buffer owned by a manager, e.g. DefaultHardwareBufferManager.
+		DefaultHardwareVertexBuffer(HardwareBufferManager * manager,
+									size_t vertex_size,
+									size_t vertex_num,
+									HardwareBuffer::Usage usage);
 		~DefaultHardwareVertexBuffer();
 		
 		void * lock(size_t offset, size_t size, LockOption option) override;
 		void unlock()  override;
 		void readData(size_t offset, size_t size, void * dest) override;
 		void writeData(size_t offset, size_t size, const void * src, bool discard_whole_buffer = false) override;
+		using HardwareBuffer::copyData;
+		// Shares chunks of source storage if source is a default buffer.
+		void copyData(HardwareBuffer & src_buffer, size_t src_offset, size_t dest_offset, size_t size,
+					  bool discard_whole_buffer = false) override;
+		const SharedBufferStorage & getStorage() const;
 		
 	protected:
-		unsigned char * data_;
+		SharedBufferStorage storage_;
 		void * lockImpl(size_t offset, size_t size, LockOption option) override;
 		void unlockImpl() override;
 	};
@@ -379,34 +529,139 @@ namespace Astero {
 } // namespace Astero
 
 namespace Astero {
+	class GLMegaBuffer;
+	class GLHardwareBufferManager;
+	struct GLBufferMemoryAccount;
+	
+	// Sliding window recording in which recent frames a GL buffer has been written.
+	class GLBufferWriteHistory {
+	public:
+		GLBufferWriteHistory();
+		
+		void notifyWrite();
+		// Closes current frame and shifts it into window.
+		void advanceFrame();
+		// Forgets all frames, e.g. after buffer usage has been changed.
+		void reset();
+		// Number of frames in window, up to GL_BUFFER_WRITE_HISTORY_FRAMES.
+		unsigned int getFrameCount() const;
+		// Number of frames in window in which buffer has been written.
+		unsigned int getWrittenFrameCount() const;
+		
+	protected:
+		// One bit per frame, most recent frame in lowest bit.
+		unsigned int history_;
+		unsigned int frame_count_;
+		bool written_;
+	};
+	
+	// OpenGL buffer object holding contents of a hardware vertex or index buffer, possibly shared with other buffers. Implements
+	// GL side of the buffer once for both types, which only differ in target and alignment.
+	class GLBufferObjectHolder {
+	public:
+		GLBufferObjectHolder(HardwareBuffer & buffer, GLHardwareBufferManager * manager, GLenum target, size_t alignment);
+		virtual ~GLBufferObjectHolder();
+		GLuint getGLBufferId() const {
+			return buffer_id_;
+		}
+		GLenum getGLTarget() const {
+			return target_;
+		}
+		// Called when contents have been moved to another buffer object or offset, e.g. by mega-buffer compaction.
+		void notifyGLBufferRelocated(GLuint buffer_id, size_t base_offset);
+		// Whether buffer is locked, in which case its buffer object must not be moved.
+		bool isGLBufferLocked() const;
+		// GL usage hint buffer object has been created with, which may differ from usage requested at creation.
+		GLenum getGLUsage() const;
+		// Recreates buffer object with another usage hint, copying contents on GPU. Returns false if buffer can not be
+		// moved now, e.g. while it is locked.
+		bool setGLUsage(GLenum gl_usage);
+		// Offset in bytes of buffer contents in buffer object.
+		size_t getGLBufferOffset() const;
+		// Size in bytes of buffer contents on GPU.
+		size_t getGLBufferSize() const;
+		// Alignment in bytes of buffer contents when sub-allocated, the vertex or index size.
+		size_t getGLBufferAlignment() const {
+			return alignment_;
+		}
+		// Whether buffer object may be deleted to free GPU memory, which requires a shadow buffer to recreate it from.
+		bool isEvictable() const;
+		// Deletes buffer object, keeping contents in shadow buffer only.
+		void evict();
+		// Recreates buffer object from shadow buffer.
+		void restore();
+		bool isResident() const {
+			return resident_;
+		}
+		// Whether buffer is a range of a shared mega-buffer rather than a buffer object of its own.
+		bool isSubAllocated() const {
+			return mega_buffer_ != nullptr;
+		}
+		GLBufferWriteHistory & getWriteHistory() {
+			return write_history_;
+		}
+		
+	protected:
+		typedef std::list<GLBufferObjectHolder *>::iterator LRUIterator;
+		
+		// Implementations of HardwareBuffer overrides, which GL buffers forward to.
+		void readGLBuffer(size_t offset, size_t size, void * dest);
+		HardwareBufferReadbackPtr readGLBufferAsync(size_t offset, size_t size);
+		void writeGLBuffer(size_t offset, size_t size, const void * src, bool discard_whole_buffer);
+		void copyGLBuffer(HardwareBuffer & src_buffer, size_t src_offset, size_t dest_offset, size_t size, bool discard_whole_buffer);
+		void updateGLBufferFromShadow();
+		void * lockGLBuffer(size_t offset, size_t size, HardwareBuffer::LockOption option);
+		void unlockGLBuffer();
+		
+		// Hardware buffer whose contents are held.
+		HardwareBuffer & buffer_;
+		GLHardwareBufferManager * gl_manager_;
+		GLenum target_;
+		size_t alignment_;
+		GLuint buffer_id_;
+		// Mega-buffer buffer contents are sub-allocated from, or nullptr if buffer has a buffer object of its own.
+		GLMegaBuffer * mega_buffer_;
+		GLenum gl_usage_;
+		GLBufferWriteHistory write_history_;
+		bool resident_;
+		// Small locks are served from scratch memory and written back on unlock.
+		bool locked_to_scratch_;
+		bool scratch_upload_on_unlock_;
+		size_t scratch_offset_;
+		size_t scratch_size_;
+		void * scratch_;
+		// Following members are maintained by GLHardwareBufferManager for memory accounting and residency.
+		bool in_lru_list_;
+		LRUIterator lru_iterator_;
+		unsigned long long last_used_frame_;
+		GLBufferMemoryAccount * resource_account_;
+		GLBufferMemoryAccount * group_account_;
+		
+		friend class GLHardwareBufferManager;
+	};
 
 	//--------------------------------------------------------------------------------------------------------------------------------
-	class GLHardwareVertexBuffer : public HardwareVertexBuffer {
+	class GLHardwareVertexBuffer : public HardwareVertexBuffer, public GLBufferObjectHolder {
 	public:
 		GLHardwareVertexBuffer(HardwareBufferManager * manager,
 							   size_t vertex_size,
 							   size_t vertex_num,
 							   HardwareBuffer::Usage usage,
 							   bool use_shadow_buffer);
-		~GLHardwareVertexBuffer();
 		
-		GLuint getGLBufferId() const;
 		void readData(size_t offset, size_t size, void * dest) override;
+		HardwareBufferReadbackPtr readDataAsync(size_t offset, size_t size) override;
 		void writeData(size_t offset, size_t size, const void * source,
 					   bool discard_whole_buffer = false) override;
+		using HardwareBuffer::copyData;
+		// Copies between two GL buffer objects on GPU.
+		void copyData(HardwareBuffer & src_buffer, size_t src_offset, size_t dest_offset, size_t size,
+					  bool discard_whole_buffer = false) override;
 		void updateFromShadow() override;
 		
 	protected:
 		void * lockImpl(size_t offset, size_t size, LockOption option) override;
 		void unlockImpl() override;
-
-	private:
-		GLuint buffer_id_;
-		bool locked_to_scratch_;
-		bool scratch_upload_on_unlock_;
-		size_t scratch_offset_;
-		size_t scratch_size_;
-		void * scratch_;
 	};
 
 } // namespace Astero
@@ -423,7 +678,14 @@ namespace Astero {
 		HardwareIndexBuffer(HardwareBufferManager * manager,
 							IndexType index_type,
 							size_t index_num,
+							HardwareBuffer::Usage usage,
+							bool use_system_memory,
 							bool use_shadow_buffer);
+		~HardwareIndexBuffer();
+		HardwareBufferManager * getManager() const {
+			return manager_;
+		}
+		
 		IndexType getType() const {
 			return index_type_;
 		}
@@ -432,55 +694,64 @@ namespace Astero {
 			return index_size_;
 		}
 		
+		size_t getIndexNum() const {
+			return index_num_;
+		}
+		
 	protected:
+		HardwareBufferManager * manager_;
 		IndexType index_type_;
 		size_t index_size_;
+		size_t index_num_;
 	};
-	class GLHardwareIndexBuffer : public HardwareIndexBuffer {
+	
+	typedef HardwareBufferLockGuard<HardwareIndexBufferPtr> HardwareIndexBufferLockGuard;
+	
+	class GLHardwareIndexBuffer : public HardwareIndexBuffer, public GLBufferObjectHolder {
 	public:
 		GLHardwareIndexBuffer(HardwareBufferManager * manager,
 							  IndexType index_type,
 							  size_t index_num,
 							  HardwareBuffer::Usage usage,
 							  bool use_shadow_buffer);
-		virtual void readData(size_t offset, size_t size, void * dest) {
-			
-		}
-		virtual void writeData(size_t offset, size_t size, const void * source,
-							   bool discard_whole_buffer = false) {
-			
-		}
-		virtual void copyData(HardwareBuffer & src_buffer, size_t src_offset,
-							  size_t dest_offset, size_t size,
-							  bool discard_whole_buffer = false) {
-			
-		}
-		GLuint getGLBufferId() const {return buffer_id_;}
+		
+		void readData(size_t offset, size_t size, void * dest) override;
+		HardwareBufferReadbackPtr readDataAsync(size_t offset, size_t size) override;
+		void writeData(size_t offset, size_t size, const void * source,
+					   bool discard_whole_buffer = false) override;
+		using HardwareBuffer::copyData;
+		// Copies between two GL buffer objects on GPU.
+		void copyData(HardwareBuffer & src_buffer, size_t src_offset, size_t dest_offset, size_t size,
+					  bool discard_whole_buffer = false) override;
+		void updateFromShadow() override;
+		
 	protected:
-		virtual void * lockImpl(size_t offset, size_t size, LockOption option) {
-			return nullptr;
-		}
-		virtual void unlockImpl(void) {
-			
-		}
-	private:
-		GLuint buffer_id_;
+		void * lockImpl(size_t offset, size_t size, LockOption option) override;
+		void unlockImpl() override;
 	};
 	
 	class DefaultHardwareIndexBuffer : public HardwareIndexBuffer
 	{
 	public:
 		DefaultHardwareIndexBuffer(IndexType index_type, size_t index_num, HardwareBuffer::Usage usage);
+		// Creates an index buffer owned by a manager, e.g. DefaultHardwareBufferManager.
+		DefaultHardwareIndexBuffer(HardwareBufferManager * manager, IndexType index_type, size_t index_num,
+								   HardwareBuffer::Usage usage);
 		~DefaultHardwareIndexBuffer();
 		void readData(size_t offset, size_t size, void * dest) override;
 		void writeData(size_t offset, size_t size, const void * source, bool discard_whole_buffer = false) override;
 		void * lock(size_t offset, size_t size, LockOption option) override;
 		void unlock() override;
+		using HardwareBuffer::copyData;
+		// Shares chunks of source storage if source is a default buffer.
+		void copyData(HardwareBuffer & src_buffer, size_t src_offset, size_t dest_offset, size_t size,
+					  bool discard_whole_buffer = false) override;
+		const SharedBufferStorage & getStorage() const;
 		
 	protected:
 		void * lockImpl(size_t offset, size_t size, LockOption option) override;
 		void unlockImpl() override;
-		unsigned char * data_;
+		SharedBufferStorage storage_;
 
 	};
 	
@@ -9,14 +9,26 @@
 #include <stdio.h>
 
 #include "AsteroHardwareBufferManager.h"
+#include "AsteroResource.h"
+#include "AsteroProfiler.h"
 
 namespace Astero {
+	template <> HardwareBufferManager * Singleton<HardwareBufferManager>::ptr_ = nullptr;
+	const size_t HardwareBufferManager::UNDER_USED_FRAME_THRESHOLD = 30000;
+	const size_t HardwareBufferManager::EXPIRED_DELAY_FRAME_THRESHOLD = 5;
 	//--------------------------------------------------------------------------------------------------------------------------------
-	HardwareBufferManager::HardwareBufferManager() : under_used_frame_count_(0) {
+	void HardwareBufferLicensee::licenseExpired(HardwareBuffer * /* buf */) {
+		
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	HardwareBufferManager::HardwareBufferManager() : under_used_frame_count_(0), upload_sequence_(0) {
 		
 	}
 	//--------------------------------------------------------------------------------------------------------------------------------
 	HardwareBufferManager::~HardwareBufferManager(){
+		for (auto upload : pending_uploads_)
+			cancelUpload(upload);
+		pending_uploads_.clear();
 		vertex_buffer_list_.clear();
 		index_buffer_list_.clear();
 		destroyAllVertexDeclarations();
@@ -49,34 +61,30 @@ namespace Astero {
 		destroyVertexBufferBindingImpl(binding);
 	}
 	//--------------------------------------------------------------------------------------------------------------------------------
-	void HardwareBufferManager::registerVertexBufferSourceAndCopy(const HardwareVertexBufferPtr & source_buffer,
+	void HardwareBufferManager::registerVertexBufferSourceAndCopy(const HardwareVertexBufferPtr & /* source_buffer */,
 												   const HardwareVertexBufferPtr & copy) {
-		Lock lock(temporary_buffer_mutex_);
-		free_temporary_vertex_buffer_map_.insert(FreeTemporaryVertexBufferMap::value_type(source_buffer.get(), copy));
+		// Copies are pooled by layout, not by source.
+		temporary_buffer_pool_.release(copy);
 	}
 	//--------------------------------------------------------------------------------------------------------------------------------
 	HardwareVertexBufferPtr HardwareBufferManager::allocateVertexBufferCopy(const HardwareVertexBufferPtr & source_buffer, // source buffer for copy.
 															 BufferLicenseType license_type, // enumeration of license type.
 															 HardwareBufferLicensee* licensee, // pointer to class who requests the copy.
 															 bool copy_data) { // Whether to copy data and the structure.
-		Lock vertex_buffer_lock(vertex_buffer_mutex_);
-		Lock temp_buffer_lock(temporary_buffer_mutex_);
-		HardwareVertexBufferPtr vbuf;
-		auto iter = free_temporary_vertex_buffer_map_.find(source_buffer.get());
-		// If source_buffer's copy does not exist in free temporary vertex buffer pool, creates one.
-		if (iter == free_temporary_vertex_buffer_map_.end()) {
-			vbuf = makeBufferCopy(source_buffer, HardwareBuffer::HBU_DYNAMIC_WRITE_ONLY_DISCARDABLE, true);
-		}
-		// If souce_buffer's copy exists, returns the copy's address.
-		else {
-			vbuf = iter->second;
-			free_temporary_vertex_buffer_map_.erase(iter);
+		TemporaryVertexBufferPool::Key key = TemporaryVertexBufferPool::makeKey(source_buffer->getVertexSize(),
+																			 source_buffer->getVertexNum(),
+																			 HardwareBuffer::HBU_DYNAMIC_WRITE_ONLY_DISCARDABLE);
+		HardwareVertexBufferPtr vbuf = temporary_buffer_pool_.acquire(key);
+		// If no free buffer of the same layout exists, creates one.
+		if (!vbuf) {
+			vbuf = createVertexBuffer(key.vertex_size, key.vertex_num, key.usage, true);
 		}
 		// Copies data from source buffer to copy.
 		if (copy_data) {
 			vbuf->copyData(*(source_buffer.get()), 0, 0, source_buffer->getSizeInBytes(), true);
 		}
 		// Assigns temporary buffer with a license.
+		Lock lock(temporary_buffer_mutex_);
 		temporary_vertex_buffer_license_map_.insert(
 													TemporaryVertexBufferLicenseMap::value_type(
 																								vbuf.get(),
@@ -91,8 +99,7 @@ namespace Astero {
 			const VertexBufferLicense & vbl = iter->second;
 			// Informs licensee that license is expired.
 			vbl.licensee->licenseExpired(vbl.buffer.get());
-			free_temporary_vertex_buffer_map_.insert(
-													 FreeTemporaryVertexBufferMap::value_type(vbl.original_buffer, vbl.buffer));
+			temporary_buffer_pool_.release(vbl.buffer);
 			temporary_vertex_buffer_license_map_.erase(iter);
 		}
 	}
@@ -108,19 +115,12 @@ namespace Astero {
 	}
 	//--------------------------------------------------------------------------------------------------------------------------------
 	void HardwareBufferManager::freeUnusedBufferCopies() {
-		Lock lock(temporary_buffer_mutex_);
-		auto iter = free_temporary_vertex_buffer_map_.begin();
-		while (iter != free_temporary_vertex_buffer_map_.end()) {
-			auto cur_iter = iter++;
-			if (cur_iter->second.use_count() <= 1) {
-				free_temporary_vertex_buffer_map_.erase(cur_iter);
-			}
-		}
+		temporary_buffer_pool_.freeUnused();
 	}
 	//--------------------------------------------------------------------------------------------------------------------------------
 	void HardwareBufferManager::releaseBufferCopies(bool force_free_unused) {
 		Lock lock(temporary_buffer_mutex_);
-		size_t num_unused = free_temporary_vertex_buffer_map_.size();
+		size_t num_unused = temporary_buffer_pool_.getRetainedCount();
 		size_t num_used = temporary_vertex_buffer_license_map_.size();
 		// Erases copies which are automatic licensed out.
 		auto iter = temporary_vertex_buffer_license_map_.begin();
@@ -129,8 +129,7 @@ namespace Astero {
 			VertexBufferLicense & vbl = cur_iter->second;
 			if (vbl.license_type == BLT_AUTOMATIC_RELEASE && --vbl.expired_delay <= 0) {
 				vbl.licensee->licenseExpired(vbl.buffer.get());
-				free_temporary_vertex_buffer_map_.insert(
-														 FreeTemporaryVertexBufferMap::value_type(vbl.original_buffer, vbl.buffer));
+				temporary_buffer_pool_.release(vbl.buffer);
 				temporary_vertex_buffer_license_map_.erase(cur_iter);
 			}
 		}
@@ -167,7 +166,60 @@ namespace Astero {
 				temporary_vertex_buffer_license_map_.erase(cur_iter);
 			}
 		}
-		free_temporary_vertex_buffer_map_.erase(source);
+		// Drops free copies of source layout.
+		temporary_buffer_pool_.freeUnused(TemporaryVertexBufferPool::makeKey(source->getVertexSize(), source->getVertexNum(),
+																			  HardwareBuffer::HBU_DYNAMIC_WRITE_ONLY_DISCARDABLE));
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	HardwareBufferUpload * HardwareBufferManager::beginUpload(const HardwareBufferPtr & buffer, size_t offset, size_t size) {
+		assert(offset + size <= buffer->getSizeInBytes());
+		HardwareBufferUpload * upload = new HardwareBufferUpload;
+		upload->buffer = buffer;
+		upload->offset = offset;
+		upload->size = size;
+		upload->data = malloc_simd<MEMCATEGORY_GEOMETRY>(size);
+		upload->sequence = 0;
+		return upload;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void HardwareBufferManager::submitUpload(HardwareBufferUpload * upload) {
+		Lock lock(upload_mutex_);
+		upload->sequence = upload_sequence_++;
+		pending_uploads_.push_back(upload);
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void HardwareBufferManager::cancelUpload(HardwareBufferUpload * upload) {
+		free_simd<MEMCATEGORY_GEOMETRY>(upload->data);
+		delete upload;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void HardwareBufferManager::processUploads() {
+		UploadList uploads;
+		{
+			Lock lock(upload_mutex_);
+			uploads.swap(pending_uploads_);
+		}
+		// Groups uploads per buffer to minimize buffer binds, keeping submission order within each buffer.
+		std::sort(uploads.begin(), uploads.end(), [](const HardwareBufferUpload * a, const HardwareBufferUpload * b) {
+			if (a->buffer != b->buffer)
+				return a->buffer.get() < b->buffer.get();
+			return a->sequence < b->sequence;
+		});
+		for (auto upload : uploads) {
+			HardwareBuffer * buffer = upload->buffer.get();
+			buffer->writeData(upload->offset, upload->size, upload->data,
+							  upload->offset == 0 && upload->size == buffer->getSizeInBytes());
+			cancelUpload(upload);
+		}
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	size_t HardwareBufferManager::getPendingUploadCount() const {
+		Lock lock(upload_mutex_);
+		return pending_uploads_.size();
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	TemporaryVertexBufferPool::Stats HardwareBufferManager::getTemporaryBufferPoolStats() const {
+		return temporary_buffer_pool_.getStats();
 	}
 	//--------------------------------------------------------------------------------------------------------------------------------
 	void HardwareBufferManager::notifyVertexBufferDestroyed(HardwareVertexBuffer * buffer) {
@@ -217,20 +269,791 @@ namespace Astero {
 		return createVertexBuffer(source->getVertexSize(), source->getVertexNum(), usage, use_shadow_buffer);
 	}
 	//--------------------------------------------------------------------------------------------------------------------------------
+	// DefaultHardwareBufferManager
+	//--------------------------------------------------------------------------------------------------------------------------------
+	DefaultHardwareBufferManager::DefaultHardwareBufferManager() {
+		
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	DefaultHardwareBufferManager::~DefaultHardwareBufferManager() {
+		destroyAllVertexDeclarations();
+		destroyAllVertexBufferBindings();
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	HardwareVertexBufferPtr DefaultHardwareBufferManager::createVertexBuffer(size_t vertex_size,
+																			 size_t vertex_num,
+																			 HardwareBuffer::Usage usage,
+																			 bool /* use_shadow_buffer */) {
+		DefaultHardwareVertexBuffer * buf = new DefaultHardwareVertexBuffer(this, vertex_size, vertex_num, usage);
+		Lock lock(vertex_buffer_mutex_);
+		vertex_buffer_list_.insert(buf);
+		return HardwareVertexBufferPtr(buf);
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	HardwareIndexBufferPtr DefaultHardwareBufferManager::createIndexBuffer(HardwareIndexBuffer::IndexType index_type,
+																		   size_t index_num,
+																		   HardwareBuffer::Usage usage,
+																		   bool /* use_shadow_buffer */) {
+		DefaultHardwareIndexBuffer * buf = new DefaultHardwareIndexBuffer(this, index_type, index_num, usage);
+		Lock lock(index_buffer_mutex_);
+		index_buffer_list_.insert(buf);
+		return HardwareIndexBufferPtr(buf);
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	RenderToVertexBufferPtr DefaultHardwareBufferManager::createRenderToVertexBuffer() {
+		return RenderToVertexBufferPtr();
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	// TemporaryVertexBufferPool
+	//--------------------------------------------------------------------------------------------------------------------------------
+	TemporaryVertexBufferPool::ThreadCache::ThreadCache() : count(0) {
+		
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	TemporaryVertexBufferPool::ThreadCacheMap::ThreadCacheMap() : last_id(0), last_cache(nullptr) {
+		
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	TemporaryVertexBufferPool::ThreadCacheMap::~ThreadCacheMap() {
+		// Thread is exiting, returns cached buffers to shared table of pools still alive. Caches of destroyed pools were
+		// already emptied by their destructors.
+		Lock registry_lock(getRegistryMutex());
+		PoolRegistry & registry = getRegistry();
+		for (auto & entry : caches) {
+			auto iter = registry.find(entry.first);
+			if (iter == registry.end())
+				continue;
+			TemporaryVertexBufferPool * pool = iter->second;
+			ThreadCache & cache = *entry.second;
+			Lock lock(pool->thread_cache_mutex_);
+			Lock cache_lock(cache.mutex);
+			for (unsigned int i = 0; i < cache.count; ++i) {
+				size_t size = cache.buffers[i]->getSizeInBytes();
+				if (!pool->releaseShared(cache.keys[i], cache.buffers[i])) {
+					--pool->retained_count_;
+					pool->retained_bytes_ -= size;
+				}
+				cache.buffers[i].reset();
+			}
+			cache.count = 0;
+			pool->thread_caches_.erase(&cache);
+		}
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	TemporaryVertexBufferPool::TemporaryVertexBufferPool()
+	: id_(0), hit_count_(0), thread_cache_hit_count_(0), miss_count_(0), retained_count_(0), retained_bytes_(0) {
+		static std::atomic<size_t> next_id(1);
+		id_ = next_id++;
+		for (auto & slot : slots_)
+			slot.state = SS_EMPTY;
+		Lock registry_lock(getRegistryMutex());
+		getRegistry()[id_] = this;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	TemporaryVertexBufferPool::~TemporaryVertexBufferPool() {
+		// Registry mutex is held throughout, so that no exiting thread flushes into this pool, or frees a cache still
+		// listed in thread_caches_.
+		Lock registry_lock(getRegistryMutex());
+		getRegistry().erase(id_);
+		Lock lock(thread_cache_mutex_);
+		for (auto cache : thread_caches_) {
+			Lock cache_lock(cache->mutex);
+			for (unsigned int i = 0; i < cache->count; ++i)
+				cache->buffers[i].reset();
+			cache->count = 0;
+		}
+		thread_caches_.clear();
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	TemporaryVertexBufferPool::Mutex & TemporaryVertexBufferPool::getRegistryMutex() {
+		// Never destroyed, threads may exit after static destruction.
+		static Mutex * mutex = new Mutex;
+		return *mutex;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	TemporaryVertexBufferPool::PoolRegistry & TemporaryVertexBufferPool::getRegistry() {
+		static PoolRegistry * registry = new PoolRegistry;
+		return *registry;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	TemporaryVertexBufferPool::ThreadCache & TemporaryVertexBufferPool::getThreadCache() {
+		static thread_local ThreadCacheMap cache_map;
+		if (cache_map.last_id == id_)
+			return *cache_map.last_cache;
+		auto iter = cache_map.caches.find(id_);
+		if (iter == cache_map.caches.end()) {
+			{
+				// Drops caches of destroyed pools.
+				Lock registry_lock(getRegistryMutex());
+				PoolRegistry & registry = getRegistry();
+				for (auto stale = cache_map.caches.begin(); stale != cache_map.caches.end();) {
+					if (registry.find(stale->first) == registry.end())
+						stale = cache_map.caches.erase(stale);
+					else
+						++stale;
+				}
+			}
+			iter = cache_map.caches.insert(std::make_pair(id_, std::unique_ptr<ThreadCache>(new ThreadCache))).first;
+			Lock lock(thread_cache_mutex_);
+			thread_caches_.insert(iter->second.get());
+		}
+		cache_map.last_id = id_;
+		cache_map.last_cache = iter->second.get();
+		return *cache_map.last_cache;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	TemporaryVertexBufferPool::Key TemporaryVertexBufferPool::makeKey(size_t vertex_size, size_t vertex_num,
+																	   HardwareBuffer::Usage usage) {
+		Key key = {vertex_size, vertex_num, usage};
+		return key;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	size_t TemporaryVertexBufferPool::hashKey(const Key & key) {
+		size_t hash = key.vertex_size * 0x9E3779B1u;
+		hash ^= key.vertex_num + 0x9E3779B9u + (hash << 6) + (hash >> 2);
+		hash ^= static_cast<size_t>(key.usage) + 0x9E3779B9u + (hash << 6) + (hash >> 2);
+		return hash % TEMPORARY_BUFFER_POOL_SLOT_COUNT;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	HardwareVertexBufferPtr TemporaryVertexBufferPool::acquire(const Key & key) {
+		HardwareVertexBufferPtr buffer;
+		ThreadCache & cache = getThreadCache();
+		{
+			Lock cache_lock(cache.mutex);
+			for (unsigned int i = 0; i < cache.count; ++i) {
+				if (cache.keys[i] == key) {
+					buffer.swap(cache.buffers[i]);
+					--cache.count;
+					if (i != cache.count) {
+						cache.keys[i] = cache.keys[cache.count];
+						cache.buffers[i].swap(cache.buffers[cache.count]);
+					}
+					++thread_cache_hit_count_;
+					break;
+				}
+			}
+		}
+		if (!buffer)
+			buffer = acquireShared(key);
+		if (!buffer) {
+			++miss_count_;
+			return buffer;
+		}
+		++hit_count_;
+		--retained_count_;
+		retained_bytes_ -= buffer->getSizeInBytes();
+		return buffer;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void TemporaryVertexBufferPool::release(const HardwareVertexBufferPtr & buffer) {
+		Key key = makeKey(buffer->getVertexSize(), buffer->getVertexNum(), buffer->getUsage());
+		++retained_count_;
+		retained_bytes_ += buffer->getSizeInBytes();
+		ThreadCache & cache = getThreadCache();
+		{
+			Lock cache_lock(cache.mutex);
+			if (cache.count < TEMPORARY_BUFFER_THREAD_CACHE_DEPTH) {
+				cache.keys[cache.count] = key;
+				cache.buffers[cache.count] = buffer;
+				++cache.count;
+				return;
+			}
+		}
+		if (!releaseShared(key, buffer)) {
+			--retained_count_;
+			retained_bytes_ -= buffer->getSizeInBytes();
+		}
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	HardwareVertexBufferPtr TemporaryVertexBufferPool::acquireShared(const Key & key) {
+		HardwareVertexBufferPtr buffer;
+		size_t start = hashKey(key);
+		for (size_t i = 0; i < TEMPORARY_BUFFER_POOL_PROBE_LENGTH; ++i) {
+			Slot & slot = slots_[(start + i) % TEMPORARY_BUFFER_POOL_SLOT_COUNT];
+			unsigned int expected = SS_FULL;
+			if (slot.state.load(std::memory_order_relaxed) != SS_FULL
+				|| !slot.state.compare_exchange_strong(expected, SS_BUSY, std::memory_order_acquire))
+				continue;
+			// Slot is owned by this thread now.
+			if (slot.key == key) {
+				buffer.swap(slot.buffer);
+				slot.state.store(SS_EMPTY, std::memory_order_release);
+				break;
+			}
+			slot.state.store(SS_FULL, std::memory_order_release);
+		}
+		return buffer;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	bool TemporaryVertexBufferPool::releaseShared(const Key & key, const HardwareVertexBufferPtr & buffer) {
+		size_t start = hashKey(key);
+		for (size_t i = 0; i < TEMPORARY_BUFFER_POOL_PROBE_LENGTH; ++i) {
+			Slot & slot = slots_[(start + i) % TEMPORARY_BUFFER_POOL_SLOT_COUNT];
+			unsigned int expected = SS_EMPTY;
+			if (slot.state.load(std::memory_order_relaxed) != SS_EMPTY
+				|| !slot.state.compare_exchange_strong(expected, SS_BUSY, std::memory_order_acquire))
+				continue;
+			slot.key = key;
+			slot.buffer = buffer;
+			slot.state.store(SS_FULL, std::memory_order_release);
+			return true;
+		}
+		return false;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void TemporaryVertexBufferPool::freeUnused() {
+		freeUnusedBuffers(nullptr);
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void TemporaryVertexBufferPool::freeUnused(const Key & key) {
+		freeUnusedBuffers(&key);
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void TemporaryVertexBufferPool::freeUnusedBuffers(const Key * key) {
+		std::vector<HardwareVertexBufferPtr> unused;
+		{
+			Lock lock(thread_cache_mutex_);
+			for (auto cache : thread_caches_) {
+				Lock cache_lock(cache->mutex);
+				freeUnusedBuffers(*cache, key, unused);
+			}
+		}
+		for (auto & slot : slots_) {
+			unsigned int expected = SS_FULL;
+			if (slot.state.load(std::memory_order_relaxed) != SS_FULL
+				|| !slot.state.compare_exchange_strong(expected, SS_BUSY, std::memory_order_acquire))
+				continue;
+			if ((!key || slot.key == *key) && slot.buffer.use_count() <= 1) {
+				--retained_count_;
+				retained_bytes_ -= slot.buffer->getSizeInBytes();
+				unused.push_back(HardwareVertexBufferPtr());
+				unused.back().swap(slot.buffer);
+				slot.state.store(SS_EMPTY, std::memory_order_release);
+			}
+			else {
+				slot.state.store(SS_FULL, std::memory_order_release);
+			}
+		}
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void TemporaryVertexBufferPool::freeUnusedBuffers(ThreadCache & cache, const Key * key,
+													   std::vector<HardwareVertexBufferPtr> & unused) {
+		unsigned int i = 0;
+		while (i < cache.count) {
+			if ((!key || cache.keys[i] == *key) && cache.buffers[i].use_count() <= 1) {
+				--retained_count_;
+				retained_bytes_ -= cache.buffers[i]->getSizeInBytes();
+				--cache.count;
+				unused.push_back(HardwareVertexBufferPtr());
+				unused.back().swap(cache.buffers[i]);
+				cache.keys[i] = cache.keys[cache.count];
+				cache.buffers[i].swap(cache.buffers[cache.count]);
+			}
+			else {
+				++i;
+			}
+		}
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	size_t TemporaryVertexBufferPool::getRetainedCount() const {
+		return retained_count_;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	TemporaryVertexBufferPool::Stats TemporaryVertexBufferPool::getStats() const {
+		Stats stats;
+		stats.hit_count = hit_count_;
+		stats.thread_cache_hit_count = thread_cache_hit_count_;
+		stats.miss_count = miss_count_;
+		stats.retained_count = retained_count_;
+		stats.retained_bytes = retained_bytes_;
+		return stats;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void TemporaryVertexBufferPool::resetStats() {
+		hit_count_ = 0;
+		thread_cache_hit_count_ = 0;
+		miss_count_ = 0;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	// GLScratchAllocator
+	//--------------------------------------------------------------------------------------------------------------------------------
+	GLScratchAllocator::ThreadCache::ThreadCache() {
+		std::fill(count, count + THREAD_CACHE_CLASS_COUNT, 0);
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	GLScratchAllocator::ThreadCacheMap::ThreadCacheMap() : last_id(0), last_cache(nullptr) {
+		
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	GLScratchAllocator::ThreadCacheMap::~ThreadCacheMap() {
+		// Thread is exiting, returns cached blocks to allocators still alive. Caches of destroyed allocators were
+		// already flushed by their destructors.
+		Lock registry_lock(getRegistryMutex());
+		AllocatorRegistry & registry = getRegistry();
+		for (auto & entry : caches) {
+			auto iter = registry.find(entry.first);
+			if (iter == registry.end())
+				continue;
+			GLScratchAllocator * allocator = iter->second;
+			Lock lock(allocator->mutex_);
+			allocator->releaseThreadCache(entry.second.get());
+			allocator->thread_caches_.erase(entry.second.get());
+		}
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	GLScratchAllocator::Mutex & GLScratchAllocator::getRegistryMutex() {
+		// Never destroyed, threads may exit after static destruction.
+		static Mutex * mutex = new Mutex;
+		return *mutex;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	GLScratchAllocator::AllocatorRegistry & GLScratchAllocator::getRegistry() {
+		static AllocatorRegistry * registry = new AllocatorRegistry;
+		return *registry;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	GLScratchAllocator::ThreadCache & GLScratchAllocator::getThreadCache() {
+		static thread_local ThreadCacheMap cache_map;
+		if (cache_map.last_id == id_)
+			return *cache_map.last_cache;
+		auto iter = cache_map.caches.find(id_);
+		if (iter == cache_map.caches.end()) {
+			{
+				// Drops caches of destroyed allocators.
+				Lock registry_lock(getRegistryMutex());
+				AllocatorRegistry & registry = getRegistry();
+				for (auto stale = cache_map.caches.begin(); stale != cache_map.caches.end();) {
+					if (registry.find(stale->first) == registry.end())
+						stale = cache_map.caches.erase(stale);
+					else
+						++stale;
+				}
+			}
+			iter = cache_map.caches.insert(std::make_pair(id_, std::unique_ptr<ThreadCache>(new ThreadCache))).first;
+			Lock lock(mutex_);
+			thread_caches_.insert(iter->second.get());
+		}
+		cache_map.last_id = id_;
+		cache_map.last_cache = iter->second.get();
+		return *cache_map.last_cache;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void GLScratchAllocator::mappingInsert(size_t size, unsigned int & fl, unsigned int & sl) {
+		if (size < SMALL_BLOCK_SIZE) {
+			fl = 0;
+			sl = static_cast<unsigned int>(size) / (SMALL_BLOCK_SIZE / SL_INDEX_COUNT);
+		}
+		else {
+			unsigned int msb = 63 - __builtin_clzll(static_cast<unsigned long long>(size));
+			sl = static_cast<unsigned int>(size >> (msb - SL_INDEX_COUNT_LOG2)) ^ SL_INDEX_COUNT;
+			fl = msb - (FL_INDEX_SHIFT - 1);
+		}
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void GLScratchAllocator::mappingSearch(size_t size, unsigned int & fl, unsigned int & sl) {
+		// Rounds size up to next class boundary, so that every block of found class is large enough.
+		if (size >= SMALL_BLOCK_SIZE) {
+			unsigned int msb = 63 - __builtin_clzll(static_cast<unsigned long long>(size));
+			size += (static_cast<size_t>(1) << (msb - SL_INDEX_COUNT_LOG2)) - 1;
+		}
+		mappingInsert(size, fl, sl);
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	GLScratchAllocator::GLScratchAllocator(size_t pool_size, size_t max_pool_size)
+	: id_(0), chunk_size_(pool_size), max_pool_size_(max_pool_size), fl_bitmap_(0), pool_size_(0), bytes_in_use_(0),
+	high_water_mark_(0), allocation_count_(0), thread_cache_hit_count_(0), pool_growth_count_(0), fallback_count_(0) {
+		static std::atomic<size_t> next_id(1);
+		id_ = next_id++;
+		std::fill(sl_bitmap_, sl_bitmap_ + FL_INDEX_COUNT, 0);
+		for (unsigned int i = 0; i < FL_INDEX_COUNT; ++i)
+			std::fill(free_lists_[i], free_lists_[i] + SL_INDEX_COUNT, nullptr);
+		{
+			Lock lock(mutex_);
+			growPool(chunk_size_ - 2 * sizeof(GLScratchBlock));
+			pool_growth_count_ = 0;
+		}
+		Lock registry_lock(getRegistryMutex());
+		getRegistry()[id_] = this;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	GLScratchAllocator::~GLScratchAllocator() {
+		// Registry mutex is held throughout, so that no exiting thread flushes into this allocator, or frees a cache
+		// still listed in thread_caches_.
+		Lock registry_lock(getRegistryMutex());
+		getRegistry().erase(id_);
+		Lock lock(mutex_);
+		// Flushes caches of living threads. Their map entries are dropped next time those threads create a cache.
+		for (auto cache : thread_caches_)
+			releaseThreadCache(cache);
+		thread_caches_.clear();
+		for (auto chunk : pool_chunks_) {
+			free_aligned<MEMCATEGORY_GEOMETRY, SCRATCH_ALIGNMENT>(chunk);
+		}
+		pool_chunks_.clear();
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void * GLScratchAllocator::allocate(size_t size) {
+		ASTERO_PROFILE_SCOPE("GLScratchAllocator::allocate");
+		if (size == 0)
+			size = 1;
+		size = (size + SCRATCH_ALIGNMENT - 1) & ~static_cast<size_t>(SCRATCH_ALIGNMENT - 1);
+		// Rounds size up to lower bound of its size class, so that a freed block is cached in the class it is searched in.
+		if (size >= SMALL_BLOCK_SIZE) {
+			unsigned int msb = 63 - __builtin_clzll(static_cast<unsigned long long>(size));
+			size_t round = (static_cast<size_t>(1) << (msb - SL_INDEX_COUNT_LOG2)) - 1;
+			size = (size + round) & ~round;
+		}
+		GLScratchBlock * block = nullptr;
+		// Tries blocks cached by this thread first.
+		unsigned int fl, sl;
+		mappingSearch(size, fl, sl);
+		unsigned int cache_class = fl * SL_INDEX_COUNT + sl;
+		ThreadCache & cache = getThreadCache();
+		if (cache_class < THREAD_CACHE_CLASS_COUNT && cache.count[cache_class] > 0) {
+			block = cache.blocks[cache_class][--cache.count[cache_class]];
+			++thread_cache_hit_count_;
+		}
+		else {
+			Lock lock(mutex_);
+			block = allocateBlock(size);
+		}
+		if (!block) {
+			++fallback_count_;
+			return nullptr;
+		}
+		++allocation_count_;
+		updateHighWaterMark(bytes_in_use_ += getBlockSize(block));
+		return block + 1;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void GLScratchAllocator::deallocate(void * ptr) {
+		ASTERO_PROFILE_SCOPE("GLScratchAllocator::deallocate");
+		if (!ptr)
+			return;
+		GLScratchBlock * block = static_cast<GLScratchBlock *>(ptr) - 1;
+		assert(!isBlockFree(block));
+		size_t size = getBlockSize(block);
+		bytes_in_use_ -= size;
+		unsigned int fl, sl;
+		mappingInsert(size, fl, sl);
+		unsigned int cache_class = fl * SL_INDEX_COUNT + sl;
+		ThreadCache & cache = getThreadCache();
+		if (cache_class < THREAD_CACHE_CLASS_COUNT && cache.count[cache_class] < SCRATCH_THREAD_CACHE_DEPTH) {
+			cache.blocks[cache_class][cache.count[cache_class]++] = block;
+			return;
+		}
+		Lock lock(mutex_);
+		deallocateBlock(block);
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	GLScratchAllocator::Stats GLScratchAllocator::getStats() const {
+		Stats stats;
+		stats.pool_size = pool_size_;
+		stats.bytes_in_use = bytes_in_use_;
+		stats.high_water_mark = high_water_mark_;
+		stats.allocation_count = allocation_count_;
+		stats.thread_cache_hit_count = thread_cache_hit_count_;
+		stats.pool_growth_count = pool_growth_count_;
+		stats.fallback_count = fallback_count_;
+		return stats;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void GLScratchAllocator::resetStats() {
+		high_water_mark_ = bytes_in_use_.load();
+		allocation_count_ = 0;
+		thread_cache_hit_count_ = 0;
+		pool_growth_count_ = 0;
+		fallback_count_ = 0;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	GLScratchBlock * GLScratchAllocator::allocateBlock(size_t size) {
+		GLScratchBlock * block = findFreeBlock(size);
+		if (!block) {
+			// Pool exhausted, reserves another chunk instead of falling back to glMapBuffer.
+			if (!growPool(size))
+				return nullptr;
+			block = findFreeBlock(size);
+			assert(block);
+		}
+		splitBlock(block, size);
+		block->size &= ~static_cast<size_t>(1);
+		return block;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void GLScratchAllocator::deallocateBlock(GLScratchBlock * block) {
+		block->size |= 1;
+		// Merges with previous block.
+		GLScratchBlock * prev = block->prev_physical;
+		if (prev && isBlockFree(prev)) {
+			removeFreeBlock(prev);
+			prev->size = (getBlockSize(prev) + sizeof(GLScratchBlock) + getBlockSize(block)) | 1;
+			block = prev;
+			getNextPhysical(block)->prev_physical = block;
+		}
+		// Merges with next block. The sentinel at the end of each chunk is never free.
+		GLScratchBlock * next = getNextPhysical(block);
+		if (isBlockFree(next)) {
+			removeFreeBlock(next);
+			block->size = (getBlockSize(block) + sizeof(GLScratchBlock) + getBlockSize(next)) | 1;
+			getNextPhysical(block)->prev_physical = block;
+		}
+		insertFreeBlock(block);
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void GLScratchAllocator::insertFreeBlock(GLScratchBlock * block) {
+		unsigned int fl, sl;
+		mappingInsert(getBlockSize(block), fl, sl);
+		GLScratchBlock * head = free_lists_[fl][sl];
+		block->prev_free = nullptr;
+		block->next_free = head;
+		if (head)
+			head->prev_free = block;
+		free_lists_[fl][sl] = block;
+		fl_bitmap_ |= 1u << fl;
+		sl_bitmap_[fl] |= 1u << sl;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void GLScratchAllocator::removeFreeBlock(GLScratchBlock * block) {
+		unsigned int fl, sl;
+		mappingInsert(getBlockSize(block), fl, sl);
+		if (block->prev_free)
+			block->prev_free->next_free = block->next_free;
+		if (block->next_free)
+			block->next_free->prev_free = block->prev_free;
+		if (free_lists_[fl][sl] == block) {
+			free_lists_[fl][sl] = block->next_free;
+			if (!free_lists_[fl][sl]) {
+				sl_bitmap_[fl] &= ~(1u << sl);
+				if (!sl_bitmap_[fl])
+					fl_bitmap_ &= ~(1u << fl);
+			}
+		}
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	GLScratchBlock * GLScratchAllocator::findFreeBlock(size_t size) {
+		unsigned int fl, sl;
+		mappingSearch(size, fl, sl);
+		if (fl >= FL_INDEX_COUNT)
+			return nullptr;
+		// Looks for a non-empty list in same first level, then in any larger first level.
+		unsigned int sl_map = sl_bitmap_[fl] & (~0u << sl);
+		if (!sl_map) {
+			unsigned int fl_map = (fl + 1 < 32) ? (fl_bitmap_ & (~0u << (fl + 1))) : 0;
+			if (!fl_map)
+				return nullptr;
+			fl = __builtin_ctz(fl_map);
+			sl_map = sl_bitmap_[fl];
+		}
+		sl = __builtin_ctz(sl_map);
+		GLScratchBlock * block = free_lists_[fl][sl];
+		removeFreeBlock(block);
+		return block;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void GLScratchAllocator::splitBlock(GLScratchBlock * block, size_t size) {
+		size_t block_size = getBlockSize(block);
+		// Only splits if remainder can hold a header and a minimum payload.
+		if (block_size < size + sizeof(GLScratchBlock) + SCRATCH_ALIGNMENT)
+			return;
+		GLScratchBlock * remaining = reinterpret_cast<GLScratchBlock *>(reinterpret_cast<char *>(block + 1) + size);
+		remaining->size = (block_size - size - sizeof(GLScratchBlock)) | 1;
+		remaining->prev_physical = block;
+		block->size = size | (block->size & 1);
+		getNextPhysical(remaining)->prev_physical = remaining;
+		insertFreeBlock(remaining);
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	bool GLScratchAllocator::growPool(size_t size) {
+		// A chunk holds one free block, followed by a sentinel block which stops merging at chunk end.
+		size_t payload = std::max(size, chunk_size_ - 2 * sizeof(GLScratchBlock));
+		size_t chunk_size = payload + 2 * sizeof(GLScratchBlock);
+		if (pool_size_ + chunk_size > max_pool_size_)
+			return false;
+		char * chunk = static_cast<char *>(malloc_aligned<MEMCATEGORY_GEOMETRY, SCRATCH_ALIGNMENT>(chunk_size));
+		if (!chunk)
+			return false;
+		GLScratchBlock * block = reinterpret_cast<GLScratchBlock *>(chunk);
+		block->prev_physical = nullptr;
+		block->size = payload | 1;
+		GLScratchBlock * sentinel = getNextPhysical(block);
+		sentinel->prev_physical = block;
+		sentinel->size = 0;
+		insertFreeBlock(block);
+		pool_chunks_.push_back(chunk);
+		pool_size_ += chunk_size;
+		++pool_growth_count_;
+		return true;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void GLScratchAllocator::releaseThreadCache(ThreadCache * cache) {
+		for (unsigned int i = 0; i < THREAD_CACHE_CLASS_COUNT; ++i) {
+			while (cache->count[i] > 0)
+				deallocateBlock(cache->blocks[i][--cache->count[i]]);
+		}
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void GLScratchAllocator::updateHighWaterMark(size_t bytes_in_use) {
+		size_t high_water_mark = high_water_mark_;
+		while (bytes_in_use > high_water_mark && !high_water_mark_.compare_exchange_weak(high_water_mark, bytes_in_use)) {
+		}
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	// GLMegaBuffer
+	//--------------------------------------------------------------------------------------------------------------------------------
+	GLMegaBuffer::GLMegaBuffer(GLHardwareBufferManager * manager, GLenum target, GLenum gl_usage, size_t size)
+	: manager_(manager), target_(target), gl_usage_(gl_usage), buffer_id_(0), size_(size), free_bytes_(size) {
+		glGenBuffersARB(1, &buffer_id_);
+		assert(buffer_id_);
+		manager_->getStateCacheManager()->bindGLBuffer(target_, buffer_id_);
+		glBufferDataARB(target_, size_, nullptr, gl_usage_);
+		free_blocks_.insert(FreeBlockMap::value_type(0, size_));
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	GLMegaBuffer::~GLMegaBuffer() {
+		assert(allocations_.empty());
+		manager_->getStateCacheManager()->deleteGLBuffer(target_, buffer_id_);
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	bool GLMegaBuffer::allocate(GLBufferObjectHolder * holder, size_t size, size_t alignment, size_t & offset) {
+		if (size == 0 || size > free_bytes_)
+			return false;
+		if (alignment == 0)
+			alignment = 1;
+		// First fit. Alignment may be any vertex size, so it is not necessarily a power of two.
+		for (auto iter = free_blocks_.begin(); iter != free_blocks_.end(); ++iter) {
+			size_t block_offset = iter->first;
+			size_t block_end = iter->first + iter->second;
+			size_t aligned_offset = (block_offset + alignment - 1) / alignment * alignment;
+			if (aligned_offset + size > block_end)
+				continue;
+			free_blocks_.erase(iter);
+			// Keeps padding before and remainder after allocation as free blocks.
+			if (aligned_offset > block_offset)
+				free_blocks_.insert(FreeBlockMap::value_type(block_offset, aligned_offset - block_offset));
+			if (aligned_offset + size < block_end)
+				free_blocks_.insert(FreeBlockMap::value_type(aligned_offset + size, block_end - aligned_offset - size));
+			Allocation allocation = {size, alignment, holder};
+			allocations_.insert(AllocationMap::value_type(aligned_offset, allocation));
+			free_bytes_ -= size;
+			offset = aligned_offset;
+			return true;
+		}
+		return false;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void GLMegaBuffer::deallocate(size_t offset) {
+		auto alloc_iter = allocations_.find(offset);
+		assert(alloc_iter != allocations_.end());
+		size_t size = alloc_iter->second.size;
+		allocations_.erase(alloc_iter);
+		free_bytes_ += size;
+		// Merges with following free block.
+		auto next = free_blocks_.find(offset + size);
+		if (next != free_blocks_.end()) {
+			size += next->second;
+			free_blocks_.erase(next);
+		}
+		// Merges with preceding free block.
+		auto iter = free_blocks_.lower_bound(offset);
+		if (iter != free_blocks_.begin()) {
+			auto prev = std::prev(iter);
+			if (prev->first + prev->second == offset) {
+				prev->second += size;
+				return;
+			}
+		}
+		free_blocks_.insert(FreeBlockMap::value_type(offset, size));
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	bool GLMegaBuffer::compact() {
+		if (!GLEW_ARB_copy_buffer || allocations_.empty())
+			return false;
+		for (auto & value : allocations_) {
+			if (value.second.holder->isGLBufferLocked())
+				return false;
+		}
+		GLStateCacheManager * state_cache_manager = manager_->getStateCacheManager();
+		GLuint new_buffer_id = 0;
+		glGenBuffersARB(1, &new_buffer_id);
+		state_cache_manager->bindGLBuffer(GL_COPY_WRITE_BUFFER, new_buffer_id);
+		glBufferDataARB(GL_COPY_WRITE_BUFFER, size_, nullptr, gl_usage_);
+		state_cache_manager->bindGLBuffer(GL_COPY_READ_BUFFER, buffer_id_);
+		// Copies live ranges on GPU, packed in offset order.
+		AllocationMap allocations;
+		size_t cursor = 0;
+		for (auto & value : allocations_) {
+			const Allocation & allocation = value.second;
+			size_t new_offset = (cursor + allocation.alignment - 1) / allocation.alignment * allocation.alignment;
+			glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, value.first, new_offset, allocation.size);
+			allocations.insert(AllocationMap::value_type(new_offset, allocation));
+			cursor = new_offset + allocation.size;
+		}
+		state_cache_manager->deleteGLBuffer(GL_COPY_READ_BUFFER, buffer_id_);
+		buffer_id_ = new_buffer_id;
+		allocations_.swap(allocations);
+		free_blocks_.clear();
+		if (cursor < size_)
+			free_blocks_.insert(FreeBlockMap::value_type(cursor, size_ - cursor));
+		free_bytes_ = size_ - cursor;
+		for (auto & value : allocations_) {
+			value.second.holder->notifyGLBufferRelocated(buffer_id_, value.first);
+		}
+		return true;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	GLuint GLMegaBuffer::getGLBufferId() const {
+		return buffer_id_;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	GLenum GLMegaBuffer::getTarget() const {
+		return target_;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	GLenum GLMegaBuffer::getGLUsage() const {
+		return gl_usage_;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	size_t GLMegaBuffer::getSize() const {
+		return size_;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	size_t GLMegaBuffer::getFreeBytes() const {
+		return free_bytes_;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	size_t GLMegaBuffer::getLargestFreeBlock() const {
+		size_t largest = 0;
+		for (auto & block : free_blocks_)
+			largest = std::max(largest, block.second);
+		return largest;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	size_t GLMegaBuffer::getAllocationCount() const {
+		return allocations_.size();
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	// GLHardwareBufferManager
+	//--------------------------------------------------------------------------------------------------------------------------------
 	GLHardwareBufferManager::GLHardwareBufferManager()
-	: scratch_buffer_pool_(nullptr), map_buffer_threshold_(GL_DEFAULT_MAP_BUFFER_THRESHOLD) {
+	: scratch_allocator_(SCRATCH_POOL_SIZE, SCRATCH_MAX_POOL_SIZE), map_buffer_threshold_(GL_DEFAULT_MAP_BUFFER_THRESHOLD),
+	static_buffer_sub_allocation_(false), memory_budget_(0), frame_number_(1), resident_bytes_(0), vertex_buffer_bytes_(0),
+	index_buffer_bytes_(0), evicted_bytes_(0), evicted_buffer_count_(0), eviction_count_(0), restore_count_(0), staging_bytes_(0),
+	idle_staging_bytes_(0), usage_promotion_(true), usage_promotion_logging_(false), usage_promotion_count_(0) {
 		state_cache_manager_ = nullptr;
-		scratch_buffer_pool_ = static_cast<char *>(malloc_aligned<MEMCATEGORY_GEOMETRY, SCRATCH_ALIGNMENT>(SCRATCH_POOL_SIZE));
-		GLScratchBufferAlloc * head_alloc = reinterpret_cast<GLScratchBufferAlloc*>(scratch_buffer_pool_);
-		head_alloc->size = SCRATCH_POOL_SIZE - sizeof(GLScratchBufferAlloc);
-		head_alloc->free = 1;
-		map_buffer_threshold_ = 0;
 	}
 	//--------------------------------------------------------------------------------------------------------------------------------
 	GLHardwareBufferManager::~GLHardwareBufferManager() {
 		destroyAllVertexDeclarations();
 		destroyAllVertexBufferBindings();
-		free_aligned<MEMCATEGORY_GEOMETRY, SCRATCH_ALIGNMENT>(scratch_buffer_pool_);
+		for (auto & value : mega_buffer_map_) {
+			for (auto mega_buffer : value.second)
+				delete mega_buffer;
+		}
+		mega_buffer_map_.clear();
+		processPendingReadbacks(true);
+		for (auto & value : staging_buffers_)
+			getStateCacheManager()->deleteGLBuffer(GL_COPY_WRITE_BUFFER, value.second.buffer_id);
+		staging_buffers_.clear();
 	}
 	//--------------------------------------------------------------------------------------------------------------------------------
 	size_t GLHardwareBufferManager::getGLMapBufferThreshold() const {
@@ -241,6 +1064,9 @@ namespace Astero {
 		map_buffer_threshold_ = value;
 	}
 	GLStateCacheManager * GLHardwareBufferManager::getStateCacheManager() {
+		// Shares state cache of render system, so both see the same bindings.
+		if (!state_cache_manager_)
+			state_cache_manager_ = GLStateCacheManager::getSingletonPtr();
 		return state_cache_manager_;
 	}
 	//--------------------------------------------------------------------------------------------------------------------------------
@@ -306,55 +1132,415 @@ namespace Astero {
 	}
 	//--------------------------------------------------------------------------------------------------------------------------------
 	void * GLHardwareBufferManager::allocateScratch(unsigned int size) {
-		Lock lock(scratch_mutex_);
-		if (size % 4 != 0)
-			size += 4 - (size % 4);
-		unsigned int pos = 0;
-		GLScratchBufferAlloc * cur = nullptr;
-		while (pos < SCRATCH_POOL_SIZE) {
-			cur = (GLScratchBufferAlloc *)(scratch_buffer_pool_ + pos);
-			if (cur->free && cur->size >= size) {
-				if (cur->size > size + sizeof(GLScratchBufferAlloc)) {
-					unsigned int offset = (unsigned int)sizeof(GLScratchBufferAlloc) + size;
-					GLScratchBufferAlloc * next = cur + offset;
-					next->free = 1;
-					next->size = cur->size - offset;
-					cur->size = size;
+		return scratch_allocator_.allocate(size);
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void GLHardwareBufferManager::deallocateScratch(void * ptr) {
+		scratch_allocator_.deallocate(ptr);
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	GLScratchAllocator::Stats GLHardwareBufferManager::getScratchStats() const {
+		return scratch_allocator_.getStats();
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void GLHardwareBufferManager::setStaticBufferSubAllocation(bool enabled) {
+		static_buffer_sub_allocation_ = enabled;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	bool GLHardwareBufferManager::isStaticBufferSubAllocationEnabled() const {
+		return static_buffer_sub_allocation_;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	bool GLHardwareBufferManager::allocateMegaBufferRange(GLBufferObjectHolder * holder, GLenum target, HardwareBuffer::Usage usage,
+														  size_t size, size_t alignment, GLMegaBuffer *& mega_buffer, size_t & offset) {
+		if (!static_buffer_sub_allocation_ || !(usage & HardwareBuffer::HBU_STATIC) || size > GL_MEGA_BUFFER_MAX_SUB_ALLOCATION)
+			return false;
+		Lock lock(mega_buffer_mutex_);
+		GLenum gl_usage = getGLUsage(usage);
+		MegaBufferList & mega_buffers = mega_buffer_map_[std::make_pair(target, gl_usage)];
+		for (auto candidate : mega_buffers) {
+			if (candidate->allocate(holder, size, alignment, offset)) {
+				mega_buffer = candidate;
+				return true;
+			}
+		}
+		// Enough free space in total, but fragmented.
+		for (auto candidate : mega_buffers) {
+			if (candidate->getFreeBytes() >= size + alignment) {
+				if (candidate->compact() && candidate->allocate(holder, size, alignment, offset)) {
+					mega_buffer = candidate;
+					return true;
 				}
-				cur->free = 0;
-				return ++cur;
 			}
-			pos += (unsigned int)sizeof(GLScratchBufferAlloc) + cur->size;
 		}
-		return nullptr;
+		GLMegaBuffer * new_mega_buffer = new GLMegaBuffer(this, target, gl_usage, GL_MEGA_BUFFER_SIZE);
+		mega_buffers.push_back(new_mega_buffer);
+		bool allocated = new_mega_buffer->allocate(holder, size, alignment, offset);
+		assert(allocated);
+		mega_buffer = new_mega_buffer;
+		return allocated;
 	}
 	//--------------------------------------------------------------------------------------------------------------------------------
-	void GLHardwareBufferManager::deallocateScratch(void * ptr) {
-		Lock lock(scratch_mutex_);
-		unsigned int pos = 0;
-		GLScratchBufferAlloc * prev = nullptr;
-		GLScratchBufferAlloc * cur = nullptr;
-		GLScratchBufferAlloc * next = nullptr;
-		while (pos < SCRATCH_POOL_SIZE) {
-			cur = reinterpret_cast<GLScratchBufferAlloc*>(scratch_buffer_pool_) + pos;
-			if (cur + sizeof(GLScratchBufferAlloc) == ptr) {
-				cur->free = 1;
-				if (prev && prev->free) {
-					pos -= prev->size + sizeof(GLScratchBufferAlloc);
-					prev->size += cur->size + sizeof(GLScratchBufferAlloc);
-					cur = prev;
-				}
-				if (pos + cur->size + sizeof(GLScratchBufferAlloc) < SCRATCH_POOL_SIZE) {
-					next = cur + cur->size + sizeof(GLScratchBufferAlloc);
-					if (next->free) {
-						cur->size += next->size + sizeof(GLScratchBufferAlloc);
-					}
-				}
-				return;
+	void GLHardwareBufferManager::deallocateMegaBufferRange(GLMegaBuffer * mega_buffer, size_t offset) {
+		Lock lock(mega_buffer_mutex_);
+		mega_buffer->deallocate(offset);
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void GLHardwareBufferManager::compactMegaBuffers() {
+		Lock lock(mega_buffer_mutex_);
+		for (auto & value : mega_buffer_map_) {
+			for (auto mega_buffer : value.second) {
+				// Compacts when largest free block is less than half of free space.
+				if (mega_buffer->getLargestFreeBlock() * 2 < mega_buffer->getFreeBytes())
+					mega_buffer->compact();
+			}
+		}
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	size_t GLHardwareBufferManager::getMegaBufferCount() const {
+		size_t count = 0;
+		for (auto & value : mega_buffer_map_)
+			count += value.second.size();
+		return count;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	bool GLHardwareBufferManager::isAsyncReadbackSupported() const {
+		return GLEW_ARB_copy_buffer && GLEW_ARB_sync;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	GLuint GLHardwareBufferManager::allocateStagingBuffer(size_t size, size_t & staging_size) {
+		// Reuses the smallest idle staging buffer which fits, unless it is much larger than needed.
+		auto iter = staging_buffers_.lower_bound(size);
+		if (iter != staging_buffers_.end() && iter->first <= size * GL_STAGING_BUFFER_MAX_SIZE_RATIO) {
+			GLuint buffer_id = iter->second.buffer_id;
+			staging_size = iter->first;
+			idle_staging_bytes_ -= staging_size;
+			staging_buffers_.erase(iter);
+			getStateCacheManager()->bindGLBuffer(GL_COPY_WRITE_BUFFER, buffer_id);
+			return buffer_id;
+		}
+		GLuint buffer_id = 0;
+		glGenBuffersARB(1, &buffer_id);
+		assert(buffer_id);
+		getStateCacheManager()->bindGLBuffer(GL_COPY_WRITE_BUFFER, buffer_id);
+		glBufferDataARB(GL_COPY_WRITE_BUFFER, size, nullptr, GL_STREAM_READ);
+		staging_size = size;
+		staging_bytes_ += size;
+		return buffer_id;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void GLHardwareBufferManager::releaseStagingBuffer(GLuint buffer_id, size_t size) {
+		if (idle_staging_bytes_ + size > GL_STAGING_BUFFER_POOL_MAX_BYTES) {
+			getStateCacheManager()->deleteGLBuffer(GL_COPY_WRITE_BUFFER, buffer_id);
+			staging_bytes_ -= size;
+			return;
+		}
+		IdleStagingBuffer idle = {buffer_id, frame_number_};
+		staging_buffers_.insert(StagingBufferMap::value_type(size, idle));
+		idle_staging_bytes_ += size;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void GLHardwareBufferManager::trimStagingBuffers() {
+		for (auto iter = staging_buffers_.begin(); iter != staging_buffers_.end();) {
+			if (frame_number_ - iter->second.release_frame > GL_STAGING_BUFFER_MAX_IDLE_FRAMES) {
+				getStateCacheManager()->deleteGLBuffer(GL_COPY_WRITE_BUFFER, iter->second.buffer_id);
+				staging_bytes_ -= iter->first;
+				idle_staging_bytes_ -= iter->first;
+				iter = staging_buffers_.erase(iter);
+			}
+			else {
+				++iter;
 			}
-			pos += sizeof(GLScratchBufferAlloc) + cur->size;
-			prev = cur;
 		}
-		assert(false);
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void GLHardwareBufferManager::queueReadback(GLuint buffer_id, size_t offset, const HardwareBufferReadbackPtr & readback) {
+		PendingReadback pending;
+		pending.readback = readback;
+		pending.staging_buffer_id = allocateStagingBuffer(readback->getSize(), pending.staging_size);
+		getStateCacheManager()->bindGLBuffer(GL_COPY_READ_BUFFER, buffer_id);
+		glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, offset, 0, readback->getSize());
+		pending.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		pending_readbacks_.push_back(pending);
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void GLHardwareBufferManager::processPendingReadbacks(bool wait) {
+		// Copies complete in submission order, so stops at the first one which is not finished.
+		while (!pending_readbacks_.empty()) {
+			PendingReadback & pending = pending_readbacks_.front();
+			GLuint64 timeout = wait ? GL_TIMEOUT_IGNORED : 0;
+			GLenum result = glClientWaitSync(pending.fence, GL_SYNC_FLUSH_COMMANDS_BIT, timeout);
+			if (result == GL_TIMEOUT_EXPIRED)
+				break;
+			assert(result != GL_WAIT_FAILED);
+			glDeleteSync(pending.fence);
+			size_t size = pending.readback->getSize();
+			getStateCacheManager()->bindGLBuffer(GL_COPY_READ_BUFFER, pending.staging_buffer_id);
+			void * src = glMapBufferRange(GL_COPY_READ_BUFFER, 0, size, GL_MAP_READ_BIT);
+			assert(src);
+			memcpy(pending.readback->getDataForWrite(), src, size);
+			glUnmapBufferARB(GL_COPY_READ_BUFFER);
+			pending.readback->notifyReady();
+			releaseStagingBuffer(pending.staging_buffer_id, pending.staging_size);
+			pending_readbacks_.pop_front();
+		}
+		trimStagingBuffers();
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	size_t GLHardwareBufferManager::getPendingReadbackCount() const {
+		return pending_readbacks_.size();
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void GLHardwareBufferManager::setUsagePromotion(bool enabled) {
+		usage_promotion_ = enabled;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	bool GLHardwareBufferManager::isUsagePromotionEnabled() const {
+		return usage_promotion_;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void GLHardwareBufferManager::setUsagePromotionLogging(bool enabled) {
+		usage_promotion_logging_ = enabled;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	size_t GLHardwareBufferManager::getUsagePromotionCount() const {
+		return usage_promotion_count_;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void GLHardwareBufferManager::updateBufferUsage() {
+		Lock lock(gl_buffer_mutex_);
+		for (auto buffer : gl_buffers_) {
+			GLBufferWriteHistory & history = buffer->getWriteHistory();
+			history.advanceFrame();
+			if (!usage_promotion_ || history.getFrameCount() < GL_BUFFER_WRITE_HISTORY_FRAMES)
+				continue;
+			unsigned int written_frames = history.getWrittenFrameCount();
+			GLenum gl_usage = buffer->getGLUsage();
+			GLenum new_gl_usage = gl_usage;
+			if (written_frames >= GL_USAGE_PROMOTION_STREAM_THRESHOLD)
+				new_gl_usage = GL_STREAM_DRAW_ARB;
+			else if (written_frames >= GL_USAGE_PROMOTION_DYNAMIC_THRESHOLD)
+				new_gl_usage = GL_DYNAMIC_DRAW_ARB;
+			else if (written_frames == 0)
+				new_gl_usage = GL_STATIC_DRAW_ARB;
+			if (new_gl_usage == gl_usage || !buffer->setGLUsage(new_gl_usage))
+				continue;
+			// Needs a full window of new history before changing again.
+			history.reset();
+			// Buffers moved into a mega-buffer are no longer evictable.
+			updateLRUList(buffer);
+			++usage_promotion_count_;
+			if (usage_promotion_logging_) {
+				fprintf(stderr, "Astero: buffer object %u changed usage from %s to %s, written in %u of last %u frames.\n",
+						buffer->getGLBufferId(), getGLUsageName(gl_usage), getGLUsageName(new_gl_usage), written_frames,
+						GL_BUFFER_WRITE_HISTORY_FRAMES);
+			}
+		}
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void GLHardwareBufferManager::registerGLBuffer(GLBufferObjectHolder * buffer) {
+		Lock lock(gl_buffer_mutex_);
+		gl_buffers_.insert(buffer);
+		// Attributes buffer to resource being loaded on this thread, if any.
+		Resource * resource = Resource::getLoadingResource();
+		if (resource) {
+			buffer->resource_account_ = &resource_accounts_[resource->getName()];
+			buffer->group_account_ = &group_accounts_[resource->getGroup()];
+			++buffer->resource_account_->buffer_count;
+			++buffer->group_account_->buffer_count;
+		}
+		accountGLBuffer(buffer, true);
+		updateLRUList(buffer);
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void GLHardwareBufferManager::unregisterGLBuffer(GLBufferObjectHolder * buffer) {
+		Lock lock(gl_buffer_mutex_);
+		gl_buffers_.erase(buffer);
+		accountGLBuffer(buffer, false);
+		if (buffer->resource_account_) {
+			--buffer->resource_account_->buffer_count;
+			--buffer->group_account_->buffer_count;
+		}
+		if (buffer->in_lru_list_) {
+			lru_list_.erase(buffer->lru_iterator_);
+			buffer->in_lru_list_ = false;
+		}
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	const char * GLHardwareBufferManager::getGLUsageName(GLenum gl_usage) {
+		switch (gl_usage) {
+			case GL_STATIC_DRAW_ARB:
+				return "GL_STATIC_DRAW";
+			case GL_DYNAMIC_DRAW_ARB:
+				return "GL_DYNAMIC_DRAW";
+			case GL_STREAM_DRAW_ARB:
+				return "GL_STREAM_DRAW";
+			default:
+				return "unknown usage";
+		}
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void GLHardwareBufferManager::setGpuMemoryBudget(size_t bytes) {
+		Lock lock(gl_buffer_mutex_);
+		memory_budget_ = bytes;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	size_t GLHardwareBufferManager::getGpuMemoryBudget() const {
+		return memory_budget_;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	GLHardwareBufferManager::MemoryStats GLHardwareBufferManager::getMemoryStats() const {
+		MemoryStats stats;
+		{
+			Lock lock(gl_buffer_mutex_);
+			stats.budget = memory_budget_;
+			stats.resident_bytes = resident_bytes_;
+			stats.vertex_buffer_bytes = vertex_buffer_bytes_;
+			stats.index_buffer_bytes = index_buffer_bytes_;
+			stats.evicted_bytes = evicted_bytes_;
+			stats.staging_bytes = staging_bytes_;
+			stats.buffer_count = gl_buffers_.size();
+			stats.evicted_buffer_count = evicted_buffer_count_;
+			stats.eviction_count = eviction_count_;
+			stats.restore_count = restore_count_;
+		}
+		stats.mega_buffer_bytes = 0;
+		Lock lock(mega_buffer_mutex_);
+		for (auto & value : mega_buffer_map_) {
+			for (auto mega_buffer : value.second)
+				stats.mega_buffer_bytes += mega_buffer->getSize();
+		}
+		return stats;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	GLBufferMemoryAccount GLHardwareBufferManager::getResourceMemoryAccount(const std::string & name) const {
+		Lock lock(gl_buffer_mutex_);
+		auto iter = resource_accounts_.find(name);
+		if (iter != resource_accounts_.end())
+			return iter->second;
+		GLBufferMemoryAccount account = {0, 0, 0};
+		return account;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	GLBufferMemoryAccount GLHardwareBufferManager::getGroupMemoryAccount(const std::string & group) const {
+		Lock lock(gl_buffer_mutex_);
+		auto iter = group_accounts_.find(group);
+		if (iter != group_accounts_.end())
+			return iter->second;
+		GLBufferMemoryAccount account = {0, 0, 0};
+		return account;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	GLHardwareBufferManager::MemoryAccountMap GLHardwareBufferManager::getResourceMemoryAccounts() const {
+		Lock lock(gl_buffer_mutex_);
+		return resource_accounts_;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	GLHardwareBufferManager::MemoryAccountMap GLHardwareBufferManager::getGroupMemoryAccounts() const {
+		Lock lock(gl_buffer_mutex_);
+		return group_accounts_;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void GLHardwareBufferManager::touchGLBuffer(GLBufferObjectHolder * buffer) {
+		Lock lock(gl_buffer_mutex_);
+		buffer->last_used_frame_ = frame_number_;
+		if (!buffer->isResident())
+			restoreGLBuffer(buffer);
+		updateLRUList(buffer);
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void GLHardwareBufferManager::updateResidency() {
+		Lock lock(gl_buffer_mutex_);
+		++frame_number_;
+		enforceMemoryBudget();
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void GLHardwareBufferManager::accountGLBuffer(GLBufferObjectHolder * buffer, bool add) {
+		size_t size = buffer->getGLBufferSize();
+		size_t & target_bytes = (buffer->getGLTarget() == GL_ELEMENT_ARRAY_BUFFER_ARB) ? index_buffer_bytes_ : vertex_buffer_bytes_;
+		if (buffer->isResident()) {
+			resident_bytes_ = add ? resident_bytes_ + size : resident_bytes_ - size;
+			target_bytes = add ? target_bytes + size : target_bytes - size;
+		}
+		else {
+			evicted_bytes_ = add ? evicted_bytes_ + size : evicted_bytes_ - size;
+			evicted_buffer_count_ = add ? evicted_buffer_count_ + 1 : evicted_buffer_count_ - 1;
+		}
+		for (GLBufferMemoryAccount * account : {buffer->resource_account_, buffer->group_account_}) {
+			if (!account)
+				continue;
+			size_t & bytes = buffer->isResident() ? account->resident_bytes : account->evicted_bytes;
+			bytes = add ? bytes + size : bytes - size;
+		}
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void GLHardwareBufferManager::updateLRUList(GLBufferObjectHolder * buffer) {
+		bool evictable = buffer->isResident() && buffer->isEvictable();
+		if (buffer->in_lru_list_) {
+			if (evictable) {
+				lru_list_.splice(lru_list_.begin(), lru_list_, buffer->lru_iterator_);
+			}
+			else {
+				lru_list_.erase(buffer->lru_iterator_);
+				buffer->in_lru_list_ = false;
+			}
+		}
+		else if (evictable) {
+			buffer->lru_iterator_ = lru_list_.insert(lru_list_.begin(), buffer);
+			buffer->in_lru_list_ = true;
+		}
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void GLHardwareBufferManager::evictGLBuffer(GLBufferObjectHolder * buffer) {
+		accountGLBuffer(buffer, false);
+		buffer->evict();
+		accountGLBuffer(buffer, true);
+		++eviction_count_;
+		if (buffer->in_lru_list_) {
+			lru_list_.erase(buffer->lru_iterator_);
+			buffer->in_lru_list_ = false;
+		}
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void GLHardwareBufferManager::restoreGLBuffer(GLBufferObjectHolder * buffer) {
+		accountGLBuffer(buffer, false);
+		buffer->restore();
+		accountGLBuffer(buffer, true);
+		++restore_count_;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void GLHardwareBufferManager::enforceMemoryBudget() {
+		if (memory_budget_ == 0)
+			return;
+		while (resident_bytes_ > memory_budget_ && !lru_list_.empty()) {
+			GLBufferObjectHolder * buffer = lru_list_.back();
+			// Everything left has been used in current frame.
+			if (buffer->last_used_frame_ >= frame_number_)
+				break;
+			// Buffer has been locked since it was last touched.
+			if (!buffer->isEvictable()) {
+				lru_list_.pop_back();
+				buffer->in_lru_list_ = false;
+				continue;
+			}
+			evictGLBuffer(buffer);
+		}
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	HardwareBufferManager * createHardwareBufferManager(HardwareBufferManagerType type) {
+		switch (type) {
+			case HBMT_SOFTWARE:
+				return new DefaultHardwareBufferManager();
+			case HBMT_OPENGL:
+			default:
+				return new GLHardwareBufferManager();
+		}
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	HardwareBufferManagerType getHardwareBufferManagerTypeFromEnvironment() {
+		const char * value = getenv("ASTERO_HARDWARE_BUFFER_MANAGER");
+		if (value && std::string(value) == "software")
+			return HBMT_SOFTWARE;
+		return HBMT_OPENGL;
 	}
 } // namespace Astero
@@ -13,6 +13,7 @@
 #include <mutex>
 #include <map>
 #include <memory> // shared_ptr
+#include <atomic>
 
 #include <GL/glew.h>
 #include <OpenGL/glu.h>
@@ -21,6 +22,13 @@
 #include "AsteroHardwareBuffer.h"
 #include "AsteroSingleton.tpp"
 
+// Slots of the lock-free table holding free temporary vertex buffers.
+#define TEMPORARY_BUFFER_POOL_SLOT_COUNT 256
+// Number of slots searched for a free buffer of one key, starting at its hash.
+#define TEMPORARY_BUFFER_POOL_PROBE_LENGTH 16
+// Free temporary vertex buffers kept by each thread.
+#define TEMPORARY_BUFFER_THREAD_CACHE_DEPTH 8
+
 //--------------------------------------------------------------------------------------------------------------------------------
 namespace Astero {
 	// Abstract class representing a licensee who requests a hardware buffer copy.
@@ -31,6 +39,126 @@ namespace Astero {
 		virtual void licenseExpired(HardwareBuffer * buf);
 	};
 	
+	// Staging memory which any thread may fill with data for a range of a hardware buffer. Once submitted, it is uploaded
+	// by render thread when hardware buffer manager processes its upload queue.
+	struct HardwareBufferUpload {
+		HardwareBufferPtr buffer;
+		size_t offset;
+		size_t size;
+		void * data;
+		// Submission order, so that overlapping uploads of a buffer are applied in order.
+		size_t sequence;
+	};
+	
+	// Pool of free temporary vertex buffers, shared by all source buffers of the same layout. Buffers are keyed by vertex
+	// size, vertex number and usage, so that a copy released by one mesh can serve another one of the same layout, and a
+	// copy always has exactly the size of its source. Each thread keeps a few free buffers per pool, the rest are kept in
+	// a fixed open-addressed table whose slots are claimed with compare-and-swap. A thread cache is guarded by a mutex of
+	// its own, which is only contended while pool frees unused buffers of all threads.
+	class TemporaryVertexBufferPool {
+	public:
+		struct Key {
+			size_t vertex_size;
+			size_t vertex_num;
+			HardwareBuffer::Usage usage;
+			
+			bool operator==(const Key & other) const {
+				return vertex_size == other.vertex_size && vertex_num == other.vertex_num && usage == other.usage;
+			}
+		};
+		struct Stats {
+			// Number of acquisitions served from pool, including thread caches.
+			size_t hit_count;
+			// Number of acquisitions served from a per-thread cache.
+			size_t thread_cache_hit_count;
+			// Number of acquisitions which found no free buffer.
+			size_t miss_count;
+			// Number of free buffers kept by pool.
+			size_t retained_count;
+			// Bytes of free buffers kept by pool.
+			size_t retained_bytes;
+		};
+		
+		TemporaryVertexBufferPool();
+		~TemporaryVertexBufferPool();
+		
+		static Key makeKey(size_t vertex_size, size_t vertex_num, HardwareBuffer::Usage usage);
+		// Takes a free buffer of key out of pool. Returns empty pointer if there is none.
+		HardwareVertexBufferPtr acquire(const Key & key);
+		// Puts a free buffer into pool. Buffer is dropped if pool is full.
+		void release(const HardwareVertexBufferPtr & buffer);
+		// Drops free buffers not referenced anywhere else, from shared table and caches of all threads.
+		void freeUnused();
+		// Drops free buffers of key not referenced anywhere else.
+		void freeUnused(const Key & key);
+		size_t getRetainedCount() const;
+		Stats getStats() const;
+		// Resets hit and miss counters.
+		void resetStats();
+		
+	protected:
+		enum SlotState {
+			SS_EMPTY,
+			// Slot is being read or written by one thread.
+			SS_BUSY,
+			SS_FULL
+		};
+		struct Slot {
+			std::atomic<unsigned int> state;
+			Key key;
+			HardwareVertexBufferPtr buffer;
+		};
+		typedef std::mutex Mutex;
+		typedef std::lock_guard<Mutex> Lock;
+		// Free buffers cached by one thread for one pool.
+		struct ThreadCache {
+			ThreadCache();
+			Mutex mutex;
+			unsigned int count;
+			Key keys[TEMPORARY_BUFFER_THREAD_CACHE_DEPTH];
+			HardwareVertexBufferPtr buffers[TEMPORARY_BUFFER_THREAD_CACHE_DEPTH];
+		};
+		// Caches of one thread, keyed by pool id. Returns cached buffers to pools still alive when thread exits.
+		struct ThreadCacheMap {
+			ThreadCacheMap();
+			~ThreadCacheMap();
+			std::map<size_t, std::unique_ptr<ThreadCache>> caches;
+			// Most recently used cache, checked before map lookup.
+			size_t last_id;
+			ThreadCache * last_cache;
+		};
+		typedef std::set<ThreadCache *> ThreadCacheList;
+		typedef std::map<size_t, TemporaryVertexBufferPool *> PoolRegistry;
+		
+		// Living pools by id. Registry mutex is held while a thread flushes its caches, or a pool is destroyed.
+		static Mutex & getRegistryMutex();
+		static PoolRegistry & getRegistry();
+		static size_t hashKey(const Key & key);
+		// Cache of calling thread for this pool, created and registered on first use.
+		ThreadCache & getThreadCache();
+		HardwareVertexBufferPtr acquireShared(const Key & key);
+		bool releaseShared(const Key & key, const HardwareVertexBufferPtr & buffer);
+		// Drops unreferenced free buffers, only those of key if key is not null. Buffers are destroyed after all locks are
+		// released, since a buffer destructor may call back into hardware buffer manager.
+		void freeUnusedBuffers(const Key * key);
+		// Moves unreferenced free buffers of a thread cache into unused. Requires cache mutex held.
+		void freeUnusedBuffers(ThreadCache & cache, const Key * key, std::vector<HardwareVertexBufferPtr> & unused);
+		
+		// Unique for process lifetime, so that a stale cache is never mistaken for one of a newer pool.
+		size_t id_;
+		Slot slots_[TEMPORARY_BUFFER_POOL_SLOT_COUNT];
+		// Registry of thread caches, only locked when a thread first uses pool or exits, or when unused buffers are freed.
+		ThreadCacheList thread_caches_;
+		Mutex thread_cache_mutex_;
+		std::atomic<size_t> hit_count_;
+		std::atomic<size_t> thread_cache_hit_count_;
+		std::atomic<size_t> miss_count_;
+		std::atomic<size_t> retained_count_;
+		std::atomic<size_t> retained_bytes_;
+		
+		friend struct ThreadCacheMap;
+	};
+	
 	// Abstract class representing a hardware buffer manager, which is responsible for managing hardware buffers, such as
 	// vertex buffer, index buffer, and temporary vertex buffer copies, and also relating classes: VertexDeclaration, and
 	// VertexBufferBinding.
@@ -92,8 +220,19 @@ namespace Astero {
 		virtual void forceReleaseBufferCopies(const HardwareVertexBufferPtr & source);
 		// Forces the release of a given buffer copy.
 		virtual void forceReleaseBufferCopies(HardwareVertexBuffer * source);
+		TemporaryVertexBufferPool::Stats getTemporaryBufferPoolStats() const;
 		// Notifies that a hardware vertex buffer has been destroyed.
 		void notifyVertexBufferDestroyed(HardwareVertexBuffer * buffer);
+		// Reserves staging memory for size bytes at offset of buffer. Thread safe, so worker threads can fill buffers
+		// without touching graphics API.
+		HardwareBufferUpload * beginUpload(const HardwareBufferPtr & buffer, size_t offset, size_t size);
+		// Queues a filled upload. Thread safe.
+		void submitUpload(HardwareBufferUpload * upload);
+		// Releases an upload which has not been submitted. Thread safe.
+		void cancelUpload(HardwareBufferUpload * upload);
+		// Writes all submitted uploads to their buffers, grouped per buffer. Must be called on render thread.
+		void processUploads();
+		size_t getPendingUploadCount() const;
 		
 	protected:
 		typedef std::set<HardwareVertexBuffer *> VertexBufferList;
@@ -121,11 +260,9 @@ namespace Astero {
 			// licensee of temporary buffer.
 			HardwareBufferLicensee * licensee;
 		};
-		// Map from original buffer to temporary buffer.
-		typedef std::multimap<HardwareVertexBuffer *, HardwareVertexBufferPtr>
-		FreeTemporaryVertexBufferMap;
 		// Map from temporary buffer to detail of license.
 		typedef std::map<HardwareVertexBuffer *, VertexBufferLicense> TemporaryVertexBufferLicenseMap;
+		typedef std::vector<HardwareBufferUpload *> UploadList;
 		typedef std::recursive_mutex Mutex;
 		typedef std::lock_guard<Mutex> Lock;
 		
@@ -158,7 +295,11 @@ namespace Astero {
 		IndexBufferList index_buffer_list_;
 		VertexDeclarationList vertex_declaration_list_;
 		VertexBufferBindingList vertex_buffer_binding_list_;
-		FreeTemporaryVertexBufferMap free_temporary_vertex_buffer_map_;
+		// Free temporary buffers, shared by all source buffers.
+		TemporaryVertexBufferPool temporary_buffer_pool_;
+		// Submitted uploads waiting for render thread.
+		UploadList pending_uploads_;
+		size_t upload_sequence_;
 		TemporaryVertexBufferLicenseMap temporary_vertex_buffer_license_map_;
 		// Mutexes
 		Mutex vertex_buffer_mutex_;
@@ -166,6 +307,7 @@ namespace Astero {
 		Mutex vertex_declaration_mutex_;
 		Mutex vertex_buffer_binding_mutex_;
 		Mutex temporary_buffer_mutex_;
+		mutable Mutex upload_mutex_;
 		
 	};
 } // namespace Astero
@@ -177,17 +319,257 @@ namespace Astero {
 #define GL_DEFAULT_MAP_BUFFER_THRESHOLD (1024*32)
 #define SCRATCH_ALIGNMENT 32
 #define SCRATCH_POOL_SIZE 1 * 1024 * 1024
+#define SCRATCH_MAX_POOL_SIZE (16 * 1024 * 1024)
+#define SCRATCH_THREAD_CACHE_DEPTH 4
+#define GL_MEGA_BUFFER_SIZE (32 * 1024 * 1024)
+// Static buffers larger than this get a buffer object of their own even when sub-allocation is enabled.
+#define GL_MEGA_BUFFER_MAX_SUB_ALLOCATION (4 * 1024 * 1024)
+// Buffers written in at least this many frames of their write history are recreated as GL_STREAM_DRAW.
+#define GL_USAGE_PROMOTION_STREAM_THRESHOLD 28
+// Buffers written in at least this many frames of their write history are recreated as GL_DYNAMIC_DRAW.
+#define GL_USAGE_PROMOTION_DYNAMIC_THRESHOLD 8
+// Idle staging buffers are reused only for readbacks of at least 1 / GL_STAGING_BUFFER_MAX_SIZE_RATIO of their size.
+#define GL_STAGING_BUFFER_MAX_SIZE_RATIO 2
+// Bytes of idle staging buffers kept for reuse. Buffers released beyond this are deleted.
+#define GL_STAGING_BUFFER_POOL_MAX_BYTES (16 * 1024 * 1024)
+// Idle staging buffers not reused for this many frames are deleted.
+#define GL_STAGING_BUFFER_MAX_IDLE_FRAMES 120
 
 namespace Astero {
 
-	struct GLScratchBufferAlloc {
-		unsigned int size: 31;
-		unsigned int free: 1;
+	// Header of a block in scratch pool. The payload follows the header directly. Physical neighbours are reached through
+	// size and prev_physical, free blocks are linked into the segregated free list of their size class.
+	struct alignas(SCRATCH_ALIGNMENT) GLScratchBlock {
+		GLScratchBlock * prev_physical;
+		// Payload size in bytes, lowest bit is set when block is free.
+		size_t size;
+		GLScratchBlock * prev_free;
+		GLScratchBlock * next_free;
+	};
+	
+	// Two-level segregated fit (TLSF) allocator serving scratch memory for small buffer locks.
+	// Allocation and deallocation are O(1): free blocks are kept in size-class lists indexed by two bitmaps, and recently
+	// freed blocks are kept in a per-thread cache so that a lock/unlock pair usually never touches the shared pool.
+	// When the pool is exhausted, another chunk is reserved until max_pool_size is reached.
+	class GLScratchAllocator {
+	public:
+		struct Stats {
+			// Bytes reserved from system for scratch pool chunks.
+			size_t pool_size;
+			// Bytes currently handed out to callers.
+			size_t bytes_in_use;
+			// Largest value bytes_in_use has reached.
+			size_t high_water_mark;
+			// Number of successful allocations.
+			size_t allocation_count;
+			// Number of allocations served from a per-thread cache.
+			size_t thread_cache_hit_count;
+			// Number of chunks reserved after the initial one.
+			size_t pool_growth_count;
+			// Number of allocations that failed, and fell back to glMapBuffer.
+			size_t fallback_count;
+		};
+		
+		GLScratchAllocator(size_t pool_size, size_t max_pool_size);
+		~GLScratchAllocator();
+		
+		// Returns nullptr when request can not be served even after growing pool.
+		void * allocate(size_t size);
+		void deallocate(void * ptr);
+		Stats getStats() const;
+		// Resets counters and sets high water mark to current usage.
+		void resetStats();
+		
+	protected:
+		enum {
+			ALIGNMENT_LOG2 = 5,
+			// Number of second level subdivisions per first level, in log2.
+			SL_INDEX_COUNT_LOG2 = 4,
+			SL_INDEX_COUNT = 1 << SL_INDEX_COUNT_LOG2,
+			// Blocks smaller than SMALL_BLOCK_SIZE are all in first level 0, linearly subdivided.
+			FL_INDEX_SHIFT = SL_INDEX_COUNT_LOG2 + ALIGNMENT_LOG2,
+			SMALL_BLOCK_SIZE = 1 << FL_INDEX_SHIFT,
+			// Largest block is 1 GB.
+			FL_INDEX_MAX = 30,
+			FL_INDEX_COUNT = FL_INDEX_MAX - FL_INDEX_SHIFT + 1,
+			// Size classes up to 32 KB are cached per thread.
+			THREAD_CACHE_MAX_SIZE_LOG2 = 15,
+			THREAD_CACHE_CLASS_COUNT = (THREAD_CACHE_MAX_SIZE_LOG2 - FL_INDEX_SHIFT + 1) * SL_INDEX_COUNT + 1
+		};
+		typedef std::mutex Mutex;
+		typedef std::lock_guard<Mutex> Lock;
+		
+		// Free blocks cached by one thread for one allocator, indexed by size class.
+		struct ThreadCache {
+			ThreadCache();
+			unsigned int count[THREAD_CACHE_CLASS_COUNT];
+			GLScratchBlock * blocks[THREAD_CACHE_CLASS_COUNT][SCRATCH_THREAD_CACHE_DEPTH];
+		};
+		// Caches of one thread, keyed by allocator id. Returns cached blocks to allocators still alive when thread exits.
+		struct ThreadCacheMap {
+			ThreadCacheMap();
+			~ThreadCacheMap();
+			std::map<size_t, std::unique_ptr<ThreadCache>> caches;
+			// Most recently used cache, checked before map lookup.
+			size_t last_id;
+			ThreadCache * last_cache;
+		};
+		typedef std::set<ThreadCache *> ThreadCacheList;
+		typedef std::map<size_t, GLScratchAllocator *> AllocatorRegistry;
+		typedef std::vector<char *> PoolChunkList;
+		
+		// Living allocators by id. Registry mutex is held while a thread flushes its caches, or an allocator is destroyed.
+		static Mutex & getRegistryMutex();
+		static AllocatorRegistry & getRegistry();
+		// Cache of calling thread for this allocator, created and registered on first use.
+		ThreadCache & getThreadCache();
+		// Maps a block size to the size class it is stored in.
+		static void mappingInsert(size_t size, unsigned int & fl, unsigned int & sl);
+		// Maps a request size to the first size class whose blocks are all large enough.
+		static void mappingSearch(size_t size, unsigned int & fl, unsigned int & sl);
+		static size_t getBlockSize(const GLScratchBlock * block) {
+			return block->size & ~static_cast<size_t>(1);
+		}
+		static bool isBlockFree(const GLScratchBlock * block) {
+			return (block->size & 1) != 0;
+		}
+		static GLScratchBlock * getNextPhysical(GLScratchBlock * block) {
+			return reinterpret_cast<GLScratchBlock *>(reinterpret_cast<char *>(block + 1) + getBlockSize(block));
+		}
+		
+		// Following methods require mutex_ held.
+		GLScratchBlock * allocateBlock(size_t size);
+		void deallocateBlock(GLScratchBlock * block);
+		void insertFreeBlock(GLScratchBlock * block);
+		void removeFreeBlock(GLScratchBlock * block);
+		GLScratchBlock * findFreeBlock(size_t size);
+		void splitBlock(GLScratchBlock * block, size_t size);
+		bool growPool(size_t size);
+		// Returns all blocks cached by a thread to the shared pool.
+		void releaseThreadCache(ThreadCache * cache);
+		void updateHighWaterMark(size_t bytes_in_use);
+		
+		// Unique for process lifetime, so that a stale cache is never mistaken for one of a newer allocator.
+		size_t id_;
+		size_t chunk_size_;
+		size_t max_pool_size_;
+		PoolChunkList pool_chunks_;
+		unsigned int fl_bitmap_;
+		unsigned int sl_bitmap_[FL_INDEX_COUNT];
+		GLScratchBlock * free_lists_[FL_INDEX_COUNT][SL_INDEX_COUNT];
+		ThreadCacheList thread_caches_;
+		Mutex mutex_;
+		// Statistics, updated outside mutex_ on thread cache hits.
+		std::atomic<size_t> pool_size_;
+		std::atomic<size_t> bytes_in_use_;
+		std::atomic<size_t> high_water_mark_;
+		std::atomic<size_t> allocation_count_;
+		std::atomic<size_t> thread_cache_hit_count_;
+		std::atomic<size_t> pool_growth_count_;
+		std::atomic<size_t> fallback_count_;
+		
+		friend struct ThreadCacheMap;
+	};
+
+	// HardwareBufferManager keeping all buffers in system memory. It needs no GL context, which makes it suitable for
+	// headless tools, tests, and measuring CPU cost of buffer management apart from driver time. Shadow buffer requests are
+	// ignored since every buffer already lives in system memory.
+	class DefaultHardwareBufferManager : public HardwareBufferManager {
+	public:
+		DefaultHardwareBufferManager();
+		~DefaultHardwareBufferManager();
+		
+		// Creates a system memory vertex buffer.
+		HardwareVertexBufferPtr createVertexBuffer(size_t vertex_size,
+												   size_t vertex_num,
+												   HardwareBuffer::Usage usage,
+												   bool use_shadow_buffer = false) override;
+		// Creates a system memory index buffer.
+		HardwareIndexBufferPtr createIndexBuffer(HardwareIndexBuffer::IndexType index_type,
+												 size_t index_num,
+												 HardwareBuffer::Usage usage,
+												 bool use_shadow_buffer = false) override;
+		// Render to vertex buffer needs a GPU, so returns empty pointer.
+		RenderToVertexBufferPtr createRenderToVertexBuffer() override;
+	};
+	
+	class GLHardwareBufferManager;
+	
+	// GPU memory of buffers attributed to one resource or resource group, i.e. buffers created while it was loading.
+	struct GLBufferMemoryAccount {
+		size_t resident_bytes;
+		// Bytes of evicted buffers, which are kept in shadow buffers only.
+		size_t evicted_bytes;
+		size_t buffer_count;
+	};
+	
+	// A large GL buffer object from which static vertex or index buffers of one usage class are sub-allocated, which cuts
+	// buffer object count and buffer bind changes. Free space is kept in an offset-ordered free list, so that neighbouring
+	// free blocks merge on deallocation, and compact() moves live ranges together when free space is fragmented.
+	class GLMegaBuffer {
+	public:
+		GLMegaBuffer(GLHardwareBufferManager * manager, GLenum target, GLenum gl_usage, size_t size);
+		~GLMegaBuffer();
+		
+		// Reserves size bytes at an offset which is a multiple of alignment. Returns false if no free block is large enough.
+		bool allocate(GLBufferObjectHolder * holder, size_t size, size_t alignment, size_t & offset);
+		void deallocate(size_t offset);
+		// Moves all live ranges to the front of a new buffer object on GPU, and notifies their holders. Returns false
+		// without moving anything while any holder is locked, since its mapping or pending upload refers to old location.
+		bool compact();
+		GLuint getGLBufferId() const;
+		GLenum getTarget() const;
+		GLenum getGLUsage() const;
+		size_t getSize() const;
+		size_t getFreeBytes() const;
+		size_t getLargestFreeBlock() const;
+		size_t getAllocationCount() const;
+		
+	protected:
+		struct Allocation {
+			size_t size;
+			size_t alignment;
+			GLBufferObjectHolder * holder;
+		};
+		// Map from offset to size of free block.
+		typedef std::map<size_t, size_t> FreeBlockMap;
+		// Map from offset to live allocation.
+		typedef std::map<size_t, Allocation> AllocationMap;
+		
+		GLHardwareBufferManager * manager_;
+		GLenum target_;
+		GLenum gl_usage_;
+		GLuint buffer_id_;
+		size_t size_;
+		size_t free_bytes_;
+		FreeBlockMap free_blocks_;
+		AllocationMap allocations_;
 	};
 
 	// HardwareBufferManager for OpenGL
 	class GLHardwareBufferManager : public HardwareBufferManager {
 	public:
+		struct MemoryStats {
+			// Budget in bytes for buffer objects, 0 when unlimited.
+			size_t budget;
+			// Bytes of buffers which have GPU storage, including sub-allocated ones.
+			size_t resident_bytes;
+			size_t vertex_buffer_bytes;
+			size_t index_buffer_bytes;
+			// Bytes of evicted buffers, which are kept in shadow buffers only.
+			size_t evicted_bytes;
+			// Bytes reserved by mega-buffers, which sub-allocated buffers are part of.
+			size_t mega_buffer_bytes;
+			// Bytes of staging buffers used for readbacks, pending or idle.
+			size_t staging_bytes;
+			size_t buffer_count;
+			size_t evicted_buffer_count;
+			// Number of evictions and restorations since creation.
+			size_t eviction_count;
+			size_t restore_count;
+		};
+		typedef std::map<std::string, GLBufferMemoryAccount> MemoryAccountMap;
+		
 		GLHardwareBufferManager();
 		~GLHardwareBufferManager();
 		
@@ -209,19 +591,133 @@ namespace Astero {
 		static GLenum getGLUsage(unsigned int usage);
 		// Utility function to get corresponding GLenum type given VET type.
 		static GLenum getGLType(unsigned int type);
+		// Allocates memory from scratch pool. Returns nullptr if it fails, in which case caller should use glMapBuffer.
 		void * allocateScratch(unsigned int size);
 		void deallocateScratch(void * ptr);
+		GLScratchAllocator::Stats getScratchStats() const;
+		// Enables sub-allocating static vertex and index buffers out of shared mega-buffers. Only affects buffers created
+		// afterwards.
+		void setStaticBufferSubAllocation(bool enabled);
+		bool isStaticBufferSubAllocationEnabled() const;
+		// Reserves a range of a mega-buffer for a new buffer. Returns false if buffer should get a buffer object of its own.
+		bool allocateMegaBufferRange(GLBufferObjectHolder * holder, GLenum target, HardwareBuffer::Usage usage, size_t size,
+									 size_t alignment, GLMegaBuffer *& mega_buffer, size_t & offset);
+		void deallocateMegaBufferRange(GLMegaBuffer * mega_buffer, size_t offset);
+		// Compacts mega-buffers whose free space is fragmented. Mega-buffers with a locked range are left for a later call.
+		void compactMegaBuffers();
+		size_t getMegaBufferCount() const;
+		// Whether buffers can be read back without stalling, which requires copy buffer and sync objects.
+		bool isAsyncReadbackSupported() const;
+		// Copies size of readback bytes at offset of a buffer object to a staging buffer, and fences the copy.
+		void queueReadback(GLuint buffer_id, size_t offset, const HardwareBufferReadbackPtr & readback);
+		// Completes readbacks whose copies have finished on GPU. Never blocks unless wait is true, in which case all
+		// pending readbacks are completed. Also deletes staging buffers which have been idle too long. Called by render
+		// system once per frame.
+		void processPendingReadbacks(bool wait = false);
+		size_t getPendingReadbackCount() const;
+		// Enables recreating buffers with the GL usage hint matching how often they are actually written.
+		void setUsagePromotion(bool enabled);
+		bool isUsagePromotionEnabled() const;
+		// Enables printing usage changes to stderr. Off by default; getUsagePromotionCount counts changes either way.
+		void setUsagePromotionLogging(bool enabled);
+		size_t getUsagePromotionCount() const;
+		// Closes current frame in write history of every GL buffer, and changes usage of those whose history is full and
+		// does not match their usage. Called by render system once per frame.
+		void updateBufferUsage();
+		// Called by GL buffers on creation and destruction.
+		void registerGLBuffer(GLBufferObjectHolder * buffer);
+		void unregisterGLBuffer(GLBufferObjectHolder * buffer);
+		static const char * getGLUsageName(GLenum gl_usage);
+		// Sets GPU memory budget in bytes for buffer objects, 0 for unlimited. When exceeded, least recently used buffers
+		// which have shadow buffers are evicted at start of next frame, and restored when they are bound again.
+		void setGpuMemoryBudget(size_t bytes);
+		size_t getGpuMemoryBudget() const;
+		MemoryStats getMemoryStats() const;
+		// Memory of buffers created while resource of given name, or a resource of given group, was loading.
+		GLBufferMemoryAccount getResourceMemoryAccount(const std::string & name) const;
+		GLBufferMemoryAccount getGroupMemoryAccount(const std::string & group) const;
+		MemoryAccountMap getResourceMemoryAccounts() const;
+		MemoryAccountMap getGroupMemoryAccounts() const;
+		// Marks buffer as used by current frame, restoring it if it has been evicted. Called before buffer is bound.
+		void touchGLBuffer(GLBufferObjectHolder * buffer);
+		// Starts a new residency frame and evicts buffers while over budget. Called by render system once per frame.
+		void updateResidency();
 		
 	protected:
-		typedef std::recursive_mutex Mutex;
-		typedef std::lock_guard<Mutex> Lock;
+		typedef std::vector<GLMegaBuffer *> MegaBufferList;
+		// Mega-buffers keyed by GL target and GL usage.
+		typedef std::map<std::pair<GLenum, GLenum>, MegaBufferList> MegaBufferMap;
+		struct PendingReadback {
+			HardwareBufferReadbackPtr readback;
+			GLuint staging_buffer_id;
+			size_t staging_size;
+			GLsync fence;
+		};
+		typedef std::list<PendingReadback> PendingReadbackList;
+		struct IdleStagingBuffer {
+			GLuint buffer_id;
+			// Residency frame in which buffer has been released.
+			unsigned long long release_frame;
+		};
+		// Idle staging buffers keyed by size.
+		typedef std::multimap<size_t, IdleStagingBuffer> StagingBufferMap;
+		
+		GLuint allocateStagingBuffer(size_t size, size_t & staging_size);
+		// Keeps staging buffer for reuse, or deletes it if pool is full.
+		void releaseStagingBuffer(GLuint buffer_id, size_t size);
+		// Deletes staging buffers idle for more than GL_STAGING_BUFFER_MAX_IDLE_FRAMES frames.
+		void trimStagingBuffers();
+		// Following methods require gl_buffer_mutex_ held.
+		// Adds or subtracts buffer to or from memory totals according to its residency.
+		void accountGLBuffer(GLBufferObjectHolder * buffer, bool add);
+		// Keeps buffer in LRU list exactly when it is resident and evictable, and moves it to front.
+		void updateLRUList(GLBufferObjectHolder * buffer);
+		void evictGLBuffer(GLBufferObjectHolder * buffer);
+		void restoreGLBuffer(GLBufferObjectHolder * buffer);
+		void enforceMemoryBudget();
 		
 		GLStateCacheManager * state_cache_manager_;
-		char * scratch_buffer_pool_;
+		GLScratchAllocator scratch_allocator_;
 		size_t map_buffer_threshold_;
-		Mutex scratch_mutex_;
+		bool static_buffer_sub_allocation_;
+		MegaBufferMap mega_buffer_map_;
+		mutable Mutex mega_buffer_mutex_;
+		PendingReadbackList pending_readbacks_;
+		StagingBufferMap staging_buffers_;
+		std::unordered_set<GLBufferObjectHolder *> gl_buffers_;
+		mutable Mutex gl_buffer_mutex_;
+		// Resident evictable buffers, most recently used first.
+		std::list<GLBufferObjectHolder *> lru_list_;
+		MemoryAccountMap resource_accounts_;
+		MemoryAccountMap group_accounts_;
+		size_t memory_budget_;
+		unsigned long long frame_number_;
+		size_t resident_bytes_;
+		size_t vertex_buffer_bytes_;
+		size_t index_buffer_bytes_;
+		size_t evicted_bytes_;
+		size_t evicted_buffer_count_;
+		size_t eviction_count_;
+		size_t restore_count_;
+		size_t staging_bytes_;
+		size_t idle_staging_bytes_;
+		bool usage_promotion_;
+		bool usage_promotion_logging_;
+		size_t usage_promotion_count_;
 		
 	};
+	
+	// Hardware buffer manager backends which can be selected at runtime.
+	enum HardwareBufferManagerType {
+		HBMT_OPENGL,
+		// System memory only, see DefaultHardwareBufferManager.
+		HBMT_SOFTWARE
+	};
+	// Creates hardware buffer manager singleton of given backend.
+	HardwareBufferManager * createHardwareBufferManager(HardwareBufferManagerType type);
+	// Returns backend named by ASTERO_HARDWARE_BUFFER_MANAGER environment variable, "software" or "opengl". Defaults to
+	// OpenGL when variable is not set.
+	HardwareBufferManagerType getHardwareBufferManagerTypeFromEnvironment();
 }
 
 
@@ -103,6 +103,7 @@ namespace Astero {
 			MeshLoader mesh_loader;
 			DataStreamPtr data(data_stream_ptr_);
 			data_stream_ptr_ = nullptr;
+			ASTERO_PROFILE_SCOPE("MeshLoader::importMesh");
 			mesh_loader.importMesh(data, this);
 			//updateMaterialForAllSubMeshes();
 		}
@@ -13,6 +13,7 @@
 
 namespace Astero {
 	class HardwareBuffer;
+	class HardwareBufferReadback;
 	class HardwareBufferManager;
 	class HardwareVertexBuffer;
 	class HardwareIndexBuffer;
@@ -30,9 +31,11 @@ namespace Astero {
 	class Matrix4;
 
 	
+	typedef std::shared_ptr<HardwareBuffer> HardwareBufferPtr;
 	typedef std::shared_ptr<HardwareVertexBuffer> HardwareVertexBufferPtr;
 	typedef std::shared_ptr<HardwareIndexBuffer> HardwareIndexBufferPtr;
 	typedef std::shared_ptr<RenderToVertexBuffer> RenderToVertexBufferPtr;
+	typedef std::shared_ptr<HardwareBufferReadback> HardwareBufferReadbackPtr;
 	
 	class GLSupport;
 	class GLRenderSystem;
@@ -0,0 +1,232 @@
+//
+//  AsteroProfiler.cpp
+//  Astero
+//
+//  Created by Yuzhe Wang on 10/18/26.
+//  Copyright © 2026 Yuzhe Wang. All rights reserved.
+//
+
+#include <chrono>
+#include "AsteroProfiler.h"
+
+#if ASTERO_PROFILER
+namespace Astero {
+	namespace {
+		void writeJSONString(std::ostream & stream, const char * text) {
+			stream << '"';
+			for (const char * c = text; *c; ++c) {
+				if (*c == '"' || *c == '\\')
+					stream << '\\' << *c;
+				else if (static_cast<unsigned char>(*c) < 0x20)
+					stream << ' ';
+				else
+					stream << *c;
+			}
+			stream << '"';
+		}
+		
+		template <typename T>
+		void writeBinaryValue(std::ostream & stream, T value) {
+			stream.write(reinterpret_cast<const char *>(&value), sizeof(value));
+		}
+		
+		const std::chrono::steady_clock::time_point profiler_epoch = std::chrono::steady_clock::now();
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	std::atomic<bool> Profiler::enabled_(getenv("ASTERO_PROFILE") != nullptr);
+	//--------------------------------------------------------------------------------------------------------------------------------
+	Profiler::ThreadBuffer::ThreadBuffer(unsigned int index) : count(0), clear_requested(false), thread_index(index), depth(0) {
+		for (auto & chunk : chunks)
+			chunk.store(nullptr, std::memory_order_relaxed);
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	Profiler::ThreadBuffer::~ThreadBuffer() {
+		for (auto & chunk : chunks)
+			delete [] chunk.load(std::memory_order_relaxed);
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	Profiler::Profiler() : dropped_event_count_(0) {
+		
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	Profiler::~Profiler() {
+		for (auto buffer : thread_buffers_)
+			delete buffer;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	Profiler & Profiler::getInstance() {
+		static Profiler profiler;
+		return profiler;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void Profiler::setEnabled(bool enabled) {
+		enabled_.store(enabled, std::memory_order_relaxed);
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	uint64_t Profiler::now() {
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - profiler_epoch).count();
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	Profiler::ThreadBuffer & Profiler::getThreadBuffer() {
+		static thread_local ThreadBuffer * buffer = nullptr;
+		if (buffer)
+			return *buffer;
+		Lock lock(mutex_);
+		buffer = new ThreadBuffer(static_cast<unsigned int>(thread_buffers_.size()));
+		thread_buffers_.push_back(buffer);
+		return *buffer;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void Profiler::record(ThreadBuffer & buffer, const Event & event) {
+		if (buffer.clear_requested.load(std::memory_order_acquire)) {
+			buffer.count.store(0, std::memory_order_release);
+			buffer.clear_requested.store(false, std::memory_order_relaxed);
+		}
+		size_t index = buffer.count.load(std::memory_order_relaxed);
+		size_t chunk_index = index / PROFILER_CHUNK_EVENT_COUNT;
+		if (chunk_index >= PROFILER_MAX_CHUNK_COUNT) {
+			dropped_event_count_.fetch_add(1, std::memory_order_relaxed);
+			return;
+		}
+		Event * chunk = buffer.chunks[chunk_index].load(std::memory_order_relaxed);
+		if (chunk == nullptr) {
+			chunk = new Event[PROFILER_CHUNK_EVENT_COUNT];
+			buffer.chunks[chunk_index].store(chunk, std::memory_order_release);
+		}
+		chunk[index % PROFILER_CHUNK_EVENT_COUNT] = event;
+		buffer.count.store(index + 1, std::memory_order_release);
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	uint64_t Profiler::beginZone() {
+		++getInstance().getThreadBuffer().depth;
+		return now();
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void Profiler::endZone(const char * name, uint64_t begin) {
+		uint64_t end = now();
+		Profiler & profiler = getInstance();
+		ThreadBuffer & buffer = profiler.getThreadBuffer();
+		--buffer.depth;
+		Event event = {name, begin, end, 0.0, buffer.depth, ET_ZONE};
+		profiler.record(buffer, event);
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void Profiler::counter(const char * name, double value) {
+		if (!isEnabled())
+			return;
+		Profiler & profiler = getInstance();
+		ThreadBuffer & buffer = profiler.getThreadBuffer();
+		uint64_t time = now();
+		Event event = {name, time, time, value, buffer.depth, ET_COUNTER};
+		profiler.record(buffer, event);
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void Profiler::setThreadName(const std::string & name) {
+		Profiler & profiler = getInstance();
+		ThreadBuffer & buffer = profiler.getThreadBuffer();
+		Lock lock(profiler.mutex_);
+		buffer.name = name;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void Profiler::clear() {
+		Lock lock(mutex_);
+		for (auto buffer : thread_buffers_)
+			buffer->clear_requested.store(true, std::memory_order_release);
+		dropped_event_count_ = 0;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	size_t Profiler::getDroppedEventCount() const {
+		return dropped_event_count_.load(std::memory_order_relaxed);
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void Profiler::writeChromeTrace(std::ostream & stream) const {
+		Lock lock(mutex_);
+		stream << "{\"traceEvents\": [";
+		bool first = true;
+		for (auto buffer : thread_buffers_) {
+			if (!buffer->name.empty()) {
+				stream << (first ? "\n" : ",\n") << "\t{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": "
+					   << buffer->thread_index << ", \"args\": {\"name\": ";
+				writeJSONString(stream, buffer->name.c_str());
+				stream << "}}";
+				first = false;
+			}
+			if (buffer->clear_requested.load(std::memory_order_acquire))
+				continue;
+			size_t count = buffer->count.load(std::memory_order_acquire);
+			for (size_t i = 0; i < count; ++i) {
+				const Event & event = buffer->chunks[i / PROFILER_CHUNK_EVENT_COUNT].load(std::memory_order_acquire)[i % PROFILER_CHUNK_EVENT_COUNT];
+				stream << (first ? "\n" : ",\n") << "\t{\"name\": ";
+				writeJSONString(stream, event.name);
+				// Chrome trace times are microseconds.
+				stream << ", \"pid\": 1, \"tid\": " << buffer->thread_index << ", \"ts\": " << event.begin / 1000.0;
+				if (event.type == ET_ZONE)
+					stream << ", \"ph\": \"X\", \"dur\": " << (event.end - event.begin) / 1000.0 << "}";
+				else
+					stream << ", \"ph\": \"C\", \"args\": {\"value\": " << event.value << "}}";
+				first = false;
+			}
+		}
+		stream << "\n], \"displayTimeUnit\": \"ms\"}\n";
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void Profiler::writeBinary(std::ostream & stream) const {
+		Lock lock(mutex_);
+		// Names are string literals, so they are pooled by address.
+		std::unordered_map<const char *, uint32_t> string_indices;
+		std::vector<std::string> strings;
+		auto get_string_index = [&](const char * text) {
+			auto result = string_indices.insert(std::make_pair(text, static_cast<uint32_t>(strings.size())));
+			if (result.second)
+				strings.push_back(text);
+			return result.first->second;
+		};
+		std::vector<size_t> counts;
+		for (auto buffer : thread_buffers_) {
+			get_string_index(buffer->name.c_str());
+			size_t count = buffer->clear_requested.load(std::memory_order_acquire) ? 0 : buffer->count.load(std::memory_order_acquire);
+			counts.push_back(count);
+			for (size_t i = 0; i < count; ++i)
+				get_string_index(buffer->chunks[i / PROFILER_CHUNK_EVENT_COUNT].load(std::memory_order_acquire)[i % PROFILER_CHUNK_EVENT_COUNT].name);
+		}
+		stream.write("ASTPROF1", 8);
+		writeBinaryValue(stream, static_cast<uint32_t>(strings.size()));
+		for (const auto & text : strings) {
+			writeBinaryValue(stream, static_cast<uint32_t>(text.size()));
+			stream.write(text.data(), text.size());
+		}
+		writeBinaryValue(stream, static_cast<uint32_t>(thread_buffers_.size()));
+		for (size_t t = 0; t < thread_buffers_.size(); ++t) {
+			const ThreadBuffer * buffer = thread_buffers_[t];
+			writeBinaryValue(stream, static_cast<uint32_t>(buffer->thread_index));
+			writeBinaryValue(stream, string_indices[buffer->name.c_str()]);
+			writeBinaryValue(stream, static_cast<uint64_t>(counts[t]));
+			for (size_t i = 0; i < counts[t]; ++i) {
+				const Event & event = buffer->chunks[i / PROFILER_CHUNK_EVENT_COUNT].load(std::memory_order_acquire)[i % PROFILER_CHUNK_EVENT_COUNT];
+				writeBinaryValue(stream, string_indices[event.name]);
+				writeBinaryValue(stream, static_cast<uint8_t>(event.type));
+				writeBinaryValue(stream, static_cast<uint16_t>(event.depth));
+				writeBinaryValue(stream, static_cast<uint64_t>(event.begin));
+				writeBinaryValue(stream, static_cast<uint64_t>(event.end));
+				writeBinaryValue(stream, event.value);
+			}
+		}
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	bool Profiler::exportChromeTrace(const std::string & path) const {
+		std::ofstream stream(path.c_str());
+		if (!stream)
+			return false;
+		writeChromeTrace(stream);
+		return true;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	bool Profiler::exportBinary(const std::string & path) const {
+		std::ofstream stream(path.c_str(), std::ios::binary);
+		if (!stream)
+			return false;
+		writeBinary(stream);
+		return true;
+	}
+}
+#endif
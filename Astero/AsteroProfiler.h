@@ -0,0 +1,142 @@
+//
+//  AsteroProfiler.h
+//  Astero
+//
+//  Created by Yuzhe Wang on 10/18/26.
+//  Copyright © 2026 Yuzhe Wang. All rights reserved.
+//
+
+#ifndef AsteroProfiler_h
+#define AsteroProfiler_h
+
+#include <atomic>
+#include <mutex>
+#include "AsteroPrerequisites.h"
+
+// Profiler is compiled in unless ASTERO_PROFILER is defined to 0. It records nothing until enabled at runtime, by
+// Profiler::setEnabled or by setting ASTERO_PROFILE environment variable.
+#ifndef ASTERO_PROFILER
+#	define ASTERO_PROFILER 1
+#endif
+// Events per chunk of a thread's event buffer.
+#define PROFILER_CHUNK_EVENT_COUNT 4096
+// Chunks per thread, events past them are dropped.
+#define PROFILER_MAX_CHUNK_COUNT 1024
+
+#if ASTERO_PROFILER
+#	define ASTERO_PROFILE_CONCAT_IMPL(a, b) a##b
+#	define ASTERO_PROFILE_CONCAT(a, b) ASTERO_PROFILE_CONCAT_IMPL(a, b)
+// Profiles rest of enclosing scope as a zone. Name must outlive profiler, such as a string literal.
+#	define ASTERO_PROFILE_SCOPE(name) ::Astero::ProfileScope ASTERO_PROFILE_CONCAT(profile_scope_, __LINE__)(name)
+// Records value of a counter at current time.
+#	define ASTERO_PROFILE_COUNTER(name, value) ::Astero::Profiler::counter(name, static_cast<double>(value))
+// Names calling thread in exported traces.
+#	define ASTERO_PROFILE_THREAD_NAME(name) ::Astero::Profiler::setThreadName(name)
+#else
+#	define ASTERO_PROFILE_SCOPE(name)
+#	define ASTERO_PROFILE_COUNTER(name, value)
+#	define ASTERO_PROFILE_THREAD_NAME(name)
+#endif
+
+namespace Astero {
+#if ASTERO_PROFILER
+	// Hierarchical CPU profiler. Each thread appends zones and counters to its own buffer without locks, and buffers are
+	// exported as Chrome trace event JSON (chrome://tracing, Perfetto) or a compact binary format. Zones nest by time, and
+	// keep their depth on their thread.
+	class Profiler {
+	public:
+		enum EventType {
+			ET_ZONE,
+			ET_COUNTER
+		};
+		struct Event {
+			const char * name;
+			// Nanoseconds since profiler started.
+			uint64_t begin;
+			uint64_t end;
+			double value;
+			unsigned short depth;
+			unsigned char type;
+		};
+		
+		static Profiler & getInstance();
+		static bool isEnabled() {
+			return enabled_.load(std::memory_order_relaxed);
+		}
+		static void setEnabled(bool enabled);
+		// Starts a zone on calling thread, and returns its begin time.
+		static uint64_t beginZone();
+		static void endZone(const char * name, uint64_t begin);
+		static void counter(const char * name, double value);
+		static void setThreadName(const std::string & name);
+		static uint64_t now();
+		
+		// Discards recorded events. Each thread drops its events when it next records.
+		void clear();
+		// Number of events dropped because a thread's buffer was full.
+		size_t getDroppedEventCount() const;
+		// Export can run while threads record, events recorded meanwhile may be left out.
+		void writeChromeTrace(std::ostream & stream) const;
+		// Layout, in native byte order: "ASTPROF1", string count (u32), strings as length (u32) and bytes, thread count (u32),
+		// then per thread index (u32), name string (u32), event count (u64) and events as name string (u32), type (u8),
+		// depth (u16), begin (u64), end (u64), value (f64). Times are nanoseconds.
+		void writeBinary(std::ostream & stream) const;
+		// Write to a file, return false if it cannot be opened.
+		bool exportChromeTrace(const std::string & path) const;
+		bool exportBinary(const std::string & path) const;
+		
+	protected:
+		typedef std::mutex Mutex;
+		typedef std::lock_guard<Mutex> Lock;
+		
+		// Events of one thread. Only owning thread writes; count is published after event is written, so readers only see
+		// complete events.
+		struct ThreadBuffer {
+			ThreadBuffer(unsigned int index);
+			~ThreadBuffer();
+			
+			std::atomic<Event *> chunks[PROFILER_MAX_CHUNK_COUNT];
+			std::atomic<size_t> count;
+			std::atomic<bool> clear_requested;
+			unsigned int thread_index;
+			unsigned short depth;
+			// Guarded by mutex_ of profiler.
+			std::string name;
+		};
+		typedef std::vector<ThreadBuffer *> ThreadBufferList;
+		
+		Profiler();
+		~Profiler();
+		
+		ThreadBuffer & getThreadBuffer();
+		void record(ThreadBuffer & buffer, const Event & event);
+		
+		static std::atomic<bool> enabled_;
+		// Buffers of threads which have recorded, kept after threads exit so their events can be exported.
+		ThreadBufferList thread_buffers_;
+		std::atomic<size_t> dropped_event_count_;
+		mutable Mutex mutex_;
+	};
+	
+	// Zone covering lifetime of this object. Costs one relaxed load when profiler is disabled.
+	class ProfileScope {
+	public:
+		explicit ProfileScope(const char * name) : name_(Profiler::isEnabled() ? name : nullptr), begin_(0) {
+			if (name_)
+				begin_ = Profiler::beginZone();
+		}
+		~ProfileScope() {
+			if (name_)
+				Profiler::endZone(name_, begin_);
+		}
+		ProfileScope(const ProfileScope &) = delete;
+		ProfileScope & operator=(const ProfileScope &) = delete;
+		
+	private:
+		const char * name_;
+		uint64_t begin_;
+	};
+#endif
+}
+
+#endif // AsteroProfiler_h
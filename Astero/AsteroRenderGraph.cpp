@@ -0,0 +1,332 @@
+//
+//  AsteroRenderGraph.cpp
+//  Astero
+//
+//  Created by Yuzhe Wang on 10/18/26.
+//  Copyright © 2026 Yuzhe Wang. All rights reserved.
+//
+
+#include <queue>
+#include "AsteroRenderGraph.h"
+
+namespace Astero {
+	//--------------------------------------------------------------------------------------------------------------------------------
+	bool RenderGraphResourceDesc::operator==(const RenderGraphResourceDesc & other) const {
+		return width == other.width && height == other.height && format == other.format && fsaa == other.fsaa
+		&& depth == other.depth;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	RenderGraph::RenderGraph(RenderGraphAllocator * allocator) : allocator_(allocator), compiled_(false) {
+		assert(allocator_);
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	RenderGraph::~RenderGraph() {
+		for (auto & physical : physical_resources_)
+			destroyPhysicalResource(physical);
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	RenderGraph::ResourceHandle RenderGraph::createTransient(const std::string & name, const RenderGraphResourceDesc & desc) {
+		Resource resource;
+		resource.name = name;
+		resource.desc = desc;
+		resource.imported = false;
+		resource.imported_target = nullptr;
+		resource.reference_count = 0;
+		resource.physical = INVALID_INDEX;
+		resource.first_use = INVALID_INDEX;
+		resource.last_use = INVALID_INDEX;
+		resources_.push_back(resource);
+		compiled_ = false;
+		return resources_.size() - 1;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	RenderGraph::ResourceHandle RenderGraph::importRenderTarget(const std::string & name, RenderTarget * render_target) {
+		RenderGraphResourceDesc desc = {0, 0, 0, 0, false};
+		ResourceHandle handle = createTransient(name, desc);
+		resources_[handle].imported = true;
+		resources_[handle].imported_target = render_target;
+		return handle;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	RenderGraph::PassHandle RenderGraph::addPass(const std::string & name, const ExecuteCallback & execute) {
+		Pass pass;
+		pass.name = name;
+		pass.execute = execute;
+		pass.side_effect = false;
+		pass.culled = false;
+		pass.reference_count = 0;
+		passes_.push_back(pass);
+		compiled_ = false;
+		return passes_.size() - 1;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void RenderGraph::read(PassHandle pass, ResourceHandle resource) {
+		assert(pass < passes_.size() && resource < resources_.size());
+		passes_[pass].reads.push_back(resource);
+		resources_[resource].readers.push_back(pass);
+		compiled_ = false;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void RenderGraph::write(PassHandle pass, ResourceHandle resource) {
+		assert(pass < passes_.size() && resource < resources_.size());
+		// Transient resources have a single producer.
+		assert(resources_[resource].imported || resources_[resource].writers.empty());
+		passes_[pass].writes.push_back(resource);
+		resources_[resource].writers.push_back(pass);
+		compiled_ = false;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void RenderGraph::setSideEffect(PassHandle pass) {
+		assert(pass < passes_.size());
+		passes_[pass].side_effect = true;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void RenderGraph::compile() {
+		cullPasses();
+		sortPasses();
+		allocateResources();
+		compiled_ = true;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void RenderGraph::cullPasses() {
+		// A pass is needed while some resource it writes is read. Kept passes hold an extra reference so they are never culled.
+		for (auto & pass : passes_) {
+			pass.culled = false;
+			pass.reference_count = pass.writes.size();
+			bool keep = pass.side_effect;
+			for (auto resource : pass.writes)
+				keep = keep || resources_[resource].imported;
+			if (keep)
+				++pass.reference_count;
+		}
+		std::vector<ResourceHandle> unreferenced;
+		for (size_t i = 0; i < resources_.size(); ++i) {
+			resources_[i].reference_count = resources_[i].readers.size();
+			if (resources_[i].reference_count == 0)
+				unreferenced.push_back(i);
+		}
+		while (!unreferenced.empty()) {
+			Resource & resource = resources_[unreferenced.back()];
+			unreferenced.pop_back();
+			for (auto writer : resource.writers) {
+				Pass & pass = passes_[writer];
+				if (pass.culled || --pass.reference_count > 0)
+					continue;
+				pass.culled = true;
+				// Inputs of a culled pass lose a reader.
+				for (auto input : pass.reads) {
+					if (--resources_[input].reference_count == 0)
+						unreferenced.push_back(input);
+				}
+			}
+		}
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void RenderGraph::sortPasses() {
+		std::vector<std::vector<PassHandle>> successors(passes_.size());
+		std::vector<size_t> in_degrees(passes_.size(), 0);
+		auto add_edge = [&](PassHandle from, PassHandle to) {
+			if (from == to || passes_[from].culled || passes_[to].culled)
+				return;
+			successors[from].push_back(to);
+			++in_degrees[to];
+		};
+		for (auto & resource : resources_) {
+			if (!resource.imported) {
+				for (auto writer : resource.writers) {
+					for (auto reader : resource.readers)
+						add_edge(writer, reader);
+				}
+				continue;
+			}
+			// Uses of an imported target keep their order of declaration: a read follows previous write, and a write follows
+			// previous write and reads since.
+			std::vector<std::pair<PassHandle, bool>> uses;
+			for (auto writer : resource.writers)
+				uses.push_back(std::make_pair(writer, true));
+			for (auto reader : resource.readers)
+				uses.push_back(std::make_pair(reader, false));
+			std::sort(uses.begin(), uses.end());
+			PassHandle last_writer = INVALID_INDEX;
+			std::vector<PassHandle> readers_since_write;
+			for (auto & use : uses) {
+				if (passes_[use.first].culled)
+					continue;
+				if (last_writer != INVALID_INDEX)
+					add_edge(last_writer, use.first);
+				if (use.second) {
+					for (auto reader : readers_since_write)
+						add_edge(reader, use.first);
+					readers_since_write.clear();
+					last_writer = use.first;
+				}
+				else {
+					readers_since_write.push_back(use.first);
+				}
+			}
+		}
+		// Among passes ready to run, earliest declared goes first, so independent passes keep order of declaration.
+		std::priority_queue<PassHandle, std::vector<PassHandle>, std::greater<PassHandle>> ready;
+		size_t kept_count = 0;
+		for (size_t i = 0; i < passes_.size(); ++i) {
+			if (passes_[i].culled)
+				continue;
+			++kept_count;
+			if (in_degrees[i] == 0)
+				ready.push(i);
+		}
+		execution_order_.clear();
+		while (!ready.empty()) {
+			PassHandle pass = ready.top();
+			ready.pop();
+			execution_order_.push_back(pass);
+			for (auto successor : successors[pass]) {
+				if (--in_degrees[successor] == 0)
+					ready.push(successor);
+			}
+		}
+		// Dependencies between passes must not form a cycle.
+		assert(execution_order_.size() == kept_count);
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void RenderGraph::allocateResources() {
+		// Destroys memory left unused for too long by earlier frames.
+		for (size_t i = 0; i < physical_resources_.size();) {
+			if (physical_resources_[i].unused_frames > RENDER_GRAPH_MAX_UNUSED_FRAMES) {
+				destroyPhysicalResource(physical_resources_[i]);
+				physical_resources_.erase(physical_resources_.begin() + i);
+			}
+			else {
+				physical_resources_[i].used = false;
+				++i;
+			}
+		}
+		// Lifetime of each resource spans from first to last pass using it.
+		std::vector<ResourceHandle> transients;
+		for (size_t i = 0; i < resources_.size(); ++i) {
+			resources_[i].physical = INVALID_INDEX;
+			resources_[i].first_use = INVALID_INDEX;
+			resources_[i].last_use = INVALID_INDEX;
+		}
+		for (size_t position = 0; position < execution_order_.size(); ++position) {
+			const Pass & pass = passes_[execution_order_[position]];
+			auto use = [&](ResourceHandle handle) {
+				Resource & resource = resources_[handle];
+				if (resource.first_use == INVALID_INDEX) {
+					resource.first_use = position;
+					if (!resource.imported)
+						transients.push_back(handle);
+				}
+				resource.last_use = position;
+			};
+			for (auto handle : pass.reads)
+				use(handle);
+			for (auto handle : pass.writes)
+				use(handle);
+		}
+		// Transients are visited by first use, each taking memory of a same sized resource whose lifetime has ended.
+		for (auto handle : transients) {
+			Resource & resource = resources_[handle];
+			size_t found = INVALID_INDEX;
+			for (size_t i = 0; i < physical_resources_.size(); ++i) {
+				PhysicalResource & physical = physical_resources_[i];
+				if (physical.desc == resource.desc && (!physical.used || physical.free_after < resource.first_use)) {
+					found = i;
+					break;
+				}
+			}
+			if (found == INVALID_INDEX) {
+				PhysicalResource physical;
+				physical.desc = resource.desc;
+				physical.render_target = resource.desc.depth ? nullptr : allocator_->createRenderTexture(resource.desc);
+				physical.depth_buffer = resource.desc.depth ? allocator_->createDepthBuffer(resource.desc) : nullptr;
+				physical.used = false;
+				physical.free_after = 0;
+				physical.unused_frames = 0;
+				physical_resources_.push_back(physical);
+				found = physical_resources_.size() - 1;
+			}
+			PhysicalResource & physical = physical_resources_[found];
+			physical.used = true;
+			physical.free_after = resource.last_use;
+			resource.physical = found;
+		}
+		for (auto & physical : physical_resources_) {
+			if (physical.used)
+				physical.unused_frames = 0;
+			else
+				++physical.unused_frames;
+		}
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void RenderGraph::destroyPhysicalResource(PhysicalResource & physical) {
+		if (physical.render_target)
+			allocator_->destroyRenderTexture(physical.render_target);
+		if (physical.depth_buffer)
+			allocator_->destroyDepthBuffer(physical.depth_buffer);
+		physical.render_target = nullptr;
+		physical.depth_buffer = nullptr;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void RenderGraph::execute() {
+		assert(compiled_);
+		for (auto pass : execution_order_) {
+			if (passes_[pass].execute)
+				passes_[pass].execute(*this);
+		}
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void RenderGraph::reset() {
+		resources_.clear();
+		passes_.clear();
+		execution_order_.clear();
+		compiled_ = false;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	RenderTarget * RenderGraph::getRenderTarget(ResourceHandle resource) const {
+		assert(compiled_ && resource < resources_.size());
+		const Resource & value = resources_[resource];
+		if (value.imported)
+			return value.imported_target;
+		assert(value.physical != INVALID_INDEX);
+		return physical_resources_[value.physical].render_target;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	DepthBuffer * RenderGraph::getDepthBuffer(ResourceHandle resource) const {
+		assert(compiled_ && resource < resources_.size());
+		const Resource & value = resources_[resource];
+		assert(!value.imported && value.physical != INVALID_INDEX);
+		return physical_resources_[value.physical].depth_buffer;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	bool RenderGraph::isPassCulled(PassHandle pass) const {
+		assert(pass < passes_.size());
+		return passes_[pass].culled;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	const std::vector<RenderGraph::PassHandle> & RenderGraph::getExecutionOrder() const {
+		return execution_order_;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	size_t RenderGraph::getPassCount() const {
+		return passes_.size();
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	size_t RenderGraph::getCulledPassCount() const {
+		size_t count = 0;
+		for (auto & pass : passes_)
+			count += pass.culled ? 1 : 0;
+		return count;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	size_t RenderGraph::getTransientResourceCount() const {
+		size_t count = 0;
+		for (auto & resource : resources_)
+			count += resource.imported ? 0 : 1;
+		return count;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	size_t RenderGraph::getPhysicalResourceCount() const {
+		return physical_resources_.size();
+	}
+}
@@ -0,0 +1,134 @@
+//
+//  AsteroRenderGraph.h
+//  Astero
+//
+//  Created by Yuzhe Wang on 10/18/26.
+//  Copyright © 2026 Yuzhe Wang. All rights reserved.
+//
+
+#ifndef AsteroRenderGraph_h
+#define AsteroRenderGraph_h
+
+#include "AsteroPrerequisites.h"
+
+// Physical resources not used by this many compiled frames are destroyed.
+#define RENDER_GRAPH_MAX_UNUSED_FRAMES 60
+
+namespace Astero {
+	class RenderTarget;
+	class DepthBuffer;
+
+	// Description of a transient resource. Resources with equal descriptions can share memory.
+	struct RenderGraphResourceDesc {
+		unsigned int width;
+		unsigned int height;
+		// Pixel format of a render texture, or bit depth of a depth buffer.
+		unsigned int format;
+		unsigned int fsaa;
+		bool depth;
+		
+		bool operator==(const RenderGraphResourceDesc & other) const;
+	};
+
+	// Creates and destroys memory backing transient resources of render graph.
+	class RenderGraphAllocator {
+	public:
+		virtual ~RenderGraphAllocator() {}
+		virtual RenderTarget * createRenderTexture(const RenderGraphResourceDesc & desc) = 0;
+		virtual void destroyRenderTexture(RenderTarget * render_target) = 0;
+		virtual DepthBuffer * createDepthBuffer(const RenderGraphResourceDesc & desc) = 0;
+		virtual void destroyDepthBuffer(DepthBuffer * depth_buffer) = 0;
+	};
+
+	// Graph of passes of a frame. Passes declare resources they read and write, then compile culls passes whose outputs are
+	// never used, orders passes so every resource is written before it is read, and places transient resources whose
+	// lifetimes do not overlap in same render texture or depth buffer. Memory of transient resources is kept across frames,
+	// so a frame rebuilding same graph allocates nothing.
+	// Each transient resource is written by one pass. Imported render targets, such as windows, can be written by several
+	// passes in order of declaration, and passes writing them are never culled.
+	class RenderGraph {
+	public:
+		typedef size_t ResourceHandle;
+		typedef size_t PassHandle;
+		typedef std::function<void(const RenderGraph &)> ExecuteCallback;
+		
+		RenderGraph(RenderGraphAllocator * allocator);
+		~RenderGraph();
+		
+		ResourceHandle createTransient(const std::string & name, const RenderGraphResourceDesc & desc);
+		ResourceHandle importRenderTarget(const std::string & name, RenderTarget * render_target);
+		PassHandle addPass(const std::string & name, const ExecuteCallback & execute);
+		void read(PassHandle pass, ResourceHandle resource);
+		void write(PassHandle pass, ResourceHandle resource);
+		// Keeps pass even if nothing reads its outputs, such as a pass reading back data.
+		void setSideEffect(PassHandle pass);
+		// Culls, orders and allocates resources. Must be called after all passes are added and before execute.
+		void compile();
+		// Runs execute callbacks of passes kept by compile, in order.
+		void execute();
+		// Removes passes and resources to build next frame's graph. Memory of transient resources is kept.
+		void reset();
+		
+		// Memory assigned to a resource by compile, valid while passes execute.
+		RenderTarget * getRenderTarget(ResourceHandle resource) const;
+		DepthBuffer * getDepthBuffer(ResourceHandle resource) const;
+		bool isPassCulled(PassHandle pass) const;
+		const std::vector<PassHandle> & getExecutionOrder() const;
+		size_t getPassCount() const;
+		size_t getCulledPassCount() const;
+		size_t getTransientResourceCount() const;
+		// Number of render textures and depth buffers backing transient resources.
+		size_t getPhysicalResourceCount() const;
+		
+	protected:
+		static const size_t INVALID_INDEX = ~static_cast<size_t>(0);
+		
+		struct Resource {
+			std::string name;
+			RenderGraphResourceDesc desc;
+			bool imported;
+			RenderTarget * imported_target;
+			// Passes writing resource in order of declaration.
+			std::vector<PassHandle> writers;
+			std::vector<PassHandle> readers;
+			size_t reference_count;
+			size_t physical;
+			// Positions in execution order of first and last passes using resource.
+			size_t first_use;
+			size_t last_use;
+		};
+		struct Pass {
+			std::string name;
+			ExecuteCallback execute;
+			std::vector<ResourceHandle> reads;
+			std::vector<ResourceHandle> writes;
+			bool side_effect;
+			bool culled;
+			size_t reference_count;
+		};
+		// Render texture or depth buffer which transient resources are placed in.
+		struct PhysicalResource {
+			RenderGraphResourceDesc desc;
+			RenderTarget * render_target;
+			DepthBuffer * depth_buffer;
+			// Position in execution order after which it is free again in frame being compiled.
+			size_t free_after;
+			bool used;
+			size_t unused_frames;
+		};
+		
+		void cullPasses();
+		void sortPasses();
+		void allocateResources();
+		void destroyPhysicalResource(PhysicalResource & physical);
+		
+		RenderGraphAllocator * allocator_;
+		std::vector<Resource> resources_;
+		std::vector<Pass> passes_;
+		std::vector<PassHandle> execution_order_;
+		std::vector<PhysicalResource> physical_resources_;
+		bool compiled_;
+	};
+}
+
+#endif // AsteroRenderGraph_h
@@ -31,7 +31,10 @@ namespace Astero {
 			OT_TRIANGLE_FAN = 6
 		};
 		
-		RenderOperation();
+		// Draws one instance of nothing, with no index data and no uniform range.
+		RenderOperation() : vertex_data(nullptr), operation_type(OT_TRIANGLE_LIST), use_indices(false), index_data(nullptr),
+		instance_number(1), base_instance(0), render_to_vertex_buffer(false), use_global_instance_vertex_buffer(false),
+		uniform_offset(0), uniform_size(0) {}
 		
 		VertexData * vertex_data;
 		OperationType operation_type;
@@ -39,9 +42,14 @@ namespace Astero {
 		bool use_indices;
 		IndexData * index_data;
 		unsigned int instance_number;
+		// First instance read from instance data, so per object data of many operations can live in one instance buffer.
+		unsigned int base_instance;
 		bool render_to_vertex_buffer;
 		// A flag to indicate that it is possible to use global instance vertex buffer.
 		bool use_global_instance_vertex_buffer;
+		// Range of per frame uniform memory from RenderSystem::allocateUniforms bound as per object uniforms, none if size is 0.
+		size_t uniform_offset;
+		size_t uniform_size;
 	};
 }
 
@@ -0,0 +1,362 @@
+//
+//  AsteroRenderQueue.cpp
+//  Astero
+//
+//  Created by Yuzhe Wang on 10/18/26.
+//  Copyright © 2026 Yuzhe Wang. All rights reserved.
+//
+
+#include <cstdint>
+#include <cstring>
+#include "AsteroRenderQueue.h"
+#include "AsteroRenderSystem.h"
+#include "AsteroHardwareBuffer.h"
+#include "AsteroHardwareBufferManager.h"
+
+namespace Astero {
+	namespace {
+		// Maps a handle to a field of bits width, 0 for null handles.
+		uint64_t hashHandle(uint64_t handle, unsigned int bits) {
+			if (handle == 0)
+				return 0;
+			return (handle * 0x9E3779B97F4A7C15ull) >> (64 - bits);
+		}
+		
+		uint64_t hashPointer(const void * pointer, unsigned int bits) {
+			return hashHandle(static_cast<uint64_t>(reinterpret_cast<uintptr_t>(pointer)), bits);
+		}
+		
+		// Quantizes non negative depth to bits. Bit pattern of a positive float grows with its value, so its top bits keep
+		// order with precision relative to depth, which suits perspective views.
+		uint64_t quantizeDepth(float depth, unsigned int bits) {
+			if (!(depth > 0.0f))
+				return 0;
+			uint32_t depth_bits;
+			memcpy(&depth_bits, &depth, sizeof(depth_bits));
+			return depth_bits >> (32 - bits);
+		}
+		
+		std::atomic<uint64_t> next_queue_id(1);
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	RenderQueue::RenderQueue() : queue_id_(next_queue_id++), instance_declaration_(nullptr), auto_instancing_enabled_(true),
+	instanced_command_count_(0), batch_count_(0), program_switch_count_(0), texture_switch_count_(0) {
+		
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	RenderQueue::~RenderQueue() {
+		for (auto bucket : buckets_)
+			delete bucket;
+		if (instance_declaration_)
+			HardwareBufferManager::getSingleton().destroyVertexDeclaration(instance_declaration_);
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void RenderQueue::setAutoInstancingEnabled(bool enabled) {
+		Lock lock(mutex_);
+		auto_instancing_enabled_ = enabled;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	bool RenderQueue::isAutoInstancingEnabled() const {
+		Lock lock(mutex_);
+		return auto_instancing_enabled_;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	uint64_t RenderQueue::makeSortKey(const RenderCommand & command) {
+		const unsigned int translucent_shift = 64 - RENDER_QUEUE_LAYER_BITS - 1;
+		uint64_t key = static_cast<uint64_t>(command.layer) << (64 - RENDER_QUEUE_LAYER_BITS);
+		uint64_t program = hashHandle(hashPointer(command.vertex_program, 32) << 32 | hashPointer(command.fragment_program, 32),
+									  RENDER_QUEUE_PROGRAM_BITS);
+		if (command.translucent) {
+			// Farthest first.
+			const uint64_t depth_mask = (static_cast<uint64_t>(1) << RENDER_QUEUE_TRANSLUCENT_DEPTH_BITS) - 1;
+			uint64_t depth = depth_mask - quantizeDepth(command.depth, RENDER_QUEUE_TRANSLUCENT_DEPTH_BITS);
+			key |= static_cast<uint64_t>(1) << translucent_shift;
+			key |= depth << (translucent_shift - RENDER_QUEUE_TRANSLUCENT_DEPTH_BITS);
+			key |= program << (translucent_shift - RENDER_QUEUE_TRANSLUCENT_DEPTH_BITS - RENDER_QUEUE_PROGRAM_BITS);
+			return key;
+		}
+		// Operations sharing vertex declaration, buffer binding and index buffer share a vertex array object.
+		const VertexData * vertex_data = command.operation.vertex_data;
+		uint64_t vertex_array = 0;
+		if (vertex_data) {
+			vertex_array = hashPointer(vertex_data->vertex_declaration, 32) << 32
+			^ hashPointer(vertex_data->vertex_buffer_binding, 32);
+		}
+		if (command.operation.use_indices && command.operation.index_data)
+			vertex_array ^= hashPointer(command.operation.index_data->index_buffer.get(), 32);
+		vertex_array = hashHandle(vertex_array, RENDER_QUEUE_VERTEX_ARRAY_BITS);
+		uint64_t texture = hashPointer(command.texture.get(), RENDER_QUEUE_TEXTURE_BITS);
+		unsigned int shift = translucent_shift - RENDER_QUEUE_PROGRAM_BITS;
+		key |= program << shift;
+		shift -= RENDER_QUEUE_VERTEX_ARRAY_BITS;
+		key |= vertex_array << shift;
+		shift -= RENDER_QUEUE_TEXTURE_BITS;
+		key |= texture << shift;
+		// Nearest first, so depth test rejects hidden fragments early.
+		key |= quantizeDepth(command.depth, RENDER_QUEUE_DEPTH_BITS);
+		return key;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	RenderQueue::Bucket & RenderQueue::getBucket() {
+		struct CachedBucket {
+			uint64_t queue_id;
+			Bucket * bucket;
+		};
+		static thread_local CachedBucket cached = {0, nullptr};
+		if (cached.queue_id == queue_id_)
+			return *cached.bucket;
+		Lock lock(mutex_);
+		Bucket *& bucket = bucket_map_[std::this_thread::get_id()];
+		if (!bucket) {
+			bucket = new Bucket();
+			buckets_.push_back(bucket);
+		}
+		cached.queue_id = queue_id_;
+		cached.bucket = bucket;
+		return *bucket;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	uint64_t RenderQueue::addCommand(const RenderCommand & command) {
+		// Bucket belongs to this thread, so no lock is needed to append.
+		Bucket & bucket = getBucket();
+		uint64_t key = makeSortKey(command);
+		bucket.keys.push_back(key);
+		bucket.commands.push_back(command);
+		return key;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	size_t RenderQueue::getCommandCount() const {
+		Lock lock(mutex_);
+		size_t count = 0;
+		for (auto bucket : buckets_)
+			count += bucket->commands.size();
+		return count;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void RenderQueue::clear() {
+		Lock lock(mutex_);
+		// Keeps capacity, so steady state recording does not allocate.
+		for (auto bucket : buckets_) {
+			bucket->keys.clear();
+			bucket->commands.clear();
+		}
+		sort_entries_.clear();
+		merged_commands_.clear();
+		batch_operations_.clear();
+		submit_items_.clear();
+		instanced_operations_.clear();
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void RenderQueue::sortEntries() {
+		size_t count = sort_entries_.size();
+		if (count < 2)
+			return;
+		// Histograms of all 8 bytes are gathered in one pass over keys.
+		size_t histograms[8][256];
+		memset(histograms, 0, sizeof(histograms));
+		for (const auto & entry : sort_entries_) {
+			uint64_t key = entry.key;
+			for (unsigned int pass = 0; pass < 8; ++pass)
+				++histograms[pass][(key >> (pass * 8)) & 0xFF];
+		}
+		sort_scratch_.resize(count);
+		SortEntry * source = sort_entries_.data();
+		SortEntry * dest = sort_scratch_.data();
+		for (unsigned int pass = 0; pass < 8; ++pass) {
+			size_t * histogram = histograms[pass];
+			unsigned int shift = pass * 8;
+			// All keys share this byte, pass would not move anything.
+			if (histogram[(source[0].key >> shift) & 0xFF] == count)
+				continue;
+			size_t offset = 0;
+			for (unsigned int i = 0; i < 256; ++i) {
+				size_t bin_count = histogram[i];
+				histogram[i] = offset;
+				offset += bin_count;
+			}
+			for (size_t i = 0; i < count; ++i)
+				dest[histogram[(source[i].key >> shift) & 0xFF]++] = source[i];
+			std::swap(source, dest);
+		}
+		if (source != sort_entries_.data())
+			sort_entries_.swap(sort_scratch_);
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	bool RenderQueue::canInstance(const RenderCommand & command) {
+		const RenderOperation & operation = command.operation;
+		// Operations drawing their own instances, or capturing vertices, have no room for instance data.
+		return command.auto_instancing && !operation.use_global_instance_vertex_buffer && operation.instance_number <= 1
+		&& !operation.render_to_vertex_buffer;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	bool RenderQueue::canMerge(const RenderCommand & first, const RenderCommand & command) {
+		// Translucent commands keep their own draws, they must blend in depth order.
+		if (first.translucent || command.translucent)
+			return false;
+		const RenderOperation & first_operation = first.operation;
+		const RenderOperation & operation = command.operation;
+		// Per object uniforms would be lost.
+		if (first_operation.uniform_size > 0 || operation.uniform_size > 0)
+			return false;
+		return command.layer == first.layer
+		&& command.vertex_program == first.vertex_program
+		&& command.fragment_program == first.fragment_program
+		&& command.texture == first.texture
+		&& operation.operation_type == first_operation.operation_type
+		&& operation.vertex_data == first_operation.vertex_data
+		&& operation.use_indices == first_operation.use_indices
+		&& (!operation.use_indices || operation.index_data == first_operation.index_data);
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void RenderQueue::writeInstanceData(const RenderCommand & command) {
+		const float * rows = &command.world_matrix.m[0][0];
+		instance_data_.insert(instance_data_.end(), rows, rows + 12);
+		instance_data_.insert(instance_data_.end(), command.colour, command.colour + 4);
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void RenderQueue::buildSubmitItems() {
+		submit_items_.clear();
+		instanced_operations_.clear();
+		instance_data_.clear();
+		instanced_command_count_ = 0;
+		// Never reallocated below, so items can point at instanced operations.
+		instanced_operations_.reserve(sort_entries_.size());
+		size_t i = 0;
+		while (i < sort_entries_.size()) {
+			const RenderCommand & first = *merged_commands_[sort_entries_[i].index];
+			if (!canInstance(first)) {
+				SubmitItem item = {&first, &first.operation, false};
+				submit_items_.push_back(item);
+				++i;
+				continue;
+			}
+			size_t end = i + 1;
+			if (auto_instancing_enabled_) {
+				while (end < sort_entries_.size()) {
+					const RenderCommand & command = *merged_commands_[sort_entries_[end].index];
+					if (!canInstance(command) || !canMerge(first, command))
+						break;
+					++end;
+				}
+			}
+			RenderOperation operation = first.operation;
+			operation.use_global_instance_vertex_buffer = true;
+			operation.base_instance = static_cast<unsigned int>(instance_data_.size() / 16);
+			operation.instance_number = static_cast<unsigned int>(end - i);
+			for (size_t j = i; j < end; ++j)
+				writeInstanceData(*merged_commands_[sort_entries_[j].index]);
+			instanced_operations_.push_back(operation);
+			SubmitItem item = {&first, &instanced_operations_.back(), true};
+			submit_items_.push_back(item);
+			instanced_command_count_ += end - i;
+			i = end;
+		}
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void RenderQueue::uploadInstanceData(RenderSystem & render_system) {
+		if (instance_data_.empty())
+			return;
+		HardwareBufferManager & buffer_manager = HardwareBufferManager::getSingleton();
+		size_t instance_size = 16 * sizeof(float);
+		size_t instance_count = instance_data_.size() / 16;
+		if (instance_declaration_ == nullptr) {
+			instance_declaration_ = buffer_manager.createVertexDeclaration();
+			// Three rows of world matrix, then colour.
+			for (unsigned short row = 0; row < 4; ++row) {
+				instance_declaration_->addElement(0, row * 4 * sizeof(float), VET_FLOAT4, VES_TEXTURE_COORDINATES,
+												  RENDER_QUEUE_INSTANCE_TEXCOORD_INDEX + row);
+			}
+		}
+		// Grows buffer geometrically, so it is recreated only a few times.
+		if (instance_buffer_ == nullptr || instance_buffer_->getVertexNum() < instance_count) {
+			size_t capacity = instance_buffer_ ? instance_buffer_->getVertexNum() : 0;
+			capacity = std::max(capacity * 2, instance_count);
+			instance_buffer_ = buffer_manager.createVertexBuffer(instance_size, capacity, HardwareBuffer::HBU_DYNAMIC_WRITE_ONLY_DISCARDABLE);
+			instance_buffer_->setIsInstanceData(true);
+			instance_buffer_->setInstanceDataStepRate(1);
+		}
+		instance_buffer_->writeData(0, instance_count * instance_size, instance_data_.data(), true);
+		render_system.setGlobalInstanceVertexBuffer(instance_buffer_);
+		render_system.setGlobalInstanceVertexBufferVertexDeclaration(instance_declaration_);
+		render_system.setGlobalInstanceNumber(1);
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void RenderQueue::mergeBuckets() {
+		sort_entries_.clear();
+		merged_commands_.clear();
+		for (auto bucket : buckets_) {
+			for (size_t i = 0; i < bucket->commands.size(); ++i) {
+				SortEntry entry = {bucket->keys[i], static_cast<uint32_t>(merged_commands_.size())};
+				sort_entries_.push_back(entry);
+				merged_commands_.push_back(&bucket->commands[i]);
+			}
+		}
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void RenderQueue::submit(RenderSystem & render_system) {
+		// Recording threads must have finished adding commands for this frame.
+		Lock lock(mutex_);
+		mergeBuckets();
+		sortEntries();
+		// Instanced operations replace global instance buffer of render system for this submit.
+		HardwareVertexBufferPtr global_instance_buffer = render_system.getGlobalInstanceVertexBuffer();
+		VertexDeclaration * global_instance_declaration = render_system.getGlobalInstanceVertexBufferVertexDeclaration();
+		unsigned int global_instance_number = render_system.getGlobalInstanceNumber();
+		buildSubmitItems();
+		uploadInstanceData(render_system);
+		
+		batch_count_ = 0;
+		program_switch_count_ = 0;
+		texture_switch_count_ = 0;
+		GpuProgram * vertex_program = nullptr;
+		GpuProgram * fragment_program = nullptr;
+		Texture * texture = nullptr;
+		const Matrix4 * world_matrix = nullptr;
+		batch_operations_.clear();
+		for (const auto & item : submit_items_) {
+			const RenderCommand & command = *item.command;
+			// One draw sees one world matrix, so commands not reading instance data split batches where it changes.
+			bool world_matrix_changed = !item.instanced
+			&& (world_matrix == nullptr || memcmp(world_matrix, &command.world_matrix, sizeof(Matrix4)) != 0);
+			bool state_changed = (command.vertex_program && command.vertex_program != vertex_program)
+			|| (command.fragment_program && command.fragment_program != fragment_program)
+			|| (command.texture && command.texture.get() != texture) || world_matrix_changed;
+			// Operations recorded so far share state, and are rendered before it changes.
+			if (state_changed && !batch_operations_.empty()) {
+				render_system.renderBatch(batch_operations_.data(), batch_operations_.size());
+				batch_operations_.clear();
+				++batch_count_;
+			}
+			if (world_matrix_changed) {
+				render_system.setWorldMatrix(command.world_matrix);
+				world_matrix = &command.world_matrix;
+			}
+			if (command.vertex_program && command.vertex_program != vertex_program) {
+				render_system.bindGpuProgram(command.vertex_program);
+				vertex_program = command.vertex_program;
+				++program_switch_count_;
+			}
+			if (command.fragment_program && command.fragment_program != fragment_program) {
+				render_system.bindGpuProgram(command.fragment_program);
+				fragment_program = command.fragment_program;
+				++program_switch_count_;
+			}
+			if (command.texture && command.texture.get() != texture) {
+				render_system.setTexture(0, true, command.texture);
+				texture = command.texture.get();
+				++texture_switch_count_;
+			}
+			batch_operations_.push_back(item.operation);
+		}
+		if (!batch_operations_.empty()) {
+			render_system.renderBatch(batch_operations_.data(), batch_operations_.size());
+			++batch_count_;
+		}
+		if (!instance_data_.empty()) {
+			render_system.setGlobalInstanceVertexBuffer(global_instance_buffer);
+			render_system.setGlobalInstanceVertexBufferVertexDeclaration(global_instance_declaration);
+			render_system.setGlobalInstanceNumber(global_instance_number);
+		}
+		clear();
+	}
+}
@@ -0,0 +1,159 @@
+//
+//  AsteroRenderQueue.h
+//  Astero
+//
+//  Created by Yuzhe Wang on 10/18/26.
+//  Copyright © 2026 Yuzhe Wang. All rights reserved.
+//
+
+#ifndef AsteroRenderQueue_h
+#define AsteroRenderQueue_h
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include "AsteroRenderOperation.h"
+#include "AsteroGeometry.h"
+
+// Bit widths of sort key fields.
+#define RENDER_QUEUE_LAYER_BITS 8
+#define RENDER_QUEUE_PROGRAM_BITS 15
+#define RENDER_QUEUE_VERTEX_ARRAY_BITS 12
+#define RENDER_QUEUE_TEXTURE_BITS 12
+#define RENDER_QUEUE_DEPTH_BITS 16
+#define RENDER_QUEUE_TRANSLUCENT_DEPTH_BITS 24
+// Per instance data is read by vertex programs from 4 texture coordinate sets starting at this one.
+#define RENDER_QUEUE_INSTANCE_TEXCOORD_INDEX 4
+
+namespace Astero {
+	class RenderSystem;
+	class GpuProgram;
+	class Texture;
+	typedef std::shared_ptr<Texture> TexturePtr;
+
+	// Command recorded by RenderQueue, holding everything needed to submit one operation.
+	struct RenderCommand {
+		RenderOperation operation;
+		GpuProgram * vertex_program;
+		GpuProgram * fragment_program;
+		// Texture bound to unit 0, null to leave texture units unchanged.
+		TexturePtr texture;
+		// View space distance from camera.
+		float depth;
+		unsigned char layer;
+		bool translucent;
+		// Whether vertex program reads world_matrix and colour as per instance data. Such a command is drawn from instance
+		// buffer, together with commands drawing same data with same state while queue merges instances. Other commands
+		// get world_matrix through RenderSystem::setWorldMatrix, and leave colour unused.
+		bool auto_instancing;
+		// Affine world matrix, whose first three rows are read as per instance data.
+		Matrix4 world_matrix;
+		float colour[4];
+	};
+
+	// Queue recording render commands to be submitted in state sorted order, instead of calling RenderSystem::render in
+	// whatever order the scene produces. Each command gets a 64 bit sort key, laid out from most significant bit:
+	//     opaque:      layer(8) 0(1) program(15) vertex array(12) texture(12) depth(16, front to back)
+	//     translucent: layer(8) 1(1) depth(24, back to front) program(15)
+	// so layers draw in order, opaque operations before translucent ones, opaque ones grouped by program, vertex layout and
+	// texture to minimise switches, and translucent ones in correct blending order. Program, vertex array and texture fields
+	// hold hashes of their handles, so a collision only costs a switch, never correctness.
+	// Commands can be recorded from several threads at once, each into its own bucket. submit merges buckets, radix sorts
+	// keys and submits all commands in one pass from the render thread. Runs of commands sharing programs and texture are
+	// handed to RenderSystem::renderBatch together, so render system can merge them into multi-draw calls.
+	// Commands whose vertex programs read instance data are drawn as instanced operations. Their world matrices and colours
+	// are packed into a dynamic instance buffer, which is set as global instance buffer of render system, and each instanced
+	// operation reads its range through base_instance. With auto instancing, runs of opaque commands drawing same vertex
+	// and index data with same state become one instanced operation, otherwise each command draws one instance.
+	class RenderQueue {
+	public:
+		RenderQueue();
+		~RenderQueue();
+
+		// Records a command to current thread's bucket, and returns its sort key.
+		uint64_t addCommand(const RenderCommand & command);
+		// Merges and sorts recorded commands, then renders them through render_system and clears queue.
+		void submit(RenderSystem & render_system);
+		// Discards recorded commands.
+		void clear();
+		// Number of recorded commands.
+		size_t getCommandCount() const;
+		// Number of renderBatch calls issued by last submit.
+		size_t getBatchCount() const { return batch_count_; }
+		// Sets whether runs of commands drawing same data are merged into one instanced operation.
+		void setAutoInstancingEnabled(bool enabled);
+		bool isAutoInstancingEnabled() const;
+		// Number of commands drawn from instance buffer by last submit.
+		size_t getInstancedCommandCount() const { return instanced_command_count_; }
+		// Number of program switches issued by last submit.
+		size_t getProgramSwitchCount() const { return program_switch_count_; }
+		// Number of texture switches issued by last submit.
+		size_t getTextureSwitchCount() const { return texture_switch_count_; }
+
+		static uint64_t makeSortKey(const RenderCommand & command);
+
+	protected:
+		typedef std::recursive_mutex Mutex;
+		typedef std::lock_guard<Mutex> Lock;
+
+		// Commands recorded by one thread, with their keys kept apart so sorting touches only keys.
+		struct Bucket {
+			std::vector<uint64_t> keys;
+			std::vector<RenderCommand> commands;
+		};
+		typedef std::vector<Bucket *> BucketList;
+		typedef std::unordered_map<std::thread::id, Bucket *> BucketMap;
+		// Sort key and index of a merged command.
+		struct SortEntry {
+			uint64_t key;
+			uint32_t index;
+		};
+		typedef std::vector<SortEntry> SortEntryList;
+		// Command in submission order, with operation to render for it.
+		struct SubmitItem {
+			const RenderCommand * command;
+			const RenderOperation * operation;
+			// Whether operation reads world matrix and colour of its commands from instance buffer.
+			bool instanced;
+		};
+
+		Bucket & getBucket();
+		// Gathers commands of all buckets into merged_commands_, with their keys in sort_entries_.
+		void mergeBuckets();
+		// Stable LSD radix sort of sort_entries_, skipping bytes equal in all keys.
+		void sortEntries();
+		// Whether command can be drawn from instance buffer.
+		static bool canInstance(const RenderCommand & command);
+		// Whether instanceable command can be drawn in same instanced operation as first.
+		static bool canMerge(const RenderCommand & first, const RenderCommand & command);
+		// Fills submit_items_ and instance_data_ from sorted commands, merging instanceable runs.
+		void buildSubmitItems();
+		// Uploads instance_data_ and sets it as global instance buffer of render_system.
+		void uploadInstanceData(RenderSystem & render_system);
+		void writeInstanceData(const RenderCommand & command);
+
+		// Buckets in registration order, so merged order of equal keys does not depend on hashing.
+		BucketList buckets_;
+		BucketMap bucket_map_;
+		// Distinguishes queues in thread local bucket lookup, since a queue may be freed and another created at same address.
+		uint64_t queue_id_;
+		SortEntryList sort_entries_;
+		SortEntryList sort_scratch_;
+		std::vector<const RenderCommand *> merged_commands_;
+		std::vector<const RenderOperation *> batch_operations_;
+		std::vector<SubmitItem> submit_items_;
+		// Operations created for instanced commands, reserved before filling, so submit_items_ can point into it.
+		std::vector<RenderOperation> instanced_operations_;
+		std::vector<float> instance_data_;
+		HardwareVertexBufferPtr instance_buffer_;
+		VertexDeclaration * instance_declaration_;
+		bool auto_instancing_enabled_;
+		size_t instanced_command_count_;
+		size_t batch_count_;
+		size_t program_switch_count_;
+		size_t texture_switch_count_;
+		mutable Mutex mutex_;
+	};
+}
+
+#endif // AsteroRenderQueue_h
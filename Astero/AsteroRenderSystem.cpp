@@ -21,9 +21,31 @@
 #include "AsteroGLSupport.h"
 #include "AsteroRenderTarget.h"
 #include "AsteroRenderWindow.h"
+#include "AsteroProfiler.h"
+#include "AsteroGLUniformBufferRing.h"
+#include "AsteroGLContext.h"
 
 namespace Astero {
 	
+	RenderSystem::RenderSystem()
+	: active_render_target_(nullptr), texture_manager_(nullptr), active_viewport_(nullptr), culling_mode_(),
+	enable_fixed_pipeline_(true), real_capabilities_(nullptr), current_capabilities_(nullptr),
+	global_instance_vertex_buffer_vertex_declaration_(nullptr), global_instance_number_(1), vertex_program_bound_(false),
+	geometry_program_bound_(false), frament_program_bound_(false), derived_depth_bias_(false), derived_depth_bias_base_(0.0f),
+	derived_depth_bias_multiplier_(0.0f), derived_depth_bias_slope_scale_(0.0f), current_pass_iteration_number_(0),
+	current_pass_iteration_count_(0), texture_units_disabled_from_(0), face_count_(0), batch_count_(0), vertex_count_(0),
+	frame_number_(0), frame_started_(false) {
+		
+	}
+	
+	RenderSystem::~RenderSystem() {
+		for (auto & value : depth_buffer_pool_) {
+			for (auto depth_buffer : value.second)
+				delete depth_buffer;
+		}
+		depth_buffer_pool_.clear();
+	}
+	
 	//--------------------------------------------------------------------------------------------------------------------------------
 	bool RenderSystem::updatePassIterationRenderState() {
 		if (current_pass_iteration_count_ <= 1)
@@ -37,17 +59,210 @@ namespace Astero {
 	void RenderSystem::attachRenderTarget(RenderTarget & render_target) {
 		render_targets_.insert(RenderTargetMap::value_type(render_target.getName(), &render_target));
 		prioritized_render_targets_.insert(RenderTargetPriorityMap::value_type(render_target.getPriority(), &render_target));
+		if (render_target.getDepthBuffer() == nullptr)
+			setDepthBufferFor(&render_target);
+	}
+	
+	void RenderSystem::setDepthBufferFor(RenderTarget * render_target) {
+		unsigned short pool_id = render_target->getDepthBufferPool();
+		if (pool_id == DepthBuffer::PI_NO_DEPTH)
+			return;
+		// Shares first compatible buffer of pool.
+		DepthBufferVector & pool = depth_buffer_pool_[pool_id];
+		for (auto depth_buffer : pool) {
+			if (render_target->attachDepthBuffer(depth_buffer))
+				return;
+		}
+		DepthBuffer * depth_buffer = createDepthBufferFor(render_target);
+		if (depth_buffer == nullptr)
+			return;
+		depth_buffer->setPoolId(pool_id);
+		pool.push_back(depth_buffer);
+		bool attached = render_target->attachDepthBuffer(depth_buffer);
+		// New depth buffer must be compatible with render target it is created for.
+		assert(attached);
+		(void)attached;
+	}
+	
+	DepthBuffer * RenderSystem::createDepthBufferFor(RenderTarget * render_target) {
+		return new DepthBuffer(render_target->getDepthBufferPool(), render_target->getDepthBitDepth(), render_target->getWidth(),
+							   render_target->getHeight(), render_target->getFSAA(), "", false);
+	}
+	
+	void RenderSystem::cleanupDepthBuffers() {
+		for (auto iter = depth_buffer_pool_.begin(); iter != depth_buffer_pool_.end();) {
+			DepthBufferVector & pool = iter->second;
+			auto end = std::remove_if(pool.begin(), pool.end(), [](DepthBuffer * depth_buffer) {
+				if (depth_buffer->isAttached() || depth_buffer->isManual())
+					return false;
+				delete depth_buffer;
+				return true;
+			});
+			pool.erase(end, pool.end());
+			if (pool.empty())
+				iter = depth_buffer_pool_.erase(iter);
+			else
+				++iter;
+		}
+	}
+	
+	size_t RenderSystem::getDepthBufferCount() const {
+		size_t count = 0;
+		for (auto & value : depth_buffer_pool_)
+			count += value.second.size();
+		return count;
+	}
+	
+	size_t RenderSystem::getDepthBufferMemory() const {
+		size_t bytes = 0;
+		for (auto & value : depth_buffer_pool_) {
+			for (auto depth_buffer : value.second) {
+				// 24 bit depth is stored with 8 bit stencil.
+				size_t pixel_size = depth_buffer->getBitDepth() <= 16 ? 2 : 4;
+				size_t samples = std::max(depth_buffer->getFSAA(), 1u);
+				bytes += static_cast<size_t>(depth_buffer->getWidth()) * depth_buffer->getHeight() * samples * pixel_size;
+			}
+		}
+		return bytes;
+	}
+	
+	void RenderSystem::setGlobalInstanceVertexBuffer(const HardwareVertexBufferPtr & vertex_buffer) {
+		assert(vertex_buffer == nullptr || vertex_buffer->getIsInstanceData());
+		global_instance_vertex_buffer_ = vertex_buffer;
+	}
+	
+	HardwareVertexBufferPtr RenderSystem::getGlobalInstanceVertexBuffer() {
+		return global_instance_vertex_buffer_;
+	}
+	
+	void RenderSystem::setGlobalInstanceVertexBufferVertexDeclaration(VertexDeclaration * decl) {
+		global_instance_vertex_buffer_vertex_declaration_ = decl;
+	}
+	
+	VertexDeclaration * RenderSystem::getGlobalInstanceVertexBufferVertexDeclaration() {
+		return global_instance_vertex_buffer_vertex_declaration_;
+	}
+	
+	void RenderSystem::setGlobalInstanceNumber(unsigned int instance_number) {
+		global_instance_number_ = instance_number;
+	}
+	
+	unsigned int RenderSystem::getGlobalInstanceNumber() const {
+		return global_instance_number_;
+	}
+	
+	void RenderSystem::render(const RenderOperation & operation) {
+		updateGeometryCount(operation);
+		updateBatchCount();
+	}
+	
+	void RenderSystem::updateGeometryCount(const RenderOperation & operation) {
+		size_t instance_number = std::max(operation.instance_number, 1u);
+		if (operation.use_global_instance_vertex_buffer)
+			instance_number *= std::max(global_instance_number_, 1u);
+		size_t element_count = operation.use_indices ? operation.index_data->index_count : operation.vertex_data->vertex_count;
+		size_t face_count = 0;
+		switch (operation.operation_type) {
+			case RenderOperation::OT_TRIANGLE_LIST:
+				face_count = element_count / 3;
+				break;
+			case RenderOperation::OT_TRIANGLE_STRIP:
+			case RenderOperation::OT_TRIANGLE_FAN:
+				face_count = element_count > 2 ? element_count - 2 : 0;
+				break;
+			default:
+				break;
+		}
+		face_count_ += face_count * instance_number;
+		vertex_count_ += operation.vertex_data->vertex_count * instance_number;
+	}
+	
+	void RenderSystem::updateBatchCount() {
+		batch_count_ += std::max(current_pass_iteration_count_, static_cast<unsigned short>(1));
+	}
+	
+	void RenderSystem::beginGeometryCount() {
+		face_count_ = 0;
+		batch_count_ = 0;
+		vertex_count_ = 0;
+	}
+	
+	unsigned int RenderSystem::getFaceCount() const {
+		return static_cast<unsigned int>(face_count_);
+	}
+	
+	unsigned int RenderSystem::getBatchCount() const {
+		return static_cast<unsigned int>(batch_count_);
+	}
+	
+	unsigned int RenderSystem::getVertexCount() const {
+		return static_cast<unsigned int>(vertex_count_);
+	}
+	
+	const FrameStatsHistory & RenderSystem::getFrameStatsHistory() const {
+		return frame_stats_history_;
+	}
+	
+	FrameStatsHistory & RenderSystem::getFrameStatsHistory() {
+		return frame_stats_history_;
+	}
+	
+	void RenderSystem::beginFrameStats() {
+		frame_begin_time_ = Clock::now();
+		frame_started_ = true;
+		beginGeometryCount();
+	}
+	
+	void RenderSystem::endFrameStats() {
+		if (!frame_started_)
+			return;
+		Clock::time_point now = Clock::now();
+		FrameRecord record;
+		record.frame_number = frame_number_++;
+		record.submission_time = std::chrono::duration<double, std::milli>(now - frame_begin_time_).count();
+		// First frame has no previous end, so its submission is all of its time known.
+		record.frame_time = frame_number_ > 1 ? std::chrono::duration<double, std::milli>(now - last_frame_end_time_).count()
+		: record.submission_time;
+		record.batch_count = batch_count_;
+		record.face_count = face_count_;
+		record.vertex_count = vertex_count_;
+		frame_stats_history_.addFrame(record);
+		last_frame_end_time_ = now;
+		frame_started_ = false;
+		ASTERO_PROFILE_COUNTER("Frame time (ms)", record.frame_time);
+		ASTERO_PROFILE_COUNTER("Batches", record.batch_count);
+		ASTERO_PROFILE_COUNTER("Faces", record.face_count);
+		for (auto & value : render_targets_)
+			value.second->updateStatistics(frame_stats_history_);
+	}
+	
+	void RenderSystem::renderBatch(const RenderOperation * const * operations, size_t count) {
+		for (size_t i = 0; i < count; ++i)
+			render(*operations[i]);
+	}
+	
+	void * RenderSystem::allocateUniforms(size_t /* size */, size_t & /* offset */) {
+		return nullptr;
+	}
+	
+	void RenderSystem::setPassUniforms(const void * /* data */, size_t /* size */) {
 		
 	}
 	
-	GLRenderSystem::GLRenderSystem() {
+	GLRenderSystem::GLRenderSystem() : render_attrib_mask_(0), render_client_state_mask_(0), vertex_array_cache_enabled_(true),
+	indirect_buffer_id_(0), indirect_buffer_size_(0), indirect_buffer_offset_(0), main_context_(nullptr),
+	uniform_buffer_ring_(nullptr), pass_uniforms_dirty_(false), world_matrix_dirty_(false),
+	skipped_draw_count_(0) {
 		state_cache_manager_ = new GLStateCacheManager;
-		render_attribs_bound_.reserve(100);
-		render_instance_attribs_bound_.reserve(100);
-		
 		
 	}
 	
+	GLRenderSystem::~GLRenderSystem() {
+		if (indirect_buffer_id_)
+			state_cache_manager_->deleteGLBuffer(GL_DRAW_INDIRECT_BUFFER, indirect_buffer_id_);
+		delete uniform_buffer_ring_;
+	}
+	
 	RenderSystemCapabilities* GLRenderSystem::createRenderSystemCapabilities() const {
 		RenderSystemCapabilities * rsc = new RenderSystemCapabilities();
 		return rsc;
@@ -70,9 +285,388 @@ namespace Astero {
 		return name;
 	}
 
+	void GLRenderSystem::beginFrame() {
+#if ASTERO_GL_CALL_STATS
+		// Finishes GL call counts of previous frame and reports them to render targets.
+		GLCallStats & call_stats = GLCallStats::getInstance();
+		call_stats.endFrame();
+		for (auto & value : render_targets_)
+			value.second->setGLCallStatistics(call_stats.getTotalIssuedCount(), call_stats.getTotalElidedCount());
+#endif
+		// Attaches depth buffers to render targets left without one, such as after their depth buffer pool changed.
+		for (auto & value : render_targets_) {
+			if (value.second->getDepthBuffer() == nullptr)
+				setDepthBufferFor(value.second);
+		}
+		// Software buffer manager, chosen through ASTERO_HARDWARE_BUFFER_MANAGER, keeps everything in system memory.
+		GLHardwareBufferManager * buffer_manager = dynamic_cast<GLHardwareBufferManager *>(HardwareBufferManager::getSingletonPtr());
+		if (buffer_manager) {
+			// Uploads vertex and index data filled by worker threads since last frame.
+			buffer_manager->processUploads();
+			// Completes buffer readbacks whose GPU copies have finished since previous frames.
+			buffer_manager->processPendingReadbacks();
+			// Moves buffers to the usage hint matching how often they have been written lately.
+			buffer_manager->updateBufferUsage();
+			// Evicts least recently used buffers if over GPU memory budget.
+			buffer_manager->updateResidency();
+		}
+		// Deletes vertex array objects which have not been used for a while.
+		state_cache_manager_->updateGLVertexArrayCache();
+		// Waits for region of uniform buffer ring used frame count frames ago.
+		if (uniform_buffer_ring_ == nullptr && GLEW_ARB_uniform_buffer_object)
+			uniform_buffer_ring_ = new GLUniformBufferRing(*state_cache_manager_);
+		if (uniform_buffer_ring_) {
+			uniform_buffer_ring_->beginFrame();
+			// Ranges bound last frame point into another region now.
+			pass_uniforms_dirty_ = true;
+			world_matrix_dirty_ = true;
+		}
+		beginFrameStats();
+	}
+	
+	void GLRenderSystem::endFrame() {
+		if (uniform_buffer_ring_) {
+			uniform_buffer_ring_->endFrame();
+			ASTERO_PROFILE_COUNTER("Uniform ring overflows", uniform_buffer_ring_->getOverflowCount());
+			ASTERO_PROFILE_COUNTER("Draws skipped for uniforms", skipped_draw_count_);
+		}
+		endFrameStats();
+	}
+	
+	void GLRenderSystem::setWorldMatrix(const Matrix4 & world_matrix) {
+		world_matrix_ = world_matrix;
+		world_matrix_dirty_ = true;
+	}
+	
+	void GLRenderSystem::setViewMatrix(const Matrix4 & view_matrix) {
+		view_matrix_ = view_matrix;
+		pass_uniforms_dirty_ = true;
+	}
+	
+	void GLRenderSystem::setProjectionMatrix(const Matrix4 & projection_matrix) {
+		projection_matrix_ = projection_matrix;
+		pass_uniforms_dirty_ = true;
+	}
+	
+	void * GLRenderSystem::allocateUniforms(size_t size, size_t & offset) {
+		if (uniform_buffer_ring_ == nullptr)
+			return nullptr;
+		return uniform_buffer_ring_->allocate(size, offset);
+	}
+	
+	void GLRenderSystem::setPassUniforms(const void * data, size_t size) {
+		if (uniform_buffer_ring_ == nullptr)
+			return;
+		writeUniforms(GL_UNIFORM_BINDING_PASS, data, size);
+		// Replaces pass uniforms made of matrices until they change again.
+		pass_uniforms_dirty_ = false;
+	}
+	
+	bool GLRenderSystem::bindOperationUniforms(const RenderOperation & operation) {
+		if (uniform_buffer_ring_ == nullptr)
+			return true;
+		// Written once per pass, not per operation. Uniforms failed to be written stay dirty.
+		if (pass_uniforms_dirty_) {
+			Matrix4 matrices[2] = {view_matrix_, projection_matrix_};
+			if (!writeUniforms(GL_UNIFORM_BINDING_PASS, matrices, sizeof(matrices)))
+				return false;
+			pass_uniforms_dirty_ = false;
+		}
+		if (operation.uniform_size > 0) {
+			uniform_buffer_ring_->bind(GL_UNIFORM_BINDING_OBJECT, operation.uniform_offset, operation.uniform_size);
+			// Binding now points at range of operation, so world matrix has to be bound again for operations without one.
+			world_matrix_dirty_ = true;
+		}
+		else if (world_matrix_dirty_) {
+			if (!writeUniforms(GL_UNIFORM_BINDING_OBJECT, &world_matrix_, sizeof(world_matrix_)))
+				return false;
+			world_matrix_dirty_ = false;
+		}
+		return true;
+	}
+	
+	bool GLRenderSystem::writeUniforms(GLuint binding, const void * data, size_t size) {
+		// Ring is full for rest of frame. It counts every failed write, and grows to fit at next frame.
+		size_t offset = uniform_buffer_ring_->write(data, size);
+		if (offset == ~(size_t)0)
+			return false;
+		uniform_buffer_ring_->bind(binding, offset, size);
+		return true;
+	}
+	
+	void GLRenderSystem::setVertexArrayCacheEnabled(bool enabled) {
+		vertex_array_cache_enabled_ = enabled;
+	}
+	
+	bool GLRenderSystem::isVertexArrayCacheEnabled() const {
+		return vertex_array_cache_enabled_;
+	}
+	
+	void GLRenderSystem::setMainContext(GLContext * context) {
+		main_context_ = context;
+	}
+	
+	GLContext * GLRenderSystem::getMainContext() const {
+		return main_context_;
+	}
+	
+	void GLRenderSystem::registerThread() {
+		// Rendering from another thread needs context of primary window, callers check canRegisterThread first.
+		if (main_context_)
+			main_context_->setCurrent();
+	}
+	
+	void GLRenderSystem::unregisterThread() {
+		if (main_context_)
+			main_context_->endCurrent();
+	}
+	
+	bool GLRenderSystem::canRegisterThread() const {
+		return main_context_ != nullptr;
+	}
+	
 	void GLRenderSystem::render(const RenderOperation & operation) {
+		ASTERO_PROFILE_SCOPE("GLRenderSystem::render");
+		// Skipping draw is better than drawing with uniforms of an earlier operation.
+		if (!bindOperationUniforms(operation)) {
+			skipped_draw_count_++;
+			return;
+		}
 		// Call super class
 		RenderSystem::render(operation);
+		GLenum prim_type = bindOperation(operation);
+		bool use_vbo = current_capabilities_->hasCapability(RSC_VBO);
+		bool has_instance_data = hasInstanceData(operation);
+		unsigned int instance_number = getInstanceNumber(operation);
+		// glDrawElements or glDrawElementsInstanced.
+		if (operation.use_indices) {
+			// Pointer to the location where indices data stored.
+			void * buffer_data = nullptr;
+			if (use_vbo) {
+				// Index buffer has been bound by bindOperation. Sub-allocated index buffers start at base offset of their mega-buffer range.
+				buffer_data = (char *)NULL + operation.index_data->index_buffer->getBaseOffset() + (operation.index_data->index_start * operation.index_data->index_buffer->getIndexSize());
+			}
+			else {
+				buffer_data = static_cast<GLDefaultHardwareIndexBuffer *>(operation.index_data->index_buffer.get())->getData(operation.index_data->index_start * operation.index_data->index_buffer->getIndexSize());
+			}
+			GLenum index_type = (operation.index_data->index_buffer->getType() == HardwareIndexBuffer::IT_16BIT) ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+			do {
+				// Updates derived depth bias.
+				if (derived_depth_bias_ && current_pass_iteration_number_ > 0) {
+					setDepthBias(derived_depth_bias_base_ + derived_depth_bias_multiplier_ * current_pass_iteration_number_,
+								 derived_depth_bias_slope_scale_);
+				}
+				ASTERO_GL_CALL_ISSUED(GCT_DRAW);
+				if (has_instance_data && operation.base_instance != 0 && GLEW_ARB_base_instance) {
+					glDrawElementsInstancedBaseInstance(prim_type, operation.index_data->index_count, index_type, buffer_data,
+														instance_number, operation.base_instance);
+				}
+				else if(has_instance_data) {
+					glDrawElementsInstanced(prim_type, operation.index_data->index_count, index_type, buffer_data, instance_number);
+				}
+				else {
+					glDrawElements(prim_type, operation.index_data->index_count, index_type, buffer_data);
+				}
+			} while (updatePassIterationRenderState());
+		}
+		// glDrawArrays or glDrawArraysInstanced.
+		else {
+			do {
+				if (derived_depth_bias_ && current_pass_iteration_number_ > 0) {
+					setDepthBias(derived_depth_bias_base_ + derived_depth_bias_multiplier_ * current_pass_iteration_number_,
+								 derived_depth_bias_slope_scale_);
+				}
+				ASTERO_GL_CALL_ISSUED(GCT_DRAW);
+				if (has_instance_data && operation.base_instance != 0 && GLEW_ARB_base_instance) {
+					glDrawArraysInstancedBaseInstance(prim_type, 0, operation.vertex_data->vertex_count, instance_number,
+													  operation.base_instance);
+				}
+				else if (has_instance_data) {
+					glDrawArraysInstanced(prim_type, 0, operation.vertex_data->vertex_count, instance_number);
+				}
+				else {
+					glDrawArrays(prim_type, 0, operation.vertex_data->vertex_count);
+				}
+			} while (updatePassIterationRenderState());
+		}
+	}
+	
+	void GLRenderSystem::renderBatch(const RenderOperation * const * operations, size_t count) {
+		size_t start = 0;
+		while (start < count) {
+			const RenderOperation & first = *operations[start];
+			batch_base_vertices_.clear();
+			batch_base_vertices_.push_back(0);
+			size_t end = start + 1;
+			GLint base_vertex = 0;
+			while (end < count && end - start < GL_MULTI_DRAW_MAX_BATCH_SIZE && canMultiDraw(first, *operations[end], base_vertex)) {
+				batch_base_vertices_.push_back(base_vertex);
+				++end;
+			}
+			if (end - start == 1)
+				render(first);
+			else
+				renderMultiDraw(operations + start, end - start);
+			start = end;
+		}
+	}
+	
+	bool GLRenderSystem::canMultiDraw(const RenderOperation & first, const RenderOperation & operation, GLint & base_vertex) const {
+		if (!current_capabilities_->hasCapability(RSC_VBO))
+			return false;
+		bool indirect = GLEW_ARB_multi_draw_indirect;
+		if (!indirect && !GLEW_ARB_draw_elements_base_vertex)
+			return false;
+		if (!first.use_indices || !operation.use_indices || first.render_to_vertex_buffer || operation.render_to_vertex_buffer)
+			return false;
+		if (operation.operation_type != first.operation_type
+			|| operation.use_global_instance_vertex_buffer != first.use_global_instance_vertex_buffer)
+			return false;
+		// One draw sees one binding of object uniforms.
+		if (operation.uniform_size != first.uniform_size || (operation.uniform_size > 0 && operation.uniform_offset != first.uniform_offset))
+			return false;
+		const VertexData * first_vertex_data = first.vertex_data;
+		const VertexData * vertex_data = operation.vertex_data;
+		if (vertex_data->vertex_declaration != first_vertex_data->vertex_declaration)
+			return false;
+		// Instance buffers bound to operations would need their own pointers, per object data has to come from global
+		// instance buffer.
+		if (first_vertex_data->vertex_buffer_binding->getHasInstanceData() || vertex_data->vertex_buffer_binding->getHasInstanceData())
+			return false;
+		// Without indirect draws instances cannot be offset per operation.
+		if (!indirect && (hasInstanceData(first) || hasInstanceData(operation)))
+			return false;
+		// Evicted buffers all have buffer id 0 until they are restored when bound, so they are never merged.
+		const HardwareIndexBuffer * first_index_buffer = first.index_data->index_buffer.get();
+		const HardwareIndexBuffer * index_buffer = operation.index_data->index_buffer.get();
+		if (index_buffer->getType() != first_index_buffer->getType()
+			|| !static_cast<const GLHardwareIndexBuffer *>(index_buffer)->isResident()
+			|| !static_cast<const GLHardwareIndexBuffer *>(first_index_buffer)->isResident()
+			|| static_cast<const GLHardwareIndexBuffer *>(index_buffer)->getGLBufferId()
+			!= static_cast<const GLHardwareIndexBuffer *>(first_index_buffer)->getGLBufferId()
+			|| index_buffer->getBaseOffset() % index_buffer->getIndexSize() != 0
+			|| first_index_buffer->getBaseOffset() % first_index_buffer->getIndexSize() != 0)
+			return false;
+		// Every source has to be in same buffer object as for first operation, at same whole number of vertices from it.
+		const VertexBufferBinding::VertexBufferBindingMap & first_bindings = first_vertex_data->vertex_buffer_binding->getBindings();
+		if (first_bindings.empty() || vertex_data->vertex_buffer_binding->getBindings().size() != first_bindings.size())
+			return false;
+		bool base_vertex_found = false;
+		for (auto & value : first_bindings) {
+			if (!vertex_data->vertex_buffer_binding->isBufferBound(value.first))
+				return false;
+			const HardwareVertexBuffer * first_buffer = value.second.get();
+			const HardwareVertexBuffer * buffer = vertex_data->vertex_buffer_binding->getBuffer(value.first).get();
+			size_t vertex_size = buffer->getVertexSize();
+			if (vertex_size != first_buffer->getVertexSize()
+				|| !static_cast<const GLHardwareVertexBuffer *>(buffer)->isResident()
+				|| !static_cast<const GLHardwareVertexBuffer *>(first_buffer)->isResident()
+				|| static_cast<const GLHardwareVertexBuffer *>(buffer)->getGLBufferId()
+				!= static_cast<const GLHardwareVertexBuffer *>(first_buffer)->getGLBufferId())
+				return false;
+			ptrdiff_t delta = static_cast<ptrdiff_t>(buffer->getBaseOffset() + vertex_data->vertex_start * vertex_size)
+			- static_cast<ptrdiff_t>(first_buffer->getBaseOffset() + first_vertex_data->vertex_start * vertex_size);
+			if (delta % static_cast<ptrdiff_t>(vertex_size) != 0)
+				return false;
+			GLint source_base_vertex = static_cast<GLint>(delta / static_cast<ptrdiff_t>(vertex_size));
+			if (base_vertex_found && source_base_vertex != base_vertex)
+				return false;
+			base_vertex = source_base_vertex;
+			base_vertex_found = true;
+		}
+		return true;
+	}
+	
+	void GLRenderSystem::renderMultiDraw(const RenderOperation * const * operations, size_t count) {
+		ASTERO_PROFILE_SCOPE("GLRenderSystem::renderMultiDraw");
+		// Operations share uniforms of first one.
+		if (!bindOperationUniforms(*operations[0])) {
+			skipped_draw_count_ += count;
+			return;
+		}
+		// Merged operations make one draw call.
+		for (size_t i = 0; i < count; ++i)
+			updateGeometryCount(*operations[i]);
+		updateBatchCount();
+		for (size_t i = 1; i < count; ++i)
+			flushOperationBuffers(*operations[i]);
+		// Vertex arrays of first operation serve all others through base vertices.
+		GLenum prim_type = bindOperation(*operations[0]);
+		const HardwareIndexBuffer * index_buffer = operations[0]->index_data->index_buffer.get();
+		GLenum index_type = (index_buffer->getType() == HardwareIndexBuffer::IT_16BIT) ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+		size_t index_size = index_buffer->getIndexSize();
+		if (GLEW_ARB_multi_draw_indirect) {
+			indirect_commands_.clear();
+			for (size_t i = 0; i < count; ++i) {
+				const RenderOperation & operation = *operations[i];
+				bool has_instance_data = hasInstanceData(operation);
+				GLDrawElementsIndirectCommand command;
+				command.count = operation.index_data->index_count;
+				command.instance_count = has_instance_data ? getInstanceNumber(operation) : 1;
+				command.first_index = static_cast<GLuint>(operation.index_data->index_buffer->getBaseOffset() / index_size
+														  + operation.index_data->index_start);
+				command.base_vertex = batch_base_vertices_[i];
+				command.base_instance = has_instance_data ? operation.base_instance : 0;
+				indirect_commands_.push_back(command);
+			}
+			size_t offset = writeIndirectCommands(indirect_commands_.data(), count);
+			do {
+				if (derived_depth_bias_ && current_pass_iteration_number_ > 0) {
+					setDepthBias(derived_depth_bias_base_ + derived_depth_bias_multiplier_ * current_pass_iteration_number_,
+								 derived_depth_bias_slope_scale_);
+				}
+				ASTERO_GL_CALL_ISSUED(GCT_DRAW);
+				glMultiDrawElementsIndirect(prim_type, index_type, (char *)NULL + offset, static_cast<GLsizei>(count), 0);
+			} while (updatePassIterationRenderState());
+		}
+		else {
+			multi_draw_counts_.clear();
+			multi_draw_indices_.clear();
+			for (size_t i = 0; i < count; ++i) {
+				const RenderOperation & operation = *operations[i];
+				multi_draw_counts_.push_back(operation.index_data->index_count);
+				multi_draw_indices_.push_back((char *)NULL + operation.index_data->index_buffer->getBaseOffset()
+											  + operation.index_data->index_start * index_size);
+			}
+			do {
+				if (derived_depth_bias_ && current_pass_iteration_number_ > 0) {
+					setDepthBias(derived_depth_bias_base_ + derived_depth_bias_multiplier_ * current_pass_iteration_number_,
+								 derived_depth_bias_slope_scale_);
+				}
+				ASTERO_GL_CALL_ISSUED(GCT_DRAW);
+				glMultiDrawElementsBaseVertex(prim_type, multi_draw_counts_.data(), index_type, multi_draw_indices_.data(),
+											  static_cast<GLsizei>(count), batch_base_vertices_.data());
+			} while (updatePassIterationRenderState());
+		}
+	}
+	
+	size_t GLRenderSystem::writeIndirectCommands(const GLDrawElementsIndirectCommand * commands, size_t count) {
+		size_t size = count * sizeof(GLDrawElementsIndirectCommand);
+		if (indirect_buffer_id_ == 0)
+			glGenBuffers(1, &indirect_buffer_id_);
+		state_cache_manager_->bindGLBuffer(GL_DRAW_INDIRECT_BUFFER, indirect_buffer_id_);
+		if (indirect_buffer_offset_ + size > indirect_buffer_size_) {
+			// Orphans full buffer, driver keeps old storage alive until GPU is done with it.
+			if (size > indirect_buffer_size_)
+				indirect_buffer_size_ = std::max(std::max(indirect_buffer_size_ * 2, size), (size_t)GL_INDIRECT_BUFFER_INITIAL_SIZE);
+			glBufferData(GL_DRAW_INDIRECT_BUFFER, indirect_buffer_size_, nullptr, GL_STREAM_DRAW);
+			indirect_buffer_offset_ = 0;
+		}
+		size_t offset = indirect_buffer_offset_;
+		void * data = glMapBufferRange(GL_DRAW_INDIRECT_BUFFER, offset, size,
+									   GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+		if (data) {
+			memcpy(data, commands, size);
+			glUnmapBuffer(GL_DRAW_INDIRECT_BUFFER);
+		}
+		else {
+			glBufferSubData(GL_DRAW_INDIRECT_BUFFER, offset, size, commands);
+		}
+		indirect_buffer_offset_ += size;
+		return offset;
+	}
+	
+	GLenum GLRenderSystem::bindOperation(const RenderOperation & operation) {
 		if (!enable_fixed_pipeline_
 			&& !real_capabilities_->hasCapability(RSC_FIXED_FUNCTION)
 			&& (current_vertex_program_ == nullptr
@@ -82,33 +676,60 @@ namespace Astero {
 		}
 		// Reset max built-in texture attrib index.
 		max_built_in_texture_attrib_index_ = 0;
-		// Has global instance data or operation has instance data.
-		bool has_instance_data = (operation.use_global_instance_vertex_buffer
-								  && global_instance_vertex_buffer_ != nullptr
-								  && global_instance_vertex_buffer_vertex_declaration_ != nullptr) || operation.vertex_data->vertex_buffer_binding->getHasInstanceData();
-		// Calculates instance number.
-		unsigned int instance_number = operation.instance_number;
-		if (operation.use_global_instance_vertex_buffer)
-			instance_number *= global_instance_number_;
-		// Binds vertex element to GPU.
-		for (auto & element : operation.vertex_data->vertex_declaration->getElements()) {
-			size_t source = element.getSource();
-			// Skips unbounded elements.
-			if (!operation.vertex_data->vertex_buffer_binding->isBufferBound(source))
-				continue;
-			HardwareVertexBufferPtr vertex_buffer = operation.vertex_data->vertex_buffer_binding->getBuffer(source);
-			bindVertexElementToGpu(element, vertex_buffer, operation.vertex_data->vertex_start,
-								   render_attribs_bound_, render_instance_attribs_bound_);
-		}
-		// Binds global instance vertex element to GPU.
-		if (global_instance_vertex_buffer_ != nullptr && global_instance_vertex_buffer_vertex_declaration_ != nullptr) {
-			for (auto & element : global_instance_vertex_buffer_vertex_declaration_->getElements()) {
-				bindVertexElementToGpu(element, global_instance_vertex_buffer_, 0,
-									   render_attribs_bound_, render_instance_attribs_bound_);
+		bool use_vbo = current_capabilities_->hasCapability(RSC_VBO);
+		// Flushes pending shadow buffer writes and restores evicted buffers, so buffer objects are final before use.
+		flushOperationBuffers(operation);
+		// A vertex array object cached for same layout, buffers and attribute locations restores all pointers, enabled
+		// arrays, divisors and index buffer binding in one call.
+		bool vertex_array_bound = false;
+		GLuint new_vertex_array = 0;
+		if (use_vbo && vertex_array_cache_enabled_ && GLEW_ARB_vertex_array_object) {
+			buildVertexArrayKey(operation);
+			GLuint vertex_array = state_cache_manager_->findGLVertexArray(vertex_array_key_);
+			if (vertex_array) {
+				state_cache_manager_->bindGLVertexArray(vertex_array);
+				vertex_array_bound = true;
+			}
+			else {
+				// Records bindings below into a new vertex array object.
+				glGenVertexArrays(1, &new_vertex_array);
+				state_cache_manager_->bindGLVertexArray(new_vertex_array, true);
+			}
+		}
+		else if (GLEW_ARB_vertex_array_object) {
+			state_cache_manager_->bindGLVertexArray(0);
+		}
+		if (!vertex_array_bound) {
+			render_attrib_mask_ = 0;
+			render_client_state_mask_ = 0;
+			// Binds vertex element to GPU.
+			for (auto & element : operation.vertex_data->vertex_declaration->getElements()) {
+				size_t source = element.getSource();
+				// Skips unbounded elements.
+				if (!operation.vertex_data->vertex_buffer_binding->isBufferBound(source))
+					continue;
+				bindVertexElementToGpu(element, operation.vertex_data->vertex_buffer_binding->getBuffer(source),
+									   operation.vertex_data->vertex_start);
+			}
+			// Binds global instance vertex element to GPU.
+			if (usesGlobalInstanceData(operation)) {
+				size_t instance_start = getGlobalInstanceStart(operation);
+				for (auto & element : global_instance_vertex_buffer_vertex_declaration_->getElements()) {
+					bindVertexElementToGpu(element, global_instance_vertex_buffer_, instance_start);
+				}
+			}
+			// Enables arrays used by this operation and disables the rest, only issuing calls for arrays whose state changes.
+			state_cache_manager_->setEnabledVertexAttribArrays(render_attrib_mask_);
+			state_cache_manager_->setEnabledClientStates(render_client_state_mask_);
+			if (operation.use_indices && use_vbo) {
+				state_cache_manager_->bindGLBuffer(GL_ELEMENT_ARRAY_BUFFER, static_cast<GLHardwareIndexBuffer *>(operation.index_data->index_buffer.get())->getGLBufferId());
+			}
+			if (new_vertex_array) {
+				state_cache_manager_->cacheGLVertexArray(vertex_array_key_, new_vertex_array, vertex_array_buffers_);
 			}
 		}
 		// OpenGL modes.
-		GLint prim_type;
+		GLenum prim_type;
 		bool use_adjacency = geometry_program_bound_ && current_geometry_program_ && current_geometry_program_->isAdjacencyInfoRequired();
 		switch (operation.operation_type) {
 			case RenderOperation::OT_POINT_LIST:
@@ -134,102 +755,124 @@ namespace Astero {
 		// glClentActiveTexture.
 		bool multitexturing = (current_capabilities_->getTextureUnitNumber() > 1);
 		if (multitexturing)
-			glClientActiveTexture(GL_TEXTURE0);
-		// glDrawElements or glDrawElementsInstanced.
-		if (operation.use_indices) {
-			// Pointer to the location where indices data stored.
-			void * buffer_data = nullptr;
-			if (current_capabilities_->hasCapability(RSC_VBO)) {
-				state_cache_manager_->bindGLBuffer(GL_ELEMENT_ARRAY_BUFFER, static_cast<GLHardwareIndexBuffer *>(operation.index_data->index_buffer.get())->getGLBufferId());
-				buffer_data = (char *)NULL + (operation.index_data->index_start * operation.index_data->index_buffer->getIndexSize());
-			}
-			else {
-				buffer_data = static_cast<GLDefaultHardwareIndexBuffer *>(operation.index_data->index_buffer.get())->getData(operation.index_data->index_start * operation.index_data->index_buffer->getIndexSize());
-			}
-			GLenum index_type = (operation.index_data->index_buffer->getType() == HardwareIndexBuffer::IT_16BIT) ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
-			do {
-				// Updates derived depth bias.
-				if (derived_depth_bias_ && current_pass_iteration_number_ > 0) {
-					setDepthBias(derived_depth_bias_base_ + derived_depth_bias_multiplier_ * current_pass_iteration_number_,
-								 derived_depth_bias_slope_scale_);
-				}
-				if(has_instance_data) {
-					glDrawElementsInstanced(prim_type, operation.index_data->index_count, index_type, buffer_data, instance_number);
-				}
-				else {
-					glDrawElements(prim_type, operation.index_data->index_count, index_type, buffer_data);
-				}
-			} while (updatePassIterationRenderState());
+			state_cache_manager_->setClientActiveTexture(0);
+		return prim_type;
+	}
+	
+	void GLRenderSystem::flushOperationBuffers(const RenderOperation & operation) {
+		// Only buffers of GL buffer manager have buffer objects to keep resident.
+		GLHardwareBufferManager * buffer_manager = nullptr;
+		if (current_capabilities_->hasCapability(RSC_VBO))
+			buffer_manager = dynamic_cast<GLHardwareBufferManager *>(HardwareBufferManager::getSingletonPtr());
+		for (auto & value : operation.vertex_data->vertex_buffer_binding->getBindings()) {
+			value.second->updateFromShadow();
+			if (buffer_manager)
+				buffer_manager->touchGLBuffer(static_cast<GLHardwareVertexBuffer *>(value.second.get()));
 		}
-		// glDrawArrays or glDrawArraysInstanced.
-		else {
-			do {
-				if (derived_depth_bias_ && current_pass_iteration_number_ > 0) {
-					setDepthBias(derived_depth_bias_base_ + derived_depth_bias_multiplier_ * current_pass_iteration_number_,
-								 derived_depth_bias_slope_scale_);
-				}
-				if (has_instance_data) {
-					glDrawArraysInstanced(prim_type, 0, operation.vertex_data->vertex_count, instance_number);
-				}
-				else {
-					glDrawArrays(prim_type, 0, operation.vertex_data->vertex_count);
-				}
-			} while (updatePassIterationRenderState());
+		if (usesGlobalInstanceData(operation)) {
+			global_instance_vertex_buffer_->updateFromShadow();
+			if (buffer_manager)
+				buffer_manager->touchGLBuffer(static_cast<GLHardwareVertexBuffer *>(global_instance_vertex_buffer_.get()));
 		}
-		// Disable client states which have been enabled in bindVertexElementToGpu.
-		glDisableClientState(GL_VERTEX_ARRAY);
-		if (multitexturing) {
-			unsigned short enabled_texture_number = std::max(std::min(texture_units_disabled_from_, fixed_function_texture_units_number_), (unsigned short)(max_built_in_texture_attrib_index_ + 1));
-			for (unsigned short i = 0; i < enabled_texture_number; ++i) {
-				glClientActiveTexture(GL_TEXTURE0 + i);
-				glDisableClientState(GL_TEXTURE_COORD_ARRAY);
-			}
-			glClientActiveTexture(GL_TEXTURE0);
+		if (operation.use_indices) {
+			operation.index_data->index_buffer->updateFromShadow();
+			if (buffer_manager)
+				buffer_manager->touchGLBuffer(static_cast<GLHardwareIndexBuffer *>(operation.index_data->index_buffer.get()));
 		}
-		else {
-			glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+	}
+	
+	bool GLRenderSystem::hasInstanceData(const RenderOperation & operation) const {
+		// Has global instance data or operation has instance data.
+		return usesGlobalInstanceData(operation) || operation.vertex_data->vertex_buffer_binding->getHasInstanceData();
+	}
+	
+	bool GLRenderSystem::usesGlobalInstanceData(const RenderOperation & operation) const {
+		return operation.use_global_instance_vertex_buffer
+		&& global_instance_vertex_buffer_ != nullptr
+		&& global_instance_vertex_buffer_vertex_declaration_ != nullptr;
+	}
+	
+	size_t GLRenderSystem::getGlobalInstanceStart(const RenderOperation & operation) const {
+		return GLEW_ARB_base_instance ? 0 : operation.base_instance;
+	}
+	
+	unsigned int GLRenderSystem::getInstanceNumber(const RenderOperation & operation) const {
+		unsigned int instance_number = operation.instance_number;
+		if (operation.use_global_instance_vertex_buffer)
+			instance_number *= global_instance_number_;
+		return instance_number;
+	}
+	
+	void GLRenderSystem::buildVertexArrayKey(const RenderOperation & operation) {
+		vertex_array_key_.clear();
+		vertex_array_buffers_.clear();
+		// Each element contributes its layout, buffer object, start in buffer, instancing and attribute location.
+		auto add_element = [this](const VertexElement & element, const HardwareVertexBufferPtr & vertex_buffer, size_t vertex_start) {
+			const GLHardwareVertexBuffer * gl_vertex_buffer = static_cast<const GLHardwareVertexBuffer *>(vertex_buffer.get());
+			size_t attrib = ~(size_t)0;
+			if (current_vertex_program_ != nullptr) {
+				GLint location = current_vertex_program_->getAttributeLocation(element.getSemantic(), element.getIndex());
+				if (location >= 0)
+					attrib = location;
+			}
+			vertex_array_key_.push_back(element.getSource());
+			vertex_array_key_.push_back(element.getOffset());
+			vertex_array_key_.push_back(element.getType());
+			vertex_array_key_.push_back(element.getSemantic());
+			vertex_array_key_.push_back(element.getIndex());
+			vertex_array_key_.push_back(attrib);
+			vertex_array_key_.push_back(gl_vertex_buffer->getGLBufferId());
+			vertex_array_key_.push_back(gl_vertex_buffer->getBaseOffset() + vertex_start * vertex_buffer->getVertexSize());
+			vertex_array_key_.push_back(vertex_buffer->getVertexSize());
+			vertex_array_key_.push_back(gl_vertex_buffer->getIsInstanceData() ? gl_vertex_buffer->getInstanceDataStepRate() : 0);
+			vertex_array_buffers_.push_back(gl_vertex_buffer->getGLBufferId());
+		};
+		for (auto & element : operation.vertex_data->vertex_declaration->getElements()) {
+			size_t source = element.getSource();
+			if (!operation.vertex_data->vertex_buffer_binding->isBufferBound(source))
+				continue;
+			add_element(element, operation.vertex_data->vertex_buffer_binding->getBuffer(source), operation.vertex_data->vertex_start);
 		}
-		glDisableClientState(GL_NORMAL_ARRAY);
-		glDisableClientState(GL_COLOR_ARRAY);
-		if (GLEW_EXT_secondary_color) {
-			glDisableClientState(GL_SECONDARY_COLOR_ARRAY);
+		if (usesGlobalInstanceData(operation)) {
+			for (auto & element : global_instance_vertex_buffer_vertex_declaration_->getElements())
+				add_element(element, global_instance_vertex_buffer_, getGlobalInstanceStart(operation));
 		}
-		for (auto index : render_attribs_bound_) {
-			glDisableVertexAttribArray(index);
+		// Index buffer binding is part of vertex array object too.
+		GLuint index_buffer_id = 0;
+		if (operation.use_indices) {
+			index_buffer_id = static_cast<const GLHardwareIndexBuffer *>(operation.index_data->index_buffer.get())->getGLBufferId();
+			vertex_array_buffers_.push_back(index_buffer_id);
 		}
-		for (auto index : render_instance_attribs_bound_) {
-			glVertexAttribDivisor(index, 0);
+		vertex_array_key_.push_back(index_buffer_id);
+		// Fixed function texture coordinates are routed to units by texture coordinate sets.
+		if (current_vertex_program_ == nullptr) {
+			vertex_array_key_.push_back(texture_units_disabled_from_);
+			for (unsigned short i = 0; i < texture_units_disabled_from_ && i < 16; ++i)
+				vertex_array_key_.push_back(texture_coordinate_index_[i]);
 		}
-		render_attribs_bound_.clear();
-		render_instance_attribs_bound_.clear();
 	}
 	void GLRenderSystem::bindVertexElementToGpu(const VertexElement & element, HardwareVertexBufferPtr vertex_buffer,
-								const size_t vertex_start, std::vector<GLuint> & attribs_bound,
-								std::vector<GLuint> & instance_attribs_bound) {
+								const size_t vertex_start) {
+		ASTERO_PROFILE_SCOPE("GLRenderSystem::bindVertexElementToGpu");
 		// Retrieves buffer_data.
 		void * buffer_data = nullptr;
-		const GLHardwareVertexBuffer * gl_vertex_buffer = static_cast<const GLHardwareVertexBuffer *>(vertex_buffer.get());
+		GLHardwareVertexBuffer * gl_vertex_buffer = static_cast<GLHardwareVertexBuffer *>(vertex_buffer.get());
 		if (current_capabilities_->hasCapability(RSC_VBO)) {
 			state_cache_manager_->bindGLBuffer(GL_ARRAY_BUFFER, gl_vertex_buffer->getGLBufferId());
-			buffer_data = (char *)NULL + element.getOffset();
+			// Sub-allocated vertex buffers start at base offset of their mega-buffer range.
+			buffer_data = (char *)NULL + gl_vertex_buffer->getBaseOffset() + vertex_start * vertex_buffer->getVertexSize() + element.getOffset();
 		}
 		else {
-			buffer_data = static_cast<const GLDefaultHardwareVertexBuffer *>(vertex_buffer.get())->getData(element.getOffset());
+			buffer_data = static_cast<const GLDefaultHardwareVertexBuffer *>(vertex_buffer.get())->getData(vertex_start * vertex_buffer->getVertexSize() + element.getOffset());
 		}
 		VertexElementSemantic semantic = element.getSemantic();
 		bool multitexturing = current_capabilities_->getTextureUnitNumber() > 1;
-		bool is_custom_attrib = false;
-		if (current_vertex_program_ != nullptr) {
-			is_custom_attrib = current_vertex_program_->isAttributeValid(semantic, element.getIndex());
-			if (gl_vertex_buffer->getIsInstanceData()) {
-				GLint attrib = current_vertex_program_->getAttributeIndex(semantic, element.getIndex());
-				glVertexAttribDivisor(attrib, gl_vertex_buffer->getInstanceDataStepRate());
-				instance_attribs_bound.push_back(attrib);
-			}
-		}
+		// One table read gives both validity and location.
+		GLint attrib = -1;
+		if (current_vertex_program_ != nullptr)
+			attrib = current_vertex_program_->getAttributeLocation(semantic, element.getIndex());
 		// Custom attribut support.
-		if (is_custom_attrib) {
-			GLint attrib = current_vertex_program_->getAttributeIndex(semantic, element.getIndex());
+		if (attrib >= 0) {
 			unsigned short type_count = VertexElement::getTypeCount(element.getType());
 			GLboolean normalized = GL_FALSE;
 			switch (element.getType()) {
@@ -242,36 +885,44 @@ namespace Astero {
 				default:
 					break;
 			}
+			ASTERO_GL_CALL_ISSUED(GCT_ATTRIB_POINTER);
 			glVertexAttribPointer(attrib, type_count, GLHardwareBufferManager::getGLType(element.getType()), normalized, static_cast<GLsizei>(vertex_buffer->getVertexSize()), buffer_data);
-			glEnableVertexAttribArray(attrib);
-			attribs_bound.push_back(attrib);
+			// Divisor is cached, so resetting it for per-vertex attributes costs nothing unless it was instanced before.
+			state_cache_manager_->setVertexAttribDivisor(attrib, gl_vertex_buffer->getIsInstanceData() ? static_cast<GLuint>(gl_vertex_buffer->getInstanceDataStepRate()) : 0);
+			assert(attrib < GL_STATE_CACHE_MAX_VERTEX_ATTRIBS);
+			render_attrib_mask_ |= 1u << attrib;
 		}
 		// Fixed-function & built in attribute support.
 		else {
 			switch (semantic) {
 				case VES_POSITION:
+					ASTERO_GL_CALL_ISSUED(GCT_ATTRIB_POINTER);
 					glVertexPointer(VertexElement::getTypeCount(element.getType()), GLHardwareBufferManager::getGLType(element.getType()), static_cast<GLsizei>(vertex_buffer->getVertexSize()), buffer_data);
-					glEnableClientState(GL_VERTEX_ARRAY);
+					render_client_state_mask_ |= GLStateCacheManager::CS_VERTEX_ARRAY;
 					break;
 				case VES_NORMAL:
+					ASTERO_GL_CALL_ISSUED(GCT_ATTRIB_POINTER);
 					glNormalPointer(GLHardwareBufferManager::getGLType(element.getType()), static_cast<GLsizei>(vertex_buffer->getVertexSize()), buffer_data);
-					glEnableClientState(GL_NORMAL_ARRAY);
+					render_client_state_mask_ |= GLStateCacheManager::CS_NORMAL_ARRAY;
 					break;
 				case VES_DIFFUSE:
+					ASTERO_GL_CALL_ISSUED(GCT_ATTRIB_POINTER);
 					glColorPointer(4, GLHardwareBufferManager::getGLType(element.getType()), static_cast<GLsizei>(vertex_buffer->getVertexSize()), buffer_data);
-					glEnableClientState(GL_COLOR_ARRAY);
+					render_client_state_mask_ |= GLStateCacheManager::CS_COLOR_ARRAY;
 					break;
 				case VES_SPECULAR:
 					if (GLEW_EXT_secondary_color) {
+						ASTERO_GL_CALL_ISSUED(GCT_ATTRIB_POINTER);
 						glSecondaryColorPointer(4, GLHardwareBufferManager::getGLType(element.getType()), static_cast<GLsizei>(vertex_buffer->getVertexSize()), buffer_data);
-						glEnableClientState(GL_SECONDARY_COLOR_ARRAY);
+						render_client_state_mask_ |= GLStateCacheManager::CS_SECONDARY_COLOR_ARRAY;
 					}
 					break;
 				case VES_TEXTURE_COORDINATES:
 					if (current_vertex_program_) {
-						glClientActiveTexture(GL_TEXTURE0 + element.getIndex());
+						state_cache_manager_->setClientActiveTexture(element.getIndex());
+						ASTERO_GL_CALL_ISSUED(GCT_ATTRIB_POINTER);
 						glTexCoordPointer(VertexElement::getTypeCount(element.getType()), GLHardwareBufferManager::getGLType(element.getType()), static_cast<GLsizei>(vertex_buffer->getVertexSize()), buffer_data);
-						glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+						render_client_state_mask_ |= GLStateCacheManager::CS_TEXTURE_COORD_ARRAY << element.getIndex();
 						// Updates max built-in texture attrib index.
 						if (element.getIndex() > max_built_in_texture_attrib_index_)
 							max_built_in_texture_attrib_index_ = element.getIndex();
@@ -281,9 +932,10 @@ namespace Astero {
 						for (unsigned int i = 0; i < texture_units_disabled_from_; ++i) {
 							if (texture_coordinate_index_[i] == element.getIndex() && i < fixed_function_texture_units_number_) {
 								if (multitexturing)
-									glClientActiveTexture(GL_TEXTURE0 + i);
+									state_cache_manager_->setClientActiveTexture(i);
+								ASTERO_GL_CALL_ISSUED(GCT_ATTRIB_POINTER);
 								glTexCoordPointer(VertexElement::getTypeCount(element.getType()), GLHardwareBufferManager::getGLType(element.getType()), static_cast<GLsizei>(vertex_buffer->getVertexSize()), buffer_data);
-								glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+								render_client_state_mask_ |= GLStateCacheManager::CS_TEXTURE_COORD_ARRAY << i;
 							}
 						}
 					}
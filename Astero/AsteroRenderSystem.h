@@ -11,7 +11,15 @@
 
 #include <GL/glew.h>
 #include <OpenGL/glu.h>
+#include <atomic>
+#include <chrono>
 #include "AsteroRenderOperation.h"
+#include "AsteroFrameStats.h"
+
+// Most operations merged into one multi-draw call.
+#define GL_MULTI_DRAW_MAX_BATCH_SIZE 1024
+// Initial size of streaming buffer holding indirect draw commands.
+#define GL_INDIRECT_BUFFER_INITIAL_SIZE (64 * 1024)
 
 namespace Astero {
 	class DepthBuffer;
@@ -70,6 +78,8 @@ namespace Astero {
 		virtual void destroyRenderTarget(const std::string & name);
 		virtual void attachRenderTarget(RenderTarget & render_target);
 		virtual RenderTarget * getRenderTarget(const std::string & name);
+		// Attaches a depth buffer from pool of render target, shared with other render targets when compatible, or a new one
+		// added to pool.
 		virtual void setDepthBufferFor(RenderTarget * render_target);
 		virtual void useLight(const LightList & lights, unsigned short limit) = 0;
 		virtual void setWorldMatrix(const Matrix4 & world_matrix);
@@ -86,7 +96,11 @@ namespace Astero {
 		virtual void setTesselationHullTexture(size_t unit, const TexturePtr & text_ptr);
 		virtual void setTesselationDomainTexture(size_t unit, const TexturePtr & text_ptr);
 		virtual void setTextureCoordinateSet(size_t unit, size_t index) = 0;
+		// Frees pooled depth buffers which no render target uses, except manual ones.
 		virtual void cleanupDepthBuffers();
+		// Number of pooled depth buffers, and their memory in bytes.
+		size_t getDepthBufferCount() const;
+		size_t getDepthBufferMemory() const;
 		virtual void beginFrame() = 0;
 		virtual void endFrame() = 0;
 		virtual void setViewport(Viewport * viewport) = 0;
@@ -98,24 +112,59 @@ namespace Astero {
 							float exp_density = 1.0f,
 							float linear_start = 0.0f,
 							float linear_end = 1.0f) = 0;
+		// Resets face, batch and vertex counts, which are counted by render from any thread.
 		virtual void beginGeometryCount();
 		virtual unsigned int getFaceCount() const;
 		virtual unsigned int getBatchCount() const;
 		virtual unsigned int getVertexCount() const;
+		// Last frames measured between beginFrame and endFrame.
+		const FrameStatsHistory & getFrameStatsHistory() const;
+		FrameStatsHistory & getFrameStatsHistory();
 		virtual void setVertexDeclaration(VertexDeclaration * decl) = 0;
 		virtual void setVertexBufferBinding(VertexBufferBinding * binding) = 0;
 		virtual void render(const RenderOperation & operation);
+		// Renders operations in order. Render systems may merge compatible consecutive operations into fewer draw calls.
+		virtual void renderBatch(const RenderOperation * const * operations, size_t count);
 		virtual void bindGpuProgram(GpuProgram* prg);
+		// Instance buffer read by operations with use_global_instance_vertex_buffer set, and layout of its instance data.
+		void setGlobalInstanceVertexBuffer(const HardwareVertexBufferPtr & vertex_buffer);
+		HardwareVertexBufferPtr getGlobalInstanceVertexBuffer();
+		void setGlobalInstanceVertexBufferVertexDeclaration(VertexDeclaration * decl);
+		VertexDeclaration * getGlobalInstanceVertexBufferVertexDeclaration();
+		// Number of instances of global instance buffer drawn per operation instance.
+		void setGlobalInstanceNumber(unsigned int instance_number);
+		unsigned int getGlobalInstanceNumber() const;
+		// Reserves size bytes of uniform memory valid until endFrame, for caller to fill with per object constants of many
+		// operations at once. Sets offset for uniform_offset of operations, and returns null if render system has none.
+		virtual void * allocateUniforms(size_t size, size_t & offset);
+		// Sets constants shared by all operations of a pass.
+		virtual void setPassUniforms(const void * data, size_t size);
 		virtual void setClipPlanes(const PlaneList & clip_planes);
 		virtual void clearFrameBuffer(unsigned int buffers,
 									  const ColorValue & colour = ColorValue::Black,
 									  float depth = 1.0f) = 0;
 		virtual void setRenderTarget(RenderTarget * render_target) = 0;
+		// Lets calling thread issue rendering calls. A GL context is current on one thread at a time, so thread using render
+		// system must unregister before another one registers.
 		virtual void registerThread() = 0;
 		virtual void unregisterThread() = 0;
+		// Whether registerThread can let a thread other than one which created context render.
+		virtual bool canRegisterThread() const = 0;
 		virtual bool setDrawBuffer();
 	protected:
+		typedef std::chrono::steady_clock Clock;
+		
 		bool updatePassIterationRenderState();
+		// Creates a depth buffer compatible with render target, not yet added to pool.
+		virtual DepthBuffer * createDepthBufferFor(RenderTarget * render_target);
+		// Adds faces and vertices of operation to geometry count.
+		void updateGeometryCount(const RenderOperation & operation);
+		// Adds one draw call per pass iteration to batch count.
+		void updateBatchCount();
+		// Called by beginFrame and endFrame of render systems. endFrame records frame to history, and updates statistics
+		// of render targets.
+		void beginFrameStats();
+		void endFrameStats();
 
 		DepthBufferVectorMap depth_buffer_pool_;
 		RenderTargetMap render_targets_;
@@ -144,10 +193,19 @@ namespace Astero {
 		unsigned short current_pass_iteration_count_;
 		// Texture units disabled from this.
 		unsigned short texture_units_disabled_from_;
+		std::atomic<size_t> face_count_;
+		std::atomic<size_t> batch_count_;
+		std::atomic<size_t> vertex_count_;
+		FrameStatsHistory frame_stats_history_;
+		size_t frame_number_;
+		bool frame_started_;
+		Clock::time_point frame_begin_time_;
+		Clock::time_point last_frame_end_time_;
 	};
 	
 	class GLStateCacheManager;
 	class GLGpuProgram;
+	class GLUniformBufferRing;
 } // namespace Astero
 
 #include "AsteroGeometry.h"
@@ -157,6 +215,7 @@ namespace Astero {
 	class GLRenderSystem : public RenderSystem {
 	public:
 		GLRenderSystem();
+		~GLRenderSystem();
 		
 		// See RenderSystem.
 		RenderWindow* initialize(bool auto_create_window, const std::string & window_title = "Astero Render Window") override;
@@ -166,19 +225,93 @@ namespace Astero {
 		const std::string & getName() const override;
 		virtual RenderSystemCapabilities * createRenderSystemCapabilities() const override;
 		
+		// See RenderSystem.
+		void beginFrame() override;
+		void endFrame() override;
+		// View and projection matrices form pass uniforms, world matrix forms object uniforms of operations without
+		// uniform range of their own. Both are streamed through uniform buffer ring, as row major matrices.
+		void setWorldMatrix(const Matrix4 & world_matrix) override;
+		void setViewMatrix(const Matrix4 & view_matrix) override;
+		void setProjectionMatrix(const Matrix4 & projection_matrix) override;
+		void * allocateUniforms(size_t size, size_t & offset) override;
+		void setPassUniforms(const void * data, size_t size) override;
 		void render(const RenderOperation & operation) override;
-		HardwareVertexBufferPtr getGlobalInstanceVertexBuffer();
-		VertexDeclaration * getGlobalInstanceVertexBufferVertexDeclaration();
+		// Operations sharing vertex declaration, index type, programs and buffer objects, such as ones sub-allocated from
+		// same mega-buffers, are drawn by one glMultiDrawElementsIndirect, or glMultiDrawElementsBaseVertex without indirect
+		// draw support. Per object data comes from global instance buffer at base_instance of each operation.
+		void renderBatch(const RenderOperation * const * operations, size_t count) override;
 		void setDepthBias(float constant_bias, float slope_scale_bias);
+		// Whether operations reuse vertex array objects cached for their vertex layout, buffers and attribute locations.
+		void setVertexArrayCacheEnabled(bool enabled);
+		bool isVertexArrayCacheEnabled() const;
+		// Number of draws skipped because their uniforms did not fit in uniform buffer ring.
+		size_t getSkippedDrawCount() const { return skipped_draw_count_; }
+		// Context of primary window, set by window creating it, like a GLFWContext of a GLFW window. Render system does not
+		// own it.
+		void setMainContext(GLContext * context);
+		GLContext * getMainContext() const;
+		// Makes main context current on calling thread. Does nothing without main context.
+		void registerThread() override;
+		// Releases main context from calling thread.
+		void unregisterThread() override;
+		// Whether main context is set.
+		bool canRegisterThread() const override;
 		
 	protected:
+		// Layout of a command in GL_DRAW_INDIRECT_BUFFER.
+		struct GLDrawElementsIndirectCommand {
+			GLuint count;
+			GLuint instance_count;
+			GLuint first_index;
+			GLint base_vertex;
+			GLuint base_instance;
+		};
+		
+		// Flushes shadow buffers of operation, binds its vertex arrays and index buffer, and returns its primitive type.
+		GLenum bindOperation(const RenderOperation & operation);
+		void flushOperationBuffers(const RenderOperation & operation);
+		bool hasInstanceData(const RenderOperation & operation) const;
+		bool usesGlobalInstanceData(const RenderOperation & operation) const;
+		// Instance that global instance arrays point at. Without base instance support, base_instance of operation is
+		// applied by offsetting arrays instead.
+		size_t getGlobalInstanceStart(const RenderOperation & operation) const;
+		unsigned int getInstanceNumber(const RenderOperation & operation) const;
+		// Whether operation can be drawn by same multi-draw call as first, and if so, its vertex offset from first.
+		bool canMultiDraw(const RenderOperation & first, const RenderOperation & operation, GLint & base_vertex) const;
+		// Draws operations with vertex arrays of first one, using base vertices in batch_base_vertices_.
+		void renderMultiDraw(const RenderOperation * const * operations, size_t count);
+		// Writes commands to streaming indirect buffer, and returns their offset in it. Buffer is orphaned when full, so
+		// commands still read by GPU are never overwritten.
+		size_t writeIndirectCommands(const GLDrawElementsIndirectCommand * commands, size_t count);
+		// Fills vertex_array_key_ and vertex_array_buffers_ for operation.
+		void buildVertexArrayKey(const RenderOperation & operation);
+		// Writes and binds pass and object uniforms changed since last operation. Returns false if they could not be written,
+		// so operation would read uniforms of an earlier one.
+		bool bindOperationUniforms(const RenderOperation & operation);
+		// Writes data to uniform buffer ring and binds it to binding point. Returns false, leaving binding unchanged, if ring
+		// is full for rest of frame.
+		bool writeUniforms(GLuint binding, const void * data, size_t size);
+		// Sets pointer of element and records array it uses in render_attrib_mask_ or render_client_state_mask_.
 		void bindVertexElementToGpu(const VertexElement & element, HardwareVertexBufferPtr vertex_buffer,
-									const size_t vertex_offset, std::vector<GLuint> & attribs_bound,
-									std::vector<GLuint> & instance_attribs_bound);
+									const size_t vertex_offset);
 		
 	private:
-		std::vector<GLuint> render_attribs_bound_;
-		std::vector<GLuint> render_instance_attribs_bound_;
+		// Vertex attribute arrays and fixed function client states used by operation being rendered. Arrays are enabled
+		// through state cache before drawing, so arrays shared by consecutive operations stay enabled.
+		unsigned int render_attrib_mask_;
+		unsigned int render_client_state_mask_;
+		bool vertex_array_cache_enabled_;
+		// Reused to build vertex array cache lookups without allocating.
+		std::vector<size_t> vertex_array_key_;
+		std::vector<GLuint> vertex_array_buffers_;
+		GLuint indirect_buffer_id_;
+		size_t indirect_buffer_size_;
+		size_t indirect_buffer_offset_;
+		// Reused to build multi-draw calls without allocating.
+		std::vector<GLint> batch_base_vertices_;
+		std::vector<GLDrawElementsIndirectCommand> indirect_commands_;
+		std::vector<GLsizei> multi_draw_counts_;
+		std::vector<void *> multi_draw_indices_;
 		GLStateCacheManager * state_cache_manager_;
 		GLGpuProgram * current_vertex_program_;
 		GLGpuProgram * current_fragment_program_;
@@ -188,10 +321,17 @@ namespace Astero {
 		unsigned short texture_coordinate_index_[16];
 		GLSupport * gl_support_;
 		bool gl_initialized_;
+		GLContext * main_context_;
 		
 		Matrix4 view_matrix_;
 		Matrix4 world_matrix_;
 		Matrix4 texture_matrix_;
+		Matrix4 projection_matrix_;
+		// Created at first frame with uniform buffer object support.
+		GLUniformBufferRing * uniform_buffer_ring_;
+		bool pass_uniforms_dirty_;
+		bool world_matrix_dirty_;
+		size_t skipped_draw_count_;
 	};
 }
 
@@ -0,0 +1,115 @@
+//
+//  AsteroRenderTarget.cpp
+//  Astero
+//
+//  Created by Yuzhe Wang on 10/18/26.
+//  Copyright © 2026 Yuzhe Wang. All rights reserved.
+//
+
+#include "AsteroRenderTarget.h"
+#include "AsteroDepthBuffer.h"
+
+namespace Astero {
+	//--------------------------------------------------------------------------------------------------------------------------------
+	RenderTarget::RenderTarget()
+	: priority_(RENDER_TARGET_DEFAULT_PRIORITY), width_(0), height_(0), fsaa_(0), depth_bit_depth_(24), depth_buffer_pool_id_(DepthBuffer::POOL_DEFAULT),
+	depth_buffer_(nullptr) {
+		stats_.lastFPS = 0.0f;
+		stats_.avgFPS = 0.0f;
+		stats_.bestFPS = 0.0f;
+		stats_.worstFPS = 0.0f;
+		stats_.bestFrameTime = 0;
+		stats_.worstFrameTime = 0;
+		stats_.triangleCount = 0;
+		stats_.batchCount = 0;
+		stats_.vBlankMissCount = -1;
+		stats_.glCallCount = 0;
+		stats_.glRedundantCallCount = 0;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	RenderTarget::~RenderTarget() {
+		detachDepthBuffer();
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	const std::string & RenderTarget::getName() const {
+		return name_;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	unsigned char RenderTarget::getPriority() const {
+		return priority_;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	unsigned int RenderTarget::getWidth() const {
+		return width_;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	unsigned int RenderTarget::getHeight() const {
+		return height_;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	unsigned int RenderTarget::getFSAA() const {
+		return fsaa_;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	unsigned short RenderTarget::getDepthBitDepth() const {
+		return depth_bit_depth_;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void RenderTarget::setDepthBufferPool(unsigned short pool_id) {
+		if (depth_buffer_pool_id_ == pool_id)
+			return;
+		depth_buffer_pool_id_ = pool_id;
+		// Current buffer belongs to another pool, render system attaches one from new pool at start of next frame.
+		detachDepthBuffer();
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	unsigned short RenderTarget::getDepthBufferPool() const {
+		return depth_buffer_pool_id_;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	DepthBuffer * RenderTarget::getDepthBuffer() const {
+		return depth_buffer_;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	bool RenderTarget::attachDepthBuffer(DepthBuffer * depth_buffer) {
+		if (!depth_buffer->isCompatible(this))
+			return false;
+		detachDepthBuffer();
+		depth_buffer_ = depth_buffer;
+		depth_buffer_->notifyRenderTargetAttached(this);
+		return true;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void RenderTarget::detachDepthBuffer() {
+		if (depth_buffer_) {
+			depth_buffer_->notifyRenderTargetDetached(this);
+			depth_buffer_ = nullptr;
+		}
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void RenderTarget::notifyDepthBufferDestroyed() {
+		depth_buffer_ = nullptr;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	const RenderTarget::FrameStats & RenderTarget::getStatistics() const {
+		return stats_;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void RenderTarget::updateStatistics(const FrameStatsHistory & history) {
+		FrameRecord record = history.getLastFrame();
+		FrameTimeSummary summary = history.getFrameTimeSummary();
+		stats_.lastFPS = record.frame_time > 0.0 ? static_cast<float>(1000.0 / record.frame_time) : 0.0f;
+		stats_.avgFPS = summary.average > 0.0 ? static_cast<float>(1000.0 / summary.average) : 0.0f;
+		stats_.bestFPS = summary.best > 0.0 ? static_cast<float>(1000.0 / summary.best) : 0.0f;
+		stats_.worstFPS = summary.worst > 0.0 ? static_cast<float>(1000.0 / summary.worst) : 0.0f;
+		stats_.bestFrameTime = static_cast<unsigned long>(summary.best);
+		stats_.worstFrameTime = static_cast<unsigned long>(summary.worst);
+		stats_.triangleCount = record.face_count;
+		stats_.batchCount = record.batch_count;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void RenderTarget::setGLCallStatistics(size_t call_count, size_t redundant_call_count) {
+		stats_.glCallCount = call_count;
+		stats_.glRedundantCallCount = redundant_call_count;
+	}
+} // namespace Astero
@@ -10,8 +10,14 @@
 #define AsteroRenderTarget_h
 
 #include "AsteroPrerequisites.h"
+#include "AsteroFrameStats.h"
+
+// Priority of render targets which do not set one, targets of lower priority are updated first.
+#define RENDER_TARGET_DEFAULT_PRIORITY 4
 
 namespace Astero {
+	class DepthBuffer;
+	
 	// Abstract class of a root to all targets or 'canvas' of render operations.
 	class RenderTarget {
 	public:
@@ -37,11 +43,15 @@ namespace Astero {
 			float avgFPS;
 			float bestFPS;
 			float worstFPS;
+			// Milliseconds.
 			unsigned long bestFrameTime;
 			unsigned long worstFrameTime;
 			size_t triangleCount;
 			size_t batchCount;
 			int vBlankMissCount; // -1 means that the value is not applicable
+			// GL calls issued and calls elided by state cache in last frame, only counted if ASTERO_GL_CALL_STATS is on.
+			size_t glCallCount;
+			size_t glRedundantCallCount;
 		};
 		
 		RenderTarget();
@@ -49,9 +59,38 @@ namespace Astero {
 		
 		virtual const std::string & getName() const;
 		virtual unsigned char getPriority() const;
+		virtual unsigned int getWidth() const;
+		virtual unsigned int getHeight() const;
+		virtual unsigned int getFSAA() const;
+		// Depth format render target needs, in bits.
+		virtual unsigned short getDepthBitDepth() const;
+		// Pool of depth buffers this render target shares its depth buffer from, DepthBuffer::PI_NO_DEPTH for none. Changing
+		// pool detaches current depth buffer, and render system attaches one from new pool at start of next frame.
+		void setDepthBufferPool(unsigned short pool_id);
+		unsigned short getDepthBufferPool() const;
+		DepthBuffer * getDepthBuffer() const;
+		// Attaches depth buffer if it is compatible, detaching current one. Returns false if it is not compatible.
+		virtual bool attachDepthBuffer(DepthBuffer * depth_buffer);
+		virtual void detachDepthBuffer();
+		// Forgets depth buffer being destroyed, without notifying it.
+		void notifyDepthBufferDestroyed();
+		// Statistics of last frame.
+		const FrameStats & getStatistics() const;
+		// Updates statistics from last frame and summary of frame history, called by render system at end of each frame.
+		void updateStatistics(const FrameStatsHistory & history);
+		// Sets GL call counts of statistics to those of previous frame, called by render system at start of each frame.
+		void setGLCallStatistics(size_t call_count, size_t redundant_call_count);
 		
 	protected:
-		
+		FrameStats stats_;
+		std::string name_;
+		unsigned char priority_;
+		unsigned int width_;
+		unsigned int height_;
+		unsigned int fsaa_;
+		unsigned short depth_bit_depth_;
+		unsigned short depth_buffer_pool_id_;
+		DepthBuffer * depth_buffer_;
 	};
 } // namespace Astero
 
@@ -0,0 +1,199 @@
+//
+//  AsteroRenderThread.cpp
+//  Astero
+//
+//  Created by Yuzhe Wang on 10/18/26.
+//  Copyright © 2026 Yuzhe Wang. All rights reserved.
+//
+
+#include <cassert>
+#include "AsteroRenderThread.h"
+#include "AsteroRenderSystem.h"
+#include "AsteroProfiler.h"
+
+namespace Astero {
+	//--------------------------------------------------------------------------------------------------------------------------------
+	RenderThread::RenderThread(RenderSystem & render_system, size_t frame_count) : render_system_(render_system),
+	submitted_frame_count_(0), completed_frame_count_(0), next_fence_(1), completed_fence_(0), recording_(false),
+	running_(false), stop_requested_(false) {
+		assert(frame_count >= 2 && frame_count <= RENDER_THREAD_MAX_FRAME_COUNT);
+		for (size_t i = 0; i < frame_count; i++)
+			queues_.emplace_back(new RenderQueue());
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	RenderThread::~RenderThread() {
+		stop();
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	bool RenderThread::start() {
+		Lock lock(mutex_);
+		if (running_)
+			return true;
+		// Render thread could not make context current, and would render without one.
+		if (!render_system_.canRegisterThread())
+			return false;
+		running_ = true;
+		stop_requested_ = false;
+		// Context can only be made current on render thread once released here.
+		render_system_.unregisterThread();
+		// Assigned under lock, so tasks on render thread see its id.
+		thread_ = std::thread(&RenderThread::run, this);
+		return true;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void RenderThread::stop() {
+		{
+			Lock lock(mutex_);
+			if (!running_ || stop_requested_)
+				return;
+			stop_requested_ = true;
+		}
+		work_condition_.notify_one();
+		thread_.join();
+		render_system_.registerThread();
+		Lock lock(mutex_);
+		running_ = false;
+		stop_requested_ = false;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	bool RenderThread::isRunning() const {
+		Lock lock(mutex_);
+		return running_;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	bool RenderThread::isRenderThread() const {
+		return std::this_thread::get_id() == thread_.get_id();
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	RenderQueue & RenderThread::beginFrame() {
+		ASTERO_PROFILE_SCOPE("RenderThread::beginFrame");
+		Lock lock(mutex_);
+		assert(!recording_);
+		// Queue of frame N is free once frame N - frame count has completed.
+		done_condition_.wait(lock, [this] { return submitted_frame_count_ - completed_frame_count_ < queues_.size(); });
+		recording_ = true;
+		return *queues_[submitted_frame_count_ % queues_.size()];
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void RenderThread::endFrame() {
+		Lock lock(mutex_);
+		assert(recording_);
+		recording_ = false;
+		RenderQueue & queue = *queues_[submitted_frame_count_ % queues_.size()];
+		submitted_frame_count_++;
+		if (running_) {
+			lock.unlock();
+			work_condition_.notify_one();
+			return;
+		}
+		lock.unlock();
+		executeFrame(queue);
+		lock.lock();
+		completed_frame_count_++;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void RenderThread::waitIdle() {
+		Lock lock(mutex_);
+		assert(!isRenderThread());
+		done_condition_.wait(lock, [this] {
+			return completed_frame_count_ == submitted_frame_count_ && completed_fence_ + 1 == next_fence_;
+		});
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	uint64_t RenderThread::enqueueTask(const Task & task) {
+		Lock lock(mutex_);
+		uint64_t fence = next_fence_++;
+		if (running_) {
+			tasks_.emplace_back(fence, task);
+			lock.unlock();
+			work_condition_.notify_one();
+			return fence;
+		}
+		lock.unlock();
+		task();
+		lock.lock();
+		completed_fence_ = fence;
+		return fence;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	bool RenderThread::isFenceComplete(uint64_t fence) const {
+		Lock lock(mutex_);
+		return fence <= completed_fence_;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void RenderThread::waitForFence(uint64_t fence) {
+		Lock lock(mutex_);
+		// Render thread would wait on itself.
+		assert(fence <= completed_fence_ || !isRenderThread());
+		done_condition_.wait(lock, [this, fence] { return fence <= completed_fence_; });
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void RenderThread::invoke(const Task & task) {
+		if (isRenderThread()) {
+			task();
+			return;
+		}
+		waitForFence(enqueueTask(task));
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	size_t RenderThread::getFramesInFlight() const {
+		Lock lock(mutex_);
+		return static_cast<size_t>(submitted_frame_count_ - completed_frame_count_);
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	uint64_t RenderThread::getSubmittedFrameCount() const {
+		Lock lock(mutex_);
+		return submitted_frame_count_;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	uint64_t RenderThread::getCompletedFrameCount() const {
+		Lock lock(mutex_);
+		return completed_frame_count_;
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void RenderThread::run() {
+		ASTERO_PROFILE_THREAD_NAME("Render");
+		render_system_.registerThread();
+		Lock lock(mutex_);
+		for (;;) {
+			work_condition_.wait(lock, [this] {
+				return stop_requested_ || !tasks_.empty() || completed_frame_count_ < submitted_frame_count_;
+			});
+			// Tasks go first, so resources they create are ready for frame that follows.
+			runTasks(lock);
+			if (completed_frame_count_ < submitted_frame_count_) {
+				RenderQueue & queue = *queues_[completed_frame_count_ % queues_.size()];
+				lock.unlock();
+				executeFrame(queue);
+				lock.lock();
+				completed_frame_count_++;
+				done_condition_.notify_all();
+				continue;
+			}
+			// Stops only once every task and frame submitted before stop is done.
+			if (stop_requested_)
+				break;
+		}
+		lock.unlock();
+		render_system_.unregisterThread();
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void RenderThread::runTasks(Lock & lock) {
+		while (!tasks_.empty()) {
+			FencedTask task = std::move(tasks_.front());
+			tasks_.pop_front();
+			lock.unlock();
+			task.second();
+			lock.lock();
+			completed_fence_ = task.first;
+			done_condition_.notify_all();
+		}
+	}
+	//--------------------------------------------------------------------------------------------------------------------------------
+	void RenderThread::executeFrame(RenderQueue & queue) {
+		ASTERO_PROFILE_SCOPE("RenderThread::executeFrame");
+		render_system_.beginFrame();
+		queue.submit(render_system_);
+		render_system_.endFrame();
+	}
+}
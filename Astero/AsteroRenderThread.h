@@ -0,0 +1,103 @@
+//
+//  AsteroRenderThread.h
+//  Astero
+//
+//  Created by Yuzhe Wang on 10/18/26.
+//  Copyright © 2026 Yuzhe Wang. All rights reserved.
+//
+
+#ifndef AsteroRenderThread_h
+#define AsteroRenderThread_h
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "AsteroRenderQueue.h"
+
+// Default number of frame command lists, 2 for double buffering.
+#define RENDER_THREAD_DEFAULT_FRAME_COUNT 2
+// Most frame command lists allowed, 3 for triple buffering.
+#define RENDER_THREAD_MAX_FRAME_COUNT 3
+
+namespace Astero {
+	class RenderSystem;
+
+	// Runs render system on a dedicated thread owning the GL context. Main thread records frame N into one of 2 or 3 render
+	// queues while render thread executes frame N - 1 from another. beginFrame blocks while every queue is still recorded or
+	// in flight, so main thread runs at most frame count - 1 frames ahead of GPU submission.
+	// Work needing the context, like creating textures or programs, is enqueued as tasks, which render thread runs in order
+	// before next frame. Each task returns a fence, which main thread can poll or wait on before using what task created.
+	// Vertex and index data referenced by recorded commands must stay alive until their frame completes.
+	// Until start is called, or after stop, everything runs inline on caller's thread, so single threaded mode needs no
+	// other code path.
+	class RenderThread {
+	public:
+		typedef std::function<void()> Task;
+
+		RenderThread(RenderSystem & render_system, size_t frame_count = RENDER_THREAD_DEFAULT_FRAME_COUNT);
+		~RenderThread();
+
+		// Unregisters calling thread from render system, releasing GL context, and starts render thread, which registers
+		// itself to take context over. Returns false, leaving everything running inline, if render system has no context to
+		// hand over.
+		bool start();
+		// Executes every submitted frame and task, joins render thread, which unregisters itself, and registers calling thread
+		// again.
+		void stop();
+		bool isRunning() const;
+
+		// Waits for a free queue, and returns it for recording next frame.
+		RenderQueue & beginFrame();
+		// Hands recorded queue over to render thread.
+		void endFrame();
+		// Waits until every submitted frame is executed.
+		void waitIdle();
+
+		// Queues task to run on render thread before next frame, and returns its fence.
+		uint64_t enqueueTask(const Task & task);
+		bool isFenceComplete(uint64_t fence) const;
+		void waitForFence(uint64_t fence);
+		// Runs task on render thread and waits for it, like for creating a resource needed right away.
+		void invoke(const Task & task);
+
+		size_t getFrameCount() const { return queues_.size(); }
+		// Number of frames submitted but not yet executed.
+		size_t getFramesInFlight() const;
+		uint64_t getSubmittedFrameCount() const;
+		uint64_t getCompletedFrameCount() const;
+
+	protected:
+		typedef std::mutex Mutex;
+		typedef std::unique_lock<Mutex> Lock;
+		typedef std::pair<uint64_t, Task> FencedTask;
+
+		void run();
+		// Runs queued tasks, unlocking lock while each one runs.
+		void runTasks(Lock & lock);
+		void executeFrame(RenderQueue & queue);
+		bool isRenderThread() const;
+
+		RenderSystem & render_system_;
+		std::vector<std::unique_ptr<RenderQueue>> queues_;
+		std::deque<FencedTask> tasks_;
+		std::thread thread_;
+		uint64_t submitted_frame_count_;
+		uint64_t completed_frame_count_;
+		uint64_t next_fence_;
+		uint64_t completed_fence_;
+		bool recording_;
+		bool running_;
+		bool stop_requested_;
+		mutable Mutex mutex_;
+		// Wakes render thread on submitted frames, tasks and stop.
+		std::condition_variable work_condition_;
+		// Wakes main thread on completed frames and fences.
+		std::condition_variable done_condition_;
+	};
+}
+
+#endif // AsteroRenderThread_h
@@ -16,6 +16,7 @@
 #include <atomic>
 #include <set>
 #include "AsteroDataStream.h"
+#include "AsteroProfiler.h"
 
 namespace Astero {
 	// Abstract class representing a loadable resource.
@@ -51,6 +52,7 @@ namespace Astero {
 		virtual ~Resource() = default;
 		
 		virtual void prepare() {
+			ASTERO_PROFILE_SCOPE("Resource::prepare");
 			// If resource is not unloaded or preparing, return.
 			LoadingState old_state = loading_state_;
 			if (old_state != LOADSTATE_UNLOADED && old_state != LOADSTATE_PREPARING)
@@ -72,6 +74,7 @@ namespace Astero {
 			prepareImpl();
 		}
 		virtual void load() {
+			ASTERO_PROFILE_SCOPE("Resource::load");
 			LoadingState old_state = loading_state_;
 			bool keepchecking = true;
 			while (keepchecking) {
@@ -106,9 +109,13 @@ namespace Astero {
 			if (old_state == LOADSTATE_UNLOADED)
 				prepareImpl();
 			Lock lock(mutex_);
-			preLoadImpl();
-			loadImpl();
-			postLoadImpl();
+			{
+				// Attributes hardware buffers created while loading to this resource.
+				LoadingResourceScope loading_scope(this);
+				preLoadImpl();
+				loadImpl();
+				postLoadImpl();
+			}
 			calculateSize();
 		}
 		virtual void unload() {
@@ -155,6 +162,10 @@ namespace Astero {
 			Lock lock(mutex_);
 			listener_set_.erase(listener);
 		}
+		// Returns resource being loaded by calling thread, or nullptr.
+		static Resource * getLoadingResource() {
+			return loadingResource();
+		}
 		// Public mutex for lock.
 		Mutex mutex_;
 	protected:
@@ -188,6 +199,26 @@ namespace Astero {
 		virtual void calculateSize() {
 			size_ = sizeof(*this);
 		}
+		static Resource *& loadingResource() {
+			static thread_local Resource * resource = nullptr;
+			return resource;
+		}
+		// Makes a resource the one being loaded by calling thread, and restores outer one on destruction, also when
+		// loading throws.
+		class LoadingResourceScope {
+		public:
+			explicit LoadingResourceScope(Resource * resource) : outer_resource_(loadingResource()) {
+				loadingResource() = resource;
+			}
+			~LoadingResourceScope() {
+				loadingResource() = outer_resource_;
+			}
+			LoadingResourceScope(const LoadingResourceScope &) = delete;
+			LoadingResourceScope & operator=(const LoadingResourceScope &) = delete;
+			
+		private:
+			Resource * outer_resource_;
+		};
 	};
 	
 	// ResourceManager is responsible for managing a pool of resources
@@ -36,6 +36,9 @@ namespace Astero {
 			assert(ptr_);
 			return ptr_;
 		}
+		static bool hasSingleton() {
+			return ptr_ != nullptr;
+		}
 	protected:
 		static T * ptr_;
 	};
@@ -0,0 +1,134 @@
+//
+//  DepthBufferTests.cpp
+//  Test
+//
+//  Created by Yuzhe Wang on 10/18/26.
+//  Copyright © 2026 Yuzhe Wang. All rights reserved.
+//
+
+#include "Tests.h"
+#include "AsteroRenderSystem.h"
+#include "AsteroRenderTarget.h"
+
+using namespace Astero;
+
+namespace {
+	// Render target of given size and depth format, never drawn to.
+	class TestRenderTarget : public RenderTarget {
+	public:
+		TestRenderTarget(unsigned int width, unsigned int height, unsigned int fsaa = 0, unsigned short depth_bit_depth = 24) {
+			width_ = width;
+			height_ = height;
+			fsaa_ = fsaa;
+			depth_bit_depth_ = depth_bit_depth;
+		}
+	};
+
+	// Render system doing nothing but depth buffer pooling, which lives in RenderSystem itself.
+	class TestRenderSystem : public RenderSystem {
+	public:
+		TestRenderSystem() : config_options_(nullptr), created_count_(0) {}
+
+		const std::string & getName() const override { return name_; }
+		// Never called, ConfigOption is only declared so far.
+		ConfigOptionMap & getConfigOptions() override { return *config_options_; }
+		void setConfigOption(const std::string & /* name */, const std::string & /* value */) override {}
+		RenderSystemCapabilities * createRenderSystemCapabilities() const override { return nullptr; }
+		void setAmbientLight(float /* r */, float /* g */, float /* b */) override {}
+		void setShadingType(ShadeOptions /* so */) override {}
+		RenderWindow * createRenderWindow(const std::string & /* name */, unsigned int /* width */, unsigned int /* height */,
+										  bool /* full_screen */, const NameValuePairList * /* misc_params */) override {
+			return nullptr;
+		}
+		void useLight(const LightList & /* lights */, unsigned short /* limit */) override {}
+		void setSurfaceParameters(const ColorValue & /* ambient */, const ColorValue & /* diffuse */,
+								  const ColorValue & /* specular */) override {}
+		void setTexture(size_t /* unit */, bool /* enabled */, const TexturePtr & /* text_ptr */) override {}
+		void setTextureCoordinateSet(size_t /* unit */, size_t /* index */) override {}
+		void beginFrame() override {}
+		void endFrame() override {}
+		void setViewport(Viewport * /* viewport */) override {}
+		void setCullingMode(CullingMode /* mode */) override {}
+		void setFog(FogMode /* mode */, const ColorValue & /* color */, float /* exp_density */, float /* linear_start */,
+					float /* linear_end */) override {}
+		void setVertexDeclaration(VertexDeclaration * /* decl */) override {}
+		void setVertexBufferBinding(VertexBufferBinding * /* binding */) override {}
+		void clearFrameBuffer(unsigned int /* buffers */, const ColorValue & /* colour */, float /* depth */) override {}
+		void setRenderTarget(RenderTarget * /* render_target */) override {}
+		void registerThread() override {}
+		void unregisterThread() override {}
+		bool canRegisterThread() const override { return false; }
+
+		size_t getCreatedCount() const { return created_count_; }
+
+	protected:
+		DepthBuffer * createDepthBufferFor(RenderTarget * render_target) override {
+			++created_count_;
+			return RenderSystem::createDepthBufferFor(render_target);
+		}
+
+	private:
+		std::string name_;
+		ConfigOptionMap * config_options_;
+		size_t created_count_;
+	};
+
+	void testCompatibility() {
+		DepthBuffer depth_buffer(DepthBuffer::POOL_DEFAULT, 24, 512, 512, 0, "", false);
+		TestRenderTarget same(512, 512);
+		TestRenderTarget smaller(256, 128);
+		TestRenderTarget wider(1024, 512);
+		TestRenderTarget multisampled(512, 512, 4);
+		TestRenderTarget shallow(512, 512, 0, 16);
+		check(depth_buffer.isCompatible(&same) && depth_buffer.isCompatible(&smaller), "depth buffer serves targets it covers");
+		check(!depth_buffer.isCompatible(&wider), "depth buffer does not serve a larger target");
+		check(!depth_buffer.isCompatible(&multisampled), "FSAA must match");
+		check(!depth_buffer.isCompatible(&shallow), "bit depth must match");
+		check(!wider.attachDepthBuffer(&depth_buffer) && !wider.getDepthBuffer(), "incompatible depth buffer is not attached");
+		check(same.attachDepthBuffer(&depth_buffer) && smaller.attachDepthBuffer(&depth_buffer), "compatible targets attach");
+		check(depth_buffer.getAttachedRenderTargetCount() == 2, "attached targets are tracked");
+		smaller.detachDepthBuffer();
+		check(depth_buffer.getAttachedRenderTargetCount() == 1 && !smaller.getDepthBuffer(), "detached target is forgotten");
+	}
+
+	void testPoolReuse() {
+		TestRenderTarget first(512, 512);
+		TestRenderTarget second(512, 512);
+		TestRenderTarget smaller(256, 256);
+		TestRenderTarget larger(1024, 1024);
+		TestRenderTarget multisampled(512, 512, 4);
+		TestRenderTarget other_pool(512, 512);
+		other_pool.setDepthBufferPool(2);
+		TestRenderTarget no_depth(512, 512);
+		no_depth.setDepthBufferPool(DepthBuffer::PI_NO_DEPTH);
+		{
+			TestRenderSystem render_system;
+			for (RenderTarget * render_target : {&first, &second, &smaller, &larger, &multisampled, &other_pool, &no_depth})
+				render_system.setDepthBufferFor(render_target);
+			check(first.getDepthBuffer() && first.getDepthBuffer() == second.getDepthBuffer(), "same targets share depth buffer");
+			check(smaller.getDepthBuffer() == first.getDepthBuffer(), "smaller target shares larger depth buffer");
+			check(larger.getDepthBuffer() && larger.getDepthBuffer() != first.getDepthBuffer(), "larger target gets its own");
+			check(multisampled.getDepthBuffer() != first.getDepthBuffer(), "target of other FSAA gets its own");
+			check(other_pool.getDepthBuffer() && other_pool.getDepthBuffer() != first.getDepthBuffer(), "pools do not share");
+			check(!no_depth.getDepthBuffer(), "target without depth pool gets no depth buffer");
+			check(render_system.getCreatedCount() == 4 && render_system.getDepthBufferCount() == 4, "one buffer per compatibility class");
+			size_t bytes = 512 * 512 * 4 + 1024 * 1024 * 4 + 512 * 512 * 4 * 4 + 512 * 512 * 4;
+			check(render_system.getDepthBufferMemory() == bytes, "depth buffer memory");
+			// Freed depth buffers are only those no target uses.
+			larger.detachDepthBuffer();
+			first.detachDepthBuffer();
+			render_system.cleanupDepthBuffers();
+			check(render_system.getDepthBufferCount() == 3, "unused depth buffer is freed");
+			check(second.getDepthBuffer() && smaller.getDepthBuffer(), "depth buffer still in use is kept");
+			render_system.setDepthBufferFor(&first);
+			check(first.getDepthBuffer() == second.getDepthBuffer() && render_system.getCreatedCount() == 4,
+				  "reattached target reuses pooled buffer");
+		}
+		check(!first.getDepthBuffer() && !other_pool.getDepthBuffer(), "destroyed depth buffers detach from their targets");
+	}
+}
+
+void testDepthBuffer() {
+	testCompatibility();
+	testPoolReuse();
+}
@@ -0,0 +1,75 @@
+//
+//  FrameStatsTests.cpp
+//  Test
+//
+//  Created by Yuzhe Wang on 10/18/26.
+//  Copyright © 2026 Yuzhe Wang. All rights reserved.
+//
+
+#include <sstream>
+#include <string>
+
+#include "Tests.h"
+#include "AsteroFrameStats.h"
+
+using namespace Astero;
+
+namespace {
+	FrameRecord makeFrame(size_t frame_number, double frame_time) {
+		FrameRecord record = {frame_number, frame_time, 0.0, 0, 0, 0};
+		return record;
+	}
+
+	void testPercentiles() {
+		FrameStatsHistory history(200);
+		check(history.getFrameTimePercentile(50.0) == 0.0, "empty history has no percentile");
+		check(history.getFrameTimeSummary().frame_count == 0, "empty history summary");
+		// Frame times 1 to 100 ms, added out of order.
+		for (size_t i = 0; i < 100; ++i)
+			history.addFrame(makeFrame(i, static_cast<double>((i * 37) % 100 + 1)));
+		// Nearest rank of p over 100 values is value p itself.
+		bool ranks_exact = true;
+		for (int percentile = 1; percentile <= 100; ++percentile)
+			ranks_exact = ranks_exact && history.getFrameTimePercentile(percentile) == percentile;
+		check(ranks_exact, "percentile is value at nearest rank");
+		check(history.getFrameTimePercentile(0.0) == 1.0, "0th percentile is best frame");
+		check(history.getFrameTimePercentile(99.5) == 100.0, "fractional rank rounds up");
+		check(history.getFrameTimePercentile(-5.0) == 1.0 && history.getFrameTimePercentile(150.0) == 100.0,
+			  "percentile is clamped to [0, 100]");
+		FrameTimeSummary summary = history.getFrameTimeSummary();
+		check(summary.frame_count == 100 && summary.average == 50.5, "summary count and average");
+		check(summary.best == 1.0 && summary.worst == 100.0, "summary best and worst");
+		check(summary.p50 == 50.0 && summary.p95 == 95.0 && summary.p99 == 99.0, "summary percentiles");
+	}
+
+	void testSmallHistory() {
+		FrameStatsHistory history;
+		for (size_t i = 1; i <= 10; ++i)
+			history.addFrame(makeFrame(i, 10.0 * i));
+		// Ranks of 10 values are ceil(p / 10).
+		check(history.getFrameTimePercentile(25.0) == 30.0, "25th percentile of 10 frames is 3rd value");
+		check(history.getFrameTimePercentile(50.0) == 50.0, "50th percentile of 10 frames is 5th value");
+		check(history.getFrameTimePercentile(95.0) == 100.0, "95th percentile of 10 frames is worst frame");
+	}
+
+	void testRingBuffer() {
+		FrameStatsHistory history(4);
+		for (size_t i = 0; i < 6; ++i)
+			history.addFrame(makeFrame(i, i < 2 ? 1000.0 : static_cast<double>(i)));
+		check(history.getFrameCount() == 4, "history keeps capacity frames");
+		check(history.getFrame(0).frame_number == 2 && history.getLastFrame().frame_number == 5, "oldest frames are dropped");
+		check(history.getFrameTimePercentile(100.0) == 5.0, "dropped frames do not count towards percentiles");
+		std::ostringstream stream;
+		history.writeCSV(stream);
+		std::string csv = stream.str();
+		check(csv.find("\n2,2,") != std::string::npos && csv.find("\n0,") == std::string::npos, "CSV lists kept frames only");
+		history.clear();
+		check(history.getFrameCount() == 0, "clear drops all frames");
+	}
+}
+
+void testFrameStats() {
+	testPercentiles();
+	testSmallHistory();
+	testRingBuffer();
+}
@@ -0,0 +1,100 @@
+//
+//  HardwareBufferManagerTests.cpp
+//  Test
+//
+//  Created by Yuzhe Wang on 10/18/26.
+//  Copyright © 2026 Yuzhe Wang. All rights reserved.
+//
+
+#include <vector>
+
+#include "Tests.h"
+#include "AsteroHardwareBufferManager.h"
+
+using namespace Astero;
+
+namespace {
+	const HardwareBuffer::Usage copy_usage = HardwareBuffer::HBU_DYNAMIC_WRITE_ONLY_DISCARDABLE;
+
+	// Counts expired licenses of buffer copies.
+	class TestLicensee : public HardwareBufferLicensee {
+	public:
+		TestLicensee() : expired_count_(0) {}
+
+		void licenseExpired(HardwareBuffer * /* buf */) override {
+			++expired_count_;
+		}
+
+		size_t getExpiredCount() const { return expired_count_; }
+
+	private:
+		size_t expired_count_;
+	};
+
+	void testPoolReuse() {
+		DefaultHardwareBufferManager manager;
+		TemporaryVertexBufferPool pool;
+		TemporaryVertexBufferPool::Key key = TemporaryVertexBufferPool::makeKey(12, 100, copy_usage);
+		check(!pool.acquire(key), "empty pool has no buffer");
+		HardwareVertexBufferPtr buffer = manager.createVertexBuffer(12, 100, copy_usage);
+		pool.release(buffer);
+		check(pool.getRetainedCount() == 1, "released buffer is retained");
+		check(!pool.acquire(TemporaryVertexBufferPool::makeKey(12, 200, copy_usage)), "buffer of another layout is not handed out");
+		check(pool.acquire(key) == buffer, "released buffer is reused");
+		TemporaryVertexBufferPool::Stats stats = pool.getStats();
+		check(stats.hit_count == 1 && stats.thread_cache_hit_count == 1, "reuse is served from thread cache");
+		check(stats.miss_count == 2, "acquisitions without free buffer are misses");
+		check(stats.retained_count == 0 && stats.retained_bytes == 0, "acquired buffer is no longer retained");
+		// More buffers than a thread cache holds spill into shared table, and are all found again.
+		std::vector<HardwareVertexBufferPtr> buffers;
+		for (size_t i = 0; i < TEMPORARY_BUFFER_THREAD_CACHE_DEPTH + 4; ++i)
+			buffers.push_back(manager.createVertexBuffer(12, 100, copy_usage));
+		for (auto & spilled : buffers)
+			pool.release(spilled);
+		check(pool.getRetainedCount() == buffers.size(), "every released buffer is retained");
+		pool.resetStats();
+		size_t reused_count = 0;
+		while (pool.acquire(key))
+			++reused_count;
+		check(reused_count == buffers.size(), "buffers in thread cache and shared table are reused");
+		check(pool.getStats().thread_cache_hit_count == TEMPORARY_BUFFER_THREAD_CACHE_DEPTH, "thread cache is used first");
+	}
+
+	void testFreeUnused() {
+		DefaultHardwareBufferManager manager;
+		TemporaryVertexBufferPool pool;
+		HardwareVertexBufferPtr referenced = manager.createVertexBuffer(12, 100, copy_usage);
+		pool.release(referenced);
+		pool.release(manager.createVertexBuffer(12, 100, copy_usage));
+		pool.release(manager.createVertexBuffer(16, 100, copy_usage));
+		pool.freeUnused(TemporaryVertexBufferPool::makeKey(16, 100, copy_usage));
+		check(pool.getRetainedCount() == 2, "freeing one key keeps buffers of other keys");
+		pool.freeUnused();
+		check(pool.getRetainedCount() == 1, "buffers referenced elsewhere are kept");
+		check(pool.acquire(TemporaryVertexBufferPool::makeKey(12, 100, copy_usage)) == referenced, "kept buffer is still reused");
+	}
+
+	void testBufferCopyReuse() {
+		DefaultHardwareBufferManager manager;
+		TestLicensee licensee;
+		HardwareVertexBufferPtr first_source = manager.createVertexBuffer(12, 100, HardwareBuffer::HBU_STATIC_WRITE_ONLY);
+		HardwareVertexBufferPtr second_source = manager.createVertexBuffer(12, 100, HardwareBuffer::HBU_STATIC_WRITE_ONLY);
+		HardwareVertexBufferPtr copy = manager.allocateVertexBufferCopy(first_source, HardwareBufferManager::BLT_MANUAL_RELEASE,
+																		&licensee);
+		check(copy && copy != first_source && copy->getSizeInBytes() == first_source->getSizeInBytes(), "copy has size of source");
+		manager.releaseVertexBufferCopy(copy);
+		check(licensee.getExpiredCount() == 1, "licensee is told when copy is released");
+		// Copies are pooled by layout, so a copy released for one source serves another.
+		HardwareVertexBufferPtr reused = manager.allocateVertexBufferCopy(second_source, HardwareBufferManager::BLT_MANUAL_RELEASE,
+																		  &licensee);
+		check(reused == copy, "released copy serves source of same layout");
+		check(manager.getTemporaryBufferPoolStats().hit_count == 1, "reuse is counted as pool hit");
+		manager.releaseVertexBufferCopy(reused);
+	}
+}
+
+void testHardwareBufferManager() {
+	testPoolReuse();
+	testFreeUnused();
+	testBufferCopyReuse();
+}
@@ -0,0 +1,167 @@
+//
+//  HardwareBufferTests.cpp
+//  Test
+//
+//  Created by Yuzhe Wang on 10/18/26.
+//  Copyright © 2026 Yuzhe Wang. All rights reserved.
+//
+
+#include <string.h>
+#include <vector>
+
+#include "Tests.h"
+#include "AsteroHardwareBuffer.h"
+
+using namespace Astero;
+
+namespace {
+	bool hasRanges(const HardwareBufferDirtyRanges & dirty_ranges, const std::vector<HardwareBufferDirtyRanges::Range> & expected) {
+		const HardwareBufferDirtyRanges::RangeList & ranges = dirty_ranges.getRanges();
+		if (ranges.size() != expected.size())
+			return false;
+		for (size_t i = 0; i < ranges.size(); ++i) {
+			if (ranges[i].offset != expected[i].offset || ranges[i].size != expected[i].size)
+				return false;
+		}
+		return true;
+	}
+
+	void testDirtyRangeMerge() {
+		HardwareBufferDirtyRanges dirty_ranges(16);
+		check(dirty_ranges.empty(), "no range is dirty initially");
+		dirty_ranges.add(0, 0);
+		check(dirty_ranges.empty(), "empty range is ignored");
+		// Added out of order, kept sorted.
+		dirty_ranges.add(200, 10);
+		dirty_ranges.add(0, 10);
+		dirty_ranges.add(100, 10);
+		check(hasRanges(dirty_ranges, {{0, 10}, {100, 10}, {200, 10}}), "distant ranges are kept apart and sorted");
+		// Within merge gap of its left neighbour only.
+		dirty_ranges.add(120, 4);
+		check(hasRanges(dirty_ranges, {{0, 10}, {100, 24}, {200, 10}}), "range within gap merges with neighbour");
+		// Overlapping one range, and within gap of next one.
+		dirty_ranges.add(5, 80);
+		check(hasRanges(dirty_ranges, {{0, 124}, {200, 10}}), "range bridging several ranges merges them all");
+		dirty_ranges.add(50, 10);
+		check(hasRanges(dirty_ranges, {{0, 124}, {200, 10}}), "range inside a dirty range changes nothing");
+		check(dirty_ranges.getDirtyBytes() == 134, "dirty bytes include merged gaps");
+		dirty_ranges.clear();
+		check(dirty_ranges.empty() && dirty_ranges.getDirtyBytes() == 0, "clear forgets all ranges");
+	}
+
+	void testDirtyRangeMergeGap() {
+		HardwareBufferDirtyRanges dirty_ranges(0);
+		dirty_ranges.add(0, 10);
+		dirty_ranges.add(10, 10);
+		dirty_ranges.add(21, 10);
+		check(hasRanges(dirty_ranges, {{0, 20}, {21, 10}}), "without gap, only touching ranges merge");
+		dirty_ranges.clear();
+		dirty_ranges.setMergeGap(1);
+		check(dirty_ranges.getMergeGap() == 1, "merge gap is set");
+		dirty_ranges.add(0, 10);
+		dirty_ranges.add(11, 10);
+		check(hasRanges(dirty_ranges, {{0, 21}}), "ranges separated by merge gap merge");
+	}
+
+	const size_t chunk_size = SHARED_BUFFER_STORAGE_CHUNK_SIZE;
+
+	// Whether every byte of a range of storage has value.
+	bool isFilled(const SharedBufferStorage & storage, size_t offset, size_t size, unsigned char value) {
+		std::vector<unsigned char> data(size);
+		storage.read(offset, size, data.data());
+		for (auto byte : data) {
+			if (byte != value)
+				return false;
+		}
+		return true;
+	}
+
+	void fill(SharedBufferStorage & storage, size_t offset, size_t size, unsigned char value) {
+		std::vector<unsigned char> data(size, value);
+		storage.write(offset, size, data.data());
+	}
+
+	void testStorageCopyOnWrite() {
+		SharedBufferStorage source(3 * chunk_size);
+		check(source.getAllocatedBytes() == 0 && isFilled(source, 0, 3 * chunk_size, 0), "new storage reads zeros without memory");
+		fill(source, 0, 2 * chunk_size, 1);
+		check(source.getAllocatedBytes() == 2 * chunk_size, "written chunks are allocated");
+		SharedBufferStorage copy(3 * chunk_size);
+		copy.share(source, 0, 0, 3 * chunk_size);
+		check(copy.getSharedBytes() == 2 * chunk_size && source.getSharedBytes() == 2 * chunk_size, "whole chunks are shared");
+		check(isFilled(copy, 0, 2 * chunk_size, 1), "shared chunks read contents of source");
+		// Writing one byte unshares only its chunk.
+		fill(copy, 10, 1, 2);
+		check(copy.getSharedBytes() == chunk_size, "written chunk is no longer shared");
+		check(isFilled(source, 0, 2 * chunk_size, 1), "write to copy leaves source untouched");
+		check(isFilled(copy, 10, 1, 2) && isFilled(copy, 11, chunk_size - 11, 1), "unshared chunk keeps rest of its contents");
+		// Ranges not aligned alike within chunks are copied, not shared.
+		SharedBufferStorage unaligned(3 * chunk_size);
+		unaligned.share(source, 0, 1, chunk_size);
+		check(unaligned.getSharedBytes() == 0 && isFilled(unaligned, 1, chunk_size, 1), "unaligned range is copied");
+	}
+
+	void testStorageLock() {
+		SharedBufferStorage source(2 * chunk_size);
+		fill(source, 0, 2 * chunk_size, 1);
+		SharedBufferStorage copy(2 * chunk_size);
+		copy.share(source, 0, 0, 2 * chunk_size);
+		// Read lock within a chunk points into shared chunk.
+		const unsigned char * read = static_cast<const unsigned char *>(copy.lock(100, 10, true));
+		check(read[0] == 1, "read lock sees shared contents");
+		copy.unlock();
+		check(copy.getSharedBytes() == 2 * chunk_size, "read lock does not unshare");
+		// Discarding lock of a whole shared chunk takes a fresh chunk rather than copying.
+		unsigned char * data = static_cast<unsigned char *>(copy.lock(0, chunk_size, false, true));
+		memset(data, 3, chunk_size);
+		copy.unlock();
+		check(isFilled(copy, 0, chunk_size, 3) && isFilled(source, 0, chunk_size, 1), "discarding lock writes copy only");
+		check(copy.getSharedBytes() == chunk_size, "discarded chunk is no longer shared");
+		// Lock across chunks is staged, and written back on unlock.
+		data = static_cast<unsigned char *>(copy.lock(chunk_size - 4, 8, false));
+		check(data[0] == 3 && data[4] == 1, "staged lock reads both chunks");
+		memset(data, 4, 8);
+		copy.unlock();
+		check(isFilled(copy, chunk_size - 4, 8, 4) && isFilled(source, chunk_size, 4, 1), "staged lock is written back to copy only");
+	}
+
+	void testStorageVisitChunks() {
+		SharedBufferStorage storage(3 * chunk_size);
+		fill(storage, 0, chunk_size, 1);
+		fill(storage, 2 * chunk_size, chunk_size, 2);
+		std::vector<size_t> offsets;
+		std::vector<size_t> sizes;
+		bool contents_match = true;
+		storage.visitChunks(chunk_size / 2, 2 * chunk_size, [&](size_t offset, const void * data, size_t size) {
+			offsets.push_back(offset);
+			sizes.push_back(size);
+			unsigned char expected = offset < chunk_size ? 1 : (offset < 2 * chunk_size ? 0 : 2);
+			for (size_t i = 0; i < size; ++i)
+				contents_match = contents_match && static_cast<const unsigned char *>(data)[i] == expected;
+		});
+		check(offsets == std::vector<size_t>{chunk_size / 2, chunk_size, 2 * chunk_size}, "range is visited chunk by chunk");
+		check(sizes == std::vector<size_t>{chunk_size / 2, chunk_size, chunk_size / 2}, "visited parts cover range");
+		check(contents_match, "unwritten chunk is visited as zeros");
+	}
+
+	void testBufferCopySharesStorage() {
+		DefaultHardwareVertexBuffer source(16, chunk_size / 4, HardwareBuffer::HBU_STATIC);
+		std::vector<unsigned char> data(source.getSizeInBytes(), 5);
+		source.writeData(0, data.size(), data.data());
+		DefaultHardwareVertexBuffer copy(16, chunk_size / 4, HardwareBuffer::HBU_STATIC);
+		copy.copyData(source);
+		check(copy.getStorage().getSharedBytes() == 4 * chunk_size, "copy of default buffer shares storage");
+		unsigned char byte = 0;
+		copy.readData(data.size() - 1, 1, &byte);
+		check(byte == 5, "copy reads contents of source");
+	}
+}
+
+void testHardwareBuffer() {
+	testDirtyRangeMerge();
+	testDirtyRangeMergeGap();
+	testStorageCopyOnWrite();
+	testStorageLock();
+	testStorageVisitChunks();
+	testBufferCopySharesStorage();
+}
@@ -0,0 +1,143 @@
+//
+//  RenderGraphTests.cpp
+//  Test
+//
+//  Created by Yuzhe Wang on 10/18/26.
+//  Copyright © 2026 Yuzhe Wang. All rights reserved.
+//
+
+#include <assert.h>
+#include <vector>
+
+#include "Tests.h"
+#include "AsteroRenderGraph.h"
+
+using namespace Astero;
+
+namespace {
+	// Hands out distinct addresses standing for render textures and depth buffers, which render graph never dereferences.
+	class TestRenderGraphAllocator : public RenderGraphAllocator {
+	public:
+		TestRenderGraphAllocator() : created_count_(0), destroyed_count_(0) {}
+
+		RenderTarget * createRenderTexture(const RenderGraphResourceDesc & /* desc */) override {
+			return reinterpret_cast<RenderTarget *>(nextSlot());
+		}
+		void destroyRenderTexture(RenderTarget * /* render_target */) override {
+			++destroyed_count_;
+		}
+		DepthBuffer * createDepthBuffer(const RenderGraphResourceDesc & /* desc */) override {
+			return reinterpret_cast<DepthBuffer *>(nextSlot());
+		}
+		void destroyDepthBuffer(DepthBuffer * /* depth_buffer */) override {
+			++destroyed_count_;
+		}
+
+		size_t getCreatedCount() const { return created_count_; }
+		size_t getDestroyedCount() const { return destroyed_count_; }
+
+	private:
+		char * nextSlot() {
+			assert(created_count_ < sizeof(slots_));
+			return &slots_[created_count_++];
+		}
+
+		char slots_[64];
+		size_t created_count_;
+		size_t destroyed_count_;
+	};
+
+	const RenderGraphResourceDesc colour_desc = {256, 256, 0, 0, false};
+	// Any distinct address does, windows are only handed back by getRenderTarget.
+	char window_storage;
+	RenderTarget * const window = reinterpret_cast<RenderTarget *>(&window_storage);
+
+	void testCulling() {
+		TestRenderGraphAllocator allocator;
+		RenderGraph graph(&allocator);
+		RenderGraph::ResourceHandle first = graph.createTransient("first", colour_desc);
+		RenderGraph::ResourceHandle second = graph.createTransient("second", colour_desc);
+		RenderGraph::ResourceHandle third = graph.createTransient("third", colour_desc);
+		RenderGraph::ResourceHandle output = graph.importRenderTarget("window", window);
+		// Chain whose last output is never read.
+		RenderGraph::PassHandle a = graph.addPass("a", nullptr);
+		graph.write(a, first);
+		RenderGraph::PassHandle b = graph.addPass("b", nullptr);
+		graph.read(b, first);
+		graph.write(b, second);
+		RenderGraph::PassHandle c = graph.addPass("c", nullptr);
+		graph.read(c, second);
+		graph.write(c, third);
+		RenderGraph::PassHandle present = graph.addPass("present", nullptr);
+		graph.write(present, output);
+		graph.compile();
+		check(graph.isPassCulled(a) && graph.isPassCulled(b) && graph.isPassCulled(c), "chain with unread output is culled");
+		check(!graph.isPassCulled(present), "pass writing imported target is kept");
+		check(graph.getCulledPassCount() == 3, "culled pass count");
+		check(graph.getExecutionOrder() == std::vector<RenderGraph::PassHandle>{present}, "only kept pass executes");
+		check(allocator.getCreatedCount() == 0, "culled transients get no memory");
+	}
+
+	void testOrder() {
+		TestRenderGraphAllocator allocator;
+		RenderGraph graph(&allocator);
+		RenderGraph::ResourceHandle scene = graph.createTransient("scene", colour_desc);
+		RenderGraph::ResourceHandle output = graph.importRenderTarget("window", window);
+		// Declared before pass producing its input.
+		RenderGraph::PassHandle composite = graph.addPass("composite", nullptr);
+		graph.read(composite, scene);
+		graph.write(composite, output);
+		RenderGraph::PassHandle draw = graph.addPass("draw", nullptr);
+		graph.write(draw, scene);
+		// Draws over composite, in order of declaration.
+		RenderGraph::PassHandle overlay = graph.addPass("overlay", nullptr);
+		graph.write(overlay, output);
+		RenderGraph::PassHandle readback = graph.addPass("readback", nullptr);
+		graph.read(readback, output);
+		graph.setSideEffect(readback);
+		graph.compile();
+		std::vector<RenderGraph::PassHandle> expected = {draw, composite, overlay, readback};
+		check(graph.getExecutionOrder() == expected, "passes run after their inputs, imported target uses in declaration order");
+		check(graph.getCulledPassCount() == 0, "no pass culled");
+		check(graph.getRenderTarget(output) == window, "imported target is handed back");
+	}
+
+	void testAliasing() {
+		TestRenderGraphAllocator allocator;
+		{
+			RenderGraph graph(&allocator);
+			for (int frame = 0; frame < 2; ++frame) {
+				graph.reset();
+				RenderGraph::ResourceHandle first = graph.createTransient("first", colour_desc);
+				RenderGraph::ResourceHandle second = graph.createTransient("second", colour_desc);
+				RenderGraph::ResourceHandle third = graph.createTransient("third", colour_desc);
+				RenderGraph::ResourceHandle output = graph.importRenderTarget("window", window);
+				RenderGraph::PassHandle a = graph.addPass("a", nullptr);
+				graph.write(a, first);
+				RenderGraph::PassHandle b = graph.addPass("b", nullptr);
+				graph.read(b, first);
+				graph.write(b, second);
+				// First is last read by b, so third can take its memory.
+				RenderGraph::PassHandle c = graph.addPass("c", nullptr);
+				graph.read(c, second);
+				graph.write(c, third);
+				RenderGraph::PassHandle present = graph.addPass("present", nullptr);
+				graph.read(present, third);
+				graph.write(present, output);
+				graph.compile();
+				check(graph.getTransientResourceCount() == 3, "transient resource count");
+				check(graph.getPhysicalResourceCount() == 2, "non overlapping transients share memory");
+				check(graph.getRenderTarget(first) == graph.getRenderTarget(third), "first and third alias");
+				check(graph.getRenderTarget(first) != graph.getRenderTarget(second), "overlapping transients do not alias");
+			}
+			check(allocator.getCreatedCount() == 2, "memory is kept across frames");
+		}
+		check(allocator.getDestroyedCount() == 2, "memory is destroyed with graph");
+	}
+}
+
+void testRenderGraph() {
+	testCulling();
+	testOrder();
+	testAliasing();
+}
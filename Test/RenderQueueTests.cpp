@@ -0,0 +1,154 @@
+//
+//  RenderQueueTests.cpp
+//  Test
+//
+//  Created by Yuzhe Wang on 10/18/26.
+//  Copyright © 2026 Yuzhe Wang. All rights reserved.
+//
+
+#include <algorithm>
+#include <vector>
+
+#include "Tests.h"
+#include "AsteroRenderQueue.h"
+
+using namespace Astero;
+
+namespace {
+	// Exposes radix sort of render queue.
+	class TestRenderQueue : public RenderQueue {
+	public:
+		// Returns indices of keys in sorted order.
+		std::vector<uint32_t> sortKeys(const std::vector<uint64_t> & keys) {
+			sort_entries_.clear();
+			for (size_t i = 0; i < keys.size(); ++i) {
+				SortEntry entry = {keys[i], static_cast<uint32_t>(i)};
+				sort_entries_.push_back(entry);
+			}
+			sortEntries();
+			std::vector<uint32_t> indices;
+			for (const auto & entry : sort_entries_)
+				indices.push_back(entry.index);
+			return indices;
+		}
+		
+		// Merges, sorts and lays out recorded commands as submit would, without rendering them.
+		void buildItems() {
+			mergeBuckets();
+			sortEntries();
+			buildSubmitItems();
+		}
+		size_t getItemCount() const { return submit_items_.size(); }
+		bool isItemInstanced(size_t index) const { return submit_items_[index].instanced; }
+		const RenderOperation & getItemOperation(size_t index) const { return *submit_items_[index].operation; }
+		const std::vector<float> & getInstanceData() const { return instance_data_; }
+	};
+
+	RenderCommand makeCommand(unsigned char layer, bool translucent, float depth) {
+		// Value initialized, so fields not set here are zero.
+		RenderCommand command = RenderCommand();
+		command.depth = depth;
+		command.layer = layer;
+		command.translucent = translucent;
+		return command;
+	}
+
+	// Command reading instance data, with a world matrix and colour told apart by first.
+	RenderCommand makeInstanceCommand(float first) {
+		RenderCommand command = makeCommand(0, false, 1.0f);
+		command.auto_instancing = true;
+		for (int i = 0; i < 16; ++i)
+			command.world_matrix.m[i / 4][i % 4] = first + i;
+		for (int i = 0; i < 4; ++i)
+			command.colour[i] = first + 100 + i;
+		return command;
+	}
+
+	// Expected instance record of a command made by makeInstanceCommand.
+	std::vector<float> makeInstanceRecord(float first) {
+		std::vector<float> record;
+		for (int i = 0; i < 12; ++i)
+			record.push_back(first + i);
+		for (int i = 0; i < 4; ++i)
+			record.push_back(first + 100 + i);
+		return record;
+	}
+
+	void testSortKey() {
+		uint64_t near_opaque = RenderQueue::makeSortKey(makeCommand(0, false, 1.0f));
+		uint64_t far_opaque = RenderQueue::makeSortKey(makeCommand(0, false, 100.0f));
+		uint64_t near_translucent = RenderQueue::makeSortKey(makeCommand(0, true, 1.0f));
+		uint64_t far_translucent = RenderQueue::makeSortKey(makeCommand(0, true, 100.0f));
+		uint64_t next_layer = RenderQueue::makeSortKey(makeCommand(1, false, 1.0f));
+		check(next_layer >> (64 - RENDER_QUEUE_LAYER_BITS) == 1, "layer takes top bits");
+		check(((near_translucent >> (64 - RENDER_QUEUE_LAYER_BITS - 1)) & 1) == 1, "translucent bit follows layer");
+		check(far_translucent < next_layer, "layers draw in order");
+		check(far_opaque < near_translucent, "opaque draws before translucent");
+		check(near_opaque < far_opaque, "opaque draws front to back");
+		check((near_opaque ^ far_opaque) >> RENDER_QUEUE_DEPTH_BITS == 0, "opaque depth takes bottom bits");
+		check(far_translucent < near_translucent, "translucent draws back to front");
+	}
+
+	void testRadixSort() {
+		TestRenderQueue queue;
+		std::vector<uint64_t> keys;
+		// Keys differing in every byte, with repeats to check stability.
+		uint64_t state = 12345;
+		for (int i = 0; i < 1000; ++i) {
+			state = state * 6364136223846793005ull + 1442695040888963407ull;
+			keys.push_back(state >> (i % 3 == 0 ? 60 : 0));
+		}
+		std::vector<uint32_t> expected(keys.size());
+		for (size_t i = 0; i < expected.size(); ++i)
+			expected[i] = static_cast<uint32_t>(i);
+		std::stable_sort(expected.begin(), expected.end(), [&keys](uint32_t a, uint32_t b) { return keys[a] < keys[b]; });
+		check(queue.sortKeys(keys) == expected, "radix sort matches stable sort");
+		// Keys differing only in top byte make every other pass skipped.
+		std::vector<uint64_t> top_byte_keys = {3ull << 56, 1ull << 56, 2ull << 56, 1ull << 56};
+		check(queue.sortKeys(top_byte_keys) == std::vector<uint32_t>({1, 3, 2, 0}), "radix sort with equal low bytes");
+	}
+
+	void testRunOfOne() {
+		TestRenderQueue queue;
+		queue.addCommand(makeInstanceCommand(1.0f));
+		queue.buildItems();
+		check(queue.getItemCount() == 1 && queue.isItemInstanced(0), "single command is drawn from instance data");
+		const RenderOperation & operation = queue.getItemOperation(0);
+		check(operation.use_global_instance_vertex_buffer && operation.instance_number == 1 && operation.base_instance == 0,
+			  "single command draws one instance");
+		check(queue.getInstanceData() == makeInstanceRecord(1.0f), "single command writes its world matrix and colour");
+		queue.clear();
+		
+		// Without merging each command still gets its own record.
+		queue.setAutoInstancingEnabled(false);
+		queue.addCommand(makeInstanceCommand(1.0f));
+		queue.addCommand(makeInstanceCommand(2.0f));
+		queue.buildItems();
+		check(queue.getItemCount() == 2 && queue.getItemOperation(1).base_instance == 1
+			  && queue.getItemOperation(1).instance_number == 1, "unmerged commands draw one instance each");
+		std::vector<float> expected = makeInstanceRecord(1.0f);
+		std::vector<float> second = makeInstanceRecord(2.0f);
+		expected.insert(expected.end(), second.begin(), second.end());
+		check(queue.getInstanceData() == expected, "unmerged commands write their records in order");
+		queue.clear();
+		
+		queue.setAutoInstancingEnabled(true);
+		queue.addCommand(makeInstanceCommand(1.0f));
+		queue.addCommand(makeInstanceCommand(2.0f));
+		queue.buildItems();
+		check(queue.getItemCount() == 1 && queue.getItemOperation(0).instance_number == 2, "run of two is merged");
+		queue.clear();
+		
+		queue.addCommand(makeCommand(0, false, 1.0f));
+		queue.buildItems();
+		check(queue.getItemCount() == 1 && !queue.isItemInstanced(0) && queue.getInstanceData().empty(),
+			  "command not reading instance data is drawn as recorded");
+		queue.clear();
+	}
+}
+
+void testRenderQueue() {
+	testSortKey();
+	testRadixSort();
+	testRunOfOne();
+}
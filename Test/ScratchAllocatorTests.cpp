@@ -0,0 +1,90 @@
+//
+//  ScratchAllocatorTests.cpp
+//  Test
+//
+//  Created by Yuzhe Wang on 10/18/26.
+//  Copyright © 2026 Yuzhe Wang. All rights reserved.
+//
+
+#include <stdint.h>
+#include <string.h>
+
+#include "Tests.h"
+#include "AsteroHardwareBufferManager.h"
+
+using namespace Astero;
+
+namespace {
+	const size_t pool_size = 64 * 1024;
+
+	// Exposes thread cache of scratch allocator, so blocks can be returned to the shared pool for merging.
+	class TestScratchAllocator : public GLScratchAllocator {
+	public:
+		TestScratchAllocator(size_t pool_size, size_t max_pool_size) : GLScratchAllocator(pool_size, max_pool_size) {}
+
+		void flushThreadCache() {
+			ThreadCache & cache = getThreadCache();
+			Lock lock(mutex_);
+			releaseThreadCache(&cache);
+		}
+	};
+
+	void testAllocateFree() {
+		TestScratchAllocator allocator(pool_size, pool_size);
+		void * first = allocator.allocate(100);
+		void * second = allocator.allocate(100);
+		check(first && second && first != second, "small allocations are served from pool");
+		check(reinterpret_cast<uintptr_t>(first) % SCRATCH_ALIGNMENT == 0, "scratch memory is aligned");
+		memset(first, 0xAB, 100);
+		memset(second, 0xCD, 100);
+		check(static_cast<unsigned char *>(first)[99] == 0xAB, "blocks do not overlap");
+		GLScratchAllocator::Stats stats = allocator.getStats();
+		check(stats.bytes_in_use >= 200 && stats.allocation_count == 2, "bytes in use and allocation count");
+		allocator.deallocate(first);
+		allocator.deallocate(second);
+		check(allocator.getStats().bytes_in_use == 0, "freed blocks are not in use");
+		check(allocator.getStats().high_water_mark == stats.bytes_in_use, "high water mark is kept after free");
+		// Most recently freed block of a size class is handed out first from thread cache.
+		void * again = allocator.allocate(100);
+		check(again == second, "freed block is reused");
+		check(allocator.getStats().thread_cache_hit_count == 1, "reuse is served from thread cache");
+		allocator.deallocate(again);
+	}
+
+	void testMerge() {
+		TestScratchAllocator allocator(pool_size, pool_size);
+		void * blocks[3];
+		for (auto & block : blocks)
+			block = allocator.allocate(20 * 1024);
+		check(blocks[0] && blocks[1] && blocks[2], "pool holds three blocks");
+		check(!allocator.allocate(20 * 1024), "pool without a free block fails");
+		// Frees middle block last, so it merges with both neighbours.
+		allocator.deallocate(blocks[0]);
+		allocator.deallocate(blocks[2]);
+		allocator.deallocate(blocks[1]);
+		allocator.flushThreadCache();
+		void * whole = allocator.allocate(48 * 1024);
+		check(whole != nullptr, "freed neighbours merge into one block");
+		check(allocator.getStats().pool_growth_count == 0, "merged block is served without growing pool");
+		allocator.deallocate(whole);
+	}
+
+	void testGrowth() {
+		TestScratchAllocator allocator(pool_size, 2 * pool_size);
+		void * first = allocator.allocate(40 * 1024);
+		void * second = allocator.allocate(40 * 1024);
+		check(first && second, "pool grows when exhausted");
+		GLScratchAllocator::Stats stats = allocator.getStats();
+		check(stats.pool_growth_count == 1 && stats.pool_size == 2 * pool_size, "one chunk is added");
+		check(!allocator.allocate(40 * 1024), "pool does not grow beyond its maximum");
+		check(allocator.getStats().fallback_count == 1, "failed allocation is counted as fallback");
+		allocator.deallocate(first);
+		allocator.deallocate(second);
+	}
+}
+
+void testScratchAllocator() {
+	testAllocateFree();
+	testMerge();
+	testGrowth();
+}
@@ -0,0 +1,38 @@
+//
+//  Tests.cpp
+//  Test
+//
+//  Created by Yuzhe Wang on 10/18/26.
+//  Copyright © 2026 Yuzhe Wang. All rights reserved.
+//
+
+#include <stdio.h>
+#include "Tests.h"
+
+namespace {
+	size_t failure_count = 0;
+}
+
+void check(bool condition, const char * description) {
+	if (condition)
+		return;
+	printf("Test failed: %s\n", description);
+	++failure_count;
+}
+
+bool runTests() {
+	failure_count = 0;
+	testDepthBuffer();
+	testFrameStats();
+	testHardwareBuffer();
+	testHardwareBufferManager();
+	testRenderGraph();
+	testRenderQueue();
+	testScratchAllocator();
+	if (failure_count > 0) {
+		printf("%zu checks failed\n", failure_count);
+		return false;
+	}
+	printf("All tests passed\n");
+	return true;
+}
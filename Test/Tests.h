@@ -0,0 +1,29 @@
+//
+//  Tests.h
+//  Test
+//
+//  Created by Yuzhe Wang on 10/18/26.
+//  Copyright © 2026 Yuzhe Wang. All rights reserved.
+//
+
+#ifndef Tests_h
+#define Tests_h
+
+#include <cstddef>
+
+// Records result of a check, printing description if it failed.
+void check(bool condition, const char * description);
+
+// Checks of engine logic which needs no GL context, one function per module.
+void testDepthBuffer();
+void testFrameStats();
+void testHardwareBuffer();
+void testHardwareBufferManager();
+void testRenderGraph();
+void testRenderQueue();
+void testScratchAllocator();
+
+// Runs every test, and returns false if any check failed.
+bool runTests();
+
+#endif // Tests_h
@@ -19,10 +19,15 @@
 #include "AsteroDataStream.h"
 #include "AsteroRenderSystem.h"
 #include "AsteroHardwareBuffer.h"
+#include "Tests.h"
 
 using namespace Astero;
 
 int main(int argc, const char * argv[]) {
+	// Engine logic checked by tests needs no window.
+	if (!runTests())
+		return -1;
+	
 	GLFWwindow* window;
 	/* Initialize the library */
 	if (!glfwInit())